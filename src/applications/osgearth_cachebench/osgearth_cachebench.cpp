@@ -0,0 +1,329 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * Measures cache bin throughput: a write phase, then readers running
+ * against writers that overwrite existing records. Compares the file
+ * system cache with the sqlite3 cache in its normal and performance modes.
+ */
+
+#include <osg/ArgumentParser>
+#include <osg/Image>
+#include <osg/Timer>
+#include <osgDB/FileUtils>
+#include <osgEarth/Cache>
+#include <osgEarth/StringUtils>
+#include <osgEarthDrivers/cache_filesystem/FileSystemCache>
+#include <osgEarthDrivers/cache_sqlite3/Sqlite3CacheOptions>
+#include <OpenThreads/Thread>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+namespace
+{
+    osg::Image* makeImage( unsigned dim, unsigned seed )
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage( dim, dim, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+
+        // some structure, so compressing serializers don't get it for free.
+        unsigned char* p = image->data();
+        unsigned state = seed * 2654435761u + 1;
+        for( unsigned i=0; i<image->getTotalSizeInBytes(); ++i )
+        {
+            state = state * 1103515245u + 12345u;
+            p[i] = (unsigned char)((i % 64) + ((state >> 16) & 0x3F));
+        }
+        return image;
+    }
+
+    std::string makeKey( unsigned i )
+    {
+        return Stringify() << "10_" << (i % 1024) << "_" << (i / 1024);
+    }
+
+    class WriterThread : public OpenThreads::Thread
+    {
+    public:
+        WriterThread( CacheBin* bin, unsigned first, unsigned count, unsigned dim ) :
+          _bin( bin ), _first( first ), _count( count ), _failures( 0 )
+        {
+            // a few distinct images are enough; serialization still runs per write.
+            for( unsigned i=0; i<4; ++i )
+                _images.push_back( makeImage(dim, first+i) );
+        }
+
+        void run()
+        {
+            for( unsigned i=_first; i<_first+_count; ++i )
+            {
+                if ( !_bin->write(makeKey(i), _images[i % _images.size()].get(), Config()) )
+                    ++_failures;
+            }
+        }
+
+        unsigned getFailures() const { return _failures; }
+
+    private:
+        osg::ref_ptr<CacheBin>                 _bin;
+        std::vector< osg::ref_ptr<osg::Image> > _images;
+        unsigned                               _first, _count;
+        unsigned                               _failures;
+    };
+
+    class ReaderThread : public OpenThreads::Thread
+    {
+    public:
+        ReaderThread( CacheBin* bin, unsigned records, unsigned reads, unsigned seed ) :
+          _bin( bin ), _records( records ), _reads( reads ), _seed( seed ), _hits( 0 )
+        {
+            //nop
+        }
+
+        void run()
+        {
+            unsigned state = _seed;
+            for( unsigned i=0; i<_reads; ++i )
+            {
+                state = state * 1103515245u + 12345u;
+                ReadResult r = _bin->readImage( makeKey((state >> 8) % _records) );
+                if ( r.succeeded() )
+                    ++_hits;
+            }
+        }
+
+        unsigned getHits() const { return _hits; }
+
+    private:
+        osg::ref_ptr<CacheBin> _bin;
+        unsigned               _records, _reads, _seed;
+        unsigned               _hits;
+    };
+
+    int
+    usage( const std::string& msg )
+    {
+        if ( !msg.empty() )
+            std::cout << msg << std::endl;
+
+        std::cout
+            << std::endl
+            << "USAGE: osgearth_cachebench [options]" << std::endl
+            << std::endl
+            << "    --path dir           ; Folder for the test caches; emptied first (default: cachebench)" << std::endl
+            << "    --cache name         ; Cache to measure: filesystem, sqlite3 or sqlite3-performance;" << std::endl
+            << "                         ; repeat for several (default: all three)" << std::endl
+            << "    --records n          ; Records written in the write phase (default: 4000)" << std::endl
+            << "    --dim n              ; Width and height of the RGBA test images (default: 64)" << std::endl
+            << "    --writers n          ; Writer threads (default: 2)" << std::endl
+            << "    --readers n          ; Reader threads in the mixed phase (default: 4)" << std::endl
+            << "    --reads n            ; Reads per reader thread (default: 5000)" << std::endl
+            << "    --max-size mb        ; sqlite3 size budget in MB; 0 for unlimited (default: 0)" << std::endl
+            << std::endl;
+
+        return -1;
+    }
+
+    Cache* createCache( const std::string& name, const std::string& root, unsigned maxSize )
+    {
+        if ( name == "filesystem" )
+        {
+            FileSystemCacheOptions options;
+            options.rootPath() = root + "/filesystem";
+            return CacheFactory::create( options );
+        }
+        else if ( name == "sqlite3" || name == "sqlite3-performance" )
+        {
+            Sqlite3CacheOptions options;
+            options.path()            = root + "/" + name + ".db";
+            options.maxSize()         = maxSize;
+            options.performanceMode() = (name == "sqlite3-performance");
+            return CacheFactory::create( options );
+        }
+        return 0L;
+    }
+
+    /**
+     * Runs the threads to completion and returns the elapsed seconds. The time
+     * includes committing writes that a write-behind cache still has queued.
+     */
+    template<typename T>
+    double runAll( CacheBin* bin, std::vector<T*>& threads, std::vector<WriterThread*>* also =0L )
+    {
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        for( unsigned i=0; i<threads.size(); ++i )
+            threads[i]->start();
+        if ( also )
+            for( unsigned i=0; i<also->size(); ++i )
+                (*also)[i]->start();
+
+        for( unsigned i=0; i<threads.size(); ++i )
+            threads[i]->join();
+        if ( also )
+            for( unsigned i=0; i<also->size(); ++i )
+                (*also)[i]->join();
+
+        while( bin->getStats().value<unsigned>("pending", 0u) > 0u )
+            OpenThreads::Thread::microSleep( 1000 );
+
+        return osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc,argv);
+
+    if ( args.read("--help") || args.read("-h") )
+        return usage("");
+
+    std::string root = "cachebench";
+    args.read( "--path", root );
+
+    std::vector<std::string> caches;
+    std::string name;
+    while( args.read("--cache", name) )
+        caches.push_back( name );
+    if ( caches.empty() )
+    {
+        caches.push_back( "filesystem" );
+        caches.push_back( "sqlite3" );
+        caches.push_back( "sqlite3-performance" );
+    }
+
+    unsigned records = 4000;
+    args.read( "--records", records );
+    if ( records < 1 ) records = 1;
+
+    unsigned dim = 64;
+    args.read( "--dim", dim );
+    if ( dim < 1 ) dim = 1;
+
+    unsigned numWriters = 2;
+    args.read( "--writers", numWriters );
+    if ( numWriters < 1 ) numWriters = 1;
+
+    unsigned numReaders = 4;
+    args.read( "--readers", numReaders );
+
+    unsigned reads = 5000;
+    args.read( "--reads", reads );
+
+    unsigned maxSize = 0;
+    args.read( "--max-size", maxSize );
+
+    if ( !osgDB::makeDirectory(root) )
+        return usage( "Unable to create the folder " + root );
+
+    std::cout
+        << "Records:    " << records << " (" << dim << "x" << dim << " RGBA)" << std::endl
+        << "Writers:    " << numWriters << std::endl
+        << "Readers:    " << numReaders << " x " << reads << " reads" << std::endl
+        << std::endl
+        << std::setw(22) << "cache"
+        << std::setw(14) << "writes/sec"
+        << std::setw(14) << "mixed r/sec"
+        << std::setw(14) << "mixed w/sec"
+        << std::setw(10) << "hits"
+        << std::endl;
+
+    for( unsigned c=0; c<caches.size(); ++c )
+    {
+        osg::ref_ptr<Cache> cache = createCache( caches[c], root, maxSize );
+        if ( !cache.valid() || !cache->isOK() )
+        {
+            std::cout << std::setw(22) << caches[c] << "  (unable to create the cache)" << std::endl;
+            continue;
+        }
+
+        osg::ref_ptr<CacheBin> bin = cache->addBin( "bench" );
+        if ( !bin.valid() )
+        {
+            std::cout << std::setw(22) << caches[c] << "  (unable to create the cache bin)" << std::endl;
+            continue;
+        }
+        bin->purge();
+
+        // write phase: the writers split the key range between them.
+        unsigned failures = 0;
+        std::vector<WriterThread*> writers;
+        unsigned perWriter = (records + numWriters - 1) / numWriters;
+        for( unsigned i=0; i<numWriters; ++i )
+        {
+            unsigned first = i * perWriter;
+            unsigned count = first < records ? osg::minimum(perWriter, records-first) : 0u;
+            writers.push_back( new WriterThread(bin.get(), first, count, dim) );
+        }
+        double writeSeconds = runAll( bin.get(), writers );
+        for( unsigned i=0; i<writers.size(); ++i )
+        {
+            failures += writers[i]->getFailures();
+            delete writers[i];
+        }
+        writers.clear();
+
+        // mixed phase: readers on random keys while the writers rewrite them all.
+        std::vector<ReaderThread*> readers;
+        for( unsigned i=0; i<numReaders; ++i )
+            readers.push_back( new ReaderThread(bin.get(), records, reads, 1234+i) );
+        for( unsigned i=0; i<numWriters; ++i )
+        {
+            unsigned first = i * perWriter;
+            unsigned count = first < records ? osg::minimum(perWriter, records-first) : 0u;
+            writers.push_back( new WriterThread(bin.get(), first, count, dim) );
+        }
+        double mixedSeconds = runAll( bin.get(), readers, &writers );
+
+        unsigned hits = 0;
+        for( unsigned i=0; i<readers.size(); ++i )
+        {
+            hits += readers[i]->getHits();
+            delete readers[i];
+        }
+        for( unsigned i=0; i<writers.size(); ++i )
+        {
+            failures += writers[i]->getFailures();
+            delete writers[i];
+        }
+
+        unsigned totalReads = numReaders * reads;
+
+        std::cout
+            << std::setw(22) << caches[c]
+            << std::setw(14) << std::fixed << std::setprecision(0) << (writeSeconds > 0.0 ? records/writeSeconds : 0.0)
+            << std::setw(14) << (mixedSeconds > 0.0 ? totalReads/mixedSeconds : 0.0)
+            << std::setw(14) << (mixedSeconds > 0.0 ? records/mixedSeconds : 0.0)
+            << std::setw(9)  << std::setprecision(1) << (totalReads > 0 ? 100.0*hits/totalReads : 0.0) << "%"
+            << std::endl;
+
+        if ( failures > 0 )
+            std::cout << "    (" << failures << " writes failed)" << std::endl;
+
+        std::cout << "    stats: " << bin->getStats().toJSON() << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,282 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * Measures the declutter sort on synthetic labels. Each label is a Geode
+ * with an icon box and a text box scattered over the viewport; the leaves
+ * go through the real "declutter" render bin's sort, with no graphics
+ * context needed. For reference the same boxes also go through an
+ * all-pairs overlap test, which is what the sort did before the grid.
+ */
+
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osgUtil/RenderBin>
+#include <osgUtil/RenderStage>
+#include <osgUtil/StateGraph>
+#include <osgEarthAnnotation/Decluttering>
+#include <iostream>
+#include <iomanip>
+#include <set>
+#include <algorithm>
+
+using namespace osgEarth;
+using namespace osgEarth::Annotation;
+
+namespace
+{
+    osg::Geometry* makeBox( float x0, float y0, float x1, float y1 )
+    {
+        osg::Vec3Array* verts = new osg::Vec3Array();
+        verts->push_back( osg::Vec3(x0, y0, 0.0f) );
+        verts->push_back( osg::Vec3(x1, y0, 0.0f) );
+        verts->push_back( osg::Vec3(x1, y1, 0.0f) );
+        verts->push_back( osg::Vec3(x0, y1, 0.0f) );
+
+        osg::Geometry* geom = new osg::Geometry();
+        geom->setVertexArray( verts );
+        geom->addPrimitiveSet( new osg::DrawArrays(GL_QUADS, 0, 4) );
+        return geom;
+    }
+
+    /** A label: screen position, depth and the Geode holding its icon and text. */
+    struct Label
+    {
+        osg::ref_ptr<osg::RefMatrix> _modelview;
+        osg::ref_ptr<osg::Geode>     _geode;
+        float                        _depth;
+    };
+
+    /** The sort the bin did before the grid: test each box against every box placed so far. */
+    unsigned allPairs( const std::vector<Label>& labels, const std::vector<unsigned>& order )
+    {
+        std::vector< std::pair<const osg::Node*, osg::BoundingBox> > used;
+        std::set<const osg::Node*> culledParents;
+        unsigned passed = 0;
+
+        for( unsigned i=0; i<order.size(); ++i )
+        {
+            const Label& label = labels[order[i]];
+            osg::Vec3d pos = label._modelview->getTrans();
+
+            // within a Geode the bin takes the drawables last to first.
+            for( int d=(int)label._geode->getNumDrawables()-1; d >= 0; --d )
+            {
+                const osg::Node* parent = label._geode.get();
+                osg::BoundingBox box = label._geode->getDrawable(d)->getBound();
+                box.set( box.xMin()+pos.x(), box.yMin()+pos.y(), 0.0f, box.xMax()+pos.x(), box.yMax()+pos.y(), 0.0f );
+
+                bool visible = culledParents.find(parent) == culledParents.end();
+                for( unsigned j=0; visible && j<used.size(); ++j )
+                {
+                    const osg::BoundingBox& b = used[j].second;
+                    if ( !(box.xMin() > b.xMax() || box.xMax() < b.xMin() || box.yMin() > b.yMax() || box.yMax() < b.yMin()) &&
+                         parent != used[j].first )
+                    {
+                        visible = false;
+                    }
+                }
+
+                if ( visible )
+                {
+                    used.push_back( std::make_pair(parent, box) );
+                    ++passed;
+                }
+                else
+                {
+                    culledParents.insert( parent );
+                }
+            }
+        }
+        return passed;
+    }
+
+    struct DepthOrder
+    {
+        DepthOrder( const std::vector<Label>& labels ) : _labels(labels) { }
+        bool operator()( unsigned a, unsigned b ) const { return _labels[a]._depth < _labels[b]._depth; }
+        const std::vector<Label>& _labels;
+    };
+
+    int
+    usage( const std::string& msg )
+    {
+        if ( !msg.empty() )
+            std::cout << msg << std::endl;
+
+        std::cout
+            << std::endl
+            << "USAGE: osgearth_declutterbench [options]" << std::endl
+            << std::endl
+            << "    --labels n           ; Label count to measure; repeat for several (default: 1000, 10000, 50000)" << std::endl
+            << "    --frames n           ; Sort passes per label count (default: 20)" << std::endl
+            << "    --width n            ; Viewport width (default: 1920)" << std::endl
+            << "    --height n           ; Viewport height (default: 1080)" << std::endl
+            << "    --max-all-pairs n    ; Largest label count to run the all-pairs reference on (default: 20000)" << std::endl
+            << std::endl;
+
+        return -1;
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc,argv);
+
+    if ( args.read("--help") || args.read("-h") )
+        return usage("");
+
+    std::vector<unsigned> labelCounts;
+    unsigned n;
+    while( args.read("--labels", n) )
+        labelCounts.push_back( n );
+    if ( labelCounts.empty() )
+    {
+        labelCounts.push_back( 1000 );
+        labelCounts.push_back( 10000 );
+        labelCounts.push_back( 50000 );
+    }
+
+    unsigned frames = 20;
+    args.read( "--frames", frames );
+    if ( frames < 1 ) frames = 1;
+
+    unsigned width = 1920, height = 1080;
+    args.read( "--width", width );
+    args.read( "--height", height );
+
+    unsigned maxAllPairs = 20000;
+    args.read( "--max-all-pairs", maxAllPairs );
+
+    // the bin reads the viewport and the window matrix off the stage's camera.
+    osg::ref_ptr<osg::Camera> camera = new osg::Camera();
+    camera->setViewport( 0, 0, width, height );
+
+    osg::ref_ptr<osgUtil::RenderStage> stage = new osgUtil::RenderStage();
+    stage->setCamera( camera.get() );
+
+    osg::ref_ptr<osg::RefMatrix> projection = new osg::RefMatrix(
+        osg::Matrix::ortho( 0.0, width, 0.0, height, -1.0, 1.0 ) );
+
+    Decluttering::setEnabled( true );
+    osg::ref_ptr<osgUtil::RenderBin> bin = osgUtil::RenderBin::createRenderBin( OSGEARTH_DECLUTTER_BIN );
+    if ( !bin.valid() )
+        return usage( "The declutter render bin is not registered" );
+    bin->setStage( stage.get() );
+
+    std::cout
+        << "Viewport:   " << width << " x " << height << std::endl
+        << "Frames:     " << frames << " per label count" << std::endl
+        << std::endl
+        << std::setw(10) << "labels"
+        << std::setw(10) << "leaves"
+        << std::setw(14) << "sort ms"
+        << std::setw(16) << "leaves/sec"
+        << std::setw(16) << "all-pairs ms"
+        << std::setw(12) << "visible"
+        << std::endl;
+
+    for( unsigned c=0; c<labelCounts.size(); ++c )
+    {
+        unsigned numLabels = labelCounts[c];
+
+        // scatter the labels, some of them partly off the viewport.
+        std::vector<Label> labels( numLabels );
+        unsigned state = 12345u;
+        for( unsigned i=0; i<numLabels; ++i )
+        {
+            state = state * 1103515245u + 12345u;
+            float x = -32.0f + (float)((state >> 8) % (width + 64));
+            state = state * 1103515245u + 12345u;
+            float y = -16.0f + (float)((state >> 8) % (height + 32));
+            state = state * 1103515245u + 12345u;
+            float textWidth = 24.0f + (float)((state >> 8) % 120);
+
+            labels[i]._modelview = new osg::RefMatrix( osg::Matrix::translate(x, y, 0.0f) );
+            labels[i]._depth     = (float)((state >> 4) % 100000) / 100000.0f;
+            labels[i]._geode     = new osg::Geode();
+            labels[i]._geode->addDrawable( makeBox(0.0f, 0.0f, 16.0f, 16.0f) );
+            labels[i]._geode->addDrawable( makeBox(18.0f, 2.0f, 18.0f + textWidth, 14.0f) );
+        }
+
+        unsigned numLeaves = numLabels * 2;
+        double sortSeconds = 0.0;
+
+        for( unsigned f=0; f<frames; ++f )
+        {
+            // the sort consumes the leaves and rewrites their matrices, so
+            // each pass gets a fresh set, as it would after a cull.
+            bin->reset();
+            osg::ref_ptr<osgUtil::StateGraph> graph = new osgUtil::StateGraph();
+            for( unsigned i=0; i<numLabels; ++i )
+            {
+                for( unsigned d=0; d<labels[i]._geode->getNumDrawables(); ++d )
+                {
+                    graph->addLeaf( new osgUtil::RenderLeaf(
+                        labels[i]._geode->getDrawable(d),
+                        projection.get(),
+                        new osg::RefMatrix( *labels[i]._modelview.get() ),
+                        labels[i]._depth,
+                        2*i + d) );
+                }
+            }
+            bin->addStateGraph( graph.get() );
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            bin->sort();
+            sortSeconds += osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+        }
+
+        double sortMS = 1000.0 * sortSeconds / frames;
+
+        std::cout
+            << std::setw(10) << numLabels
+            << std::setw(10) << numLeaves
+            << std::setw(14) << std::fixed << std::setprecision(3) << sortMS
+            << std::setw(16) << std::setprecision(0) << (sortSeconds > 0.0 ? (double)numLeaves * frames / sortSeconds : 0.0);
+
+        if ( numLabels <= maxAllPairs )
+        {
+            std::vector<unsigned> order( numLabels );
+            for( unsigned i=0; i<numLabels; ++i )
+                order[i] = i;
+            std::sort( order.begin(), order.end(), DepthOrder(labels) );
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            unsigned visible = allPairs( labels, order );
+            double allPairsMS = osg::Timer::instance()->delta_m( start, osg::Timer::instance()->tick() );
+
+            std::cout
+                << std::setw(16) << std::setprecision(3) << allPairsMS
+                << std::setw(12) << visible;
+        }
+        else
+        {
+            std::cout << std::setw(16) << "-" << std::setw(12) << "-";
+        }
+
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,284 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * Measures GDAL driver throughput: tiles per second against thread count
+ * on a local raster, with per-thread dataset handles on and off. The tile
+ * source's memory cache is disabled so every tile goes to the driver.
+ */
+
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <osgEarth/Registry>
+#include <osgEarth/TileSource>
+#include <osgEarthDrivers/gdal/GDALOptions>
+#include <OpenThreads/Thread>
+#include <iostream>
+#include <iomanip>
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+namespace
+{
+    class ReadThread : public OpenThreads::Thread
+    {
+    public:
+        ReadThread( TileSource* source, const std::vector<TileKey>& keys, unsigned first, unsigned stride, bool heightFields ) :
+          _source( source ), _keys( keys ), _first( first ), _stride( stride ), _heightFields( heightFields ), _tiles( 0 ), _empty( 0 ) { }
+
+        void run()
+        {
+            for( unsigned i=_first; i<_keys.size(); i += _stride )
+            {
+                bool ok;
+                if ( _heightFields )
+                {
+                    osg::ref_ptr<osg::HeightField> hf = _source->createHeightField( _keys[i] );
+                    ok = hf.valid();
+                }
+                else
+                {
+                    osg::ref_ptr<osg::Image> image = _source->createImage( _keys[i] );
+                    ok = image.valid();
+                }
+                ++_tiles;
+                if ( !ok )
+                    ++_empty;
+            }
+        }
+
+        unsigned getTiles() const { return _tiles; }
+        unsigned getEmpty() const { return _empty; }
+
+    private:
+        osg::ref_ptr<TileSource>    _source;
+        const std::vector<TileKey>& _keys;
+        unsigned                    _first, _stride;
+        bool                        _heightFields;
+        unsigned                    _tiles, _empty;
+    };
+
+    /** Keys of the tiles at "lod" that cover the extent, up to "max". */
+    void collectKeys( const Profile* profile, const GeoExtent& extent, unsigned lod, unsigned max, std::vector<TileKey>& out )
+    {
+        out.clear();
+
+        TileKey ul = profile->createTileKey( extent.xMin(), extent.yMax(), lod );
+        TileKey lr = profile->createTileKey( extent.xMax(), extent.yMin(), lod );
+        if ( !ul.valid() || !lr.valid() )
+            return;
+
+        for( unsigned y = ul.getTileY(); y <= lr.getTileY() && out.size() < max; ++y )
+            for( unsigned x = ul.getTileX(); x <= lr.getTileX() && out.size() < max; ++x )
+                out.push_back( TileKey(lod, x, y, profile) );
+    }
+
+    int
+    usage( const std::string& msg )
+    {
+        if ( !msg.empty() )
+            std::cout << msg << std::endl;
+
+        std::cout
+            << std::endl
+            << "USAGE: osgearth_gdalbench --url file [options]" << std::endl
+            << std::endl
+            << "    --url file           ; Raster to read (a GeoTIFF, for example)" << std::endl
+            << "    --lod n              ; LOD to read; default is the first LOD with --tiles tiles over the data" << std::endl
+            << "    --tiles n            ; Tiles per run (default: 512)" << std::endl
+            << "    --threads n          ; Thread count to measure; repeat for several (default: 1, 2, 4, 8)" << std::endl
+            << "    --heightfield        ; Read heightfields instead of images" << std::endl
+            << "    --interpolation name ; nearest, average or bilinear (default: average)" << std::endl
+            << "    --shared-only        ; Only measure the shared, locked dataset handle" << std::endl
+            << std::endl;
+
+        return -1;
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc,argv);
+
+    if ( args.read("--help") || args.read("-h") )
+        return usage("");
+
+    std::string url;
+    if ( !args.read("--url", url) )
+        return usage( "Missing --url" );
+
+    int lod = -1;
+    args.read( "--lod", lod );
+
+    unsigned numTiles = 512;
+    args.read( "--tiles", numTiles );
+    if ( numTiles < 1 ) numTiles = 1;
+
+    std::vector<unsigned> threadCounts;
+    unsigned n;
+    while( args.read("--threads", n) )
+        threadCounts.push_back( n > 0 ? n : 1 );
+    if ( threadCounts.empty() )
+    {
+        threadCounts.push_back( 1 );
+        threadCounts.push_back( 2 );
+        threadCounts.push_back( 4 );
+        threadCounts.push_back( 8 );
+    }
+
+    bool heightFields = args.read( "--heightfield" );
+    bool sharedOnly   = args.read( "--shared-only" );
+
+    ElevationInterpolation interp = INTERP_AVERAGE;
+    std::string interpName;
+    if ( args.read("--interpolation", interpName) )
+    {
+        if      ( interpName == "nearest" )  interp = INTERP_NEAREST;
+        else if ( interpName == "average" )  interp = INTERP_AVERAGE;
+        else if ( interpName == "bilinear" ) interp = INTERP_BILINEAR;
+        else return usage( "Unknown interpolation: " + interpName );
+    }
+
+    std::cout
+        << "Source:     " << url << std::endl
+        << "Tiles:      " << (heightFields ? "heightfields" : "images") << ", " << numTiles << " per run" << std::endl;
+
+    std::vector<TileKey> keys;
+    bool printedHeader = false;
+
+    for( unsigned mode = 0; mode < 2; ++mode )
+    {
+        bool threadLocal = mode == 0;
+        if ( threadLocal && sharedOnly )
+            continue;
+
+        GDALOptions options;
+        options.url()                 = url;
+        options.interpolation()       = interp;
+        options.interpolateImagery()  = interp != INTERP_NEAREST;
+        options.threadLocalDatasets() = threadLocal;
+        options.L2CacheSize()         = 0;
+
+        osg::ref_ptr<TileSource> source = TileSourceFactory::create( options );
+        if ( !source.valid() )
+            return usage( "Unable to load the GDAL driver" );
+
+        TileSource::Status status = source->startup( 0L );
+        if ( status.isError() )
+            return usage( "Unable to open " + url + ": " + status.message() );
+
+        const Profile* profile = source->getProfile();
+
+        if ( keys.empty() )
+        {
+            // the tiles cover the data, not the whole profile.
+            GeoExtent extent;
+            const DataExtentList& dataExtents = source->getDataExtents();
+            if ( dataExtents.empty() )
+            {
+                extent = profile->getExtent();
+            }
+            else
+            {
+                extent = dataExtents.front().transform( profile->getSRS() );
+                for( DataExtentList::const_iterator i = dataExtents.begin(); i != dataExtents.end(); ++i )
+                    extent.expandToInclude( i->transform(profile->getSRS()) );
+            }
+
+            if ( lod < 0 )
+            {
+                for( lod = 0; lod < 24; ++lod )
+                {
+                    collectKeys( profile, extent, lod, numTiles, keys );
+                    if ( keys.size() >= numTiles )
+                        break;
+                }
+            }
+            else
+            {
+                collectKeys( profile, extent, lod, numTiles, keys );
+            }
+
+            if ( keys.empty() )
+                return usage( "No tiles cover the data" );
+
+            std::cout
+                << "LOD:        " << lod << " (" << keys.size() << " tiles)" << std::endl;
+        }
+
+        if ( !printedHeader )
+        {
+            std::cout
+                << std::endl
+                << std::setw(14) << "datasets"
+                << std::setw(10) << "threads"
+                << std::setw(12) << "seconds"
+                << std::setw(14) << "tiles/sec"
+                << std::setw(12) << "speedup"
+                << std::endl;
+            printedHeader = true;
+        }
+
+        double baseline = 0.0;
+
+        for( unsigned t=0; t<threadCounts.size(); ++t )
+        {
+            unsigned numThreads = threadCounts[t];
+
+            std::vector<ReadThread*> threads;
+            for( unsigned i=0; i<numThreads; ++i )
+                threads.push_back( new ReadThread(source.get(), keys, i, numThreads, heightFields) );
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            for( unsigned i=0; i<numThreads; ++i )
+                threads[i]->start();
+
+            unsigned tiles = 0, empty = 0;
+            for( unsigned i=0; i<numThreads; ++i )
+            {
+                threads[i]->join();
+                tiles += threads[i]->getTiles();
+                empty += threads[i]->getEmpty();
+                delete threads[i];
+            }
+
+            double seconds = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+            double rate    = seconds > 0.0 ? tiles / seconds : 0.0;
+            if ( baseline == 0.0 )
+                baseline = rate;
+
+            std::cout
+                << std::setw(14) << (threadLocal ? "per-thread" : "shared")
+                << std::setw(10) << numThreads
+                << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+                << std::setw(14) << std::setprecision(1) << rate
+                << std::setw(11) << std::setprecision(2) << (baseline > 0.0 ? rate/baseline : 0.0) << "x"
+                << std::endl;
+
+            if ( empty > 0 )
+                std::cout << "    (" << empty << " tiles came back empty)" << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,308 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * Measures GeoJSON parse throughput: the direct GeoJSONReader against the
+ * OGR GeoJSON driver plus OgrUtils::createFeature, which is what the TFS
+ * and WFS drivers used before. The OGR path runs under the GDAL lock, as
+ * it does in the drivers, so with several threads it also shows the cost
+ * of that lock.
+ */
+
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <osgDB/FileUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/SpatialReference>
+#include <osgEarthFeatures/Feature>
+#include <osgEarthFeatures/GeoJSON>
+#include <osgEarthFeatures/OgrUtils>
+#include <OpenThreads/Thread>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+namespace
+{
+    /** Builds a FeatureCollection of points, lines and polygons with a few attributes. */
+    std::string makeCollection( unsigned numFeatures, unsigned pointsPerShape, const SpatialReference* srs )
+    {
+        FeatureList features;
+        unsigned state = 12345u;
+
+        for( unsigned i=0; i<numFeatures; ++i )
+        {
+            state = state * 1103515245u + 12345u;
+            double cx = -180.0 + 360.0 * (double)((state >> 8) % 100000) / 100000.0;
+            state = state * 1103515245u + 12345u;
+            double cy =  -80.0 + 160.0 * (double)((state >> 8) % 100000) / 100000.0;
+
+            osg::ref_ptr<Geometry> geom;
+            switch( i % 3 )
+            {
+            case 0:
+                geom = new PointSet();
+                geom->push_back( osg::Vec3d(cx, cy, 0.0) );
+                break;
+
+            case 1:
+                geom = new LineString( pointsPerShape );
+                for( unsigned p=0; p<pointsPerShape; ++p )
+                    geom->push_back( osg::Vec3d(cx + 0.001*p, cy + 0.0005*(p%7), 0.0) );
+                break;
+
+            default:
+                {
+                    Polygon* poly = new Polygon( pointsPerShape );
+                    for( unsigned p=0; p<pointsPerShape; ++p )
+                    {
+                        double a = 2.0 * osg::PI * (double)p / (double)pointsPerShape;
+                        poly->push_back( osg::Vec3d(cx + 0.01*cos(a), cy + 0.01*sin(a), 0.0) );
+                    }
+                    if ( i % 2 == 0 )
+                    {
+                        Ring* hole = new Ring( 4 );
+                        hole->push_back( osg::Vec3d(cx - 0.002, cy - 0.002, 0.0) );
+                        hole->push_back( osg::Vec3d(cx - 0.002, cy + 0.002, 0.0) );
+                        hole->push_back( osg::Vec3d(cx + 0.002, cy + 0.002, 0.0) );
+                        hole->push_back( osg::Vec3d(cx + 0.002, cy - 0.002, 0.0) );
+                        poly->getHoles().push_back( hole );
+                    }
+                    geom = poly;
+                }
+                break;
+            }
+
+            Feature* f = new Feature( geom.get(), srs, Style(), i+1 );
+            f->set( "name",       std::string("feature ") + toString(i) );
+            f->set( "population", (int)(state % 1000000) );
+            f->set( "area",       (double)(state % 10000) / 7.0 );
+            f->set( "visible",    (i % 5) != 0 );
+            features.push_back( f );
+        }
+
+        std::stringstream buf;
+        GeoJSONWriter::writeFeatureCollection( buf, features );
+        return buf.str();
+    }
+
+    unsigned parseDirect( const std::string& buffer, const SpatialReference* srs )
+    {
+        unsigned count = 0;
+        GeoJSONReader reader( buffer, srs );
+        osg::ref_ptr<Feature> f;
+        while( reader.next(f) )
+            if ( f.valid() )
+                ++count;
+        return reader.hasError() ? 0 : count;
+    }
+
+    unsigned parseOGR( const std::string& buffer, const SpatialReference* srs )
+    {
+        GDAL_SCOPED_LOCK;
+
+        OGRSFDriverH ogrDriver = OGRGetDriverByName( "GeoJSON" );
+        if ( !ogrDriver )
+            return 0;
+
+        OGRDataSourceH ds = OGROpen( buffer.c_str(), FALSE, &ogrDriver );
+        if ( !ds )
+            return 0;
+
+        unsigned count = 0;
+        OGRLayerH layer = OGR_DS_GetLayer( ds, 0 );
+        if ( layer )
+        {
+            OGR_L_ResetReading( layer );
+            OGRFeatureH feat_handle;
+            while( (feat_handle = OGR_L_GetNextFeature(layer)) != NULL )
+            {
+                osg::ref_ptr<Feature> f = OgrUtils::createFeature( feat_handle, srs );
+                if ( f.valid() )
+                    ++count;
+                OGR_F_Destroy( feat_handle );
+            }
+        }
+
+        OGR_DS_Destroy( ds );
+        return count;
+    }
+
+    class ParseThread : public OpenThreads::Thread
+    {
+    public:
+        ParseThread( const std::string& buffer, const SpatialReference* srs, bool useOGR, unsigned iterations ) :
+          _buffer( buffer ), _srs( srs ), _useOGR( useOGR ), _iterations( iterations ), _features( 0 ) { }
+
+        void run()
+        {
+            for( unsigned i=0; i<_iterations; ++i )
+                _features += _useOGR ? parseOGR(_buffer, _srs.get()) : parseDirect(_buffer, _srs.get());
+        }
+
+        unsigned getFeatures() const { return _features; }
+
+    private:
+        const std::string&                   _buffer;
+        osg::ref_ptr<const SpatialReference> _srs;
+        bool                                 _useOGR;
+        unsigned                             _iterations;
+        unsigned                             _features;
+    };
+
+    int
+    usage( const std::string& msg )
+    {
+        if ( !msg.empty() )
+            std::cout << msg << std::endl;
+
+        std::cout
+            << std::endl
+            << "USAGE: osgearth_geojsonbench [options]" << std::endl
+            << std::endl
+            << "    --file path          ; GeoJSON file to parse (default: a generated collection)" << std::endl
+            << "    --features n         ; Features in the generated collection (default: 10000)" << std::endl
+            << "    --points n           ; Points per generated line or polygon (default: 32)" << std::endl
+            << "    --iterations n       ; Parses per thread (default: 20)" << std::endl
+            << "    --threads n          ; Thread count to measure; repeat for several (default: 1, 4)" << std::endl
+            << std::endl;
+
+        return -1;
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc,argv);
+
+    if ( args.read("--help") || args.read("-h") )
+        return usage("");
+
+    std::string file;
+    args.read( "--file", file );
+
+    unsigned numFeatures = 10000;
+    args.read( "--features", numFeatures );
+
+    unsigned numPoints = 32;
+    args.read( "--points", numPoints );
+    if ( numPoints < 4 ) numPoints = 4;
+
+    unsigned iterations = 20;
+    args.read( "--iterations", iterations );
+
+    std::vector<unsigned> threadCounts;
+    unsigned n;
+    while( args.read("--threads", n) )
+        threadCounts.push_back( n > 0 ? n : 1 );
+    if ( threadCounts.empty() )
+    {
+        threadCounts.push_back( 1 );
+        threadCounts.push_back( 4 );
+    }
+
+    osg::ref_ptr<const SpatialReference> srs = SpatialReference::create( "wgs84" );
+
+    // registers the OGR drivers.
+    Registry::instance();
+
+    std::string buffer;
+    if ( !file.empty() )
+    {
+        std::ifstream in( file.c_str(), std::ios::binary );
+        if ( !in.is_open() )
+            return usage( "Unable to open " + file );
+        std::stringstream buf;
+        buf << in.rdbuf();
+        buffer = buf.str();
+    }
+    else
+    {
+        buffer = makeCollection( numFeatures, numPoints, srs.get() );
+    }
+
+    double mb = (double)buffer.size() / (1024.0*1024.0);
+
+    unsigned directCount = parseDirect( buffer, srs.get() );
+    unsigned ogrCount    = parseOGR( buffer, srs.get() );
+
+    std::cout
+        << "Input:      " << (file.empty() ? std::string("generated") : file)
+        << " (" << std::fixed << std::setprecision(2) << mb << " MB)" << std::endl
+        << "Features:   " << directCount << " (GeoJSONReader), " << ogrCount << " (OGR)" << std::endl
+        << "Iterations: " << iterations << " per thread" << std::endl
+        << std::endl
+        << std::setw(16) << "parser"
+        << std::setw(10) << "threads"
+        << std::setw(12) << "seconds"
+        << std::setw(12) << "MB/sec"
+        << std::setw(16) << "features/sec"
+        << std::endl;
+
+    if ( directCount != ogrCount )
+        std::cout << "    (warning: the parsers disagree on the feature count)" << std::endl;
+
+    for( unsigned p=0; p<2; ++p )
+    {
+        bool useOGR = p == 1;
+
+        for( unsigned t=0; t<threadCounts.size(); ++t )
+        {
+            unsigned numThreads = threadCounts[t];
+
+            std::vector<ParseThread*> threads;
+            for( unsigned i=0; i<numThreads; ++i )
+                threads.push_back( new ParseThread(buffer, srs.get(), useOGR, iterations) );
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            for( unsigned i=0; i<numThreads; ++i )
+                threads[i]->start();
+
+            unsigned features = 0;
+            for( unsigned i=0; i<numThreads; ++i )
+            {
+                threads[i]->join();
+                features += threads[i]->getFeatures();
+                delete threads[i];
+            }
+
+            double seconds = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+            double parses  = (double)numThreads * iterations;
+
+            std::cout
+                << std::setw(16) << (useOGR ? "OGR" : "GeoJSONReader")
+                << std::setw(10) << numThreads
+                << std::setw(12) << std::setprecision(3) << seconds
+                << std::setw(12) << std::setprecision(1) << (seconds > 0.0 ? parses * mb / seconds : 0.0)
+                << std::setw(16) << std::setprecision(0) << (seconds > 0.0 ? features / seconds : 0.0)
+                << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,538 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * Measures HTTP throughput against an in-process stub server that adds a
+ * fixed latency to every response. Compares the blocking HTTPClient (one
+ * connection per thread) with the async engine (one thread multiplexing
+ * a capped pool of keep-alive connections), and exercises cancellation,
+ * the per-host connection limit and gzip-encoded responses.
+ */
+
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <osgEarth/HTTPClient>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
+#include <OpenThreads/Thread>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <list>
+#include <vector>
+
+#ifdef OSGEARTH_HAVE_ZLIB
+#  include <zlib.h>
+#endif
+
+#ifdef _WIN32
+#  include <winsock2.h>
+   typedef SOCKET socket_t;
+#  define CLOSE_SOCKET closesocket
+#  define SHUTDOWN_BOTH SD_BOTH
+#else
+#  include <sys/types.h>
+#  include <sys/socket.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <arpa/inet.h>
+#  include <unistd.h>
+   typedef int socket_t;
+#  define INVALID_SOCKET (-1)
+#  define CLOSE_SOCKET ::close
+#  define SHUTDOWN_BOTH SHUT_RDWR
+#endif
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0
+#endif
+
+using namespace osgEarth;
+
+namespace
+{
+    /**
+     * Minimal HTTP/1.1 server on the loopback interface. Every GET gets the
+     * same body after a configurable delay; connections stay alive until
+     * the client closes them. It keeps count of connections and of the
+     * requests in flight at once, so connection limits can be checked.
+     */
+    class StubServer
+    {
+    public:
+        StubServer( const std::string& body ) :
+          _body( body ), _socket( INVALID_SOCKET ), _port( 0 ), _latencyMS( 0 ), _done( false ),
+          _acceptThread( 0L ), _connections( 0 ), _requests( 0 ), _inFlight( 0 ), _maxInFlight( 0 ),
+          _bytesSent( 0 )
+        {
+#ifdef OSGEARTH_HAVE_ZLIB
+            _gzipBody = gzip( body );
+#endif
+        }
+
+        ~StubServer() { stop(); }
+
+        /** Starts listening on an ephemeral loopback port. */
+        bool start()
+        {
+#ifdef _WIN32
+            WSADATA wsa;
+            if ( WSAStartup( MAKEWORD(2,2), &wsa ) != 0 )
+                return false;
+#endif
+            _socket = ::socket( AF_INET, SOCK_STREAM, 0 );
+            if ( _socket == INVALID_SOCKET )
+                return false;
+
+            sockaddr_in addr;
+            ::memset( &addr, 0, sizeof(addr) );
+            addr.sin_family      = AF_INET;
+            addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+            addr.sin_port        = 0;
+
+            if ( ::bind( _socket, (sockaddr*)&addr, sizeof(addr) ) != 0 ||
+                 ::listen( _socket, 128 ) != 0 )
+                return false;
+
+#ifdef _WIN32
+            int len = sizeof(addr);
+#else
+            socklen_t len = sizeof(addr);
+#endif
+            if ( ::getsockname( _socket, (sockaddr*)&addr, &len ) != 0 )
+                return false;
+            _port = ntohs( addr.sin_port );
+
+            _acceptThread = new AcceptThread( this );
+            _acceptThread->start();
+            return true;
+        }
+
+        void stop()
+        {
+            if ( _acceptThread == 0L )
+                return;
+
+            _done = true;
+            ::shutdown( _socket, SHUTDOWN_BOTH );
+            CLOSE_SOCKET( _socket );
+            _acceptThread->join();
+            delete _acceptThread;
+            _acceptThread = 0L;
+
+            std::list<ConnectionThread*> connections;
+            {
+                Threading::ScopedMutexLock lock( _mutex );
+                connections.swap( _connectionThreads );
+            }
+            for( std::list<ConnectionThread*>::iterator i = connections.begin(); i != connections.end(); ++i )
+            {
+                ::shutdown( (*i)->_socket, SHUTDOWN_BOTH );
+                (*i)->join();
+                delete *i;
+            }
+
+#ifdef _WIN32
+            WSACleanup();
+#endif
+        }
+
+        std::string getURL( const std::string& path ) const {
+            return Stringify() << "http://127.0.0.1:" << _port << path;
+        }
+
+        /** Delay before each response, in milliseconds. */
+        void setLatency( unsigned ms ) { _latencyMS = ms; }
+
+        bool supportsGzip() const { return !_gzipBody.empty(); }
+
+        /** Zeroes the counters, to measure a new phase. */
+        void resetStats()
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            _connections = 0;
+            _requests    = 0;
+            _maxInFlight = _inFlight;
+            _bytesSent   = 0;
+        }
+
+        unsigned getConnections() { Threading::ScopedMutexLock lock( _mutex ); return _connections; }
+        unsigned getRequests()    { Threading::ScopedMutexLock lock( _mutex ); return _requests; }
+        unsigned getMaxInFlight() { Threading::ScopedMutexLock lock( _mutex ); return _maxInFlight; }
+        double   getBytesSent()   { Threading::ScopedMutexLock lock( _mutex ); return _bytesSent; }
+
+    private:
+        struct AcceptThread : public OpenThreads::Thread
+        {
+            AcceptThread( StubServer* server ) : _server( server ) { }
+            void run() { _server->acceptLoop(); }
+            StubServer* _server;
+        };
+
+        struct ConnectionThread : public OpenThreads::Thread
+        {
+            ConnectionThread( StubServer* server, socket_t s ) : _server( server ), _socket( s ) { }
+            void run() { _server->serve( _socket ); CLOSE_SOCKET( _socket ); }
+            StubServer* _server;
+            socket_t    _socket;
+        };
+
+        void acceptLoop()
+        {
+            while( !_done )
+            {
+                socket_t s = ::accept( _socket, 0L, 0L );
+                if ( s == INVALID_SOCKET )
+                    continue;
+
+                if ( _done )
+                {
+                    CLOSE_SOCKET( s );
+                    break;
+                }
+
+                int one = 1;
+                ::setsockopt( s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one) );
+
+                ConnectionThread* thread = new ConnectionThread( this, s );
+                {
+                    Threading::ScopedMutexLock lock( _mutex );
+                    _connectionThreads.push_back( thread );
+                    ++_connections;
+                }
+                thread->start();
+            }
+        }
+
+        // answers the requests on one connection until the client closes it.
+        void serve( socket_t s )
+        {
+            std::string buffer;
+            char chunk[4096];
+
+            while( !_done )
+            {
+                std::string::size_type end = buffer.find( "\r\n\r\n" );
+                if ( end == std::string::npos )
+                {
+                    int n = ::recv( s, chunk, sizeof(chunk), 0 );
+                    if ( n <= 0 )
+                        return;
+                    buffer.append( chunk, n );
+                    continue;
+                }
+
+                std::string headers = toLower( buffer.substr(0, end) );
+                buffer.erase( 0, end + 4 );
+
+                bool useGzip   = supportsGzip() && headers.find("gzip") != std::string::npos;
+                bool keepAlive = headers.find("connection: close") == std::string::npos;
+
+                {
+                    Threading::ScopedMutexLock lock( _mutex );
+                    ++_requests;
+                    if ( ++_inFlight > _maxInFlight )
+                        _maxInFlight = _inFlight;
+                }
+
+                if ( _latencyMS > 0 )
+                    OpenThreads::Thread::microSleep( _latencyMS * 1000 );
+
+                const std::string& body = useGzip ? _gzipBody : _body;
+                std::string response = Stringify()
+                    << "HTTP/1.1 200 OK\r\n"
+                    << "Content-Type: text/plain\r\n"
+                    << "Content-Length: " << body.size() << "\r\n"
+                    << (useGzip ? "Content-Encoding: gzip\r\n" : "")
+                    << (keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n")
+                    << "\r\n";
+                response += body;
+
+                bool sent = sendAll( s, response );
+
+                {
+                    Threading::ScopedMutexLock lock( _mutex );
+                    --_inFlight;
+                    if ( sent )
+                        _bytesSent += response.size();
+                }
+
+                if ( !sent || !keepAlive )
+                    return;
+            }
+        }
+
+        static bool sendAll( socket_t s, const std::string& data )
+        {
+            const char* p = data.data();
+            int remaining = (int)data.size();
+            while( remaining > 0 )
+            {
+                int n = ::send( s, p, remaining, MSG_NOSIGNAL );
+                if ( n <= 0 )
+                    return false;
+                p += n;
+                remaining -= n;
+            }
+            return true;
+        }
+
+#ifdef OSGEARTH_HAVE_ZLIB
+        static std::string gzip( const std::string& in )
+        {
+            z_stream zs;
+            ::memset( &zs, 0, sizeof(zs) );
+            if ( deflateInit2( &zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+                return std::string();
+
+            std::string out( deflateBound(&zs, in.size()), '\0' );
+            zs.next_in   = (Bytef*)in.data();
+            zs.avail_in  = in.size();
+            zs.next_out  = (Bytef*)&out[0];
+            zs.avail_out = out.size();
+            int rc = deflate( &zs, Z_FINISH );
+            out.resize( zs.total_out );
+            deflateEnd( &zs );
+            return rc == Z_STREAM_END ? out : std::string();
+        }
+#endif
+
+        std::string                  _body;
+        std::string                  _gzipBody;
+        socket_t                     _socket;
+        unsigned short               _port;
+        volatile unsigned            _latencyMS;
+        volatile bool                _done;
+        AcceptThread*                _acceptThread;
+        Threading::Mutex             _mutex;
+        std::list<ConnectionThread*> _connectionThreads;
+        unsigned                     _connections;
+        unsigned                     _requests;
+        unsigned                     _inFlight;
+        unsigned                     _maxInFlight;
+        double                       _bytesSent;
+    };
+
+    //------------------------------------------------------------------------
+
+    /** Issues blocking GETs until its share of the requests is done. */
+    class BlockingThread : public OpenThreads::Thread
+    {
+    public:
+        BlockingThread( const std::string& url, unsigned count, unsigned bodySize ) :
+          _url( url ), _count( count ), _bodySize( bodySize ), _ok( 0 ), _bad( 0 ) { }
+
+        void run()
+        {
+            for( unsigned i=0; i<_count; ++i )
+            {
+                HTTPResponse response = HTTPClient::get( _url );
+                if ( response.isOK() && response.getNumParts() > 0 && response.getPartSize(0) == _bodySize )
+                    ++_ok;
+                else
+                    ++_bad;
+            }
+        }
+
+        unsigned _ok, _bad;
+
+    private:
+        std::string _url;
+        unsigned    _count, _bodySize;
+    };
+
+    struct Result
+    {
+        Result() : _seconds(0.0), _ok(0), _bad(0), _canceled(0) { }
+        double   _seconds;
+        unsigned _ok, _bad, _canceled;
+    };
+
+    Result runBlocking( const std::string& url, unsigned requests, unsigned numThreads, unsigned bodySize )
+    {
+        std::vector<BlockingThread*> threads;
+        for( unsigned i=0; i<numThreads; ++i )
+            threads.push_back( new BlockingThread(url, requests/numThreads + (i < requests%numThreads ? 1 : 0), bodySize) );
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        for( unsigned i=0; i<threads.size(); ++i )
+            threads[i]->start();
+
+        Result r;
+        for( unsigned i=0; i<threads.size(); ++i )
+        {
+            threads[i]->join();
+            r._ok  += threads[i]->_ok;
+            r._bad += threads[i]->_bad;
+            delete threads[i];
+        }
+        r._seconds = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+        return r;
+    }
+
+    /** Issues all the requests through the async engine at once; cancels every "cancelEvery"th one. */
+    Result runAsync( const std::string& url, unsigned requests, unsigned bodySize, unsigned cancelEvery =0 )
+    {
+        std::vector< osg::ref_ptr<HTTPFuture> > futures;
+        futures.reserve( requests );
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        for( unsigned i=0; i<requests; ++i )
+            futures.push_back( HTTPClient::getAsync( HTTPRequest(url) ) );
+
+        if ( cancelEvery > 0 )
+            for( unsigned i=0; i<requests; i += cancelEvery )
+                futures[i]->cancel();
+
+        Result r;
+        for( unsigned i=0; i<futures.size(); ++i )
+        {
+            const HTTPResponse& response = futures[i]->getResponse();
+            if ( response.isCancelled() )
+                ++r._canceled;
+            else if ( response.isOK() && response.getNumParts() > 0 && response.getPartSize(0) == bodySize )
+                ++r._ok;
+            else
+                ++r._bad;
+        }
+
+        r._seconds = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+        return r;
+    }
+
+    void report( const std::string& name, const Result& r, StubServer& server )
+    {
+        unsigned total = r._ok + r._bad + r._canceled;
+        std::cout
+            << std::setw(24) << std::left << name << std::right
+            << std::setw(10) << std::fixed << std::setprecision(3) << r._seconds
+            << std::setw(12) << std::setprecision(1) << (r._seconds > 0.0 ? total / r._seconds : 0.0)
+            << std::setw(8)  << r._ok
+            << std::setw(8)  << r._bad
+            << std::setw(10) << r._canceled
+            << std::setw(12) << server.getRequests()
+            << std::setw(8)  << server.getConnections()
+            << std::setw(10) << server.getMaxInFlight()
+            << std::setw(12) << std::setprecision(0) << server.getBytesSent() / 1024.0
+            << std::endl;
+    }
+
+    int
+    usage( const std::string& msg )
+    {
+        if ( !msg.empty() )
+            std::cout << msg << std::endl;
+
+        std::cout
+            << std::endl
+            << "USAGE: osgearth_httpbench [options]" << std::endl
+            << std::endl
+            << "    --requests n         ; Requests per run (default: 400)" << std::endl
+            << "    --latency ms         ; Server delay before each response (default: 50)" << std::endl
+            << "    --size kb            ; Response body size (default: 16)" << std::endl
+            << "    --threads n          ; Threads for the blocking client (default: 8)" << std::endl
+            << "    --host-connections n ; Async engine's per-host connection limit (default: the client's)" << std::endl
+            << std::endl;
+
+        return -1;
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc,argv);
+
+    if ( args.read("--help") || args.read("-h") )
+        return usage("");
+
+    unsigned requests = 400;
+    args.read( "--requests", requests );
+    if ( requests < 1 ) requests = 1;
+
+    unsigned latency = 50;
+    args.read( "--latency", latency );
+
+    unsigned sizeKB = 16;
+    args.read( "--size", sizeKB );
+
+    unsigned numThreads = 8;
+    args.read( "--threads", numThreads );
+    if ( numThreads < 1 ) numThreads = 1;
+
+    int hostConnections;
+    if ( args.read("--host-connections", hostConnections) )
+        HTTPClient::setMaxConnectionsPerHost( hostConnections );
+
+    // a compressible body, like most map tile metadata and vector tiles.
+    std::string body;
+    for( unsigned i=0; body.size() < sizeKB*1024u; ++i )
+        body += Stringify() << "{\"id\":" << i << ",\"name\":\"feature " << i << "\",\"value\":" << (i*37)%1000 << "}\n";
+    body.resize( sizeKB*1024u );
+
+    StubServer server( body );
+    if ( !server.start() )
+        return usage( "Unable to start the stub server" );
+
+    std::string url = server.getURL( "/tile" );
+    server.setLatency( latency );
+
+    std::cout
+        << "Server:     " << url << std::endl
+        << "Requests:   " << requests << " per run, " << latency << " ms latency, " << sizeKB << " KB body" << std::endl
+        << "Gzip:       " << (server.supportsGzip() ? "on (bodies are sent gzip-encoded to clients that accept it)" : "off (built without zlib)") << std::endl
+        << "Host limit: " << HTTPClient::getMaxConnectionsPerHost() << " async connections" << std::endl
+        << std::endl
+        << std::setw(24) << std::left << "client" << std::right
+        << std::setw(10) << "seconds"
+        << std::setw(12) << "req/sec"
+        << std::setw(8)  << "ok"
+        << std::setw(8)  << "bad"
+        << std::setw(10) << "canceled"
+        << std::setw(12) << "served"
+        << std::setw(8)  << "conns"
+        << std::setw(10) << "in-flight"
+        << std::setw(12) << "KB on wire"
+        << std::endl;
+
+    // blocking client: each thread waits out the latency on its own connection.
+    HTTPClient::setUseAsyncEngine( false );
+    server.resetStats();
+    report( Stringify() << "blocking x" << numThreads, runBlocking(url, requests, numThreads, body.size()), server );
+
+    // async engine: every request in flight at once, capped by the host limit.
+    server.resetStats();
+    report( "async", runAsync(url, requests, body.size()), server );
+
+    // blocking calls routed through the engine share its connections and limits.
+    HTTPClient::setUseAsyncEngine( true );
+    server.resetStats();
+    report( Stringify() << "blocking x" << numThreads << " via async", runBlocking(url, requests, numThreads, body.size()), server );
+    HTTPClient::setUseAsyncEngine( false );
+
+    // cancellation: cancel every other request right after issuing it. The
+    // canceled ones should finish early and never tie up a connection.
+    server.resetStats();
+    report( "async, half canceled", runAsync(url, requests, body.size(), 2), server );
+
+    server.stop();
+    return 0;
+}
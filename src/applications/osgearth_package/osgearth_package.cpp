@@ -20,6 +20,7 @@
 #include <osg/io_utils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
+#include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
 
 #include <osgEarth/Common>
@@ -30,6 +31,7 @@
 #include <osgEarth/HTTPClient>
 #include <osgEarthUtil/TMSPackager>
 #include <osgEarthDrivers/tms/TMSOptions>
+#include <osgEarthDrivers/mbtiles/MBTilesOptions>
 
 #include <iostream>
 #include <sstream>
@@ -65,6 +67,9 @@ usage( const std::string& msg = "" )
         << "            [--overwrite]                   : overwrite existing tiles\n"
         << "            [--keep-empties]                : writes out fully transparent image tiles (normally discarded)\n"
         << "            [--db-options]                : db options string to pass to the image writer in quotes (e.g., \"JPEG_QUALITY 60\")\n"
+        << "            [--mbtiles]                     : write each layer to an MBTiles file instead of a TMS folder\n"
+        << "            [--fetch-threads <num>]         : number of threads reading tiles from the layers (default=1)\n"
+        << "            [--encode-threads <num>]        : number of threads encoding tiles (default=1)\n"
         << std::endl
         << "         [--quiet]               : suppress progress output" << std::endl;
 
@@ -98,6 +103,46 @@ findArgumentWithExtension( osg::ArgumentParser& args, const std::string& ext )
 }
 
 
+/** Loads a packaged earth file and checks that every layer starts up. */
+bool
+checkEarthFile( const std::string& earthFile )
+{
+    osg::ref_ptr<osg::Node> node = osgDB::readNodeFile( earthFile );
+    MapNode* mapNode = MapNode::findMapNode( node.get() );
+    if ( !mapNode )
+    {
+        OE_WARN << LC << "Could not read back \"" << earthFile << "\"" << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+
+    ImageLayerVector imageLayers;
+    mapNode->getMap()->getImageLayers( imageLayers );
+    for( ImageLayerVector::iterator i = imageLayers.begin(); i != imageLayers.end(); ++i )
+    {
+        if ( !i->get()->getTileSource() )
+        {
+            OE_WARN << LC << "Image layer \"" << i->get()->getName() << "\" in \"" << earthFile << "\" does not load" << std::endl;
+            ok = false;
+        }
+    }
+
+    ElevationLayerVector elevationLayers;
+    mapNode->getMap()->getElevationLayers( elevationLayers );
+    for( ElevationLayerVector::iterator i = elevationLayers.begin(); i != elevationLayers.end(); ++i )
+    {
+        if ( !i->get()->getTileSource() )
+        {
+            OE_WARN << LC << "Elevation layer \"" << i->get()->getName() << "\" in \"" << earthFile << "\" does not load" << std::endl;
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+
 /** Packages an image layer as a TMS folder. */
 int
 makeTMS( osg::ArgumentParser& args )
@@ -156,6 +201,16 @@ makeTMS( osg::ArgumentParser& args )
     // whether to keep 'empty' tiles
     bool keepEmpties = args.read("--keep-empties");    
 
+    // whether to write MBTiles files instead of TMS folders
+    bool mbtiles = args.read("--mbtiles");
+
+    // pipeline thread counts
+    unsigned fetchThreads = 1;
+    args.read( "--fetch-threads", fetchThreads );
+
+    unsigned encodeThreads = 1;
+    args.read( "--encode-threads", encodeThreads );
+
     // load up the map
     osg::ref_ptr<MapNode> mapNode = MapNode::load( args );
     if ( !mapNode.valid() )
@@ -174,6 +229,10 @@ makeTMS( osg::ArgumentParser& args )
     packager.setVerbose( verbose );
     packager.setOverwrite( overwrite );
     packager.setKeepEmptyImageTiles( keepEmpties );
+    packager.setNumFetchThreads( fetchThreads );
+    packager.setNumEncodeThreads( encodeThreads );
+    if ( mbtiles )
+        packager.setFormat( TMSPackager::FORMAT_MBTILES );
 
     if ( maxLevel != ~0 )
         packager.setMaxLevel( maxLevel );
@@ -220,6 +279,9 @@ makeTMS( osg::ArgumentParser& args )
                 OE_NOTICE << LC << "Packaging image layer \"" << layerFolder << "\"" << std::endl;
             }
 
+            if ( mbtiles )
+                layerFolder += ".mbtiles";
+
             std::string layerRoot = osgDB::concatPaths( rootFolder, layerFolder );
             TMSPackager::Result r = packager.package( layer, layerRoot, extension );
             if ( r.ok )
@@ -227,13 +289,28 @@ makeTMS( osg::ArgumentParser& args )
                 // save to the output map if requested:
                 if ( outMap.valid() )
                 {
-                    // new TMS driver info:
-                    TMSOptions tms;
-                    tms.url() = URI(
-                        osgDB::concatPaths(layerFolder, "tms.xml"),
-                        outEarthFile );
-
-                    ImageLayerOptions layerOptions( layer->getName(), tms );
+                    TileSourceOptions driver;
+                    if ( mbtiles )
+                    {
+                        // new MBTiles driver info:
+                        MBTilesOptions mbt;
+                        mbt.filename() = layerFolder; // relative to the earth file
+                        mbt.profile()  = map->getProfile()->toProfileOptions();
+                        if ( !extension.empty() )
+                            mbt.format() = extension;
+                        driver = mbt;
+                    }
+                    else
+                    {
+                        // new TMS driver info:
+                        TMSOptions tms;
+                        tms.url() = URI(
+                            osgDB::concatPaths(layerFolder, "tms.xml"),
+                            outEarthFile );
+                        driver = tms;
+                    }
+
+                    ImageLayerOptions layerOptions( layer->getName(), driver );
                     layerOptions.mergeConfig( layer->getInitialOptions().getConfig(true) );
                     layerOptions.cachePolicy() = CachePolicy::NO_CACHE;
 
@@ -270,6 +347,9 @@ makeTMS( osg::ArgumentParser& args )
                 OE_NOTICE << LC << "Packaging elevation layer \"" << layerFolder << "\"" << std::endl;
             }
 
+            if ( mbtiles )
+                layerFolder += ".mbtiles";
+
             std::string layerRoot = osgDB::concatPaths( rootFolder, layerFolder );
             TMSPackager::Result r = packager.package( layer, layerRoot );
 
@@ -278,13 +358,27 @@ makeTMS( osg::ArgumentParser& args )
                 // save to the output map if requested:
                 if ( outMap.valid() )
                 {
-                    // new TMS driver info:
-                    TMSOptions tms;
-                    tms.url() = URI(
-                        osgDB::concatPaths(layerFolder, "tms.xml"),
-                        outEarthFile );
-
-                    ElevationLayerOptions layerOptions( layer->getName(), tms );
+                    TileSourceOptions driver;
+                    if ( mbtiles )
+                    {
+                        // new MBTiles driver info:
+                        MBTilesOptions mbt;
+                        mbt.filename() = layerFolder; // relative to the earth file
+                        mbt.profile()  = map->getProfile()->toProfileOptions();
+                        mbt.format()   = "tif";
+                        driver = mbt;
+                    }
+                    else
+                    {
+                        // new TMS driver info:
+                        TMSOptions tms;
+                        tms.url() = URI(
+                            osgDB::concatPaths(layerFolder, "tms.xml"),
+                            outEarthFile );
+                        driver = tms;
+                    }
+
+                    ElevationLayerOptions layerOptions( layer->getName(), driver );
                     layerOptions.mergeConfig( layer->getInitialOptions().getConfig(true) );
                     layerOptions.cachePolicy() = CachePolicy::NO_CACHE;
 
@@ -310,11 +404,17 @@ makeTMS( osg::ArgumentParser& args )
         if ( !osgDB::writeNodeFile(*outMapNode.get(), outEarthFile) )
         {
             OE_WARN << LC << "Error writing earth file to \"" << outEarthFile << "\"" << std::endl;
+            return 1;
         }
-        else if ( verbose )
+
+        if ( verbose )
         {
             OE_NOTICE << LC << "Wrote earth file to \"" << outEarthFile << "\"" << std::endl;
         }
+
+        // read it back, so a package that won't load shows up here and not in the viewer.
+        if ( !checkEarthFile(outEarthFile) )
+            return 1;
     }
 
     return 0;
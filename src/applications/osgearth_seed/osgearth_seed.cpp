@@ -80,6 +80,8 @@ usage( const std::string& msg )
         << "        [--bounds xmin ymin xmax ymax]* ; Geospatial bounding box to seed (in map coordinates; default=entire map)" << std::endl
         << "        [--cache-path path]             ; Overrides the cache path in the .earth file" << std::endl
         << "        [--cache-type type]             ; Overrides the cache type in the .earth file" << std::endl
+        << "        [--threads num]                 ; Number of seeding threads (default=1)" << std::endl
+        << "        [--journal file]                ; Records finished tiles; rerun with the same file to resume" << std::endl
         << std::endl
         << "    --purge file.earth                  ; Purges a layer cache in a .earth file (interactive)" << std::endl
         << std::endl;
@@ -127,6 +129,14 @@ seed( osg::ArgumentParser& args )
     std::string cacheType;
     while (args.read("--cache-type", cacheType));
 
+    //Read the number of seeding threads
+    unsigned int numThreads = 1;
+    while (args.read("--threads", numThreads));
+
+    //Read the resume journal
+    std::string journalFile;
+    while (args.read("--journal", journalFile));
+
     bool verbose = args.read("--verbose");
 
     //Read in the earth file.
@@ -141,6 +151,8 @@ seed( osg::ArgumentParser& args )
     CacheSeed seeder;
     seeder.setMinLevel( minLevel );
     seeder.setMaxLevel( maxLevel );
+    seeder.setNumThreads( numThreads );
+    seeder.setJournalFile( journalFile );
 
     for (unsigned int i = 0; i < bounds.size(); i++)
     {
@@ -0,0 +1,209 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * Measures SpatialReference::transform throughput against thread count.
+ * Each thread transforms its own batch of points over and over; with the
+ * per-thread OGR handle cache, the threads should share no lock once warm.
+ */
+
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <osgEarth/SpatialReference>
+#include <OpenThreads/Thread>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+using namespace osgEarth;
+
+namespace
+{
+    class TransformThread : public OpenThreads::Thread
+    {
+    public:
+        TransformThread(const SpatialReference* from,
+                        const SpatialReference* to,
+                        const GeoExtent&        extent,
+                        unsigned                batch,
+                        unsigned                iterations,
+                        unsigned                seed ) :
+          _from( from ), _to( to ), _batch( batch ), _iterations( iterations ), _failures( 0 )
+        {
+            // scatter the points over the extent; each thread gets its own set.
+            ::srand( seed );
+            _source.reserve( batch );
+            for( unsigned i=0; i<batch; ++i )
+            {
+                double u = (double)::rand() / (double)RAND_MAX;
+                double v = (double)::rand() / (double)RAND_MAX;
+                _source.push_back( osg::Vec3d(
+                    extent.xMin() + u * extent.width(),
+                    extent.yMin() + v * extent.height(),
+                    0.0) );
+            }
+        }
+
+        void run()
+        {
+            std::vector<osg::Vec3d> points;
+            for( unsigned i=0; i<_iterations; ++i )
+            {
+                points = _source;
+                if ( _batch == 1 )
+                {
+                    osg::Vec3d out;
+                    if ( !_from->transform(points[0], _to.get(), out) )
+                        ++_failures;
+                }
+                else if ( !_from->transform(points, _to.get()) )
+                {
+                    ++_failures;
+                }
+            }
+        }
+
+        unsigned getFailures() const { return _failures; }
+
+    private:
+        osg::ref_ptr<const SpatialReference> _from, _to;
+        std::vector<osg::Vec3d>              _source;
+        unsigned                             _batch;
+        unsigned                             _iterations;
+        unsigned                             _failures;
+    };
+
+    int
+    usage( const std::string& msg )
+    {
+        if ( !msg.empty() )
+            std::cout << msg << std::endl;
+
+        std::cout
+            << std::endl
+            << "USAGE: osgearth_srsbench [options]" << std::endl
+            << std::endl
+            << "    --from srs           ; Source SRS (default: wgs84)" << std::endl
+            << "    --to srs             ; Target SRS (default: a Lambert conformal conic, which goes through OGR)" << std::endl
+            << "    --threads n          ; Thread count to measure; repeat for several (default: 1, 2, 4, 8)" << std::endl
+            << "    --batch n            ; Points per transform call; 1 uses the single-point API (default: 64)" << std::endl
+            << "    --iterations n       ; Transform calls per thread (default: 20000)" << std::endl
+            << std::endl;
+
+        return -1;
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc,argv);
+
+    if ( args.read("--help") || args.read("-h") )
+        return usage("");
+
+    std::string fromInit = "wgs84";
+    args.read( "--from", fromInit );
+
+    std::string toInit = "+proj=lcc +lat_1=33 +lat_2=45 +lat_0=39 +lon_0=-96 +datum=WGS84 +units=m";
+    args.read( "--to", toInit );
+
+    std::vector<unsigned> threadCounts;
+    unsigned n;
+    while( args.read("--threads", n) )
+        threadCounts.push_back( n );
+    if ( threadCounts.empty() )
+    {
+        threadCounts.push_back( 1 );
+        threadCounts.push_back( 2 );
+        threadCounts.push_back( 4 );
+        threadCounts.push_back( 8 );
+    }
+
+    unsigned batch = 64;
+    args.read( "--batch", batch );
+    if ( batch < 1 ) batch = 1;
+
+    unsigned iterations = 20000;
+    args.read( "--iterations", iterations );
+
+    osg::ref_ptr<const SpatialReference> from = SpatialReference::create( fromInit );
+    osg::ref_ptr<const SpatialReference> to   = SpatialReference::create( toInit );
+    if ( !from.valid() || !to.valid() )
+        return usage( "Unable to create the source or target SRS" );
+
+    // keep the points where the target projection is well defined.
+    GeoExtent extent = from->isGeographic() ?
+        GeoExtent( from.get(), -120.0, 25.0, -70.0, 50.0 ) :
+        GeoExtent( from.get(), -1.0e6, -1.0e6, 1.0e6, 1.0e6 );
+
+    std::cout
+        << "From:       " << from->getName() << std::endl
+        << "To:         " << to->getName() << std::endl
+        << "Batch:      " << batch << " points" << std::endl
+        << "Iterations: " << iterations << " per thread" << std::endl
+        << std::endl
+        << std::setw(8)  << "threads"
+        << std::setw(12) << "seconds"
+        << std::setw(16) << "points/sec"
+        << std::setw(12) << "speedup"
+        << std::endl;
+
+    double baseline = 0.0;
+
+    for( unsigned t=0; t<threadCounts.size(); ++t )
+    {
+        unsigned numThreads = threadCounts[t] > 0 ? threadCounts[t] : 1;
+
+        std::vector<TransformThread*> threads;
+        for( unsigned i=0; i<numThreads; ++i )
+            threads.push_back( new TransformThread(from.get(), to.get(), extent, batch, iterations, 1234+i) );
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        for( unsigned i=0; i<numThreads; ++i )
+            threads[i]->start();
+
+        unsigned failures = 0;
+        for( unsigned i=0; i<numThreads; ++i )
+        {
+            threads[i]->join();
+            failures += threads[i]->getFailures();
+            delete threads[i];
+        }
+
+        double seconds = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+        double rate    = seconds > 0.0 ? (double)numThreads * iterations * batch / seconds : 0.0;
+        if ( baseline == 0.0 )
+            baseline = rate / (double)numThreads;
+
+        std::cout
+            << std::setw(8)  << numThreads
+            << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+            << std::setw(16) << std::setprecision(0) << rate
+            << std::setw(11) << std::setprecision(2) << (baseline > 0.0 ? rate/baseline : 0.0) << "x"
+            << std::endl;
+
+        if ( failures > 0 )
+            std::cout << "    (" << failures << " transform calls failed)" << std::endl;
+    }
+
+    return 0;
+}
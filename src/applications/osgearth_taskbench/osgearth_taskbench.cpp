@@ -0,0 +1,230 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * Measures TaskService scheduling throughput. Pushes a large number of
+ * no-op and tiny tasks through the priority queue and the work-stealing
+ * scheduler, optionally with each task fanning out into child tasks from
+ * inside a worker thread, and reports tasks per second.
+ */
+
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <osgEarth/TaskService>
+#include <iostream>
+#include <iomanip>
+
+using namespace osgEarth;
+
+namespace
+{
+    /** Body of a leaf task: a short loop the compiler can't remove. */
+    struct Work
+    {
+        Work() : _iterations(0), _sink(0) { }
+
+        void execute()
+        {
+            unsigned x = _sink;
+            for( unsigned i=0; i<_iterations; ++i )
+                x = x * 1664525u + 1013904223u;
+            _sink = x;
+        }
+
+        unsigned          _iterations;
+        volatile unsigned _sink;
+    };
+
+    typedef ParallelTask<Work> LeafTask;
+
+    /** A task that, once running, adds its children to the same service. */
+    struct FanOutTask : public TaskRequest
+    {
+        FanOutTask( TaskService* service, Threading::MultiEvent* ev, unsigned children, unsigned iterations, float priority ) :
+          TaskRequest( priority ), _service( service ), _ev( ev ), _children( children ), _iterations( iterations ) { }
+
+        void operator()( ProgressCallback* pc )
+        {
+            for( unsigned i=0; i<_children; ++i )
+            {
+                LeafTask* child = new LeafTask( _ev );
+                child->_iterations = _iterations;
+                child->setPriority( getPriority() );
+                _service->add( child );
+            }
+            _ev->notify();
+        }
+
+        TaskService*           _service;
+        Threading::MultiEvent* _ev;
+        unsigned               _children;
+        unsigned               _iterations;
+    };
+
+    int
+    usage( const std::string& msg )
+    {
+        if ( !msg.empty() )
+            std::cout << msg << std::endl;
+
+        std::cout
+            << std::endl
+            << "USAGE: osgearth_taskbench [options]" << std::endl
+            << std::endl
+            << "    --tasks n            ; Tasks per run, children included (default: 1000000)" << std::endl
+            << "    --threads n          ; Thread count to measure; repeat for several (default: 1, 2, 4, 8, 16)" << std::endl
+            << "    --work n             ; Loop iterations per task; repeat for several; 0 is a no-op task" << std::endl
+            << "                         ; (default: 0 and 200)" << std::endl
+            << "    --fanout n           ; Child tasks each task adds from its worker thread; 0 submits" << std::endl
+            << "                         ; everything from the main thread (default: 0)" << std::endl
+            << "    --scheduler name     ; priority or work_stealing (default: both)" << std::endl
+            << std::endl;
+
+        return -1;
+    }
+
+    /** Pushes the tasks through a new service and returns the elapsed seconds. */
+    double
+    run( TaskService::Scheduler scheduler, unsigned numThreads, unsigned numTasks, unsigned iterations, unsigned fanout )
+    {
+        osg::ref_ptr<TaskService> service = new TaskService( "taskbench", numThreads, scheduler );
+
+        unsigned numRoots = fanout > 0 ? osg::maximum( numTasks / (1 + fanout), 1u ) : numTasks;
+        unsigned total    = numRoots * (1 + fanout);
+
+        Threading::MultiEvent done( total );
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        for( unsigned i=0; i<numRoots; ++i )
+        {
+            // spread the priorities so the priority ordering has work to do.
+            float priority = (float)((i * 2654435761u) % 1024u);
+
+            if ( fanout > 0 )
+            {
+                service->add( new FanOutTask(service.get(), &done, fanout, iterations, priority) );
+            }
+            else
+            {
+                LeafTask* task = new LeafTask( &done );
+                task->_iterations = iterations;
+                task->setPriority( priority );
+                service->add( task );
+            }
+        }
+
+        done.wait();
+
+        return osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc,argv);
+
+    if ( args.read("--help") || args.read("-h") )
+        return usage("");
+
+    unsigned numTasks = 1000000;
+    args.read( "--tasks", numTasks );
+    if ( numTasks < 1 ) numTasks = 1;
+
+    unsigned n;
+
+    std::vector<unsigned> threadCounts;
+    while( args.read("--threads", n) )
+        threadCounts.push_back( n > 0 ? n : 1 );
+    if ( threadCounts.empty() )
+    {
+        threadCounts.push_back( 1 );
+        threadCounts.push_back( 2 );
+        threadCounts.push_back( 4 );
+        threadCounts.push_back( 8 );
+        threadCounts.push_back( 16 );
+    }
+
+    std::vector<unsigned> workLoads;
+    while( args.read("--work", n) )
+        workLoads.push_back( n );
+    if ( workLoads.empty() )
+    {
+        workLoads.push_back( 0 );
+        workLoads.push_back( 200 );
+    }
+
+    unsigned fanout = 0;
+    args.read( "--fanout", fanout );
+
+    std::vector<TaskService::Scheduler> schedulers;
+    std::string name;
+    while( args.read("--scheduler", name) )
+    {
+        if ( name == "priority" )
+            schedulers.push_back( TaskService::SCHEDULER_PRIORITY_QUEUE );
+        else if ( name == "work_stealing" )
+            schedulers.push_back( TaskService::SCHEDULER_WORK_STEALING );
+        else
+            return usage( "Unknown scheduler: " + name );
+    }
+    if ( schedulers.empty() )
+    {
+        schedulers.push_back( TaskService::SCHEDULER_PRIORITY_QUEUE );
+        schedulers.push_back( TaskService::SCHEDULER_WORK_STEALING );
+    }
+
+    std::cout
+        << "Tasks:      " << numTasks << " per run" << std::endl
+        << "Fan-out:    " << fanout << std::endl
+        << std::endl
+        << std::setw(16) << "scheduler"
+        << std::setw(8)  << "work"
+        << std::setw(10) << "threads"
+        << std::setw(12) << "seconds"
+        << std::setw(16) << "tasks/sec"
+        << std::endl;
+
+    for( unsigned w=0; w<workLoads.size(); ++w )
+    {
+        for( unsigned s=0; s<schedulers.size(); ++s )
+        {
+            for( unsigned t=0; t<threadCounts.size(); ++t )
+            {
+                unsigned total = fanout > 0 ?
+                    osg::maximum( numTasks / (1 + fanout), 1u ) * (1 + fanout) :
+                    numTasks;
+
+                double seconds = run( schedulers[s], threadCounts[t], numTasks, workLoads[w], fanout );
+
+                std::cout
+                    << std::setw(16) << (schedulers[s] == TaskService::SCHEDULER_WORK_STEALING ? "work_stealing" : "priority")
+                    << std::setw(8)  << workLoads[w]
+                    << std::setw(10) << threadCounts[t]
+                    << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+                    << std::setw(16) << std::setprecision(0) << (seconds > 0.0 ? total/seconds : 0.0)
+                    << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}
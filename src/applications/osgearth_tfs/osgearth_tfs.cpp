@@ -52,6 +52,8 @@ usage( const std::string& msg )
         << "    --order-by         ; Sort the features, if not already included in the expression. Append DESC for descending order!" << std::endl
         << "    --crop             ; Crops features instead of doing a centroid check.  Features can be added to multiple tiles when cropping is enabled" << std::endl
         << "    --dest-srs         ;The destination SRS string in any format osgEarth can understand (wkt, proj4, epsg).  If none is specified the source data SRS will be used" << std::endl
+        << "    --in-memory        ; Keep the features in memory instead of reading each one from the source again when writing tiles" << std::endl
+        << "    --threads          ; The number of threads to use for writing tiles" << std::endl
         << std::endl;
 
     return -1;
@@ -105,6 +107,15 @@ int main(int argc, char** argv)
 
     std::string destSRS;
     while(arguments.read("--dest-srs", destSRS));
+
+    bool inMemory = false;
+    if (arguments.read("--in-memory"))
+    {
+        inMemory = true;
+    }
+
+    unsigned int numThreads = 1;
+    while (arguments.read("--threads", numThreads));
     
     std::string filename;
 
@@ -154,6 +165,8 @@ int main(int argc, char** argv)
               << "  OrderBy=" << queryOrderBy << std::endl
               << "  Method= " << method << std::endl
               << "  DestSRS= " << destSRS << std::endl
+              << "  InMemory= " << inMemory << std::endl
+              << "  Threads= " << numThreads << std::endl
               << std::endl;
 
 
@@ -177,6 +190,8 @@ int main(int argc, char** argv)
     packager.setQuery( query );
     packager.setMethod( cropMethod );    
     packager.setDestSRS( destSRS );
+    packager.setInMemory( inMemory );
+    packager.setNumThreads( numThreads );
     packager.package( features, destination, layer, description );
     osg::Timer_t endTime = osg::Timer::instance()->tick();
     OE_NOTICE << "Completed in " << osg::Timer::instance()->delta_s( startTime, endTime ) << " s " << std::endl;
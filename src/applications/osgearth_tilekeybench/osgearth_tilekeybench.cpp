@@ -0,0 +1,256 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * Measures TileKey creation and lookup speed: constructing keys, making
+ * child and parent keys, and finding keys in an ordered map, in a hash
+ * table on getHash(), and in a map keyed on str() (the way keys were
+ * identified before they were packed).
+ */
+
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <osgEarth/Registry>
+#include <osgEarth/TileKey>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <vector>
+
+using namespace osgEarth;
+
+namespace
+{
+    /** Minimal chained hash table on TileKey::getHash(). */
+    class TileKeyHashTable
+    {
+    public:
+        TileKeyHashTable( unsigned size )
+        {
+            unsigned n = 1;
+            while( n < size ) n <<= 1;
+            _buckets.resize( n );
+            _mask = n - 1;
+        }
+
+        void insert( const TileKey& key, unsigned value )
+        {
+            _buckets[key.getHash() & _mask].push_back( std::make_pair(key, value) );
+        }
+
+        const unsigned* find( const TileKey& key ) const
+        {
+            const Bucket& b = _buckets[key.getHash() & _mask];
+            for( Bucket::const_iterator i = b.begin(); i != b.end(); ++i )
+                if ( i->first == key )
+                    return &i->second;
+            return 0L;
+        }
+
+    private:
+        typedef std::vector< std::pair<TileKey,unsigned> > Bucket;
+        std::vector<Bucket> _buckets;
+        unsigned            _mask;
+    };
+
+    struct Sample
+    {
+        unsigned lod, x, y;
+    };
+
+    double elapsed( osg::Timer_t start )
+    {
+        return osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+    }
+
+    void report( const std::string& name, unsigned ops, double seconds, unsigned check )
+    {
+        std::cout
+            << std::setw(28) << std::left << name << std::right
+            << std::setw(12) << std::fixed << std::setprecision(3) << seconds
+            << std::setw(16) << std::setprecision(0) << (seconds > 0.0 ? ops/seconds : 0.0)
+            << "    (" << check << ")"
+            << std::endl;
+    }
+
+    int
+    usage( const std::string& msg )
+    {
+        if ( !msg.empty() )
+            std::cout << msg << std::endl;
+
+        std::cout
+            << std::endl
+            << "USAGE: osgearth_tilekeybench [options]" << std::endl
+            << std::endl
+            << "    --keys n             ; Distinct keys stored in the containers (default: 200000)" << std::endl
+            << "    --ops n              ; Operations per measurement (default: 5000000)" << std::endl
+            << "    --max-lod n          ; Deepest LOD of the sample keys (default: 18)" << std::endl
+            << std::endl;
+
+        return -1;
+    }
+}
+
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc,argv);
+
+    if ( args.read("--help") || args.read("-h") )
+        return usage("");
+
+    unsigned numKeys = 200000;
+    args.read( "--keys", numKeys );
+    if ( numKeys < 1 ) numKeys = 1;
+
+    unsigned ops = 5000000;
+    args.read( "--ops", ops );
+
+    unsigned maxLOD = 18;
+    args.read( "--max-lod", maxLOD );
+    if ( maxLOD > 28 )
+        return usage( "--max-lod must be 28 or less" );
+
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    // sample (lod, x, y) tuples spread over the LODs, half of them stored in
+    // the containers and half of them misses.
+    std::vector<Sample> samples( 2 * numKeys );
+    unsigned state = 12345u;
+    for( unsigned i=0; i<samples.size(); ++i )
+    {
+        unsigned wide, high;
+        state = state * 1103515245u + 12345u;
+        samples[i].lod = 1 + (state >> 8) % maxLOD;
+        profile->getNumTiles( samples[i].lod, wide, high );
+        state = state * 1103515245u + 12345u;
+        samples[i].x = (state >> 4) % wide;
+        state = state * 1103515245u + 12345u;
+        samples[i].y = (state >> 4) % high;
+    }
+
+    std::cout
+        << "Keys:       " << numKeys << " stored, " << numKeys << " missing" << std::endl
+        << "Operations: " << ops << " per measurement" << std::endl
+        << std::endl
+        << std::setw(28) << std::left << "operation" << std::right
+        << std::setw(12) << "seconds"
+        << std::setw(16) << "ops/sec"
+        << "    (check)"
+        << std::endl;
+
+    unsigned check;
+    osg::Timer_t start;
+
+    // creation
+    check = 0;
+    start = osg::Timer::instance()->tick();
+    for( unsigned i=0; i<ops; ++i )
+    {
+        const Sample& s = samples[i % samples.size()];
+        TileKey key( s.lod, s.x, s.y, profile );
+        check += (unsigned)key.getPackedKey();
+    }
+    report( "construct", ops, elapsed(start), check );
+
+    check = 0;
+    start = osg::Timer::instance()->tick();
+    for( unsigned i=0; i<ops; ++i )
+    {
+        const Sample& s = samples[i % samples.size()];
+        TileKey key( s.lod, s.x, s.y, profile );
+        check += key.str().length();
+    }
+    report( "construct + str()", ops, elapsed(start), check );
+
+    std::vector<TileKey> keys;
+    keys.reserve( samples.size() );
+    for( unsigned i=0; i<samples.size(); ++i )
+        keys.push_back( TileKey(samples[i].lod, samples[i].x, samples[i].y, profile) );
+
+    check = 0;
+    start = osg::Timer::instance()->tick();
+    for( unsigned i=0; i<ops; ++i )
+    {
+        check += (unsigned)keys[i % keys.size()].createChildKey( i & 3 ).getPackedKey();
+    }
+    report( "createChildKey", ops, elapsed(start), check );
+
+    check = 0;
+    start = osg::Timer::instance()->tick();
+    for( unsigned i=0; i<ops; ++i )
+    {
+        check += (unsigned)keys[i % keys.size()].createParentKey().getPackedKey();
+    }
+    report( "createParentKey", ops, elapsed(start), check );
+
+    // lookups: the first numKeys keys are stored; alternate hits and misses.
+    std::map<TileKey, unsigned>     keyMap;
+    std::map<std::string, unsigned> stringMap;
+    TileKeyHashTable                hashTable( numKeys );
+
+    start = osg::Timer::instance()->tick();
+    for( unsigned i=0; i<numKeys; ++i )
+        keyMap[keys[i]] = i;
+    report( "std::map<TileKey> insert", numKeys, elapsed(start), keyMap.size() );
+
+    start = osg::Timer::instance()->tick();
+    for( unsigned i=0; i<numKeys; ++i )
+        hashTable.insert( keys[i], i );
+    report( "hash table insert", numKeys, elapsed(start), numKeys );
+
+    start = osg::Timer::instance()->tick();
+    for( unsigned i=0; i<numKeys; ++i )
+        stringMap[keys[i].str()] = i;
+    report( "std::map<string> insert", numKeys, elapsed(start), stringMap.size() );
+
+    check = 0;
+    start = osg::Timer::instance()->tick();
+    for( unsigned i=0; i<ops; ++i )
+    {
+        unsigned k = (i >> 1) % numKeys + (i & 1) * numKeys;
+        if ( keyMap.find(keys[k]) != keyMap.end() )
+            ++check;
+    }
+    report( "std::map<TileKey> find", ops, elapsed(start), check );
+
+    check = 0;
+    start = osg::Timer::instance()->tick();
+    for( unsigned i=0; i<ops; ++i )
+    {
+        unsigned k = (i >> 1) % numKeys + (i & 1) * numKeys;
+        if ( hashTable.find(keys[k]) )
+            ++check;
+    }
+    report( "hash table find", ops, elapsed(start), check );
+
+    check = 0;
+    start = osg::Timer::instance()->tick();
+    for( unsigned i=0; i<ops; ++i )
+    {
+        unsigned k = (i >> 1) % numKeys + (i & 1) * numKeys;
+        if ( stringMap.find(keys[k].str()) != stringMap.end() )
+            ++check;
+    }
+    report( "std::map<string> find", ops, elapsed(start), check );
+
+    return 0;
+}
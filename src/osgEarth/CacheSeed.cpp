@@ -19,19 +19,526 @@
 
 #include <osgEarth/CacheSeed>
 #include <osgEarth/MapFrame>
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
 #include <OpenThreads/ScopedLock>
+#include <OpenThreads/Atomic>
+#include <osg/Timer>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
 #include <limits.h>
+#include <string.h>
 
 #define LC "[CacheSeed] "
 
 using namespace osgEarth;
 using namespace OpenThreads;
 
+//------------------------------------------------------------------------
+
+namespace
+{
+    /**
+     * Keys are journaled by TileKey::getPackedKey(), which keeps the LOD in
+     * the top 6 bits. Journaled keys are limited to LOD 31 so the top bit is
+     * free for the JOURNAL_GOT_DATA flag; deeper keys are simply not journaled
+     * and get seeded again on resume.
+     */
+    const unsigned JOURNAL_MAX_LOD = 31;
+
+    // The top bit of a journal record is set if the key produced data,
+    // i.e. if its children were visited.
+    const unsigned long long JOURNAL_GOT_DATA = 1ULL << 63;
+    const unsigned long long JOURNAL_KEY_MASK = ~JOURNAL_GOT_DATA;
+    const char               JOURNAL_MAGIC[8] = { 'O','E','S','E','E','D','0','3' };
+
+    struct JournalRecordLess
+    {
+        bool operator()( unsigned long long lhs, unsigned long long rhs ) const {
+            return (lhs & JOURNAL_KEY_MASK) < (rhs & JOURNAL_KEY_MASK);
+        }
+    };
+
+    /**
+     * Append-only record of completed keys, 8 bytes per key. Records are
+     * flushed in batches; a record lost in a crash just means that one tile
+     * is seeded again on the next run. The header names the seed (map, levels,
+     * extents and layers) the records belong to; a journal written for a
+     * different seed is discarded.
+     */
+    class SeedJournal
+    {
+    public:
+        SeedJournal() : _unflushed(0) { }
+
+        ~SeedJournal() { close(); }
+
+        bool open( const std::string& path, const std::string& identity )
+        {
+            bool rewrite = false;
+            bool exists  = false;
+
+            std::ifstream in( path.c_str(), std::ios::binary );
+            if ( in.is_open() )
+            {
+                char magic[8];
+                in.read( magic, 8 );
+                if ( in.gcount() > 0 )
+                {
+                    exists = true;
+                    if ( in.gcount() < 8 || ::memcmp(magic, JOURNAL_MAGIC, 6) != 0 )
+                    {
+                        OE_WARN << LC << "\"" << path << "\" is not a seed journal; ignoring it." << std::endl;
+                        return false;
+                    }
+
+                    unsigned    idLen = 0;
+                    std::string id;
+                    if ( ::memcmp(magic, JOURNAL_MAGIC, 8) == 0 && in.read((char*)&idLen, sizeof(idLen)) && idLen == identity.size() )
+                    {
+                        id.resize( idLen );
+                        in.read( &id[0], idLen );
+                    }
+
+                    if ( !in || id != identity )
+                    {
+                        OE_NOTICE << LC << "Journal \"" << path << "\" is from a different seed; starting over." << std::endl;
+                        rewrite = true;
+                    }
+                    else
+                    {
+                        unsigned long long record;
+                        while( in.read( (char*)&record, sizeof(record) ) )
+                            _done.push_back( record );
+
+                        // a partial record at the end means the last run died mid-write;
+                        // rewrite the file so new records stay aligned.
+                        rewrite = in.gcount() > 0;
+
+                        std::sort( _done.begin(), _done.end(), JournalRecordLess() );
+                    }
+                }
+            }
+            in.close();
+
+            if ( rewrite || !exists )
+            {
+                unsigned idLen = identity.size();
+                _out.open( path.c_str(), std::ios::binary | std::ios::out | std::ios::trunc );
+                _out.write( JOURNAL_MAGIC, 8 );
+                _out.write( (const char*)&idLen, sizeof(idLen) );
+                _out.write( identity.c_str(), idLen );
+                if ( _done.size() > 0 )
+                    _out.write( (const char*)&_done[0], _done.size() * sizeof(unsigned long long) );
+            }
+            else
+            {
+                _out.open( path.c_str(), std::ios::binary | std::ios::out | std::ios::app );
+            }
+
+            if ( !_out.is_open() )
+            {
+                OE_WARN << LC << "Failed to open journal \"" << path << "\" for writing" << std::endl;
+                return false;
+            }
+
+            return true;
+        }
+
+        /** Number of keys completed by earlier runs. */
+        unsigned getNumDone() const { return _done.size(); }
+
+        /** Whether an earlier run completed the key. Safe to call from any thread. */
+        bool find( const TileKey& key, bool& out_gotData ) const
+        {
+            if ( key.getLevelOfDetail() > JOURNAL_MAX_LOD )
+                return false;
+
+            unsigned long long packed = key.getPackedKey();
+            std::vector<unsigned long long>::const_iterator i = std::lower_bound(
+                _done.begin(), _done.end(), packed, JournalRecordLess() );
+
+            if ( i != _done.end() && ((*i) & JOURNAL_KEY_MASK) == packed )
+            {
+                out_gotData = ((*i) & JOURNAL_GOT_DATA) != 0;
+                return true;
+            }
+            return false;
+        }
+
+        void record( const TileKey& key, bool gotData )
+        {
+            if ( key.getLevelOfDetail() > JOURNAL_MAX_LOD )
+                return;
+
+            unsigned long long record = key.getPackedKey() | (gotData ? JOURNAL_GOT_DATA : 0ULL);
+
+            Threading::ScopedMutexLock lock( _mutex );
+            _out.write( (const char*)&record, sizeof(record) );
+            if ( ++_unflushed >= 256 )
+            {
+                _out.flush();
+                _unflushed = 0;
+            }
+        }
+
+        void close()
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            if ( _out.is_open() )
+                _out.close();
+        }
+
+    private:
+        std::vector<unsigned long long> _done;
+        std::ofstream                   _out;
+        Threading::Mutex                _mutex;
+        unsigned                        _unflushed;
+    };
+
+
+    /** Seeding totals for one layer. */
+    struct LayerStats
+    {
+        LayerStats() : _tiles(0), _bytes(0) { }
+        unsigned           _tiles;
+        unsigned long long _bytes;
+    };
+
+
+    /** A key whose layers are being seeded by separate tasks. */
+    struct KeyJob : public osg::Referenced
+    {
+        KeyJob( const TileKey& key, const std::vector<unsigned>& extents, unsigned numLayers )
+            : _key(key), _extents(extents), _remaining(numLayers), _gotData(0) { }
+
+        TileKey               _key;
+        std::vector<unsigned> _extents;    // seed extents that intersect the key
+        OpenThreads::Atomic   _remaining;  // layer tasks yet to finish
+        OpenThreads::Atomic   _gotData;    // layer tasks that produced data
+    };
+
+
+    /**
+     * One run of the seeder. Each layer of each key is a task on a private
+     * TaskService; the last task to finish for a key visits its children.
+     * Deeper keys get higher priority, which keeps the walk depth-first and
+     * the queue small.
+     */
+    class SeedSession
+    {
+    public:
+        SeedSession(unsigned                          minLevel,
+                    unsigned                          maxLevel,
+                    const std::vector<GeoExtent>&     extents,
+                    const Profile*                    profile,
+                    const std::vector<TerrainLayer*>& layers,
+                    ProgressCallback*                 progress,
+                    SeedJournal*                      journal,
+                    unsigned                          total,
+                    unsigned                          numThreads );
+
+        ~SeedSession();
+
+        /** Seeds everything under the root keys, and blocks until done. */
+        void run( const std::vector<TileKey>& rootKeys );
+
+        unsigned getCompleted() const { return _completed; }
+
+        // called from the tasks:
+        void seedLayer( KeyJob* job, unsigned layerIndex );
+
+    private:
+        void visit( const TileKey& key, const std::vector<unsigned>& extents );
+        void finish( const TileKey& key, const std::vector<unsigned>& extents, bool gotData, bool journaled );
+        void taskDone();
+        void reportThroughput( bool final );
+
+        unsigned                   _minLevel;
+        unsigned                   _maxLevel;
+        std::vector<GeoExtent>     _extents;
+        std::vector<TerrainLayer*> _layers;
+        ProgressCallback*          _progress;
+        SeedJournal*               _journal;
+        unsigned                   _total;
+
+        OpenThreads::Atomic        _completed;
+        OpenThreads::Atomic        _pending;
+        Threading::Event           _done;
+        Threading::Mutex           _progressMutex;
+
+        std::vector<LayerStats>    _stats;
+        Threading::Mutex           _statsMutex;
+        osg::Timer_t               _startTime;
+
+        osg::ref_ptr<TaskService>  _service;
+    };
+
+
+    class SeedLayerTask : public TaskRequest
+    {
+    public:
+        SeedLayerTask( SeedSession* session, KeyJob* job, unsigned layerIndex )
+            : TaskRequest( -(float)job->_key.getLevelOfDetail() ),
+              _session   ( session ),
+              _job       ( job ),
+              _layerIndex( layerIndex ) { }
+
+        void operator()( ProgressCallback* progress )
+        {
+            _session->seedLayer( _job.get(), _layerIndex );
+        }
+
+    private:
+        SeedSession*         _session;
+        osg::ref_ptr<KeyJob> _job;
+        unsigned             _layerIndex;
+    };
+
+
+    SeedSession::SeedSession(unsigned                          minLevel,
+                             unsigned                          maxLevel,
+                             const std::vector<GeoExtent>&     extents,
+                             const Profile*                    profile,
+                             const std::vector<TerrainLayer*>& layers,
+                             ProgressCallback*                 progress,
+                             SeedJournal*                      journal,
+                             unsigned                          total,
+                             unsigned                          numThreads ) :
+    _minLevel ( minLevel ),
+    _maxLevel ( maxLevel ),
+    _layers   ( layers ),
+    _progress ( progress ),
+    _journal  ( journal ),
+    _total    ( total ),
+    _completed( 0 ),
+    _pending  ( 0 ),
+    _stats    ( layers.size() )
+    {
+        // bring the extents into the profile's SRS once, so the per-key
+        // intersection tests don't have to.
+        for( unsigned i=0; i<extents.size(); ++i )
+        {
+            GeoExtent ex = extents[i].transform( profile->getSRS() );
+            _extents.push_back( ex.isValid() ? ex : extents[i] );
+        }
+
+        _service = new TaskService( "CacheSeed", numThreads );
+    }
+
+    SeedSession::~SeedSession()
+    {
+        // joins the worker threads before the session goes away.
+        _service = 0L;
+    }
+
+    void
+    SeedSession::run( const std::vector<TileKey>& rootKeys )
+    {
+        _startTime = osg::Timer::instance()->tick();
+
+        // hold a pending count while queueing the roots, so the first subtree
+        // to finish cannot signal completion early.
+        ++_pending;
+
+        for( unsigned i=0; i<rootKeys.size(); ++i )
+        {
+            std::vector<unsigned> extents;
+            const GeoExtent& keyExtent = rootKeys[i].getExtent();
+            for( unsigned j=0; j<_extents.size(); ++j )
+            {
+                if ( _extents[j].intersects(keyExtent) )
+                    extents.push_back( j );
+            }
+            if ( extents.size() > 0 )
+                visit( rootKeys[i], extents );
+        }
+
+        taskDone();
+
+        while( !_done.wait(10000) )
+        {
+            reportThroughput( false );
+        }
+
+        reportThroughput( true );
+    }
+
+    void
+    SeedSession::visit( const TileKey& key, const std::vector<unsigned>& extents )
+    {
+        if ( _progress->isCanceled() )
+            return;
+
+        if ( key.getLevelOfDetail() < _minLevel )
+        {
+            finish( key, extents, true, false );
+            return;
+        }
+
+        bool gotData;
+        if ( _journal && _journal->find(key, gotData) )
+        {
+            finish( key, extents, gotData, true );
+            return;
+        }
+
+        std::vector<unsigned> layers;
+        for( unsigned i=0; i<_layers.size(); ++i )
+        {
+            if ( _layers[i]->isKeyValid(key) )
+                layers.push_back( i );
+        }
+
+        if ( layers.empty() )
+        {
+            finish( key, extents, false, false );
+            return;
+        }
+
+        osg::ref_ptr<KeyJob> job = new KeyJob( key, extents, layers.size() );
+        for( unsigned i=0; i<layers.size(); ++i )
+        {
+            ++_pending;
+            _service->add( new SeedLayerTask(this, job.get(), layers[i]) );
+        }
+    }
+
+    void
+    SeedSession::seedLayer( KeyJob* job, unsigned layerIndex )
+    {
+        if ( !_progress->isCanceled() )
+        {
+            TerrainLayer*      layer = _layers[layerIndex];
+            unsigned long long bytes = 0;
+
+            //Assumes the the TileSource will perform the caching for us
+            ImageLayer* imageLayer = dynamic_cast<ImageLayer*>( layer );
+            if ( imageLayer )
+            {
+                GeoImage image = imageLayer->createImage( job->_key );
+                if ( image.valid() )
+                    bytes = image.getImage()->getImageSizeInBytes();
+            }
+            else
+            {
+                ElevationLayer* elevationLayer = dynamic_cast<ElevationLayer*>( layer );
+                if ( elevationLayer )
+                {
+                    GeoHeightField hf = elevationLayer->createHeightField( job->_key );
+                    if ( hf.valid() )
+                        bytes = hf.getHeightField()->getHeightList().size() * sizeof(float);
+                }
+            }
+
+            if ( bytes > 0 )
+            {
+                ++job->_gotData;
+
+                Threading::ScopedMutexLock lock( _statsMutex );
+                _stats[layerIndex]._tiles++;
+                _stats[layerIndex]._bytes += bytes;
+            }
+        }
+
+        if ( --job->_remaining == 0 )
+        {
+            finish( job->_key, job->_extents, job->_gotData > 0, false );
+        }
+
+        taskDone();
+    }
+
+    void
+    SeedSession::finish( const TileKey& key, const std::vector<unsigned>& extents, bool gotData, bool journaled )
+    {
+        unsigned lod = key.getLevelOfDetail();
+
+        if ( lod >= _minLevel )
+        {
+            // a canceled key may not have been seeded; leave it for next time.
+            if ( _progress->isCanceled() )
+                return;
+
+            if ( _journal && !journaled )
+                _journal->record( key, gotData );
+
+            if ( gotData )
+            {
+                unsigned completed = ++_completed;
+
+                Threading::ScopedMutexLock lock( _progressMutex );
+                if ( _progress->reportProgress(completed, _total, std::string("Cached tile: ") + key.str()) )
+                {
+                    _progress->cancel();
+                    return;
+                }
+            }
+        }
+
+        if ( gotData && lod < _maxLevel )
+        {
+            // only the extents that touched the parent can touch a child.
+            for( unsigned q=0; q<4; ++q )
+            {
+                TileKey child = key.createChildKey( q );
+                const GeoExtent& childExtent = child.getExtent();
+
+                std::vector<unsigned> childExtents;
+                for( unsigned i=0; i<extents.size(); ++i )
+                {
+                    if ( _extents[extents[i]].intersects(childExtent, false) )
+                        childExtents.push_back( extents[i] );
+                }
+
+                if ( childExtents.size() > 0 )
+                    visit( child, childExtents );
+            }
+        }
+    }
+
+    void
+    SeedSession::taskDone()
+    {
+        if ( --_pending == 0 )
+            _done.set();
+    }
+
+    void
+    SeedSession::reportThroughput( bool final )
+    {
+        double seconds = osg::Timer::instance()->delta_s( _startTime, osg::Timer::instance()->tick() );
+        if ( seconds <= 0.0 )
+            return;
+
+        Threading::ScopedMutexLock lock( _statsMutex );
+        for( unsigned i=0; i<_layers.size(); ++i )
+        {
+            const LayerStats& s = _stats[i];
+            std::stringstream buf;
+            buf << LC << "Layer \"" << _layers[i]->getName() << "\": "
+                << s._tiles << " tiles, "
+                << (double)s._bytes/1048576.0 << " MB; "
+                << (double)s._tiles/seconds << " tiles/s, "
+                << (double)s._bytes/(1048576.0*seconds) << " MB/s";
+
+            if ( final )
+                OE_NOTICE << buf.str() << std::endl;
+            else
+                OE_INFO << buf.str() << std::endl;
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
 CacheSeed::CacheSeed():
-_minLevel (0),
-_maxLevel (12),
-_total    (0),
-_completed(0)
+_minLevel  (0),
+_maxLevel  (12),
+_total     (0),
+_completed (0),
+_numThreads(1)
 {
 }
 
@@ -58,6 +565,9 @@ void CacheSeed::seed( Map* map )
 
     MapFrame mapf( map, Map::TERRAIN_LAYERS, "CacheSeed::seed" );
 
+    // layers that passed validation, and will be seeded
+    std::vector<TerrainLayer*> layers;
+
     //Assumes the the TileSource will perform the caching for us when we call createImage
     for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); i++ )
     {
@@ -85,6 +595,7 @@ void CacheSeed::seed( Map* map )
         else
         {
             hasCaches = true;
+            layers.push_back( layer );
 
             if (opt.minLevel().isSet() && (int)opt.minLevel().get() < src_min_level)
                 src_min_level = opt.minLevel().get();
@@ -118,6 +629,7 @@ void CacheSeed::seed( Map* map )
         else
         {
             hasCaches = true;
+            layers.push_back( layer );
 
             if (opt.minLevel().isSet() && (int)opt.minLevel().get() < src_min_level)
                 src_min_level = opt.minLevel().get();
@@ -261,107 +773,52 @@ void CacheSeed::seed( Map* map )
 
     OE_INFO << "Processing ~" << _total << " tiles" << std::endl;
 
-    for (unsigned int i = 0; i < keys.size(); ++i)
-    {
-        processKey( mapf, keys[i] );
-    }
-
-    _total = _completed;
-
-    if ( _progress.valid()) _progress->reportProgress(_completed, _total, 0, 1, "Finished");
-}
-
-void CacheSeed::incrementCompleted( unsigned int total ) const
-{    
-    CacheSeed* nonconst_this = const_cast<CacheSeed*>(this);
-    nonconst_this->_completed += total;
-}
-
-void
-CacheSeed::processKey(const MapFrame& mapf, const TileKey& key ) const
-{
-    unsigned int x, y, lod;
-    key.getTileXY(x, y);
-    lod = key.getLevelOfDetail();
+    if ( !_progress.valid() )
+        _progress = new ProgressCallback();
 
-    bool gotData = true;
-
-    if ( _minLevel <= lod && _maxLevel >= lod )
+    SeedJournal journal;
+    bool useJournal = false;
+    if ( !_journalFile.empty() )
     {
-        gotData = cacheTile( mapf, key );
-        if (gotData)
+        // records only carry over to a seed of the same area, levels and layers.
+        std::stringstream identity;
+        identity << map->getProfile()->getFullSignature() << ";levels=" << _minLevel << "-" << _maxLevel;
+        for( std::vector<GeoExtent>::const_iterator i = _extents.begin(); i != _extents.end(); ++i )
+            identity << ";extent=" << i->toString();
+        for( std::vector<TerrainLayer*>::const_iterator i = layers.begin(); i != layers.end(); ++i )
+            identity << ";layer=" << (*i)->getName();
+
+        useJournal = journal.open( _journalFile, identity.str() );
+        if ( useJournal && journal.getNumDone() > 0 )
         {
-        incrementCompleted( 1 );
+            OE_NOTICE << LC << "Resuming; " << journal.getNumDone() << " tiles already done according to \""
+                << _journalFile << "\"" << std::endl;
         }
-
-        if ( _progress.valid() && _progress->isCanceled() )
-            return; // Task has been cancelled by user
-
-        if ( _progress.valid() && gotData && _progress->reportProgress(_completed, _total, std::string("Cached tile: ") + key.str()) )
-            return; // Canceled
     }
 
-    if ( gotData && lod <= _maxLevel )
-    {
-        TileKey k0 = key.createChildKey(0);
-        TileKey k1 = key.createChildKey(1);
-        TileKey k2 = key.createChildKey(2);
-        TileKey k3 = key.createChildKey(3); 
+    OE_INFO << LC << "Seeding with " << _numThreads << " thread(s)" << std::endl;
 
-        bool intersectsKey = false;
-        if (_extents.empty()) intersectsKey = true;
-        else
-        {
-            for (unsigned int i = 0; i < _extents.size(); ++i)
-            {
-                if (_extents[i].intersects( k0.getExtent() ) ||
-                    _extents[i].intersects( k1.getExtent() ) ||
-                    _extents[i].intersects( k2.getExtent() ) ||
-                    _extents[i].intersects( k3.getExtent() ))
-                {
-                    intersectsKey = true;
-                }
+    {
+        SeedSession session(
+            _minLevel, _maxLevel, _extents, map->getProfile(), layers,
+            _progress.get(), useJournal ? &journal : 0L, _total, _numThreads );
 
-            }
-        }
+        session.run( keys );
 
-        //Check to see if the bounds intersects ANY of the tile's children.  If it does, then process all of the children
-        //for this level
-        if (intersectsKey)
-        {
-            processKey(mapf, k0);
-            processKey(mapf, k1);
-            processKey(mapf, k2);
-            processKey(mapf, k3);
-        }
+        incrementCompleted( session.getCompleted() );
     }
-}
 
-bool
-CacheSeed::cacheTile(const MapFrame& mapf, const TileKey& key ) const
-{
-    bool gotData = false;
+    journal.close();
 
-    for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); i++ )
-    {
-        ImageLayer* layer = i->get();
-        if ( layer->isKeyValid( key ) )
-        {
-            GeoImage image = layer->createImage( key );
-            if ( image.valid() )
-                gotData = true;
-        }
-    }
+    _total = _completed;
 
-    if ( mapf.elevationLayers().size() > 0 )
-    {
-        osg::ref_ptr<osg::HeightField> hf;
-        mapf.getHeightField( key, false, hf );
-        if ( hf.valid() )
-            gotData = true;
-    }
+    if ( _progress.valid()) _progress->reportProgress(_completed, _total, 0, 1, "Finished");
+}
 
-    return gotData;
+void CacheSeed::incrementCompleted( unsigned int total ) const
+{    
+    CacheSeed* nonconst_this = const_cast<CacheSeed*>(this);
+    nonconst_this->_completed += total;
 }
 
 void
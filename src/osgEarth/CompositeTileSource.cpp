@@ -21,6 +21,7 @@
 #include <osgEarth/StringUtils>
 #include <osgEarth/Registry>
 #include <osgDB/FileNameUtils>
+#include <cstring>
 
 #define LC "[CompositeTileSource] "
 
@@ -118,6 +119,209 @@ namespace
 
         ImageLayerTileProcessor _processor;
     };
+
+    // most component fetches to run at once.
+    const unsigned FETCH_MAX_THREADS = 8;
+
+    /**
+     * Fetches the image for one component. With _fallback set, walks up
+     * the component's ancestor keys instead until one has an image, and
+     * crops that to the requested key.
+     */
+    struct FetchComponent
+    {
+        TileSource*               _source;
+        const ImageLayerOptions*  _layerOptions;
+        const osgDB::Options*     _dbOptions;
+        TileKey                   _key;
+        ProgressCallback*         _progress;
+        ImageInfo*                _info;
+        bool                      _fallback;
+        osg::Vec2s                _textureSize;
+
+        bool canceled() const { return _progress && _progress->isCanceled(); }
+
+        void execute()
+        {
+            if ( canceled() )
+                return;
+
+            osg::ref_ptr< ImageLayerPreCacheOperation > preCacheOp;
+            if ( _layerOptions )
+            {
+                preCacheOp = new ImageLayerPreCacheOperation();
+                preCacheOp->_processor.init( *_layerOptions, _dbOptions, true );
+            }
+
+            if ( _fallback )
+                fetchAncestor( preCacheOp.get() );
+            else
+                fetch( preCacheOp.get() );
+        }
+
+        void fetch( ImageLayerPreCacheOperation* preCacheOp )
+        {
+            _info->image = _source->createImage( _key, preCacheOp, _progress );
+
+            //If the image is not valid and the progress was not cancelled, blacklist
+            if ( !_info->image.valid() && !canceled() )
+            {
+                OE_DEBUG << LC << "Adding tile " << _key.str() << " to the blacklist" << std::endl;
+                _source->getBlacklist()->add( _key.getTileId() );
+            }
+            _info->opacity = _layerOptions ? _layerOptions->opacity().value() : 1.0f;
+        }
+
+        void fetchAncestor( ImageLayerPreCacheOperation* preCacheOp )
+        {
+            osg::ref_ptr< osg::Image > image;
+            TileKey parentKey = _key.createParentKey();
+            while ( parentKey.valid() && !canceled() )
+            {
+                image = _source->createImage( parentKey, preCacheOp, _progress );
+                if ( image.valid() )
+                    break;
+                parentKey = parentKey.createParentKey();
+            }
+
+            if ( image.valid() )
+            {
+                //We got an image, but now we need to crop it to match the incoming key's extents
+                GeoImage geoImage( image.get(), parentKey.getExtent() );
+                GeoImage cropped = geoImage.crop( _key.getExtent(), true, _textureSize.x(), _textureSize.y(), *_source->getOptions().bilinearReprojection() );
+                _info->image = cropped.getImage();
+            }
+        }
+    };
+
+    typedef std::vector< osg::ref_ptr< ParallelTask<FetchComponent> > > FetchTasks;
+
+    ParallelTask<FetchComponent>* createFetchTask(TileSource*                        source,
+                                                  const optional<ImageLayerOptions>& layerOptions,
+                                                  const osgDB::Options*              dbOptions,
+                                                  const TileKey&                     key,
+                                                  ProgressCallback*                  progress,
+                                                  ImageInfo*                         info )
+    {
+        ParallelTask<FetchComponent>* task = new ParallelTask<FetchComponent>();
+        task->_source       = source;
+        task->_layerOptions = layerOptions.isSet() ? &layerOptions.value() : 0L;
+        task->_dbOptions    = dbOptions;
+        task->_key          = key;
+        task->_progress     = progress;
+        task->_info         = info;
+        task->_fallback     = false;
+        return task;
+    }
+
+    // runs the fetches on the service and waits for them all; a single
+    // fetch runs in the calling thread.
+    void runFetchTasks( FetchTasks& tasks, TaskService* service )
+    {
+        if ( tasks.size() == 1 || !service )
+        {
+            for( unsigned i = 0; i < tasks.size(); ++i )
+                tasks[i]->execute();
+            return;
+        }
+
+        Threading::MultiEvent semaphore( (int)tasks.size() );
+        for( unsigned i = 0; i < tasks.size(); ++i )
+        {
+            tasks[i]->_mev = &semaphore;
+            service->add( tasks[i].get() );
+        }
+        semaphore.wait();
+    }
+
+    inline bool isRGBA8( const osg::Image* image )
+    {
+        return
+            image->getPixelFormat() == GL_RGBA &&
+            image->getDataType()    == GL_UNSIGNED_BYTE &&
+            image->r()              == 1;
+    }
+
+    // (x + 127) / 255 for each 16-bit lane of a word holding two products
+    // of 8-bit values, leaving the results in the low byte of each lane.
+    inline unsigned div255x2( unsigned lanes )
+    {
+        lanes += 0x00800080;
+        return ((lanes + ((lanes >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    }
+
+    /**
+     * Blends an RGBA8 image "over" an RGBA8 image of the same size with
+     * integer math, two channels per multiply (the red/blue and
+     * green/alpha byte pairs of a pixel word). Matches ImageUtils::mix:
+     * the source weight is opacity * source alpha, and the result alpha is
+     * the greater of that weight and the destination alpha. Runs of fully
+     * transparent source pixels are skipped and, at full opacity, runs of
+     * fully opaque ones are copied.
+     */
+    void blendOverRGBA8( osg::Image* dest, const osg::Image* src, float opacity )
+    {
+        const unsigned op = (unsigned)( osg::clampBetween(opacity, 0.0f, 1.0f) * 255.0f + 0.5f );
+        if ( op == 0 )
+            return;
+
+        const int width = src->s();
+
+        for( int t = 0; t < src->t(); ++t )
+        {
+            const unsigned char* s = src->data( 0, t );
+            unsigned char*       d = dest->data( 0, t );
+
+            int x = 0;
+            while( x < width )
+            {
+                // skip a transparent span.
+                if ( s[4*x+3] == 0 )
+                {
+                    ++x;
+                    while( x < width && s[4*x+3] == 0 )
+                        ++x;
+                    continue;
+                }
+
+                // copy an opaque span.
+                if ( op == 255 && s[4*x+3] == 255 )
+                {
+                    int first = x++;
+                    while( x < width && s[4*x+3] == 255 )
+                        ++x;
+                    ::memcpy( d + 4*first, s + 4*first, 4*(x-first) );
+                    continue;
+                }
+
+                // blend one pixel.
+                unsigned a   = op == 255 ? s[4*x+3] : (div255x2( op * s[4*x+3] ) & 0xFF);
+                unsigned inv = 255 - a;
+
+                unsigned sp, dp;
+                ::memcpy( &sp, s + 4*x, 4 );
+                ::memcpy( &dp, d + 4*x, 4 );
+
+                unsigned lo = div255x2( (dp & 0x00FF00FF) * inv + (sp & 0x00FF00FF) * a );
+                unsigned hi = div255x2( ((dp >> 8) & 0x00FF00FF) * inv + ((sp >> 8) & 0x00FF00FF) * a );
+                dp = lo | (hi << 8);
+                ::memcpy( d + 4*x, &dp, 4 );
+
+                // alpha doesn't blend; it takes the greater of the two.
+                d[4*x+3] = (unsigned char)osg::maximum( a, (unsigned)d[4*x+3] );
+                ++x;
+            }
+        }
+    }
+
+    // blends src over dest, taking the integer path for RGBA8 pairs.
+    void blendOver( osg::Image* dest, const osg::Image* src, float opacity )
+    {
+        if ( isRGBA8(dest) && isRGBA8(src) && dest->s() == src->s() && dest->t() == src->t() )
+            blendOverRGBA8( dest, src, opacity );
+        else
+            ImageUtils::mix( dest, src, opacity );
+    }
 }
 
 //-----------------------------------------------------------------------
@@ -164,46 +368,45 @@ osg::Image*
 CompositeTileSource::createImage(const TileKey&    key,
                                  ProgressCallback* progress )
 {
-    ImageMixVector images;
-    images.reserve( _options._components.size() );
+    ImageMixVector images( _options._components.size() );
+
+    // fetch every component that's in range and has data, concurrently.
+    FetchTasks tasks;
+    tasks.reserve( images.size() );
 
-    for(CompositeTileSourceOptions::ComponentVector::const_iterator i = _options._components.begin();
-        i != _options._components.end();
-        ++i )
+    for( unsigned i = 0; i < _options._components.size(); ++i )
     {
         if ( progress && progress->isCanceled() )
             return 0L;
 
-        ImageInfo imageInfo;
-        imageInfo.dataInExtents = false;
+        const CompositeTileSourceOptions::Component& comp = _options._components[i];
+        ImageInfo& imageInfo = images[i];
 
-
-
-        TileSource* source = i->_tileSourceInstance.get();
+        TileSource* source = comp._tileSourceInstance.get();
         if ( source )
         {
             //TODO:  This duplicates code in ImageLayer::isKeyValid.  Maybe should move that to TileSource::isKeyValid instead
             int minLevel = 0;
             int maxLevel = INT_MAX;
-            if (i->_imageLayerOptions->minLevel().isSet())
+            if (comp._imageLayerOptions->minLevel().isSet())
             {
-                minLevel = i->_imageLayerOptions->minLevel().value();
+                minLevel = comp._imageLayerOptions->minLevel().value();
             }
-            else if (i->_imageLayerOptions->minResolution().isSet())
+            else if (comp._imageLayerOptions->minResolution().isSet())
             {
                 minLevel = source->getProfile()->getLevelOfDetailForHorizResolution( 
-                    i->_imageLayerOptions->minResolution().value(), 
+                    comp._imageLayerOptions->minResolution().value(), 
                     source->getPixelsPerTile());
             }
 
-            if (i->_imageLayerOptions->maxLevel().isSet())
+            if (comp._imageLayerOptions->maxLevel().isSet())
             {
-                maxLevel = i->_imageLayerOptions->maxLevel().value();
+                maxLevel = comp._imageLayerOptions->maxLevel().value();
             }
-            else if (i->_imageLayerOptions->maxResolution().isSet())
+            else if (comp._imageLayerOptions->maxResolution().isSet())
             {
                 maxLevel = source->getProfile()->getLevelOfDetailForHorizResolution( 
-                    i->_imageLayerOptions->maxResolution().value(), 
+                    comp._imageLayerOptions->maxResolution().value(), 
                     source->getPixelsPerTile());
             }
 
@@ -213,45 +416,30 @@ CompositeTileSource::createImage(const TileKey&    key,
             {
                 continue;
             }
-            
-                //Only try to get data if the source actually has data                
-                if (source->hasDataInExtent( key.getExtent() ) )
-                {
-                    //We have data within these extents
-                    imageInfo.dataInExtents = true;
-
-                    if ( !source->getBlacklist()->contains( key.getTileId() ) )
-                    {                        
-                        osg::ref_ptr< ImageLayerPreCacheOperation > preCacheOp;
-                        if ( i->_imageLayerOptions.isSet() )
-                        {
-                            preCacheOp = new ImageLayerPreCacheOperation();
-                            preCacheOp->_processor.init( i->_imageLayerOptions.value(), _dbOptions.get(), true );                        
-                        }
-
-                        imageInfo.image = source->createImage( key, preCacheOp.get(), progress );
-                        imageInfo.opacity = 1.0f;
-
-                        //If the image is not valid and the progress was not cancelled, blacklist
-                        if (!imageInfo.image.valid() && (!progress || !progress->isCanceled()))
-                        {
-                            //Add the tile to the blacklist
-                            OE_DEBUG << LC << "Adding tile " << key.str() << " to the blacklist" << std::endl;
-                            source->getBlacklist()->add( key.getTileId() );
-                        }
-                        imageInfo.opacity = i->_imageLayerOptions.isSet() ? i->_imageLayerOptions->opacity().value() : 1.0f;
-                    }
-                }
-                else
+
+            //Only try to get data if the source actually has data                
+            if (source->hasDataInExtent( key.getExtent() ) )
+            {
+                //We have data within these extents
+                imageInfo.dataInExtents = true;
+
+                if ( !source->getBlacklist()->contains( key.getTileId() ) )
                 {
-                    OE_DEBUG << LC << "Source has no data at " << key.str() << std::endl;
+                    tasks.push_back( createFetchTask(source, comp._imageLayerOptions, _dbOptions.get(), key, progress, &imageInfo) );
                 }
+            }
+            else
+            {
+                OE_DEBUG << LC << "Source has no data at " << key.str() << std::endl;
+            }
         }
-
-        //Add the ImageInfo to the list
-        images.push_back( imageInfo );
     }
 
+    runFetchTasks( tasks, _fetchService.get() );
+
+    if ( progress && progress->isCanceled() )
+        return 0L;
+
     unsigned numValidImages = 0;
     osg::Vec2s textureSize;
     for (unsigned int i = 0; i < images.size(); i++)
@@ -269,47 +457,23 @@ CompositeTileSource::createImage(const TileKey&    key,
 
     //Try to fallback on any empty images if we have some valid images but not valid images for ALL layers
     if (numValidImages > 0 && numValidImages < images.size())
-    {        
+    {
+        tasks.clear();
         for (unsigned int i = 0; i < images.size(); i++)
         {
             ImageInfo& info = images[i];
-            if (!info.image.valid() && info.dataInExtents)
-            {                                
-                TileKey parentKey = key.createParentKey();
-
-                TileSource* source = _options._components[i]._tileSourceInstance;
-                if (source)
-                {                 
-                    osg::ref_ptr< ImageLayerPreCacheOperation > preCacheOp;
-                    if ( _options._components[i]._imageLayerOptions.isSet() )
-                    {
-                        preCacheOp = new ImageLayerPreCacheOperation();
-                        preCacheOp->_processor.init( _options._components[i]._imageLayerOptions.value(), _dbOptions.get(), true );                        
-                    }                
-
-                    osg::ref_ptr< osg::Image > image;
-                    while (!image.valid() && parentKey.valid())
-                    {                        
-                        image = source->createImage( parentKey, preCacheOp.get(), progress );
-                        if (image.valid())
-                        {                     
-                            break;
-                        }
-                        parentKey = parentKey.createParentKey();
-                    }     
-
-                    if (image.valid())
-                    {
-                        //We got an image, but now we need to crop it to match the incoming key's extents
-                        GeoImage geoImage( image.get(), parentKey.getExtent());
-                        GeoImage cropped = geoImage.crop( key.getExtent(), true, textureSize.x(), textureSize.y(), *source->_options.bilinearReprojection());
-                        image = cropped.getImage();
-                    }
-
-                    info.image = image.get();
-                }
+            if (!info.image.valid() && info.dataInExtents && _options._components[i]._tileSourceInstance.valid())
+            {
+                const CompositeTileSourceOptions::Component& comp = _options._components[i];
+                ParallelTask<FetchComponent>* task = createFetchTask(
+                    comp._tileSourceInstance.get(), comp._imageLayerOptions, _dbOptions.get(), key, progress, &info );
+                task->_fallback    = true;
+                task->_textureSize = textureSize;
+                tasks.push_back( task );
             }
         }
+
+        runFetchTasks( tasks, _fetchService.get() );
     }
 
     //Recompute the number of valid images
@@ -356,7 +520,7 @@ CompositeTileSource::createImage(const TileKey&    key,
             {
                 if (imageInfo.image.valid())
                 {
-                    ImageUtils::mix( result, imageInfo.image, imageInfo.opacity );
+                    blendOver( result, imageInfo.image.get(), imageInfo.opacity );
                 }
             }            
         }        
@@ -485,6 +649,14 @@ CompositeTileSource::initialize(const osgDB::Options* dbOptions)
     // set the new profile that was derived from the components
     setProfile( profile.get() );
 
+    // fetches the components of a tile concurrently.
+    if ( _options._components.size() > 1 )
+    {
+        _fetchService = new TaskService(
+            "CompositeTileSource fetch",
+            (int)osg::minimum( (unsigned)_options._components.size(), FETCH_MAX_THREADS ) );
+    }
+
     _initialized = true;
     return STATUS_OK;
 }
@@ -20,6 +20,7 @@
 #include <osgEarth/VerticalDatum>
 #include <osgEarth/HeightFieldUtils>
 #include <osg/Version>
+#include <algorithm>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -208,11 +209,12 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
         }
 
         // Make it from the source:
-        result = source->createHeightField( key, _preCacheOp.get(), progress );
+        osg::ref_ptr<osg::HeightField> hf;
+        fetchHeightFieldFromTileSource( key, progress, hf );
 
         // If the result is good, we how have a heightfield but it's vertical values
         // are still relative to the tile source's vertical datum. Convert them.
-        if ( result )
+        if ( hf.valid() )
         {
             if ( ! key.getExtent().getSRS()->isVertEquivalentTo( getProfile()->getSRS() ) )
             {
@@ -220,9 +222,11 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
                     getProfile()->getSRS()->getVerticalDatum(),    // from
                     key.getExtent().getSRS()->getVerticalDatum(),  // to
                     key.getExtent(),
-                    result );
+                    hf.get() );
             }
         }
+
+        result = hf.release();
         
         // Blacklist the tile if it is the same projection as the source and we can't get it and it wasn't cancelled
         if ( !result && (!progress || !progress->isCanceled()))
@@ -264,6 +268,56 @@ ElevationLayer::createHeightFieldFromTileSource(const TileKey&    key,
 }
 
 
+bool
+ElevationLayer::fetchHeightFieldFromTileSource(const TileKey&                  key,
+                                               ProgressCallback*               progress,
+                                               osg::ref_ptr<osg::HeightField>& out_hf)
+{
+    TileSource* source = getTileSource();
+    if ( !source )
+        return false;
+
+    const std::string& flightKey = key.str();
+
+    for( ; ; )
+    {
+        osg::ref_ptr<TileSourceFlights::Flight> flight;
+        if ( _tileSourceFlights.join(flightKey, flight) )
+        {
+            out_hf = source->createHeightField( key, _preCacheOp.get(), progress );
+
+            // a shared L2 cache hands out the instance it holds. Everything downstream
+            // (datum shift, origin setup, compositing, Plate Carre scaling) modifies the
+            // heightfield in place, so take a private copy.
+            if ( out_hf.valid() && out_hf->referenceCount() > 1 )
+                out_hf = new osg::HeightField( *out_hf.get(), osg::CopyOp::DEEP_COPY_ALL );
+
+            if ( _tileSourceFlights.land(flightKey, flight.get()) )
+            {
+                bool canceled = progress && progress->isCanceled();
+                osg::ref_ptr<osg::HeightField> copy = out_hf.valid() ?
+                    new osg::HeightField( *out_hf.get(), osg::CopyOp::DEEP_COPY_ALL ) : 0L;
+                _tileSourceFlights.publish( flight.get(), copy, !canceled );
+            }
+            return out_hf.valid();
+        }
+
+        osg::ref_ptr<osg::HeightField> shared;
+        if ( _tileSourceFlights.wait(flight.get(), shared, progress) )
+        {
+            out_hf = shared.valid() ? new osg::HeightField( *shared.get(), osg::CopyOp::DEEP_COPY_ALL ) : 0L;
+            return out_hf.valid();
+        }
+
+        if ( progress && progress->isCanceled() )
+        {
+            out_hf = 0L;
+            return false;
+        }
+    }
+}
+
+
 osg::HeightField*
 ElevationLayer::assembleHeightFieldFromTileSource(const TileKey&    key,
                                                   ProgressCallback* progress)
@@ -365,9 +419,56 @@ ElevationLayer::assembleHeightFieldFromTileSource(const TileKey&    key,
 }
 
 
+unsigned
+ElevationLayer::getNumCoalescedRequests() const
+{
+    return _keyFlights.getNumCoalesced() + _tileSourceFlights.getNumCoalesced();
+}
+
+
 GeoHeightField
 ElevationLayer::createHeightField(const TileKey&    key, 
                                   ProgressCallback* progress )
+{
+    // coalesce concurrent requests for the same tile so that only one of them
+    // hits the cache/tile source:
+    std::string flightKey = key.str() + "_" + key.getProfile()->getFullSignature();
+
+    for( ; ; )
+    {
+        osg::ref_ptr<KeyFlights::Flight> flight;
+        if ( _keyFlights.join(flightKey, flight) )
+        {
+            GeoHeightField result = readOrCreateHeightField( key, progress );
+            if ( _keyFlights.land(flightKey, flight.get()) )
+            {
+                bool canceled = progress && progress->isCanceled();
+                GeoHeightField copy = result.valid() ?
+                    GeoHeightField( new osg::HeightField(*result.getHeightField(), osg::CopyOp::DEEP_COPY_ALL), result.getExtent() ) :
+                    GeoHeightField::INVALID;
+                _keyFlights.publish( flight.get(), copy, !canceled );
+            }
+            return result;
+        }
+
+        GeoHeightField shared;
+        if ( _keyFlights.wait(flight.get(), shared, progress) )
+        {
+            return shared.valid() ?
+                GeoHeightField( new osg::HeightField(*shared.getHeightField(), osg::CopyOp::DEEP_COPY_ALL), shared.getExtent() ) :
+                GeoHeightField::INVALID;
+        }
+
+        // the leader was canceled. Try again unless we were too.
+        if ( progress && progress->isCanceled() )
+            return GeoHeightField::INVALID;
+    }
+}
+
+
+GeoHeightField
+ElevationLayer::readOrCreateHeightField(const TileKey&    key, 
+                                        ProgressCallback* progress )
 {
     osg::HeightField* result = 0L;
 
@@ -459,6 +560,151 @@ ElevationLayer::createHeightField(const TileKey&    key,
 //------------------------------------------------------------------------
 
 
+namespace
+{
+    /**
+     * One source heightfield in an elevation composite, with its mapping from
+     * the output sample grid precomputed. When the source shares the output
+     * SRS, the mapping is separable: the column lookups depend only on the
+     * output column and the row lookups only on the output row, so both are
+     * computed once per tile and each row is sampled with a tight loop.
+     * Otherwise we fall back on a (slow) per-sample GeoHeightField query.
+     */
+    struct CompositeSource
+    {
+        const GeoHeightField*   _geoHF;
+        const osg::HeightField* _hf;
+        bool                    _aligned;
+        std::vector<double>     _px;   // fractional source column, per output column
+        std::vector<int>        _c0;   // left source column, per output column
+        std::vector<int>        _c1;   // right source column, per output column
+        std::vector<float>      _fx;   // weight of the right column, per output column
+        std::vector<char>       _inX;  // whether the output column falls inside the source
+        int                     _firstIn, _lastIn;
+
+        void init(const GeoHeightField& geoHF, const SpatialReference* keySRS,
+                  double minx, double dx, unsigned width)
+        {
+            _geoHF = &geoHF;
+            _hf    = geoHF.getHeightField();
+
+            const GeoExtent& ex = geoHF.getExtent();
+
+            _aligned =
+                ex.getSRS()->isEquivalentTo( keySRS ) &&
+                !ex.crossesAntimeridian() &&
+                _hf->getNumColumns() > 1 &&
+                _hf->getNumRows() > 1;
+
+            if ( !_aligned )
+                return;
+
+            const int    cols      = (int)_hf->getNumColumns();
+            const double xInterval = ex.width() / (double)(cols-1);
+
+            _px.resize( width );
+            _c0.resize( width );
+            _c1.resize( width );
+            _fx.resize( width );
+            _inX.resize( width );
+            _firstIn = (int)width;
+            _lastIn  = -1;
+
+            for( unsigned c=0; c<width; ++c )
+            {
+                double x = minx + dx*(double)c;
+
+                // the extent isn't split, so containment is separable in x and y:
+                _inX[c] = ex.contains( x, ex.south() ) ? 1 : 0;
+                if ( _inX[c] )
+                {
+                    _firstIn = osg::minimum( _firstIn, (int)c );
+                    _lastIn  = (int)c;
+                }
+
+                double px = osg::clampBetween( (x - ex.xMin())/xInterval, 0.0, (double)(cols-1) );
+                int c0 = osg::maximum( (int)floor(px), 0 );
+                int c1 = osg::maximum( osg::minimum( (int)ceil(px), cols-1 ), 0 );
+                if ( c0 > c1 ) c0 = c1;
+                _px[c] = px;
+                _c0[c] = c0;
+                _c1[c] = c1;
+                _fx[c] = (float)(px - (double)c0);
+            }
+        }
+
+        /**
+         * Samples one output row into "out"; samples that fall outside the source
+         * or on NODATA come back as NO_DATA_VALUE.
+         */
+        void sampleRow(double y, double minx, double dx, unsigned width,
+                       ElevationInterpolation interp, const SpatialReference* keySRS,
+                       float* out) const
+        {
+            if ( !_aligned )
+            {
+                for( unsigned c=0; c<width; ++c )
+                {
+                    float h;
+                    if ( !_geoHF->getElevation(keySRS, minx + dx*(double)c, y, interp, keySRS, h) )
+                        h = NO_DATA_VALUE;
+                    out[c] = h;
+                }
+                return;
+            }
+
+            std::fill( out, out+width, NO_DATA_VALUE );
+
+            const GeoExtent& ex = _geoHF->getExtent();
+            if ( _lastIn < 0 || !ex.contains(ex.west(), y) )
+                return;
+
+            const int    rows      = (int)_hf->getNumRows();
+            const double yInterval = ex.height() / (double)(rows-1);
+            double py = osg::clampBetween( (y - ex.yMin())/yInterval, 0.0, (double)(rows-1) );
+
+            if ( interp == INTERP_BILINEAR || interp == INTERP_AVERAGE )
+            {
+                // For in-range samples these are equivalent to the per-sample
+                // math in HeightFieldUtils::getHeightAtPixel.
+                int r0 = osg::maximum( (int)floor(py), 0 );
+                int r1 = osg::maximum( osg::minimum( (int)ceil(py), rows-1 ), 0 );
+                if ( r0 > r1 ) r0 = r1;
+                const float fy = (float)(py - (double)r0);
+
+                const unsigned cols = _hf->getNumColumns();
+                const float* row0 = &_hf->getHeightList()[r0*cols];
+                const float* row1 = &_hf->getHeightList()[r1*cols];
+
+                for( int c=_firstIn; c<=_lastIn; ++c )
+                {
+                    float ll = row0[_c0[c]], lr = row0[_c1[c]];
+                    float ul = row1[_c0[c]], ur = row1[_c1[c]];
+                    float fx = _fx[c];
+                    float bottom = ll + (lr-ll)*fx;
+                    float top    = ul + (ur-ul)*fx;
+                    float h      = bottom + (top-bottom)*fy;
+
+                    // select rather than branch, so the loop stays vectorizable:
+                    bool valid =
+                        _inX[c] &&
+                        ll != NO_DATA_VALUE && lr != NO_DATA_VALUE &&
+                        ul != NO_DATA_VALUE && ur != NO_DATA_VALUE;
+                    out[c] = valid ? h : NO_DATA_VALUE;
+                }
+            }
+            else
+            {
+                for( int c=_firstIn; c<=_lastIn; ++c )
+                {
+                    if ( _inX[c] )
+                        out[c] = HeightFieldUtils::getHeightAtPixel( _hf, _px[c], py, interp );
+                }
+            }
+        }
+    };
+}
+
 bool
 ElevationLayerVector::createHeightField(const TileKey&                  key,
                                         bool                            fallback,
@@ -595,66 +841,64 @@ ElevationLayerVector::createHeightField(const TileKey&                  key,
 
         const SpatialReference* keySRS = keyToUse.getProfile()->getSRS();
 
-        //Create the new heightfield by sampling all of them.
-        for (unsigned int c = 0; c < width; ++c)
+        // Precompute each source's mapping from the output grid. Iterate BACKWARDS
+        // because the last layer is the highest priority.
+        std::vector<CompositeSource> sources( heightFields.size() );
+        unsigned n = 0;
+        for( GeoHeightFieldVector::reverse_iterator itr = heightFields.rbegin(); itr != heightFields.rend(); ++itr, ++n )
         {
-            double x = minx + (dx * (double)c);
-            for (unsigned r = 0; r < height; ++r)
-            {
-                double y = miny + (dy * (double)r);
+            sources[n].init( *itr, keySRS, minx, dx, width );
+        }
 
-                //Collect elevations from all of the layers. Iterate BACKWARDS because the last layer
-                // is the highest priority.
-                std::vector<float> elevations;
-                for( GeoHeightFieldVector::reverse_iterator itr = heightFields.rbegin(); itr != heightFields.rend(); ++itr )
-                {
-                    const GeoHeightField& geoHF = *itr;
+        // Scratch rows, reused for the whole tile:
+        std::vector<float>    samples( width );
+        std::vector<float>    result( width );
+        std::vector<unsigned> counts( width );
 
-                    float elevation = 0.0f;
-                    if ( geoHF.getElevation(keySRS, x, y, interpolation, keySRS, elevation) )
-                    {
-                        if (elevation != NO_DATA_VALUE)
-                        {
-                            elevations.push_back(elevation);
-                        }
-                    }
-                }
+        //Create the new heightfield by compositing one row at a time.
+        for (unsigned r = 0; r < height; ++r)
+        {
+            double y = miny + (dy * (double)r);
 
-                float elevation = NO_DATA_VALUE;
+            float init =
+                samplePolicy == SAMPLE_HIGHEST ? -FLT_MAX :
+                samplePolicy == SAMPLE_LOWEST  ?  FLT_MAX :
+                samplePolicy == SAMPLE_AVERAGE ?  0.0f    :
+                NO_DATA_VALUE;
+
+            std::fill( result.begin(), result.end(), init );
+            std::fill( counts.begin(), counts.end(), 0u );
 
-                //The list of elevations only contains valid values
-                if (elevations.size() > 0)
+            for( unsigned s = 0; s < sources.size(); ++s )
+            {
+                sources[s].sampleRow( y, minx, dx, width, interpolation, keySRS, &samples[0] );
+
+                for( unsigned c = 0; c < width; ++c )
                 {
-                    if (samplePolicy == SAMPLE_FIRST_VALID)
-                    {
-                        elevation = elevations[0];
-                    }
-                    else if (samplePolicy == SAMPLE_HIGHEST)
-                    {
-                        elevation = -FLT_MAX;
-                        for (unsigned int i = 0; i < elevations.size(); ++i)
-                        {
-                            if (elevation < elevations[i]) elevation = elevations[i];
-                        }
-                    }
-                    else if (samplePolicy == SAMPLE_LOWEST)
-                    {
-                        elevation = FLT_MAX;
-                        for (unsigned i = 0; i < elevations.size(); ++i)
-                        {
-                            if (elevation > elevations[i]) elevation = elevations[i];
-                        }
-                    }
-                    else if (samplePolicy == SAMPLE_AVERAGE)
-                    {
-                        elevation = 0.0;
-                        for (unsigned i = 0; i < elevations.size(); ++i)
-                        {
-                            elevation += elevations[i];
-                        }
-                        elevation /= (float)elevations.size();
-                    }
+                    float h = samples[c];
+                    if ( h == NO_DATA_VALUE )
+                        continue;
+
+                    if ( samplePolicy == SAMPLE_HIGHEST )
+                        result[c] = osg::maximum( result[c], h );
+                    else if ( samplePolicy == SAMPLE_LOWEST )
+                        result[c] = osg::minimum( result[c], h );
+                    else if ( samplePolicy == SAMPLE_AVERAGE )
+                        result[c] += h;
+                    else if ( counts[c] == 0 ) // SAMPLE_FIRST_VALID
+                        result[c] = h;
+
+                    ++counts[c];
                 }
+            }
+
+            for( unsigned c = 0; c < width; ++c )
+            {
+                float elevation =
+                    counts[c] == 0                 ? NO_DATA_VALUE :
+                    samplePolicy == SAMPLE_AVERAGE ? result[c] / (float)counts[c] :
+                    result[c];
+
                 out_result->setHeight(c, r, elevation);
             }
         }
@@ -1,6 +1,8 @@
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/Locators>
 #include <osgEarth/HeightFieldUtils>
+#include <osgEarth/Registry>
+#include <osgEarth/TaskService>
 #include <osgUtil/IntersectionVisitor>
 #include <osgUtil/LineSegmentIntersector>
 
@@ -9,6 +11,94 @@
 using namespace osgEarth;
 using namespace OpenThreads;
 
+namespace
+{
+    // Builds one heightfield for a batch query.
+    struct BuildHeightField
+    {
+        void execute()
+        {
+            _mapf->getHeightField( _key, true, _hf, 0L );
+        }
+
+        const MapFrame*                _mapf;
+        TileKey                        _key;
+        osg::ref_ptr<osg::HeightField> _hf;
+    };
+
+    typedef ParallelTask<BuildHeightField> BuildHeightFieldTask;
+
+    // Shared task service for building batch query heightfields.
+    TaskService* getQueryTaskService()
+    {
+        static Threading::Mutex s_mutex;
+        static UID              s_uid = -1;
+
+        Threading::ScopedMutexLock lock( s_mutex );
+        if ( s_uid < 0 )
+            s_uid = Registry::instance()->createUID();
+
+        return Registry::instance()->getTaskServiceManager()->getOrAdd( s_uid );
+    }
+
+    // Raises each point's max level to the best level available from "layer"
+    // at that point. Same logic as ElevationQuery::getMaxLevel, but it transforms
+    // the whole batch at once.
+    void accumulateMaxLevels(TerrainLayer*                  layer,
+                             const Profile*                 profile,
+                             const std::vector<osg::Vec3d>& mapPoints,
+                             std::vector<unsigned>&         levels)
+    {
+        osgEarth::TileSource* ts = layer->getTileSource();
+
+        optional<unsigned> runtimeMax = layer->getTerrainLayerRuntimeOptions().maxLevel();
+
+        if ( ts && ts->getDataExtents().size() > 0 )
+        {
+            const SpatialReference* mapSRS = profile->getSRS();
+            const SpatialReference* tsSRS  = ts->getProfile() ? ts->getProfile()->getSRS() : mapSRS;
+
+            std::vector<osg::Vec3d> tsPoints( mapPoints );
+            if ( !mapSRS->isHorizEquivalentTo(tsSRS) )
+                mapSRS->transform( tsPoints, tsSRS );
+
+            for( unsigned p=0; p<tsPoints.size(); ++p )
+            {
+                unsigned layerMax = 0;
+                for (osgEarth::DataExtentList::iterator j = ts->getDataExtents().begin(); j != ts->getDataExtents().end(); j++)
+                {
+                    if (j->maxLevel().isSet() && j->maxLevel() > layerMax && j->contains( tsPoints[p].x(), tsPoints[p].y(), tsSRS ))
+                    {
+                        layerMax = j->maxLevel().value();
+                    }
+                }
+
+                //Need to convert the layer max of this TileSource to that of the actual profile
+                layerMax = profile->getEquivalentLOD( ts->getProfile(), layerMax );
+
+                if ( runtimeMax.isSet() )
+                    layerMax = std::min( layerMax, *runtimeMax );
+
+                if ( layerMax > levels[p] )
+                    levels[p] = layerMax;
+            }
+        }
+        else
+        {
+            unsigned layerMax = layer->getMaxDataLevel();
+
+            if ( runtimeMax.isSet() )
+                layerMax = std::min( layerMax, *runtimeMax );
+
+            for( unsigned p=0; p<levels.size(); ++p )
+            {
+                if ( layerMax > levels[p] )
+                    levels[p] = layerMax;
+            }
+        }
+    }
+}
+
 ElevationQuery::ElevationQuery( const Map* map ) :
 _mapf( map, Map::TERRAIN_LAYERS )
 {
@@ -183,14 +273,16 @@ ElevationQuery::getElevations(std::vector<osg::Vec3d>& points,
                               double                   desiredResolution )
 {
     sync();
-    for( osg::Vec3dArray::iterator i = points.begin(); i != points.end(); ++i )
+
+    std::vector<double> elevations;
+    std::vector<bool>   valid;
+    getElevationsImpl( points, pointsSRS, elevations, valid, desiredResolution );
+
+    for( unsigned i=0; i<points.size(); ++i )
     {
-        double elevation;
-        double z = (*i).z();
-        GeoPoint p(pointsSRS, *i, ALTMODE_ABSOLUTE);
-        if ( getElevationImpl( p, elevation, desiredResolution ) )
+        if ( valid[i] )
         {
-            (*i).z() = ignoreZ ? elevation : elevation + z;
+            points[i].z() = ignoreZ ? elevations[i] : elevations[i] + points[i].z();
         }
     }
     return true;
@@ -203,20 +295,206 @@ ElevationQuery::getElevations(const std::vector<osg::Vec3d>& points,
                               double                         desiredResolution )
 {
     sync();
-    for( osg::Vec3dArray::const_iterator i = points.begin(); i != points.end(); ++i )
+
+    std::vector<double> elevations;
+    std::vector<bool>   valid;
+    getElevationsImpl( points, pointsSRS, elevations, valid, desiredResolution );
+
+    // failed queries report zero.
+    out_elevations.reserve( out_elevations.size() + points.size() );
+    for( unsigned i=0; i<points.size(); ++i )
+    {
+        out_elevations.push_back( valid[i] ? elevations[i] : 0.0 );
+    }
+    return true;
+}
+
+void
+ElevationQuery::getMaxLevels(const std::vector<osg::Vec3d>& mapPoints,
+                             std::vector<unsigned>&         out_levels ) const
+{
+    const Profile* profile = _mapf.getProfile();
+
+    out_levels.assign( mapPoints.size(), 0u );
+
+    for( ElevationLayerVector::const_iterator i = _mapf.elevationLayers().begin(); i != _mapf.elevationLayers().end(); ++i )
+    {
+        accumulateMaxLevels( i->get(), profile, mapPoints, out_levels );
+    }
+
+    // need to check the image layers too; see getMaxLevel.
+    for( ImageLayerVector::const_iterator i = _mapf.imageLayers().begin(); i != _mapf.imageLayers().end(); ++i )
+    {
+        accumulateMaxLevels( i->get(), profile, mapPoints, out_levels );
+    }
+}
+
+bool
+ElevationQuery::getElevationsImpl(const std::vector<osg::Vec3d>& points,
+                                  const SpatialReference*        pointsSRS,
+                                  std::vector<double>&           out_elevations,
+                                  std::vector<bool>&             out_valid,
+                                  double                         desiredResolution)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    const unsigned numPoints = points.size();
+    out_elevations.assign( numPoints, 0.0 );
+    out_valid.assign( numPoints, false );
+
+    if ( _maxDataLevel == 0 || _tileSize == 0 )
     {
-        double elevation;
-        GeoPoint p(pointsSRS, *i, ALTMODE_ABSOLUTE);
+        // this means there are no heightfields.
+        out_valid.assign( numPoints, true );
+        return true;
+    }
+
+    if ( numPoints == 0 )
+        return true;
+
+    const Profile*          profile = _mapf.getProfile();
+    const SpatialReference* mapSRS  = profile->getSRS();
+
+    // transform all the input coords to map coords at once:
+    std::vector<osg::Vec3d> mapPoints( points );
+    std::vector<bool>       transformed( numPoints, true );
+    if ( pointsSRS && !pointsSRS->isEquivalentTo(mapSRS) )
+    {
+        if ( !pointsSRS->transform(mapPoints, mapSRS) )
+        {
+            // something in the batch failed, so find out which points are bad.
+            for( unsigned i=0; i<numPoints; ++i )
+            {
+                transformed[i] = pointsSRS->transform( points[i], mapSRS, mapPoints[i] );
+            }
+        }
+    }
 
-        if ( getElevationImpl(p, elevation, desiredResolution) )
+    // find the best available data level at each point:
+    std::vector<unsigned> levels;
+    getMaxLevels( mapPoints, levels );
+
+    if ( desiredResolution > 0.0 )
+    {
+        unsigned desiredLevel = profile->getLevelOfDetailForHorizResolution( desiredResolution, _tileSize );
+        for( unsigned i=0; i<numPoints; ++i )
         {
-            out_elevations.push_back( elevation );
+            if ( desiredLevel < levels[i] )
+                levels[i] = desiredLevel;
+        }
+    }
+
+    // group the points by the tile that covers them:
+    typedef std::map< TileKey, std::vector<unsigned> > PointsByKey;
+    PointsByKey buckets;
+
+    unsigned numOutside = 0;
+    for( unsigned i=0; i<numPoints; ++i )
+    {
+        if ( !transformed[i] )
+            continue;
+
+        TileKey key = profile->createTileKey( mapPoints[i].x(), mapPoints[i].y(), levels[i] );
+        if ( key.valid() )
+            buckets[key].push_back( i );
+        else
+            ++numOutside;
+    }
+
+    if ( numOutside > 0 )
+    {
+        OE_WARN << LC << numOutside << " points fall outside the map" << std::endl;
+    }
+
+    // resolve a heightfield for each bucket, from the cache if possible:
+    std::vector< osg::ref_ptr<osg::HeightField> > tiles( buckets.size() );
+    std::vector< osg::ref_ptr<BuildHeightFieldTask> > tasks;
+
+    Threading::MultiEvent semaphore;
+    unsigned b = 0;
+    for( PointsByKey::const_iterator k = buckets.begin(); k != buckets.end(); ++k, ++b )
+    {
+        TileCache::Record record;
+        if ( _tileCache.get(k->first, record) )
+        {
+            tiles[b] = record.value().get();
         }
         else
         {
-            out_elevations.push_back( 0.0 );
+            BuildHeightFieldTask* task = new BuildHeightFieldTask( &semaphore );
+            task->_mapf = &_mapf;
+            task->_key  = k->first;
+            task->setPriority( -(float)k->first.getLevelOfDetail() );
+            tasks.push_back( task );
         }
     }
+
+    // build the missing heightfields in parallel. The calling thread builds
+    // the first one instead of sitting idle.
+    if ( tasks.size() > 0 )
+    {
+        semaphore.reset( tasks.size() );
+
+        if ( tasks.size() > 1 )
+        {
+            TaskService* service = getQueryTaskService();
+            for( unsigned t=1; t<tasks.size(); ++t )
+                service->add( tasks[t].get() );
+        }
+
+        (*tasks[0].get())( 0L );
+
+        semaphore.wait();
+    }
+
+    // collect the new heightfields:
+    unsigned t = 0;
+    b = 0;
+    for( PointsByKey::const_iterator k = buckets.begin(); k != buckets.end(); ++k, ++b )
+    {
+        if ( !tiles[b].valid() && t < tasks.size() && tasks[t]->_key == k->first )
+        {
+            tiles[b] = tasks[t]->_hf.get();
+            if ( tiles[b].valid() )
+                _tileCache.insert( k->first, tiles[b].get() );
+            else
+                OE_WARN << LC << "Unable to create heightfield for key " << k->first.str() << std::endl;
+            ++t;
+        }
+    }
+
+    // finally, sample each tile for all the points that fall on it:
+    ElevationInterpolation interp = _mapf.getMapInfo().getElevationInterpolation();
+    b = 0;
+    for( PointsByKey::const_iterator k = buckets.begin(); k != buckets.end(); ++k, ++b )
+    {
+        const osg::HeightField* tile = tiles[b].get();
+        if ( !tile )
+            continue;
+
+        const GeoExtent& extent = k->first.getExtent();
+        double xInterval = extent.width()  / (double)(tile->getNumColumns()-1);
+        double yInterval = extent.height() / (double)(tile->getNumRows()-1);
+        double xMin = extent.xMin();
+        double yMin = extent.yMin();
+
+        const std::vector<unsigned>& indices = k->second;
+        for( unsigned j=0; j<indices.size(); ++j )
+        {
+            unsigned i = indices[j];
+            out_elevations[i] = (double) HeightFieldUtils::getHeightAtLocation(
+                tile,
+                mapPoints[i].x(), mapPoints[i].y(),
+                xMin, yMin,
+                xInterval, yInterval, interp );
+            out_valid[i] = true;
+        }
+    }
+
+    osg::Timer_t end = osg::Timer::instance()->tick();
+    _queries += (double)numPoints;
+    _totalTime += osg::Timer::instance()->delta_s( start, end );
+
     return true;
 }
 
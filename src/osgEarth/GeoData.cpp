@@ -28,6 +28,7 @@
 
 #include <osg/Notify>
 #include <osg/Timer>
+#include <OpenThreads/Thread>
 
 #include <gdal_priv.h>
 #include <gdalwarper.h>
@@ -1435,189 +1436,412 @@ reprojectImage(osg::Image* srcImage, const std::string srcWKT, double srcMinX, d
 
 namespace
 {
-    osg::Image* manualReproject(
-        const osg::Image* image, 
-        const GeoExtent&  src_extent, 
-        const GeoExtent&  dest_extent,
-        unsigned int      width = 0, 
-        unsigned int      height = 0)
+    /**
+     * Sparse approximation of the destination-to-source coordinate mapping.
+     * Rather than transforming every destination pixel, we transform a coarse
+     * grid of nodes and linearly interpolate between them. The node spacing is
+     * refined until the interpolation error is below a fraction of a source
+     * texel, so the result is indistinguishable from a per-pixel transform.
+     */
+    struct ReprojectGrid
     {
-        //TODO:  Compute the optimal destination size
-        if (width == 0 || height == 0)
+        unsigned            _step;
+        std::vector<int>    _cols;  // destination pixel column of each node column
+        std::vector<int>    _rows;  // destination pixel row of each node row
+        std::vector<double> _x;     // source x of each node, row-major
+        std::vector<double> _y;     // source y of each node, row-major
+
+        static void makeNodes(unsigned step, unsigned n, std::vector<int>& out)
         {
-            //If no width and height are specified, just use the minimum dimension for the image
-            width = osg::minimum(image->s(), image->t());
-            height = osg::minimum(image->s(), image->t());
+            out.clear();
+            for(unsigned i=0; i+1 < n; i += step)
+                out.push_back( i );
+            out.push_back( n > 0 ? n-1 : 0 );
         }
 
-        // need to know this in order to choose the right interpolation algorithm
-        const bool isSrcContiguous = src_extent.getSRS()->isContiguous();
-
-        osg::Image *result = new osg::Image();
-        //result->allocateImage(width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE);
-        result->allocateImage(width, height, 1, image->getPixelFormat(), GL_UNSIGNED_BYTE);
+        /** Interpolates the source coordinates of a whole destination row. */
+        void interpolateRow(int r, std::vector<double>& outX, std::vector<double>& outY) const
+        {
+            const unsigned ncols = _cols.size();
+            const unsigned nrows = _rows.size();
+
+            // vertical interpolation at each node column:
+            unsigned j = nrows > 1 ? osg::minimum( (unsigned)r / _step, nrows-2 ) : 0;
+            double t = nrows > 1 ? (double)(r - _rows[j]) / (double)(_rows[j+1] - _rows[j]) : 0.0;
+            const double* x0 = &_x[j*ncols];
+            const double* y0 = &_y[j*ncols];
+            const double* x1 = nrows > 1 ? x0 + ncols : x0;
+            const double* y1 = nrows > 1 ? y0 + ncols : y0;
+
+            // horizontal interpolation across the row:
+            double nx = x0[0] + (x1[0]-x0[0])*t;
+            double ny = y0[0] + (y1[0]-y0[0])*t;
+            outX[0] = nx;
+            outY[0] = ny;
+            for(unsigned i=0; i+1 < ncols; ++i)
+            {
+                double nx2 = x0[i+1] + (x1[i+1]-x0[i+1])*t;
+                double ny2 = y0[i+1] + (y1[i+1]-y0[i+1])*t;
+                int    c0   = _cols[i];
+                int    span = _cols[i+1] - c0;
+                double ddx  = (nx2 - nx) / (double)span;
+                double ddy  = (ny2 - ny) / (double)span;
+                for(int k=1; k <= span; ++k)
+                {
+                    outX[c0+k] = nx + ddx*(double)k;
+                    outY[c0+k] = ny + ddy*(double)k;
+                }
+                nx = nx2;
+                ny = ny2;
+            }
+        }
 
-        //Initialize the image to be completely transparent/black
-        memset(result->data(), 0, result->getImageSizeInBytes());
+        /** Interpolates the source coordinates of a single destination pixel. */
+        void interpolate(int c, int r, double& outX, double& outY) const
+        {
+            const unsigned ncols = _cols.size();
+            const unsigned nrows = _rows.size();
+            unsigned i = ncols > 1 ? osg::minimum( (unsigned)c / _step, ncols-2 ) : 0;
+            unsigned j = nrows > 1 ? osg::minimum( (unsigned)r / _step, nrows-2 ) : 0;
+            double s = ncols > 1 ? (double)(c - _cols[i]) / (double)(_cols[i+1] - _cols[i]) : 0.0;
+            double t = nrows > 1 ? (double)(r - _rows[j]) / (double)(_rows[j+1] - _rows[j]) : 0.0;
+            unsigned i1 = ncols > 1 ? i+1 : i;
+            unsigned j1 = nrows > 1 ? j+1 : j;
+            outX =
+                (_x[j*ncols+i]  * (1.0-s) + _x[j*ncols+i1]  * s) * (1.0-t) +
+                (_x[j1*ncols+i] * (1.0-s) + _x[j1*ncols+i1] * s) * t;
+            outY =
+                (_y[j*ncols+i]  * (1.0-s) + _y[j*ncols+i1]  * s) * (1.0-t) +
+                (_y[j1*ncols+i] * (1.0-s) + _y[j1*ncols+i1] * s) * t;
+        }
 
-        //ImageUtils::PixelReader ra(result);
-        ImageUtils::PixelWriter writer(result);
-        const double dx = dest_extent.width() / (double)width;
-        const double dy = dest_extent.height() / (double)height;
-
-        // offset the sample points by 1/2 a pixel so we are sampling "pixel center".
-        // (This is especially useful in the UnifiedCubeProfile since it nullifes the chances for
-        // edge ambiguity.)
-
-        unsigned int numPixels = width * height;
-
-        // Start by creating a sample grid over the destination
-        // extent. These will be the source coordinates. Then, reproject
-        // the sample grid into the source coordinate system.
-        double *srcPointsX = new double[numPixels * 2];
-        double *srcPointsY = srcPointsX + numPixels;
-        dest_extent.getSRS()->transformExtentPoints(
-            src_extent.getSRS(),
-            dest_extent.xMin() + .5 * dx, dest_extent.yMin() + .5 * dy,
-            dest_extent.xMax() - .5 * dx, dest_extent.yMax() - .5 * dy,
-            srcPointsX, srcPointsY, width, height);
-
-        // Next, go through the source-SRS sample grid, read the color at each point from the source image,
-        // and write it to the corresponding pixel in the destination image.
-        int pixel = 0;
-        ImageUtils::PixelReader ia(image);
-        double xfac = (image->s() - 1) / src_extent.width();
-        double yfac = (image->t() - 1) / src_extent.height();
-        for (unsigned int c = 0; c < width; ++c)
+        /**
+         * Builds the grid. "xres" and "yres" are the size of a source texel, and
+         * are used to decide whether the approximation is good enough.
+         */
+        bool build(const GeoExtent& src_extent, const GeoExtent& dest_extent,
+                   unsigned width, unsigned height, double xres, double yres)
         {
-            for (unsigned int r = 0; r < height; ++r)
-            {   
-                double src_x = srcPointsX[pixel];
-                double src_y = srcPointsY[pixel];
+            const double dx = dest_extent.width()  / (double)width;
+            const double dy = dest_extent.height() / (double)height;
+
+            // maximum allowable interpolation error, in source texels.
+            const double maxError = 0.125;
 
-                if ( src_x < src_extent.xMin() || src_x > src_extent.xMax() || src_y < src_extent.yMin() || src_y > src_extent.yMax() )
+            _step = 16;
+            while( true )
+            {
+                makeNodes( _step, width,  _cols );
+                makeNodes( _step, height, _rows );
+
+                // transform the nodes (at pixel centers) into the source SRS:
+                std::vector<osg::Vec3d> points;
+                points.reserve( _cols.size() * _rows.size() );
+                for(unsigned j=0; j<_rows.size(); ++j)
+                    for(unsigned i=0; i<_cols.size(); ++i)
+                        points.push_back( osg::Vec3d(
+                            dest_extent.xMin() + ((double)_cols[i] + 0.5)*dx,
+                            dest_extent.yMin() + ((double)_rows[j] + 0.5)*dy,
+                            0.0) );
+
+                if ( !dest_extent.getSRS()->transform(points, src_extent.getSRS()) )
+                    return false;
+
+                _x.resize( points.size() );
+                _y.resize( points.size() );
+                for(unsigned p=0; p<points.size(); ++p)
                 {
-                    //If the sample point is outside of the bound of the source extent, increment the pixel and keep looping through.
-                    //OE_WARN << LC << "ERROR: sample point out of bounds: " << src_x << ", " << src_y << std::endl;
-                    pixel++;
-                    continue;
+                    _x[p] = points[p].x();
+                    _y[p] = points[p].y();
                 }
 
-                float px = (src_x - src_extent.xMin()) * xfac;
-                float py = (src_y - src_extent.yMin()) * yfac;
+                if ( _step == 1 )
+                    return true;
+
+                // check the approximation at the center of each grid cell, which
+                // is where linear interpolation is at its worst.
+                std::vector<int> checkCols, checkRows;
+                for(unsigned i=0; i+1 < _cols.size(); ++i)
+                    checkCols.push_back( (_cols[i]+_cols[i+1])/2 );
+                for(unsigned j=0; j+1 < _rows.size(); ++j)
+                    checkRows.push_back( (_rows[j]+_rows[j+1])/2 );
+                if ( checkCols.empty() ) checkCols.push_back( _cols[0] );
+                if ( checkRows.empty() ) checkRows.push_back( _rows[0] );
+
+                std::vector<osg::Vec3d> check;
+                check.reserve( checkCols.size() * checkRows.size() );
+                for(unsigned j=0; j<checkRows.size(); ++j)
+                    for(unsigned i=0; i<checkCols.size(); ++i)
+                        check.push_back( osg::Vec3d(
+                            dest_extent.xMin() + ((double)checkCols[i] + 0.5)*dx,
+                            dest_extent.yMin() + ((double)checkRows[j] + 0.5)*dy,
+                            0.0) );
+
+                if ( !dest_extent.getSRS()->transform(check, src_extent.getSRS()) )
+                    return false;
+
+                double error = 0.0;
+                unsigned p = 0;
+                for(unsigned j=0; j<checkRows.size(); ++j)
+                {
+                    for(unsigned i=0; i<checkCols.size(); ++i, ++p)
+                    {
+                        double ax, ay;
+                        interpolate( checkCols[i], checkRows[j], ax, ay );
+                        error = osg::maximum( error, fabs(ax - check[p].x()) / xres );
+                        error = osg::maximum( error, fabs(ay - check[p].y()) / yres );
+                    }
+                }
+
+                if ( error <= maxError )
+                    return true;
+
+                _step /= 2;
+            }
+        }
+    };
 
-                int px_i = osg::clampBetween( (int)osg::round(px), 0, image->s()-1 );
-                int py_i = osg::clampBetween( (int)osg::round(py), 0, image->t()-1 );
+    /** Bilinear blend of one channel, specialized by texel type. */
+    template<typename T> struct Bilinear;
 
-                osg::Vec4 color(0,0,0,0);
+    template<> struct Bilinear<unsigned char>
+    {
+        // 8-bit fixed-point weights; the whole blend stays in integer registers.
+        typedef int Weight;
+        static Weight weight(double f) { return (int)(f*256.0 + 0.5); }
+        static unsigned char blend(int p00, int p10, int p01, int p11, Weight wx, Weight wy)
+        {
+            int top = p00*(256-wx) + p10*wx;
+            int bot = p01*(256-wx) + p11*wx;
+            return (unsigned char)( (top*(256-wy) + bot*wy + 32768) >> 16 );
+        }
+    };
+
+    template<> struct Bilinear<float>
+    {
+        typedef float Weight;
+        static Weight weight(double f) { return (float)f; }
+        static float blend(float p00, float p10, float p01, float p11, Weight wx, Weight wy)
+        {
+            float top = p00 + (p10-p00)*wx;
+            float bot = p01 + (p11-p01)*wx;
+            return top + (bot-top)*wy;
+        }
+    };
+
+    /** Everything a worker needs to reproject a band of rows. */
+    struct ReprojectJob
+    {
+        const osg::Image*    _src;
+        osg::Image*          _dest;
+        const ReprojectGrid* _grid;
+        double               _xmin, _ymin, _xmax, _ymax;
+        double               _xfac, _yfac;
+        unsigned             _numComponents;
 
-                // TODO: consider this again later. Causes blockiness.
-                if ( false ) //! isSrcContiguous ) // non-contiguous space- use nearest neighbot
+        void run(unsigned r0, unsigned r1) const
+        {
+            if ( _dest->getDataType() == GL_UNSIGNED_BYTE && _src->getDataType() == GL_UNSIGNED_BYTE )
+            {
+                switch( _numComponents )
                 {
-                    color = ia(px_i, py_i);
+                case 1: runTyped<unsigned char,1>( r0, r1 ); return;
+                case 2: runTyped<unsigned char,2>( r0, r1 ); return;
+                case 3: runTyped<unsigned char,3>( r0, r1 ); return;
+                case 4: runTyped<unsigned char,4>( r0, r1 ); return;
                 }
+            }
+            else if ( _dest->getDataType() == GL_FLOAT && _src->getDataType() == GL_FLOAT )
+            {
+                switch( _numComponents )
+                {
+                case 1: runTyped<float,1>( r0, r1 ); return;
+                case 2: runTyped<float,2>( r0, r1 ); return;
+                case 3: runTyped<float,3>( r0, r1 ); return;
+                case 4: runTyped<float,4>( r0, r1 ); return;
+                }
+            }
+            runGeneric( r0, r1 );
+        }
+
+        // Computes the bilinear footprint of a source location. Returns false if
+        // the location falls outside the source extent.
+        inline bool footprint(double sx, double sy, int& x0, int& x1, int& y0, int& y1, double& fx, double& fy) const
+        {
+            if ( sx < _xmin || sx > _xmax || sy < _ymin || sy > _ymax )
+                return false;
+
+            double px = (sx - _xmin) * _xfac;
+            double py = (sy - _ymin) * _yfac;
+            x0 = osg::clampBetween( (int)px, 0, _src->s()-1 );
+            y0 = osg::clampBetween( (int)py, 0, _src->t()-1 );
+            x1 = osg::minimum( x0+1, _src->s()-1 );
+            y1 = osg::minimum( y0+1, _src->t()-1 );
+            fx = osg::clampBetween( px - (double)x0, 0.0, 1.0 );
+            fy = osg::clampBetween( py - (double)y0, 0.0, 1.0 );
+            return true;
+        }
+
+        // Direct-access kernel for a known texel type and component count. The
+        // inner loop over components has a compile-time trip count, so it unrolls
+        // and vectorizes without going through the PixelReader function pointers.
+        template<typename T, unsigned N>
+        void runTyped(unsigned r0, unsigned r1) const
+        {
+            typedef Bilinear<T> B;
+            const unsigned width = _dest->s();
+            std::vector<double> sx( width ), sy( width );
 
-                else // contiguous space - use bilinear sampling
+            for(unsigned r=r0; r<r1; ++r)
+            {
+                _grid->interpolateRow( r, sx, sy );
+                T* out = reinterpret_cast<T*>( _dest->data(0, r) );
+
+                for(unsigned c=0; c<width; ++c, out += N)
                 {
-                    int rowMin = osg::maximum((int)floor(py), 0);
-                    int rowMax = osg::maximum(osg::minimum((int)ceil(py), (int)(image->t()-1)), 0);
-                    int colMin = osg::maximum((int)floor(px), 0);
-                    int colMax = osg::maximum(osg::minimum((int)ceil(px), (int)(image->s()-1)), 0);
-
-                    if (rowMin > rowMax) rowMin = rowMax;
-                    if (colMin > colMax) colMin = colMax;
-
-                    osg::Vec4 urColor = ia(colMax, rowMax);
-                    osg::Vec4 llColor = ia(colMin, rowMin);
-                    osg::Vec4 ulColor = ia(colMin, rowMax);
-                    osg::Vec4 lrColor = ia(colMax, rowMin);
-
-                    /*Average Interpolation*/
-                    /*double x_rem = px - (int)px;
-                    double y_rem = py - (int)py;
-
-                    double w00 = (1.0 - y_rem) * (1.0 - x_rem);
-                    double w01 = (1.0 - y_rem) * x_rem;
-                    double w10 = y_rem * (1.0 - x_rem);
-                    double w11 = y_rem * x_rem;
-                    double wsum = w00 + w01 + w10 + w11;
-                    wsum = 1.0/wsum;
-
-                    color.r() = (w00 * llColor.r() + w01 * lrColor.r() + w10 * ulColor.r() + w11 * urColor.r()) * wsum;
-                    color.g() = (w00 * llColor.g() + w01 * lrColor.g() + w10 * ulColor.g() + w11 * urColor.g()) * wsum;
-                    color.b() = (w00 * llColor.b() + w01 * lrColor.b() + w10 * ulColor.b() + w11 * urColor.b()) * wsum;
-                    color.a() = (w00 * llColor.a() + w01 * lrColor.a() + w10 * ulColor.a() + w11 * urColor.a()) * wsum;*/
-
-                    /*Nearest Neighbor Interpolation*/
-                    /*if (px_i >= 0 && px_i < image->s() &&
-                    py_i >= 0 && py_i < image->t())
+                    int x0, x1, y0, y1;
+                    double fx, fy;
+                    if ( !footprint(sx[c], sy[c], x0, x1, y0, y1, fx, fy) )
+                        continue;
+
+                    const T* row0 = reinterpret_cast<const T*>( _src->data(0, y0) );
+                    const T* row1 = reinterpret_cast<const T*>( _src->data(0, y1) );
+                    const T* p00 = row0 + x0*N;
+                    const T* p10 = row0 + x1*N;
+                    const T* p01 = row1 + x0*N;
+                    const T* p11 = row1 + x1*N;
+
+                    typename B::Weight wx = B::weight( fx );
+                    typename B::Weight wy = B::weight( fy );
+                    for(unsigned k=0; k<N; ++k)
                     {
-                    //OE_NOTICE << "[osgEarth::GeoData] Sampling pixel " << px << "," << py << std::endl;
-                    color = ImageUtils::getColor(image, px_i, py_i);
+                        out[k] = B::blend( p00[k], p10[k], p01[k], p11[k], wx, wy );
                     }
-                    else
-                    {
-                    OE_NOTICE << "[osgEarth::GeoData] Pixel out of range " << px_i << "," << py_i << "  image is " << image->s() << "x" << image->t() << std::endl;
-                    }*/
+                }
+            }
+        }
 
-                    /*Bilinear interpolation*/
-                    //Check for exact value
-                    if ((colMax == colMin) && (rowMax == rowMin))
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Exact value" << std::endl;
-                        color = ia(px_i, py_i);
-                    }
-                    else if (colMax == colMin)
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Vertically" << std::endl;
-                        //Linear interpolate vertically
-                        for (unsigned int i = 0; i < 4; ++i)
-                        {
-                            color[i] = ((float)rowMax - py) * llColor[i] + (py - (float)rowMin) * ulColor[i];
-                        }
-                    }
-                    else if (rowMax == rowMin)
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Horizontally" << std::endl;
-                        //Linear interpolate horizontally
-                        for (unsigned int i = 0; i < 4; ++i)
-                        {
-                            color[i] = ((float)colMax - px) * llColor[i] + (px - (float)colMin) * lrColor[i];
-                        }
-                    }
-                    else
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Bilinear" << std::endl;
-                        //Bilinear interpolate
-                        float col1 = colMax - px, col2 = px - colMin;
-                        float row1 = rowMax - py, row2 = py - rowMin;
-                        for (unsigned int i = 0; i < 4; ++i)
-                        {
-                            float r1 = col1 * llColor[i] + col2 * lrColor[i];
-                            float r2 = col1 * ulColor[i] + col2 * urColor[i];
-
-                            //OE_INFO << "r1, r2 = " << r1 << " , " << r2 << std::endl;
-                            color[i] = row1 * r1 + row2 * r2;
-                        }
-                    }
+        // Fallback for pixel formats we don't have a kernel for.
+        void runGeneric(unsigned r0, unsigned r1) const
+        {
+            ImageUtils::PixelReader read( _src );
+            ImageUtils::PixelWriter write( _dest );
+            const unsigned width = _dest->s();
+            std::vector<double> sx( width ), sy( width );
+
+            for(unsigned r=r0; r<r1; ++r)
+            {
+                _grid->interpolateRow( r, sx, sy );
+
+                for(unsigned c=0; c<width; ++c)
+                {
+                    int x0, x1, y0, y1;
+                    double fx, fy;
+                    if ( !footprint(sx[c], sy[c], x0, x1, y0, y1, fx, fy) )
+                        continue;
+
+                    osg::Vec4 top = read(x0, y0) * (1.0f-(float)fx) + read(x1, y0) * (float)fx;
+                    osg::Vec4 bot = read(x0, y1) * (1.0f-(float)fx) + read(x1, y1) * (float)fx;
+                    write( top * (1.0f-(float)fy) + bot * (float)fy, c, r );
                 }
+            }
+        }
+    };
+
+    /** Runs one band of a reprojection job in its own thread. */
+    class ReprojectThread : public OpenThreads::Thread
+    {
+    public:
+        ReprojectThread(const ReprojectJob& job, unsigned r0, unsigned r1)
+            : _job(job), _r0(r0), _r1(r1) { }
 
-                writer(color, c, r);
+        void run() { _job.run( _r0, _r1 ); }
 
-#if 0
-                unsigned char* rgba = const_cast<unsigned char*>(ra.data(c,r,0));
+    private:
+        const ReprojectJob& _job;
+        unsigned            _r0, _r1;
+    };
 
-                rgba[0] = (unsigned char)(color.r() * 255);
-                rgba[1] = (unsigned char)(color.g() * 255);
-                rgba[2] = (unsigned char)(color.b() * 255);
-                rgba[3] = (unsigned char)(color.a() * 255);
-#endif
+    // Images at least this big get split across threads.
+    const unsigned REPROJECT_MIN_PIXELS_PER_THREAD = 256*256;
+    const unsigned REPROJECT_MAX_THREADS           = 4;
 
-                pixel++;            
-            }
+    osg::Image* manualReproject(
+        const osg::Image* image, 
+        const GeoExtent&  src_extent, 
+        const GeoExtent&  dest_extent,
+        unsigned int      width = 0, 
+        unsigned int      height = 0)
+    {
+        //TODO:  Compute the optimal destination size
+        if (width == 0 || height == 0)
+        {
+            //If no width and height are specified, just use the minimum dimension for the image
+            width = osg::minimum(image->s(), image->t());
+            height = osg::minimum(image->s(), image->t());
         }
 
-        delete[] srcPointsX;
+        // float images stay float; everything else is written as 8-bit like before.
+        GLenum dataType = image->getDataType() == GL_FLOAT ? GL_FLOAT : GL_UNSIGNED_BYTE;
+
+        osg::Image *result = new osg::Image();
+        result->allocateImage(width, height, 1, image->getPixelFormat(), dataType);
+
+        //Initialize the image to be completely transparent/black
+        memset(result->data(), 0, result->getImageSizeInBytes());
+
+        ReprojectJob job;
+        job._src           = image;
+        job._dest          = result;
+        job._xmin          = src_extent.xMin();
+        job._ymin          = src_extent.yMin();
+        job._xmax          = src_extent.xMax();
+        job._ymax          = src_extent.yMax();
+        job._xfac          = (image->s() - 1) / src_extent.width();
+        job._yfac          = (image->t() - 1) / src_extent.height();
+        job._numComponents = osg::Image::computeNumComponents(image->getPixelFormat());
+
+        // Sample at pixel centers. (This is especially useful in the UnifiedCubeProfile
+        // since it nullifes the chances for edge ambiguity.)
+        ReprojectGrid grid;
+        if ( !grid.build(src_extent, dest_extent, width, height,
+                         src_extent.width()  / (double)osg::maximum(image->s()-1, 1),
+                         src_extent.height() / (double)osg::maximum(image->t()-1, 1)) )
+        {
+            OE_WARN << LC << "Failed to transform the reprojection grid" << std::endl;
+            return result;
+        }
+        job._grid = &grid;
+
+        // split large images into bands of rows and process them in parallel.
+        unsigned numThreads = osg::clampBetween(
+            (width*height) / REPROJECT_MIN_PIXELS_PER_THREAD,
+            1u,
+            osg::minimum( (unsigned)OpenThreads::GetNumberOfProcessors(), REPROJECT_MAX_THREADS ) );
+
+        if ( numThreads <= 1 )
+        {
+            job.run( 0, height );
+        }
+        else
+        {
+            unsigned band = (height + numThreads - 1) / numThreads;
+            std::vector<ReprojectThread*> threads;
+            for(unsigned r0 = band; r0 < height; r0 += band)
+            {
+                ReprojectThread* thread = new ReprojectThread( job, r0, osg::minimum(r0+band, height) );
+                thread->start();
+                threads.push_back( thread );
+            }
+
+            job.run( 0, band );
+
+            for(unsigned i=0; i<threads.size(); ++i)
+            {
+                threads[i]->join();
+                delete threads[i];
+            }
+        }
 
         return result;
     }
@@ -29,6 +29,7 @@
 #include <iterator>
 #include <iostream>
 #include <algorithm>
+#include <list>
 #include <curl/curl.h>
 
 #define LC "[HTTPClient] "
@@ -127,6 +128,58 @@ namespace osgEarth
     }
 }
 
+namespace
+{
+    // response headers kept with a response (and so with cached entries).
+    const std::string* s_keptHeaders[] = {
+        &IOMetadata::ETAG,
+        &IOMetadata::LAST_MODIFIED,
+        &IOMetadata::CACHE_CONTROL,
+        &IOMetadata::EXPIRES,
+        &IOMetadata::DATE
+    };
+
+    // stores the caching headers of a response under their IOMetadata names.
+    size_t
+    HeaderReadCallback(void* ptr, size_t size, size_t nmemb, void* data)
+    {
+        size_t realsize = size * nmemb;
+        std::map<std::string,std::string>* headers = (std::map<std::string,std::string>*)data;
+        if ( headers )
+        {
+            std::string line( (const char*)ptr, realsize );
+            std::string::size_type colon = line.find( ':' );
+            if ( colon != std::string::npos )
+            {
+                std::string name = trim( line.substr(0, colon) );
+                for( unsigned i = 0; i < sizeof(s_keptHeaders)/sizeof(s_keptHeaders[0]); ++i )
+                {
+                    if ( ciEquals(name, *s_keptHeaders[i]) )
+                    {
+                        (*headers)[*s_keptHeaders[i]] = trim( line.substr(colon+1) );
+                        break;
+                    }
+                }
+            }
+        }
+        return realsize;
+    }
+
+    // headers of a request in curl's form; free with curl_slist_free_all.
+    curl_slist*
+    createHeaderList( const HTTPRequest& request )
+    {
+        curl_slist* list = 0L;
+        const HTTPRequest::Headers& headers = request.getHeaders();
+        for( HTTPRequest::Headers::const_iterator i = headers.begin(); i != headers.end(); ++i )
+        {
+            std::string line = i->first + ": " + i->second;
+            list = curl_slist_append( list, line.c_str() );
+        }
+        return list;
+    }
+}
+
 static int CurlProgressCallback(void *clientp,double dltotal,double dlnow,double ultotal,double ulnow)
 {
     ProgressCallback* callback = (ProgressCallback*)clientp;
@@ -148,6 +201,7 @@ HTTPRequest::HTTPRequest( const std::string& url )
 
 HTTPRequest::HTTPRequest( const HTTPRequest& rhs ) :
 _parameters( rhs._parameters ),
+_headers( rhs._headers ),
 _url( rhs._url )
 {
     //nop
@@ -185,6 +239,18 @@ HTTPRequest::getParameters() const
     return _parameters; 
 }
 
+void
+HTTPRequest::addHeader( const std::string& name, const std::string& value )
+{
+    _headers[name] = value;
+}
+
+const HTTPRequest::Headers&
+HTTPRequest::getHeaders() const
+{
+    return _headers;
+}
+
 std::string
 HTTPRequest::getURL() const
 {
@@ -306,6 +372,25 @@ namespace
 
     // HTTP debugging.
     static bool                        s_HTTP_DEBUG = false;
+
+    // async engine settings.
+    static int                         s_maxHostConnections = 6;
+    static int                         s_maxConnections     = 32;
+    static bool                        s_useAsyncEngine     = false;
+
+    // user agent, which the OSGEARTH_USERAGENT environment variable overrides.
+    std::string getUserAgentSetting()
+    {
+        const char* userAgentEnv = getenv("OSGEARTH_USERAGENT");
+        return userAgentEnv ? std::string(userAgentEnv) : s_userAgent;
+    }
+
+    // timeout, which the OSGEARTH_HTTP_TIMEOUT environment variable overrides.
+    long getTimeoutSetting()
+    {
+        const char* timeoutEnv = getenv("OSGEARTH_HTTP_TIMEOUT");
+        return timeoutEnv ? osgEarth::as<long>(std::string(timeoutEnv), 0) : s_timeout;
+    }
 }
 
 HTTPClient&
@@ -339,12 +424,7 @@ HTTPClient::initializeImpl()
     _curl_handle = curl_easy_init();
 
     //Get the user agent
-    std::string userAgent = s_userAgent;
-    const char* userAgentEnv = getenv("OSGEARTH_USERAGENT");
-    if (userAgentEnv)
-    {
-        userAgent = std::string(userAgentEnv);
-    }
+    std::string userAgent = getUserAgentSetting();
 
     //Check for a response-code simulation (for testing)
     const char* simCode = getenv("OSGEARTH_SIMULATE_HTTP_RESPONSE_CODE");
@@ -361,6 +441,12 @@ HTTPClient::initializeImpl()
         OE_WARN << LC << "HTTP debugging enabled" << std::endl;
     }
 
+    // Sends blocking requests through the async engine
+    if ( ::getenv("OSGEARTH_HTTP_ASYNC") )
+    {
+        s_useAsyncEngine = true;
+    }
+
     OE_DEBUG << LC << "HTTPClient setting userAgent=" << userAgent << std::endl;
 
     curl_easy_setopt( _curl_handle, CURLOPT_USERAGENT, userAgent.c_str() );
@@ -369,12 +455,11 @@ HTTPClient::initializeImpl()
     curl_easy_setopt( _curl_handle, CURLOPT_MAXREDIRS, (void*)5 );
     curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSFUNCTION, &CurlProgressCallback);
     curl_easy_setopt( _curl_handle, CURLOPT_NOPROGRESS, (void*)0 ); //FALSE);    
-    long timeout = s_timeout;
-    const char* timeoutEnv = getenv("OSGEARTH_HTTP_TIMEOUT");
-    if (timeoutEnv)
-    {        
-        timeout = osgEarth::as<long>(std::string(timeoutEnv), 0);
-    }
+#if LIBCURL_VERSION_NUM >= 0x070a00
+    // advertise every encoding curl supports (gzip, deflate) and decode responses transparently.
+    curl_easy_setopt( _curl_handle, CURLOPT_ENCODING, "" );
+#endif
+    long timeout = getTimeoutSetting();
     OE_DEBUG << LC << "Setting timeout to " << timeout << std::endl;
     curl_easy_setopt( _curl_handle, CURLOPT_TIMEOUT, timeout );
 
@@ -414,7 +499,7 @@ void HTTPClient::setTimeout( long timeout )
 }
 
 void
-HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port) const
+HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port)
 {
     // try to set proxy host/port by reading the CURL proxy options
     if ( options )
@@ -436,6 +521,76 @@ HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host,
     }
 }
 
+void
+HTTPClient::getProxy(const osgDB::Options* options, std::string& out_addr, std::string& out_auth)
+{
+    std::string proxy_host;
+    std::string proxy_port = "8080";
+
+    std::string proxy_auth;
+
+    //Try to get the proxy settings from the global settings
+    if (s_proxySettings.isSet())
+    {
+        proxy_host = s_proxySettings.get().hostName();
+        std::stringstream buf;
+        buf << s_proxySettings.get().port();
+        proxy_port = buf.str();
+
+        std::string proxy_username = s_proxySettings.get().userName();
+        std::string proxy_password = s_proxySettings.get().password();
+        if (!proxy_username.empty() && !proxy_password.empty())
+        {
+            proxy_auth = proxy_username + std::string(":") + proxy_password;
+        }
+    }
+
+    //Try to get the proxy settings from the local options that are passed in.
+    readOptions( options, proxy_host, proxy_port );
+
+    optional< ProxySettings > proxySettings;
+    ProxySettings::fromOptions( options, proxySettings );
+    if (proxySettings.isSet())
+    {       
+        proxy_host = proxySettings.get().hostName();
+        proxy_port = toString<int>(proxySettings.get().port());
+        OE_DEBUG << "Read proxy settings from options " << proxy_host << " " << proxy_port << std::endl;
+    }
+
+    //Try to get the proxy settings from the environment variable
+    const char* proxyEnvAddress = getenv("OSG_CURL_PROXY");
+    if (proxyEnvAddress) //Env Proxy Settings
+    {
+        proxy_host = std::string(proxyEnvAddress);
+
+        const char* proxyEnvPort = getenv("OSG_CURL_PROXYPORT"); //Searching Proxy Port on Env
+        if (proxyEnvPort)
+        {
+            proxy_port = std::string( proxyEnvPort );
+        }
+    }
+
+    const char* proxyEnvAuth = getenv("OSGEARTH_CURL_PROXYAUTH");	
+    if (proxyEnvAuth)
+    {
+        proxy_auth = std::string(proxyEnvAuth);
+    }
+
+    // Set up proxy server:
+    if ( !proxy_host.empty() )
+    {
+        std::stringstream buf;
+        buf << proxy_host << ":" << proxy_port;
+        out_addr = buf.str();
+    }
+    else
+    {
+        out_addr.clear();
+    }
+
+    out_auth = proxy_auth;
+}
+
 namespace
 {
     // from: http://www.rosettacode.org/wiki/Tokenizing_A_String#C.2B.2B
@@ -468,7 +623,7 @@ namespace
 void
 HTTPClient::decodeMultipartStream(const std::string&   boundary,
                                   HTTPResponse::Part*  input,
-                                  HTTPResponse::Parts& output) const
+                                  HTTPResponse::Parts& output)
 {
     std::string bstr = std::string("--") + boundary;
     std::string line;
@@ -566,6 +721,383 @@ HTTPClient::get( const std::string&    url,
     return getClient().doGet( url, options, callback);
 }
 
+/****************************************************************************/
+
+HTTPFuture::HTTPFuture(const HTTPRequest&    request,
+                       const osgDB::Options* dbOptions,
+                       ProgressCallback*     progress,
+                       HTTPResponseCallback* callback) :
+_request  ( request ),
+_dbOptions( dbOptions ),
+_progress ( progress ),
+_callback ( callback ),
+_canceled ( false )
+{
+    //nop
+}
+
+/****************************************************************************/
+
+namespace
+{
+    // guards creation of the async engine.
+    static Threading::Mutex s_asyncEngineMutex;
+}
+
+namespace osgEarth
+{
+    /**
+     * Runs asynchronous requests: a single thread drives a curl multi handle,
+     * whose connection cache keeps connections to each host alive between
+     * requests and caps how many are open at once.
+     */
+    class HTTPAsyncEngine : public OpenThreads::Thread
+    {
+    public:
+        static HTTPAsyncEngine& instance()
+        {
+            Threading::ScopedMutexLock lock( s_asyncEngineMutex );
+            static HTTPAsyncEngine s_engine;
+            return s_engine;
+        }
+
+        /** Queues a request; the engine thread picks it up on its next pass. */
+        void add( HTTPFuture* future )
+        {
+            {
+                Threading::ScopedMutexLock lock( _queueMutex );
+                _queue.push_back( future );
+                if ( !_started )
+                {
+                    _started = true;
+                    start();
+                }
+            }
+            _queueEvent.set();
+        }
+
+        void run()
+        {
+            while( !_done )
+            {
+                // when idle, sleep until a request arrives.
+                if ( _active.empty() )
+                {
+                    _queueEvent.wait( 250 );
+                    _queueEvent.reset();
+                }
+
+                startQueued();
+
+                int running = 0;
+                curl_multi_perform( _multi, &running );
+
+                finishCompleted();
+                removeCanceled();
+
+                if ( !_active.empty() )
+                {
+#if LIBCURL_VERSION_NUM >= 0x071c00
+                    // wait for socket activity; the short timeout bounds how long a
+                    // newly queued request waits to start.
+                    int numfds = 0;
+                    curl_multi_wait( _multi, 0L, 0, 5, &numfds );
+#else
+                    OpenThreads::Thread::microSleep( 1000 );
+#endif
+                }
+            }
+        }
+
+        int cancel()
+        {
+            if ( isRunning() )
+            {
+                _done = true;
+                _queueEvent.set();
+                while( isRunning() )
+                    OpenThreads::Thread::YieldCurrentThread();
+            }
+            return 0;
+        }
+
+    private:
+        struct Job
+        {
+            Job( HTTPFuture* future ) : _future(future), _handle(0L), _headerList(0L), _part(new HTTPResponse::Part()), _stream(&_part->_stream) { }
+            osg::ref_ptr<HTTPFuture>         _future;
+            CURL*                            _handle;
+            curl_slist*                      _headerList;
+            osg::ref_ptr<HTTPResponse::Part> _part;
+            StreamObject                     _stream;
+            std::string                      _url;
+        };
+
+        CURLM*                                 _multi;
+        std::string                            _userAgent;
+        long                                   _timeout;
+        volatile bool                          _done;
+        bool                                   _started;
+        Threading::Mutex                       _queueMutex;
+        Threading::Event                       _queueEvent;
+        std::vector< osg::ref_ptr<HTTPFuture> > _queue;
+        std::list<Job*>                        _active;
+
+        HTTPAsyncEngine() :
+        _done   ( false ),
+        _started( false )
+        {
+            curl_global_init( CURL_GLOBAL_ALL );
+
+            _multi     = curl_multi_init();
+            _userAgent = getUserAgentSetting();
+            _timeout   = getTimeoutSetting();
+
+            int maxHost = s_maxHostConnections;
+            const char* maxHostEnv = getenv("OSGEARTH_HTTP_MAX_HOST_CONNECTIONS");
+            if ( maxHostEnv )
+                maxHost = osgEarth::as<int>(std::string(maxHostEnv), maxHost);
+
+            int maxTotal = s_maxConnections;
+            const char* maxTotalEnv = getenv("OSGEARTH_HTTP_MAX_CONNECTIONS");
+            if ( maxTotalEnv )
+                maxTotal = osgEarth::as<int>(std::string(maxTotalEnv), maxTotal);
+
+#if LIBCURL_VERSION_NUM >= 0x071e00
+            curl_multi_setopt( _multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)maxHost );
+            curl_multi_setopt( _multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)maxTotal );
+            // size the idle connection cache to hold every connection we allow.
+            curl_multi_setopt( _multi, CURLMOPT_MAXCONNECTS, (long)maxTotal );
+#else
+            OE_INFO << LC << "libcurl is too old to limit connections per host" << std::endl;
+#endif
+            OE_INFO << LC << "Async engine: max " << maxHost << " connections per host, "
+                << maxTotal << " total" << std::endl;
+        }
+
+        ~HTTPAsyncEngine()
+        {
+            cancel();
+
+            for( std::list<Job*>::iterator i = _active.begin(); i != _active.end(); ++i )
+            {
+                curl_multi_remove_handle( _multi, (*i)->_handle );
+                finish( *i, CURLE_ABORTED_BY_CALLBACK );
+            }
+            _active.clear();
+
+            // requests that never started.
+            for( unsigned i = 0; i < _queue.size(); ++i )
+                finish( new Job(_queue[i].get()), CURLE_ABORTED_BY_CALLBACK );
+            _queue.clear();
+
+            curl_multi_cleanup( _multi );
+            curl_global_cleanup();
+        }
+
+        // moves queued requests onto the multi handle.
+        void startQueued()
+        {
+            std::vector< osg::ref_ptr<HTTPFuture> > queue;
+            {
+                Threading::ScopedMutexLock lock( _queueMutex );
+                queue.swap( _queue );
+            }
+
+            for( unsigned i = 0; i < queue.size(); ++i )
+            {
+                Job* job = new Job( queue[i].get() );
+                if ( job->_future->isCanceled() )
+                {
+                    finish( job, CURLE_ABORTED_BY_CALLBACK );
+                    continue;
+                }
+                setup( job );
+                curl_multi_add_handle( _multi, job->_handle );
+                _active.push_back( job );
+            }
+        }
+
+        void setup( Job* job )
+        {
+            HTTPFuture* future = job->_future.get();
+            job->_url = future->getRequest().getURL();
+
+            CURL* h = curl_easy_init();
+            job->_handle = h;
+
+            curl_easy_setopt( h, CURLOPT_PRIVATE, (void*)job );
+            curl_easy_setopt( h, CURLOPT_URL, job->_url.c_str() );
+
+            job->_headerList = createHeaderList( future->getRequest() );
+            if ( job->_headerList )
+                curl_easy_setopt( h, CURLOPT_HTTPHEADER, job->_headerList );
+
+            curl_easy_setopt( h, CURLOPT_USERAGENT, _userAgent.c_str() );
+            curl_easy_setopt( h, CURLOPT_WRITEFUNCTION, osgEarth::StreamObjectReadCallback );
+            curl_easy_setopt( h, CURLOPT_WRITEDATA, (void*)&job->_stream );
+            curl_easy_setopt( h, CURLOPT_HEADERFUNCTION, HeaderReadCallback );
+            curl_easy_setopt( h, CURLOPT_HEADERDATA, (void*)&job->_part->_headers );
+            curl_easy_setopt( h, CURLOPT_FOLLOWLOCATION, (void*)1 );
+            curl_easy_setopt( h, CURLOPT_MAXREDIRS, (void*)5 );
+            curl_easy_setopt( h, CURLOPT_PROGRESSFUNCTION, &CurlProgressCallback );
+            curl_easy_setopt( h, CURLOPT_PROGRESSDATA, (void*)future->_progress.get() );
+            curl_easy_setopt( h, CURLOPT_NOPROGRESS, (void*)0 );
+            curl_easy_setopt( h, CURLOPT_NOSIGNAL, (void*)1 );
+            curl_easy_setopt( h, CURLOPT_TIMEOUT, _timeout );
+            curl_easy_setopt( h, CURLOPT_SSL_VERIFYPEER, (void*)0 );
+#if LIBCURL_VERSION_NUM >= 0x070a00
+            curl_easy_setopt( h, CURLOPT_ENCODING, "" );
+#endif
+
+            std::string proxy_addr, proxy_auth;
+            HTTPClient::getProxy( future->_dbOptions.get(), proxy_addr, proxy_auth );
+            if ( !proxy_addr.empty() )
+            {
+                curl_easy_setopt( h, CURLOPT_PROXY, proxy_addr.c_str() );
+                if ( !proxy_auth.empty() )
+                    curl_easy_setopt( h, CURLOPT_PROXYUSERPWD, proxy_auth.c_str() );
+            }
+
+            const osgDB::Options* options = future->_dbOptions.get();
+            const osgDB::AuthenticationMap* authenticationMap = (options && options->getAuthenticationMap()) ? 
+                options->getAuthenticationMap() :
+                osgDB::Registry::instance()->getAuthenticationMap();
+
+            const osgDB::AuthenticationDetails* details = authenticationMap ?
+                authenticationMap->getAuthenticationDetails( job->_url ) :
+                0;
+
+            if ( details )
+            {
+                std::string password( details->username + ":" + details->password );
+                curl_easy_setopt( h, CURLOPT_USERPWD, password.c_str() );
+#if LIBCURL_VERSION_NUM >= 0x070a07
+                if ( details->httpAuthentication != 0 )
+                    curl_easy_setopt( h, CURLOPT_HTTPAUTH, details->httpAuthentication );
+#endif
+            }
+        }
+
+        // completes the requests that curl has finished.
+        void finishCompleted()
+        {
+            int remaining = 0;
+            while( CURLMsg* msg = curl_multi_info_read(_multi, &remaining) )
+            {
+                if ( msg->msg != CURLMSG_DONE )
+                    continue;
+
+                Job* job = 0L;
+                curl_easy_getinfo( msg->easy_handle, CURLINFO_PRIVATE, (char**)&job );
+                CURLcode result = msg->data.result;
+
+                _active.remove( job );
+                curl_multi_remove_handle( _multi, job->_handle );
+                finish( job, result );
+            }
+        }
+
+        // drops the requests that were cancelled while in flight.
+        void removeCanceled()
+        {
+            for( std::list<Job*>::iterator i = _active.begin(); i != _active.end(); )
+            {
+                Job* job = *i;
+                if ( job->_future->isCanceled() )
+                {
+                    i = _active.erase( i );
+                    curl_multi_remove_handle( _multi, job->_handle );
+                    finish( job, CURLE_ABORTED_BY_CALLBACK );
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+        }
+
+        // publishes a job's response and frees it.
+        void finish( Job* job, CURLcode result )
+        {
+            HTTPFuture* future = job->_future.get();
+
+            long response_code = 0L;
+            if ( job->_handle && result != CURLE_ABORTED_BY_CALLBACK )
+                curl_easy_getinfo( job->_handle, CURLINFO_RESPONSE_CODE, &response_code );
+
+            if ( job->_handle )
+                HTTPClient::readResponse( job->_handle, result, response_code, job->_url, job->_part.get(), future->_response );
+
+            if ( result == CURLE_ABORTED_BY_CALLBACK )
+                future->_response._cancelled = true;
+
+            if ( s_HTTP_DEBUG )
+            {
+                OE_NOTICE << LC << "GET(" << response_code << ", async): \"" << job->_url << "\"" << std::endl;
+            }
+
+            future->_done.set();
+
+            if ( future->_callback.valid() )
+                future->_callback->onResponse( future->getRequest(), future->_response );
+
+            if ( job->_handle )
+                curl_easy_cleanup( job->_handle );
+            if ( job->_headerList )
+                curl_slist_free_all( job->_headerList );
+            delete job;
+        }
+    };
+}
+
+osg::ref_ptr<HTTPFuture>
+HTTPClient::getAsync(const HTTPRequest&    request,
+                     const osgDB::Options* options,
+                     ProgressCallback*     progress,
+                     HTTPResponseCallback* callback)
+{
+    osg::ref_ptr<HTTPFuture> future = new HTTPFuture( request, options, progress, callback );
+    HTTPAsyncEngine::instance().add( future.get() );
+    return future;
+}
+
+void
+HTTPClient::setMaxConnectionsPerHost( int value )
+{
+    s_maxHostConnections = value;
+}
+
+int
+HTTPClient::getMaxConnectionsPerHost()
+{
+    return s_maxHostConnections;
+}
+
+void
+HTTPClient::setMaxConnections( int value )
+{
+    s_maxConnections = value;
+}
+
+int
+HTTPClient::getMaxConnections()
+{
+    return s_maxConnections;
+}
+
+void
+HTTPClient::setUseAsyncEngine( bool value )
+{
+    s_useAsyncEngine = value;
+}
+
+bool
+HTTPClient::getUseAsyncEngine()
+{
+    return s_useAsyncEngine;
+}
+
 ReadResult
 HTTPClient::readImage(const std::string&    location,
                       const osgDB::Options* options,
@@ -574,6 +1106,14 @@ HTTPClient::readImage(const std::string&    location,
     return getClient().doReadImage( location, options, callback );
 }
 
+ReadResult
+HTTPClient::readImage(const HTTPRequest&    request,
+                      const osgDB::Options* options,
+                      ProgressCallback*     callback)
+{
+    return getClient().doReadImage( request, options, callback );
+}
+
 ReadResult
 HTTPClient::readNode(const std::string&    location,
                      const osgDB::Options* options,
@@ -582,6 +1122,14 @@ HTTPClient::readNode(const std::string&    location,
     return getClient().doReadNode( location, options, callback );
 }
 
+ReadResult
+HTTPClient::readNode(const HTTPRequest&    request,
+                     const osgDB::Options* options,
+                     ProgressCallback*     callback)
+{
+    return getClient().doReadNode( request, options, callback );
+}
+
 ReadResult
 HTTPClient::readObject(const std::string&    location,
                        const osgDB::Options* options,
@@ -590,6 +1138,14 @@ HTTPClient::readObject(const std::string&    location,
     return getClient().doReadObject( location, options, callback );
 }
 
+ReadResult
+HTTPClient::readObject(const HTTPRequest&    request,
+                       const osgDB::Options* options,
+                       ProgressCallback*     callback)
+{
+    return getClient().doReadObject( request, options, callback );
+}
+
 ReadResult
 HTTPClient::readString(const std::string&    location,
                        const osgDB::Options* options,
@@ -598,6 +1154,14 @@ HTTPClient::readString(const std::string&    location,
     return getClient().doReadString( location, options, callback );
 }
 
+ReadResult
+HTTPClient::readString(const HTTPRequest&    request,
+                       const osgDB::Options* options,
+                       ProgressCallback*     callback)
+{
+    return getClient().doReadString( request, options, callback );
+}
+
 bool
 HTTPClient::download(const std::string& uri,
                      const std::string& localPath)
@@ -605,80 +1169,101 @@ HTTPClient::download(const std::string& uri,
     return getClient().doDownload( uri, localPath );
 }
 
-HTTPResponse
-HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, ProgressCallback* callback) const
+void
+HTTPClient::readResponse(void*               curl_handle,
+                         int                 curl_result,
+                         long                response_code,
+                         const std::string&  url,
+                         HTTPResponse::Part* part,
+                         HTTPResponse&       out_response)
 {
-    initialize();
+    CURL* handle = (CURL*)curl_handle;
+    CURLcode res = (CURLcode)curl_result;
 
-    const osgDB::AuthenticationMap* authenticationMap = (options && options->getAuthenticationMap()) ? 
-            options->getAuthenticationMap() :
-            osgDB::Registry::instance()->getAuthenticationMap();
+    out_response = HTTPResponse( response_code );
+   
+    if ( response_code == 200L && res != CURLE_ABORTED_BY_CALLBACK && res != CURLE_OPERATION_TIMEDOUT )
+    {
+        // check for multipart content:
+        char* content_type_cp;
+        curl_easy_getinfo( handle, CURLINFO_CONTENT_TYPE, &content_type_cp );
+        if ( content_type_cp == NULL )
+        {
+            OE_WARN << LC
+                << "NULL Content-Type (protocol violation) " 
+                << "URL=" << url << std::endl;
+            out_response = HTTPResponse(0L);
+            return;
+        }
 
-    std::string proxy_host;
-    std::string proxy_port = "8080";
+        // NOTE:
+        //   WCS 1.1 specified a "multipart/mixed" response, but ArcGIS Server gives a "multipart/related"
+        //   content type ...
 
-    std::string proxy_auth;
+        std::string content_type( content_type_cp );
 
-    //TODO: don't do all this proxy setup on every GET. Just do it once per client, or only when 
-    // the proxy information changes.
+        //OE_DEBUG << LC << "content-type = \"" << content_type << "\"" << std::endl;
 
-    //Try to get the proxy settings from the global settings
-    if (s_proxySettings.isSet())
-    {
-        proxy_host = s_proxySettings.get().hostName();
-        std::stringstream buf;
-        buf << s_proxySettings.get().port();
-        proxy_port = buf.str();
+        if ( content_type.length() > 9 && ::strstr( content_type.c_str(), "multipart" ) == content_type.c_str() )
+        //if ( content_type == "multipart/mixed; boundary=wcs" ) //todo: parse this.
+        {
+            OE_DEBUG << LC << "detected multipart data; decoding..." << std::endl;
 
-        std::string proxy_username = s_proxySettings.get().userName();
-        std::string proxy_password = s_proxySettings.get().password();
-        if (!proxy_username.empty() && !proxy_password.empty())
+            //TODO: parse out the "wcs" -- this is WCS-specific
+            decodeMultipartStream( "wcs", part, out_response._parts );
+        }
+        else
         {
-            proxy_auth = proxy_username + std::string(":") + proxy_password;
+            // store headers that we care about
+            part->_headers[IOMetadata::CONTENT_TYPE] = content_type;
+
+            out_response._parts.push_back( part );
         }
     }
-
-    //Try to get the proxy settings from the local options that are passed in.
-    readOptions( options, proxy_host, proxy_port );
-
-    optional< ProxySettings > proxySettings;
-    ProxySettings::fromOptions( options, proxySettings );
-    if (proxySettings.isSet())
-    {       
-        proxy_host = proxySettings.get().hostName();
-        proxy_port = toString<int>(proxySettings.get().port());
-        OE_DEBUG << "Read proxy settings from options " << proxy_host << " " << proxy_port << std::endl;
+    else if (res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT)
+    {        
+        //If we were aborted by a callback, then it was cancelled by a user
+        out_response._cancelled = true;
     }
-
-    //Try to get the proxy settings from the environment variable
-    const char* proxyEnvAddress = getenv("OSG_CURL_PROXY");
-    if (proxyEnvAddress) //Env Proxy Settings
+    else if ( response_code == 304L )
     {
-        proxy_host = std::string(proxyEnvAddress);
+        // not modified: there's no body, but keep the refreshed caching headers.
+        out_response._parts.push_back( part );
+    }
 
-        const char* proxyEnvPort = getenv("OSG_CURL_PROXYPORT"); //Searching Proxy Port on Env
-        if (proxyEnvPort)
-        {
-            proxy_port = std::string( proxyEnvPort );
-        }
+    // Store the mime-type, if any. (Note: CURL manages the buffer returned by
+    // this call.)
+    char* ctbuf = NULL;
+    if ( curl_easy_getinfo(handle, CURLINFO_CONTENT_TYPE, &ctbuf) == 0 && ctbuf )
+    {
+        out_response._mimeType = ctbuf;
     }
 
-    const char* proxyEnvAuth = getenv("OSGEARTH_CURL_PROXYAUTH");	
-    if (proxyEnvAuth)
+}
+
+HTTPResponse
+HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, ProgressCallback* callback) const
+{
+    initialize();
+
+    if ( s_useAsyncEngine && _simResponseCode < 0 )
     {
-        proxy_auth = std::string(proxyEnvAuth);
+        osg::ref_ptr<HTTPFuture> future = getAsync( request, options, callback );
+        return future->getResponse();
     }
 
-    // Set up proxy server:
+    const osgDB::AuthenticationMap* authenticationMap = (options && options->getAuthenticationMap()) ? 
+            options->getAuthenticationMap() :
+            osgDB::Registry::instance()->getAuthenticationMap();
+
+    //TODO: don't do all this proxy setup on every GET. Just do it once per client, or only when 
+    // the proxy information changes.
     std::string proxy_addr;
-    if ( !proxy_host.empty() )
+    std::string proxy_auth;
+    getProxy( options, proxy_addr, proxy_auth );
+
+    if ( !proxy_addr.empty() )
     {
-        std::stringstream buf;
-        buf << proxy_host << ":" << proxy_port;
-        std::string bufStr;
-        bufStr = buf.str();
-        proxy_addr = bufStr;
-    
         if ( s_HTTP_DEBUG )
             OE_NOTICE << LC << "Using proxy: " << proxy_addr << std::endl;
 
@@ -761,10 +1346,19 @@ HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, Pr
         errorBuf[0] = 0;
         curl_easy_setopt( _curl_handle, CURLOPT_ERRORBUFFER, (void*)errorBuf );
 
+        // request headers (e.g. conditional GET validators), and capture the caching headers of the response.
+        curl_slist* headerList = createHeaderList( request );
+        curl_easy_setopt( _curl_handle, CURLOPT_HTTPHEADER, headerList );
+        curl_easy_setopt( _curl_handle, CURLOPT_HEADERFUNCTION, HeaderReadCallback );
+        curl_easy_setopt( _curl_handle, CURLOPT_HEADERDATA, (void*)&part->_headers );
+
         curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)&sp);
         res = curl_easy_perform( _curl_handle );
         curl_easy_setopt( _curl_handle, CURLOPT_WRITEDATA, (void*)0 );
         curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSDATA, (void*)0);
+        curl_easy_setopt( _curl_handle, CURLOPT_HEADERDATA, (void*)0 );
+        curl_easy_setopt( _curl_handle, CURLOPT_HTTPHEADER, (void*)0 );
+        curl_slist_free_all( headerList );
 
         //Disable peer certificate verification to allow us to access in https servers where the peer certificate cannot be verified.
         curl_easy_setopt( _curl_handle, CURLOPT_SSL_VERIFYPEER, (void*)0 );
@@ -794,59 +1388,8 @@ HTTPClient::doGet( const HTTPRequest& request, const osgDB::Options* options, Pr
         OE_NOTICE << LC << "GET(" << response_code << "): \"" << request.getURL() << "\"" << std::endl;
     }
 
-    HTTPResponse response( response_code );
-   
-    if ( response_code == 200L && res != CURLE_ABORTED_BY_CALLBACK && res != CURLE_OPERATION_TIMEDOUT )
-    {
-        // check for multipart content:
-        char* content_type_cp;
-        curl_easy_getinfo( _curl_handle, CURLINFO_CONTENT_TYPE, &content_type_cp );
-        if ( content_type_cp == NULL )
-        {
-            OE_WARN << LC
-                << "NULL Content-Type (protocol violation) " 
-                << "URL=" << request.getURL() << std::endl;
-            return HTTPResponse(0L);
-        }
-
-        // NOTE:
-        //   WCS 1.1 specified a "multipart/mixed" response, but ArcGIS Server gives a "multipart/related"
-        //   content type ...
-
-        std::string content_type( content_type_cp );
-
-        //OE_DEBUG << LC << "content-type = \"" << content_type << "\"" << std::endl;
-
-        if ( content_type.length() > 9 && ::strstr( content_type.c_str(), "multipart" ) == content_type.c_str() )
-        //if ( content_type == "multipart/mixed; boundary=wcs" ) //todo: parse this.
-        {
-            OE_DEBUG << LC << "detected multipart data; decoding..." << std::endl;
-
-            //TODO: parse out the "wcs" -- this is WCS-specific
-            decodeMultipartStream( "wcs", part.get(), response._parts );
-        }
-        else
-        {
-            // store headers that we care about
-            part->_headers[IOMetadata::CONTENT_TYPE] = content_type;
-
-            response._parts.push_back( part.get() );
-        }
-    }
-    else if (res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT)
-    {        
-        //If we were aborted by a callback, then it was cancelled by a user
-        response._cancelled = true;
-    }
-
-    // Store the mime-type, if any. (Note: CURL manages the buffer returned by
-    // this call.)
-    char* ctbuf = NULL;
-    if ( curl_easy_getinfo(_curl_handle, CURLINFO_CONTENT_TYPE, &ctbuf) == 0 && ctbuf )
-    {
-        response._mimeType = ctbuf;
-    }
-
+    HTTPResponse response;
+    readResponse( _curl_handle, res, response_code, request.getURL(), part.get(), response );
     return response;
 }
 
@@ -921,7 +1464,7 @@ namespace
 }
 
 ReadResult
-HTTPClient::doReadImage(const std::string&    location,
+HTTPClient::doReadImage(const HTTPRequest&    request,
                         const osgDB::Options* options,
                         ProgressCallback*     callback)
 {
@@ -929,7 +1472,8 @@ HTTPClient::doReadImage(const std::string&    location,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet(location, options, callback);
+    std::string location = request.getURL();
+    HTTPResponse response = this->doGet(request, options, callback);
 
     if (response.isOK())
     {
@@ -962,9 +1506,11 @@ HTTPClient::doReadImage(const std::string&    location,
     {
         result = ReadResult(
             response.isCancelled() ? ReadResult::RESULT_CANCELED :
+            response.getCode() == HTTPResponse::NOT_MODIFIED ? ReadResult::RESULT_NOT_MODIFIED :
             response.getCode() == HTTPResponse::NOT_FOUND ? ReadResult::RESULT_NOT_FOUND :
             response.getCode() == HTTPResponse::SERVER_ERROR ? ReadResult::RESULT_SERVER_ERROR :
-            ReadResult::RESULT_UNKNOWN_ERROR );
+            ReadResult::RESULT_UNKNOWN_ERROR,
+            response.getHeadersAsConfig() );
 
         //If we have an error but it's recoverable, like a server error or timeout then set the callback to retry.
         if (HTTPClient::isRecoverable( result.code() ) )
@@ -985,7 +1531,7 @@ HTTPClient::doReadImage(const std::string&    location,
 }
 
 ReadResult
-HTTPClient::doReadNode(const std::string&    location,
+HTTPClient::doReadNode(const HTTPRequest&    request,
                        const osgDB::Options* options,
                        ProgressCallback*     callback)
 {
@@ -993,7 +1539,8 @@ HTTPClient::doReadNode(const std::string&    location,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet(location, options, callback);
+    std::string location = request.getURL();
+    HTTPResponse response = this->doGet(request, options, callback);
 
     if (response.isOK())
     {
@@ -1026,9 +1573,11 @@ HTTPClient::doReadNode(const std::string&    location,
     {
         result = ReadResult(
             response.isCancelled() ? ReadResult::RESULT_CANCELED :
+            response.getCode() == HTTPResponse::NOT_MODIFIED ? ReadResult::RESULT_NOT_MODIFIED :
             response.getCode() == HTTPResponse::NOT_FOUND ? ReadResult::RESULT_NOT_FOUND :
             response.getCode() == HTTPResponse::SERVER_ERROR ? ReadResult::RESULT_SERVER_ERROR :
-            ReadResult::RESULT_UNKNOWN_ERROR );
+            ReadResult::RESULT_UNKNOWN_ERROR,
+            response.getHeadersAsConfig() );
 
         //If we have an error but it's recoverable, like a server error or timeout then set the callback to retry.
         if (HTTPClient::isRecoverable( result.code() ) )
@@ -1045,7 +1594,7 @@ HTTPClient::doReadNode(const std::string&    location,
 }
 
 ReadResult
-HTTPClient::doReadObject(const std::string&    location,
+HTTPClient::doReadObject(const HTTPRequest&    request,
                          const osgDB::Options* options,
                          ProgressCallback*     callback)
 {
@@ -1053,7 +1602,8 @@ HTTPClient::doReadObject(const std::string&    location,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet(location, options, callback);
+    std::string location = request.getURL();
+    HTTPResponse response = this->doGet(request, options, callback);
 
     if (response.isOK())
     {
@@ -1086,9 +1636,11 @@ HTTPClient::doReadObject(const std::string&    location,
     {
         result = ReadResult(
             response.isCancelled() ? ReadResult::RESULT_CANCELED :
+            response.getCode() == HTTPResponse::NOT_MODIFIED ? ReadResult::RESULT_NOT_MODIFIED :
             response.getCode() == HTTPResponse::NOT_FOUND ? ReadResult::RESULT_NOT_FOUND :
             response.getCode() == HTTPResponse::SERVER_ERROR ? ReadResult::RESULT_SERVER_ERROR :
-            ReadResult::RESULT_UNKNOWN_ERROR );
+            ReadResult::RESULT_UNKNOWN_ERROR,
+            response.getHeadersAsConfig() );
 
         //If we have an error but it's recoverable, like a server error or timeout then set the callback to retry.
         if (HTTPClient::isRecoverable( result.code() ) )
@@ -1106,7 +1658,7 @@ HTTPClient::doReadObject(const std::string&    location,
 
 
 ReadResult
-HTTPClient::doReadString(const std::string&    location,
+HTTPClient::doReadString(const HTTPRequest&    request,
                          const osgDB::Options* options,
                          ProgressCallback*     callback )
 {
@@ -1114,7 +1666,8 @@ HTTPClient::doReadString(const std::string&    location,
 
     ReadResult result;
 
-    HTTPResponse response = this->doGet( location, options, callback );
+    std::string location = request.getURL();
+    HTTPResponse response = this->doGet( request, options, callback );
     if ( response.isOK() )
     {
         result = ReadResult( new StringObject(response.getPartAsString(0)), response.getHeadersAsConfig());
@@ -1123,9 +1676,11 @@ HTTPClient::doReadString(const std::string&    location,
     {
         result = ReadResult(
             response.isCancelled() ? ReadResult::RESULT_CANCELED :
+            response.getCode() == HTTPResponse::NOT_MODIFIED ? ReadResult::RESULT_NOT_MODIFIED :
             response.getCode() == HTTPResponse::NOT_FOUND ? ReadResult::RESULT_NOT_FOUND :
             response.getCode() == HTTPResponse::SERVER_ERROR ? ReadResult::RESULT_SERVER_ERROR :
-            ReadResult::RESULT_UNKNOWN_ERROR );
+            ReadResult::RESULT_UNKNOWN_ERROR,
+            response.getHeadersAsConfig() );
 
         //If we have an error but it's recoverable, like a server error or timeout then set the callback to retry.
         if (HTTPClient::isRecoverable( result.code() ) )
@@ -27,7 +27,13 @@ using namespace osgEarth;
 
 //------------------------------------------------------------------------
 
-const std::string IOMetadata::CONTENT_TYPE = "Content-type";
+const std::string IOMetadata::CONTENT_TYPE  = "Content-type";
+const std::string IOMetadata::ETAG          = "ETag";
+const std::string IOMetadata::LAST_MODIFIED = "Last-Modified";
+const std::string IOMetadata::CACHE_CONTROL = "Cache-Control";
+const std::string IOMetadata::EXPIRES       = "Expires";
+const std::string IOMetadata::DATE          = "Date";
+const std::string IOMetadata::CACHE_TIME    = "osgearth-cache-time";
 
 //------------------------------------------------------------------------
 
@@ -478,8 +478,62 @@ ImageLayer::createImageInNativeProfile( const TileKey& key, ProgressCallback* pr
 }
 
 
+namespace
+{
+    // each caller gets its own copy of a coalesced image, since callers are
+    // free to modify the images they get back.
+    GeoImage copyOf( const GeoImage& image )
+    {
+        return image.valid() ?
+            GeoImage( ImageUtils::cloneImage(image.getImage()), image.getExtent() ) :
+            image;
+    }
+}
+
+unsigned
+ImageLayer::getNumCoalescedRequests() const
+{
+    return _keyProfileFlights.getNumCoalesced() + _tileSourceFlights.getNumCoalesced();
+}
+
 GeoImage
 ImageLayer::createImageInKeyProfile( const TileKey& key, ProgressCallback* progress, bool forceFallback, bool& out_isFallback )
+{
+    std::string flightKey = 
+        key.str() + "_" + key.getProfile()->getHorizSignature() + (forceFallback ? "_f" : "");
+
+    for( ; ; )
+    {
+        osg::ref_ptr<KeyProfileFlights::Flight> flight;
+        if ( _keyProfileFlights.join(flightKey, flight) )
+        {
+            GeoImage result = readOrCreateImageInKeyProfile( key, progress, forceFallback, out_isFallback );
+            if ( _keyProfileFlights.land(flightKey, flight.get()) )
+            {
+                bool canceled = progress && progress->isCanceled();
+                _keyProfileFlights.publish( flight.get(), std::make_pair(copyOf(result), out_isFallback), !canceled );
+            }
+            return result;
+        }
+
+        std::pair<GeoImage,bool> shared;
+        if ( _keyProfileFlights.wait(flight.get(), shared, progress) )
+        {
+            out_isFallback = shared.second;
+            return copyOf( shared.first );
+        }
+
+        // the leader was canceled. Try again unless we were too.
+        if ( progress && progress->isCanceled() )
+        {
+            out_isFallback = false;
+            return GeoImage::INVALID;
+        }
+    }
+}
+
+GeoImage
+ImageLayer::readOrCreateImageInKeyProfile( const TileKey& key, ProgressCallback* progress, bool forceFallback, bool& out_isFallback )
 {
     GeoImage result;
 
@@ -542,8 +596,15 @@ ImageLayer::createImageInKeyProfile( const TileKey& key, ProgressCallback* progr
         ReadResult r = cacheBin->readImage( key.str() );
         if ( r.succeeded() )
         {            
-            ImageUtils::normalizeImage( r.getImage() );
-            return GeoImage( r.releaseImage(), key.getExtent() );
+            osg::ref_ptr<osg::Image> image = r.releaseImage();
+            if ( !ImageUtils::isNormalized(image.get()) )
+            {
+                // a zero-copy memory cache hands out the image it holds; don't modify that one.
+                if ( image->referenceCount() > 1 )
+                    image = ImageUtils::cloneImage( image.get() );
+                ImageUtils::normalizeImage( image.get() );
+            }
+            return GeoImage( image.get(), key.getExtent() );
         }
         else
         {
@@ -560,9 +621,12 @@ ImageLayer::createImageInKeyProfile( const TileKey& key, ProgressCallback* progr
     // Get an image from the underlying TileSource.
     result = createImageFromTileSource( key, progress, forceFallback, out_isFallback );
 
-    // Normalize the image if necessary
-    if ( result.valid() )
+    // Normalize the image if necessary. The image may be the one held by a
+    // shared L2 cache, so copy it rather than modify it in place.
+    if ( result.valid() && !ImageUtils::isNormalized(result.getImage()) )
     {
+        if ( result.getImage()->referenceCount() > 1 )
+            result = GeoImage( ImageUtils::cloneImage(result.getImage()), result.getExtent() );
         ImageUtils::normalizeImage( result.getImage() );
     }
 
@@ -649,8 +713,6 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
     }
 
     // Good to go, ask the tile source for an image:
-    osg::ref_ptr<TileSource::ImageOperation> op = _preCacheOp;
-
     osg::ref_ptr<osg::Image> result;
     TileKey finalKey = key;
     bool fellBack = false;
@@ -661,7 +723,7 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
         {
             if ( !source->getBlacklist()->contains( finalKey.getTileId() ) )
             {
-                result = source->createImage( finalKey, op.get(), progress );
+                fetchImageFromTileSource( finalKey, progress, result );
                 if ( result.valid() )
                 {
                     if ( finalKey.getLevelOfDetail() != key.getLevelOfDetail() )
@@ -693,7 +755,7 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
 
     else
     {
-        result = source->createImage( key, op.get(), progress );
+        fetchImageFromTileSource( key, progress, result );
     }
     
     // If image creation failed (but was not intentionally canceled),
@@ -709,6 +771,49 @@ ImageLayer::createImageFromTileSource(const TileKey&    key,
 }
 
 
+bool
+ImageLayer::fetchImageFromTileSource(const TileKey&            key,
+                                     ProgressCallback*         progress,
+                                     osg::ref_ptr<osg::Image>& out_image)
+{
+    TileSource* source = getTileSource();
+    if ( !source )
+        return false;
+
+    osg::ref_ptr<TileSource::ImageOperation> op = _preCacheOp;
+    const std::string& flightKey = key.str();
+
+    for( ; ; )
+    {
+        osg::ref_ptr<TileSourceFlights::Flight> flight;
+        if ( _tileSourceFlights.join(flightKey, flight) )
+        {
+            out_image = source->createImage( key, op.get(), progress );
+            if ( _tileSourceFlights.land(flightKey, flight.get()) )
+            {
+                bool canceled = progress && progress->isCanceled();
+                osg::ref_ptr<osg::Image> copy = out_image.valid() ? ImageUtils::cloneImage(out_image.get()) : 0L;
+                _tileSourceFlights.publish( flight.get(), copy, !canceled );
+            }
+            return out_image.valid();
+        }
+
+        osg::ref_ptr<osg::Image> shared;
+        if ( _tileSourceFlights.wait(flight.get(), shared, progress) )
+        {
+            out_image = shared.valid() ? ImageUtils::cloneImage(shared.get()) : 0L;
+            return out_image.valid();
+        }
+
+        if ( progress && progress->isCanceled() )
+        {
+            out_image = 0L;
+            return false;
+        }
+    }
+}
+
+
 GeoImage
 ImageLayer::assembleImageFromTileSource(const TileKey&    key,
                                         ProgressCallback* progress,
@@ -61,7 +61,7 @@ ImageUtils::normalizeImage( osg::Image* image )
     // OpenGL is lax about internal texture formats, and e.g. allows GL_RGBA to be used
     // instead of the proper GL_RGBA8, etc. Correct that here, since some of our compositors
     // rely on having a proper internal texture format.
-    if ( image->getDataType() == GL_UNSIGNED_BYTE )
+    if ( image->getDataType() == GL_UNSIGNED_BYTE && !isNormalized(image) )
     {
         if ( image->getPixelFormat() == GL_RGB )
             image->setInternalTextureFormat( GL_RGB8_INTERNAL );
@@ -70,6 +70,19 @@ ImageUtils::normalizeImage( osg::Image* image )
     }
 }
 
+bool
+ImageUtils::isNormalized( const osg::Image* image )
+{
+    if ( image->getDataType() == GL_UNSIGNED_BYTE )
+    {
+        if ( image->getPixelFormat() == GL_RGB )
+            return image->getInternalTextureFormat() == GL_RGB8_INTERNAL;
+        else if ( image->getPixelFormat() == GL_RGBA )
+            return image->getInternalTextureFormat() == GL_RGB8A_INTERNAL;
+    }
+    return true;
+}
+
 bool
 ImageUtils::copyAsSubImage(const osg::Image* src, osg::Image* dst, int dst_start_col, int dst_start_row, int dst_img )
 {
@@ -20,6 +20,11 @@
 #include <osgEarth/StringUtils>
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/Containers>
+#include <osg/Image>
+#include <osg/Shape>
+#include <list>
+#include <map>
+#include <vector>
 
 using namespace osgEarth;
 
@@ -86,6 +91,17 @@ namespace
                 return false;
         }
 
+        bool touch( const std::string& key, const Config& meta )
+        {
+            MemCacheLRU::Record rec;
+            _lru.get(key, rec);
+            if ( !rec.valid() )
+                return false;
+
+            _lru.insert( key, std::make_pair(rec.value().first, meta) );
+            return true;
+        }
+
         bool isCached( const std::string& key, double maxAge ) 
         {
             return _lru.has(key);
@@ -103,20 +119,284 @@ namespace
     
 
     static Threading::Mutex s_defaultBinMutex;
+
+    //--------------------------------------------------------------------
+
+    // process-wide accounting of sharded bin contents.
+    static Threading::Mutex   s_totalsMutex;
+    static unsigned long long s_totalBytes   = 0;
+    static unsigned           s_totalEntries = 0;
+
+    void adjustTotals( long long bytes, int entries )
+    {
+        Threading::ScopedMutexLock lock( s_totalsMutex );
+        s_totalBytes   = (unsigned long long)((long long)s_totalBytes + bytes);
+        s_totalEntries = (unsigned)((int)s_totalEntries + entries);
+    }
+
+    // approximate memory footprint of a cached object.
+    unsigned long estimateSize( const std::string& key, const osg::Object* object )
+    {
+        unsigned long size = key.size() + sizeof(std::string) * 2;
+
+        if ( const osg::Image* image = dynamic_cast<const osg::Image*>(object) )
+        {
+            size += sizeof(osg::Image) + image->getTotalSizeInBytesIncludingMipmaps();
+        }
+        else if ( const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object) )
+        {
+            size += sizeof(osg::HeightField) + hf->getNumColumns() * hf->getNumRows() * sizeof(float);
+        }
+        else if ( const StringObject* str = dynamic_cast<const StringObject*>(object) )
+        {
+            size += sizeof(StringObject) + str->getString().size();
+        }
+        else
+        {
+            size += 256;
+        }
+
+        return size;
+    }
+
+    /**
+     * Cache bin that splits its key space across several independently locked
+     * shards, each with its own LRU list. Capped by estimated bytes (or by entry
+     * count if no byte budget is set). Optionally returns the cached objects
+     * themselves instead of deep copies.
+     */
+    struct ShardedMemCacheBin : public CacheBin
+    {
+        enum { NUM_SHARDS = 8 };
+
+        ShardedMemCacheBin( const std::string& id, unsigned maxEntries, unsigned long maxBytes, bool share )
+            : CacheBin( id ),
+              _share  ( share )
+        {
+            _maxShardBytes   = maxBytes / NUM_SHARDS;
+            _maxShardEntries = std::max( 1u, (maxEntries + NUM_SHARDS - 1) / NUM_SHARDS );
+        }
+
+        virtual ~ShardedMemCacheBin()
+        {
+            purge();
+        }
+
+        ReadResult readObject(const std::string& key,
+                              double             maxAge )
+        {
+            osg::ref_ptr<const osg::Object> object;
+            Config meta;
+            {
+                Shard& shard = getShard( key );
+                Threading::ScopedMutexLock lock( shard._mutex );
+
+                EntryMap::iterator i = shard._entries.find( key );
+                if ( i == shard._entries.end() )
+                    return ReadResult();
+
+                // move to the most-recently-used end of the list.
+                shard._lru.splice( shard._lru.end(), shard._lru, i->second._lru );
+
+                object = i->second._object.get();
+                meta   = i->second._meta;
+            }
+
+            return ReadResult(
+                _share ? const_cast<osg::Object*>(object.get()) : osg::clone(object.get(), osg::CopyOp::DEEP_COPY_ALL),
+                meta );
+        }
+
+        ReadResult readImage(const std::string& key,
+                             double             maxAge )
+        {
+            return readObject( key, maxAge );
+        }
+
+        ReadResult readString(const std::string& key,
+                              double             maxAge )
+        {
+            return readObject( key, maxAge );
+        }
+
+        ReadResult readConfig(const std::string& key,
+                              double             maxAge )
+        {
+            return readObject( key, maxAge );
+        }
+
+        bool write( const std::string& key, const osg::Object* object, const Config& meta )
+        {
+            if ( !object )
+                return false;
+
+            unsigned long size = estimateSize( key, object );
+
+            // an object that would blow the whole budget is not worth caching.
+            if ( _maxShardBytes > 0 && size > _maxShardBytes )
+                return false;
+
+            long long deltaBytes   = 0;
+            int       deltaEntries = 0;
+
+            // evicted objects are released outside of the lock.
+            std::vector< osg::ref_ptr<const osg::Object> > evicted;
+            {
+                Shard& shard = getShard( key );
+                Threading::ScopedMutexLock lock( shard._mutex );
+
+                EntryMap::iterator i = shard._entries.find( key );
+                if ( i != shard._entries.end() )
+                {
+                    evicted.push_back( i->second._object.get() );
+                    deltaBytes -= (long long)i->second._bytes;
+                    shard._bytes -= i->second._bytes;
+                    shard._lru.erase( i->second._lru );
+                    shard._entries.erase( i );
+                    deltaEntries--;
+                }
+
+                // make room:
+                while( !shard._lru.empty() && isFull(shard, size) )
+                {
+                    EntryMap::iterator victim = shard._entries.find( shard._lru.front() );
+                    evicted.push_back( victim->second._object.get() );
+                    deltaBytes -= (long long)victim->second._bytes;
+                    shard._bytes -= victim->second._bytes;
+                    shard._entries.erase( victim );
+                    shard._lru.pop_front();
+                    deltaEntries--;
+                }
+
+                shard._lru.push_back( key );
+                Entry& entry = shard._entries[key];
+                entry._object = object;
+                entry._meta   = meta;
+                entry._bytes  = size;
+                entry._lru    = shard._lru.end();
+                entry._lru--;
+                shard._bytes += size;
+                deltaBytes   += (long long)size;
+                deltaEntries++;
+            }
+
+            adjustTotals( deltaBytes, deltaEntries );
+            return true;
+        }
+
+        bool touch( const std::string& key, const Config& meta )
+        {
+            Shard& shard = getShard( key );
+            Threading::ScopedMutexLock lock( shard._mutex );
+
+            EntryMap::iterator i = shard._entries.find( key );
+            if ( i == shard._entries.end() )
+                return false;
+
+            i->second._meta = meta;
+            shard._lru.splice( shard._lru.end(), shard._lru, i->second._lru );
+            return true;
+        }
+
+        bool isCached( const std::string& key, double maxAge ) 
+        {
+            Shard& shard = getShard( key );
+            Threading::ScopedMutexLock lock( shard._mutex );
+            return shard._entries.find( key ) != shard._entries.end();
+        }
+
+        bool purge()
+        {
+            long long deltaBytes   = 0;
+            int       deltaEntries = 0;
+
+            for( unsigned s = 0; s < NUM_SHARDS; ++s )
+            {
+                EntryMap dead;
+                {
+                    Shard& shard = _shards[s];
+                    Threading::ScopedMutexLock lock( shard._mutex );
+                    deltaBytes   -= (long long)shard._bytes;
+                    deltaEntries -= (int)shard._entries.size();
+                    dead.swap( shard._entries );
+                    shard._lru.clear();
+                    shard._bytes = 0;
+                }
+            }
+
+            adjustTotals( deltaBytes, deltaEntries );
+            return true;
+        }
+
+    private:
+        typedef std::list<std::string> LRUList;
+
+        struct Entry
+        {
+            Entry() : _bytes(0) { }
+            osg::ref_ptr<const osg::Object> _object;
+            Config                          _meta;
+            unsigned long                   _bytes;
+            LRUList::iterator               _lru;
+        };
+        typedef std::map<std::string, Entry> EntryMap;
+
+        struct Shard
+        {
+            Shard() : _bytes(0) { }
+            Threading::Mutex _mutex;
+            EntryMap         _entries;
+            LRUList          _lru;
+            unsigned long    _bytes;
+        };
+
+        Shard& getShard( const std::string& key )
+        {
+            // FNV-1a
+            unsigned h = 2166136261u;
+            for( std::string::const_iterator c = key.begin(); c != key.end(); ++c )
+                h = (h ^ (unsigned char)(*c)) * 16777619u;
+            return _shards[h % NUM_SHARDS];
+        }
+
+        bool isFull( const Shard& shard, unsigned long incoming ) const
+        {
+            if ( _maxShardBytes > 0 )
+                return shard._bytes + incoming > _maxShardBytes;
+            else
+                return shard._entries.size() + 1 > _maxShardEntries;
+        }
+
+        Shard         _shards[NUM_SHARDS];
+        unsigned long _maxShardBytes;
+        unsigned      _maxShardEntries;
+        bool          _share;
+    };
 }
 
 //------------------------------------------------------------------------
 
 MemCache::MemCache( unsigned maxBinSize ) :
-_maxBinSize( std::max(maxBinSize, 1u) )
+_maxBinSize  ( std::max(maxBinSize, 1u) ),
+_maxBinBytes ( 0 ),
+_shareObjects( false )
 {
     //nop
 }
 
+CacheBin*
+MemCache::createBin( const std::string& binID ) const
+{
+    if ( _maxBinBytes > 0 || _shareObjects )
+        return new ShardedMemCacheBin( binID, _maxBinSize, _maxBinBytes, _shareObjects );
+    else
+        return new MemCacheBin( binID, _maxBinSize );
+}
+
 CacheBin*
 MemCache::addBin( const std::string& binID )
 {
-    return _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize) );
+    return _bins.getOrCreate( binID, createBin(binID) );
 }
 
 CacheBin*
@@ -128,9 +408,23 @@ MemCache::getOrCreateDefaultBin()
         // double check
         if ( !_defaultBin.valid() )
         {
-            _defaultBin = new MemCacheBin("__default", _maxBinSize);
+            _defaultBin = createBin( "__default" );
         }
     }
 
     return _defaultBin.get();
 }
+
+unsigned long long
+MemCache::getTotalBytes()
+{
+    Threading::ScopedMutexLock lock( s_totalsMutex );
+    return s_totalBytes;
+}
+
+unsigned
+MemCache::getTotalEntries()
+{
+    Threading::ScopedMutexLock lock( s_totalsMutex );
+    return s_totalEntries;
+}
@@ -117,6 +117,203 @@ namespace
             points[i].set( osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), alt );
         }
     }
+
+    // Universal Transverse Mercator, using the ellipsoidal series expansions
+    // from Snyder, "Map Projections: A Working Manual" (USGS PP 1395), pp. 61-64.
+    // The truncated series are good to about a millimeter inside the zone (3
+    // degrees either side of the central meridian) but degrade quickly past it,
+    // so we only take this route within a small margin of the zone and leave
+    // everything else to OGR.
+    const double UTM_K0              = 0.9996;
+    const double UTM_FALSE_EASTING   = 500000.0;
+    const double UTM_FALSE_NORTHING  = 10000000.0;
+    const double UTM_MAX_DLON        = 4.0;       // degrees from the central meridian
+    const double UTM_MAX_DX          = 450000.0;  // meters from the central meridian
+
+    double utmCentralMeridian( int zone )
+    {
+        return osg::DegreesToRadians( (double)(zone-1)*6.0 - 180.0 + 3.0 );
+    }
+
+    bool geographicToUTM( std::vector<osg::Vec3d>& points, const osg::EllipsoidModel* em, int zone, bool north )
+    {
+        const double a   = em->getRadiusEquator();
+        const double b   = em->getRadiusPolar();
+        const double e2  = 1.0 - (b*b)/(a*a);
+        const double e4  = e2*e2;
+        const double e6  = e4*e2;
+        const double ep2 = e2/(1.0-e2);
+        const double lon0 = utmCentralMeridian( zone );
+
+        const double m0 = 1.0 - e2/4.0 - 3.0*e4/64.0 - 5.0*e6/256.0;
+        const double m2 = 3.0*e2/8.0 + 3.0*e4/32.0 + 45.0*e6/1024.0;
+        const double m4 = 15.0*e4/256.0 + 45.0*e6/1024.0;
+        const double m6 = 35.0*e6/3072.0;
+
+        for( unsigned i=0; i<points.size(); ++i )
+        {
+            double dlon = points[i].x() - osg::RadiansToDegrees(lon0);
+            if ( dlon >  180.0 ) dlon -= 360.0;
+            if ( dlon < -180.0 ) dlon += 360.0;
+            if ( fabs(dlon) > UTM_MAX_DLON || fabs(points[i].y()) > 90.0 )
+                return false;
+        }
+
+        for( unsigned i=0; i<points.size(); ++i )
+        {
+            double lat = osg::DegreesToRadians( points[i].y() );
+            double dlon = osg::DegreesToRadians( points[i].x() ) - lon0;
+            if ( dlon >  osg::PI ) dlon -= 2.0*osg::PI;
+            if ( dlon < -osg::PI ) dlon += 2.0*osg::PI;
+
+            double sinLat = sin(lat);
+            double cosLat = cos(lat);
+            double tanLat = cosLat != 0.0 ? sinLat/cosLat : 0.0;
+
+            double N = a / sqrt(1.0 - e2*sinLat*sinLat);
+            double T = tanLat*tanLat;
+            double C = ep2*cosLat*cosLat;
+            double A = cosLat*dlon;
+            double A2 = A*A, A3 = A2*A, A4 = A3*A, A5 = A4*A, A6 = A5*A;
+
+            double M = a * (m0*lat - m2*sin(2.0*lat) + m4*sin(4.0*lat) - m6*sin(6.0*lat));
+
+            double x = UTM_K0 * N * (A + (1.0-T+C)*A3/6.0 + (5.0-18.0*T+T*T+72.0*C-58.0*ep2)*A5/120.0);
+            double y = UTM_K0 * (M + N*tanLat*(A2/2.0 + (5.0-T+9.0*C+4.0*C*C)*A4/24.0 + (61.0-58.0*T+T*T+600.0*C-330.0*ep2)*A6/720.0));
+
+            points[i].x() = x + UTM_FALSE_EASTING;
+            points[i].y() = north ? y : y + UTM_FALSE_NORTHING;
+        }
+        return true;
+    }
+
+    bool UTMToGeographic( std::vector<osg::Vec3d>& points, const osg::EllipsoidModel* em, int zone, bool north )
+    {
+        const double a   = em->getRadiusEquator();
+        const double b   = em->getRadiusPolar();
+        const double e2  = 1.0 - (b*b)/(a*a);
+        const double e4  = e2*e2;
+        const double e6  = e4*e2;
+        const double ep2 = e2/(1.0-e2);
+        const double lon0 = utmCentralMeridian( zone );
+
+        const double sqrt1me2 = sqrt(1.0-e2);
+        const double e1  = (1.0-sqrt1me2)/(1.0+sqrt1me2);
+        const double e1_2 = e1*e1, e1_3 = e1_2*e1, e1_4 = e1_3*e1;
+        const double m0 = 1.0 - e2/4.0 - 3.0*e4/64.0 - 5.0*e6/256.0;
+
+        for( unsigned i=0; i<points.size(); ++i )
+        {
+            if ( fabs(points[i].x() - UTM_FALSE_EASTING) > UTM_MAX_DX )
+                return false;
+        }
+
+        for( unsigned i=0; i<points.size(); ++i )
+        {
+            double x = points[i].x() - UTM_FALSE_EASTING;
+            double y = north ? points[i].y() : points[i].y() - UTM_FALSE_NORTHING;
+
+            double M  = y / UTM_K0;
+            double mu = M / (a*m0);
+
+            double lat1 = mu
+                + (3.0*e1/2.0 - 27.0*e1_3/32.0) * sin(2.0*mu)
+                + (21.0*e1_2/16.0 - 55.0*e1_4/32.0) * sin(4.0*mu)
+                + (151.0*e1_3/96.0) * sin(6.0*mu)
+                + (1097.0*e1_4/512.0) * sin(8.0*mu);
+
+            double sinLat1 = sin(lat1);
+            double cosLat1 = cos(lat1);
+            double tanLat1 = cosLat1 != 0.0 ? sinLat1/cosLat1 : 0.0;
+            double w  = 1.0 - e2*sinLat1*sinLat1;
+
+            double C1 = ep2*cosLat1*cosLat1;
+            double T1 = tanLat1*tanLat1;
+            double N1 = a / sqrt(w);
+            double R1 = a*(1.0-e2) / (w*sqrt(w));
+            double D  = x / (N1*UTM_K0);
+            double D2 = D*D, D3 = D2*D, D4 = D3*D, D5 = D4*D, D6 = D5*D;
+
+            double lat = lat1 - (N1*tanLat1/R1) * (
+                D2/2.0
+                - (5.0 + 3.0*T1 + 10.0*C1 - 4.0*C1*C1 - 9.0*ep2)*D4/24.0
+                + (61.0 + 90.0*T1 + 298.0*C1 + 45.0*T1*T1 - 252.0*ep2 - 3.0*C1*C1)*D6/720.0 );
+
+            double lon = cosLat1 != 0.0 ? lon0 + (
+                D
+                - (1.0 + 2.0*T1 + C1)*D3/6.0
+                + (5.0 - 2.0*C1 + 28.0*T1 - 3.0*C1*C1 + 8.0*ep2 + 24.0*T1*T1)*D5/120.0 ) / cosLat1 : lon0;
+
+            points[i].x() = osg::clampBetween( osg::RadiansToDegrees(lon), -180.0, 180.0 );
+            points[i].y() = osg::clampBetween( osg::RadiansToDegrees(lat),  -90.0,  90.0 );
+        }
+        return true;
+    }
+
+    // Unique ID for each SRS instance; used to key the per-thread transform cache.
+    // IDs are never reused, so a stale cache entry can never match a new SRS.
+    OpenThreads::Atomic s_srsUID;
+
+    // Per-thread cache of OGR coordinate transformation handles. Only the owning
+    // thread uses a cache, so OCTTransform() can run without holding the global
+    // GDAL lock; we only need the lock to create or destroy a handle.
+    struct TransformHandleCache
+    {
+        typedef std::pair<unsigned,unsigned>  Key;
+        typedef std::map<Key,void*>           HandleMap;
+        HandleMap _handles;
+
+        // Entries for SRS's that have since been destroyed linger until the
+        // cache fills up, at which point we flush everything.
+        enum { MAX_ENTRIES = 128 };
+
+        // runs when the owning thread exits.
+        ~TransformHandleCache()
+        {
+            if ( !_handles.empty() )
+            {
+                GDAL_SCOPED_LOCK;
+                clear();
+            }
+        }
+
+        void* get( const Key& key, void* fromHandle, void* toHandle )
+        {
+            HandleMap::const_iterator i = _handles.find( key );
+            if ( i != _handles.end() )
+                return i->second;
+
+            GDAL_SCOPED_LOCK;
+
+            if ( _handles.size() >= MAX_ENTRIES )
+            {
+                OE_DEBUG << LC << "flushing per-thread transform cache" << std::endl;
+                clear();
+            }
+
+            OE_DEBUG << LC << "allocating new OCT Transform" << std::endl;
+            void* handle = OCTNewCoordinateTransformation( fromHandle, toHandle );
+
+            // cache failures too, so we don't keep retrying an impossible transform.
+            _handles[key] = handle;
+            return handle;
+        }
+
+        // caller holds the GDAL lock.
+        void clear()
+        {
+            for( HandleMap::iterator h = _handles.begin(); h != _handles.end(); ++h )
+            {
+                if ( h->second )
+                    OCTDestroyCoordinateTransformation( h->second );
+            }
+            _handles.clear();
+        }
+    };
+
+    // Each thread gets its own cache on first use, found through native thread-local
+    // storage without a lock; it is destroyed, handles and all, when the thread exits.
+    Threading::ThreadLocal<TransformHandleCache> s_transformHandleCache;
 }
 
 //------------------------------------------------------------------------
@@ -393,7 +590,10 @@ _is_contiguous  ( false ),
 _is_user_defined( false ),
 _is_ltp         ( false ),
 _is_plate_carre ( false ),
-_is_spherical_mercator( false )
+_is_spherical_mercator( false ),
+_utm_zone       ( 0 ),
+_utm_north      ( true ),
+_uid            ( ++s_srsUID )
 {
     // nop
 }
@@ -405,7 +605,10 @@ _handle        ( handle ),
 _owns_handle   ( ownsHandle ),
 _is_ltp        ( false ),
 _is_plate_carre( false ),
-_is_ecef       ( false )
+_is_ecef       ( false ),
+_utm_zone      ( 0 ),
+_utm_north     ( true ),
+_uid           ( ++s_srsUID )
 {
     //nop
 }
@@ -416,11 +619,6 @@ SpatialReference::~SpatialReference()
     {
         GDAL_SCOPED_LOCK;
 
-        for (TransformHandleCache::iterator itr = _transformHandleCache.begin(); itr != _transformHandleCache.end(); ++itr)
-        {
-            OCTDestroyCoordinateTransformation(itr->second);
-        }
-
         if ( _owns_handle )
         {
             OSRDestroySpatialReference( _handle );
@@ -803,6 +1001,14 @@ SpatialReference::isSphericalMercator() const
     return _is_spherical_mercator;
 }
 
+bool
+SpatialReference::isUTM() const
+{
+    if ( !_initialized )
+        const_cast<SpatialReference*>(this)->init();
+    return _utm_zone != 0;
+}
+
 bool 
 SpatialReference::isNorthPolar() const
 {
@@ -1023,7 +1229,34 @@ SpatialReference::transform(std::vector<osg::Vec3d>& points,
         return success;
     }
 
-    else if ( isECEF() && !outputSRS->isECEF() )
+    // UTM <=> geographic on the same datum is common enough (and OGR slow enough)
+    // to warrant a native implementation. These fall through to OGR if any of
+    // the points are too far outside the zone for the series to be accurate.
+    else if ( isGeographic() && isNativeUTMPair(outputSRS, this) )
+    {
+        std::vector<osg::Vec3d> original( points );
+        transformZ( points, outputSRS, true );
+        if ( geographicToUTM(points, getEllipsoid(), outputSRS->_utm_zone, outputSRS->_utm_north) )
+        {
+            outputSRS->postTransform( points );
+            return true;
+        }
+        points.swap( original );
+    }
+
+    else if ( isUTM() && isNativeUTMPair(this, outputSRS) )
+    {
+        std::vector<osg::Vec3d> original( points );
+        if ( UTMToGeographic(points, getEllipsoid(), _utm_zone, _utm_north) )
+        {
+            transformZ( points, outputSRS, true );
+            outputSRS->postTransform( points );
+            return true;
+        }
+        points.swap( original );
+    }
+
+    if ( isECEF() && !outputSRS->isECEF() )
     {
         const SpatialReference* outputGeoSRS = outputSRS->getGeodeticSRS();
         ECEFtoGeodetic(points, outputGeoSRS->getEllipsoid());
@@ -1120,22 +1353,14 @@ SpatialReference::transformXYPointArrays(double*  x,
                                          unsigned count,
                                          const SpatialReference* out_srs) const
 {  
-    // Transform the X and Y values inside an exclusive GDAL/OGR lock
-    GDAL_SCOPED_LOCK;
+    // The handle cache belongs to this thread, so the transformation itself
+    // does not need the global GDAL/OGR lock.
+    void* xform_handle = s_transformHandleCache.get().get(
+        TransformHandleCache::Key(_uid, out_srs->_uid),
+        _handle,
+        out_srs->_handle );
 
-    void* xform_handle = NULL;
-    TransformHandleCache::const_iterator itr = _transformHandleCache.find(out_srs->getWKT());
-    if (itr != _transformHandleCache.end())
-    {
-        OE_DEBUG << "using cached transform handle" << std::endl;
-        xform_handle = itr->second;
-    }
-    else
-    {
-        OE_DEBUG << "allocating new OCT Transform" << std::endl;
-        xform_handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle);
-        const_cast<SpatialReference*>(this)->_transformHandleCache[out_srs->getWKT()] = xform_handle;
-    }
+    bool ok = xform_handle && OCTTransform( xform_handle, count, x, y, 0L ) > 0;
 
     if ( !xform_handle )
     {
@@ -1143,10 +1368,24 @@ SpatialReference::transformXYPointArrays(double*  x,
             << "SRS xform not possible" << std::endl
             << "    From => " << getName() << std::endl
             << "    To   => " << out_srs->getName() << std::endl;
-        return false;
     }
 
-    return OCTTransform( xform_handle, count, x, y, 0L ) > 0;
+    return ok;
+}
+
+
+bool
+SpatialReference::isNativeUTMPair(const SpatialReference* utm,
+                                  const SpatialReference* geo) const
+{
+    return
+        utm->isUTM()                                  &&
+        geo->isGeographic()                           &&
+        !geo->isPlateCarre()                          &&
+        utm->_ellipsoidId == geo->_ellipsoidId        &&
+        utm->_datum       == geo->_datum              &&
+        utm->getUnits()   == Units::METERS            &&
+        osg::equivalent( Units::convert(geo->getUnits(), Units::DEGREES, 1.0), 1.0 );
 }
 
 
@@ -1599,6 +1838,11 @@ SpatialReference::_init()
     // Try to extract the horizontal datum
     _datum = getOGRAttrValue( _handle, "DATUM", 0, true );
 
+    // check for UTM, which we can transform natively:
+    int north = 1;
+    _utm_zone  = _is_geographic || _is_ecef ? 0 : OSRGetUTMZone( _handle, &north );
+    _utm_north = north != 0;
+
     // Extract the base units:
     std::string units = getOGRAttrValue( _handle, "UNIT", 0, true );
     double unitMultiplier = osgEarth::as<double>( getOGRAttrValue( _handle, "UNIT", 1, true ), 1.0 );
@@ -19,6 +19,8 @@
 #include <osgEarth/TaskService>
 #include <osg/Notify>
 #include <osg/Math>
+#include <cmath>
+#include <cstdlib>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -67,7 +69,8 @@ TaskRequest::wasCanceled() const
 
 TaskRequestQueue::TaskRequestQueue() :
 osg::Referenced( true ),
-_done( false )
+_done( false ),
+_stamp( 0 )
 {
 }
 
@@ -166,9 +169,276 @@ TaskRequestQueue::setDone()
 
 //------------------------------------------------------------------------
 
+WorkStealingTaskRequestQueue::WorkStealingTaskRequestQueue() :
+TaskRequestQueue(),
+_numSlots( 0 )
+{
+    //nop
+}
+
+int
+WorkStealingTaskRequestQueue::getBucket( float priority ) const
+{
+    // Priorities in use are small floats (typically +/- LOD plus a fractional
+    // offset), so one bucket per integer step centered on zero keeps the buckets
+    // in priority order. Requests within a bucket remain sorted.
+    int b = (int)::floor(priority) + NUM_BUCKETS/2;
+    return osg::clampBetween( b, 0, (int)NUM_BUCKETS-1 );
+}
+
+void
+WorkStealingTaskRequestQueue::wake()
+{
+    // only pay for the condition mutex when someone is actually asleep.
+    if ( _sleeping > 0 )
+    {
+        ScopedLock<Mutex> lock(_sleepMutex);
+        _sleepCond.signal();
+    }
+}
+
+void
+WorkStealingTaskRequestQueue::inject( TaskRequest* request )
+{
+    Bucket& bucket = _buckets[ getBucket(request->getPriority()) ];
+    ScopedLock<Mutex> lock(bucket._mutex);
+    bucket._requests.insert( std::pair<float,TaskRequest*>(request->getPriority(), request) );
+    bucket._size = bucket._requests.size();
+}
+
+void
+WorkStealingTaskRequestQueue::add( TaskRequest* request )
+{
+    request->setState( TaskRequest::STATE_PENDING );
+
+    // install a progress callback if one isn't already installed
+    if ( !request->getProgressCallback() )
+        request->setProgressCallback( new ProgressCallback() );
+
+    // a task thread of this queue spawning work pushes onto its own deque:
+    TaskThread* thread = dynamic_cast<TaskThread*>( OpenThreads::Thread::CurrentThread() );
+    if ( thread && thread->getQueue() == this && thread->getSlot() >= 0 )
+    {
+        Slot& slot = _slots[thread->getSlot()];
+        ScopedLock<Mutex> lock(slot._mutex);
+        slot._requests.push_back( request );
+        slot._size = slot._requests.size();
+    }
+    else
+    {
+        inject( request );
+    }
+
+    ++_pending;
+    wake();
+}
+
+TaskRequest*
+WorkStealingTaskRequestQueue::popLocal( int s )
+{
+    Slot& slot = _slots[s];
+    if ( slot._size == 0 )
+        return 0L;
+
+    ScopedLock<Mutex> lock(slot._mutex);
+    if ( slot._requests.empty() )
+        return 0L;
+
+    osg::ref_ptr<TaskRequest> next = slot._requests.back();
+    slot._requests.pop_back();
+    slot._size = slot._requests.size();
+    return next.release();
+}
+
+TaskRequest*
+WorkStealingTaskRequestQueue::popInjected()
+{
+    for( int b = 0; b < NUM_BUCKETS; ++b )
+    {
+        Bucket& bucket = _buckets[b];
+        if ( bucket._size == 0 )
+            continue;
+
+        ScopedLock<Mutex> lock(bucket._mutex);
+        if ( bucket._requests.empty() )
+            continue;
+
+        osg::ref_ptr<TaskRequest> next = bucket._requests.begin()->second.get();
+        bucket._requests.erase( bucket._requests.begin() );
+        bucket._size = bucket._requests.size();
+        return next.release();
+    }
+    return 0L;
+}
+
+TaskRequest*
+WorkStealingTaskRequestQueue::steal( int thiefSlot )
+{
+    int numSlots = _numSlots;
+    if ( numSlots == 0 )
+        return 0L;
+
+    // start at a different victim for each thief to spread the contention.
+    int start = thiefSlot >= 0 ? thiefSlot+1 : 0;
+    for( int i = 0; i < numSlots; ++i )
+    {
+        int s = (start + i) % numSlots;
+        if ( s == thiefSlot )
+            continue;
+
+        Slot& victim = _slots[s];
+        if ( victim._size == 0 )
+            continue;
+
+        ScopedLock<Mutex> lock(victim._mutex);
+        if ( victim._requests.empty() )
+            continue;
+
+        // steal the oldest request, leaving the victim its most recent ones
+        osg::ref_ptr<TaskRequest> next = victim._requests.front();
+        victim._requests.pop_front();
+        victim._size = victim._requests.size();
+        return next.release();
+    }
+    return 0L;
+}
+
+TaskRequest*
+WorkStealingTaskRequestQueue::tryGet( int slot )
+{
+    TaskRequest* next = 0L;
+
+    if ( slot >= 0 )
+        next = popLocal( slot );
+
+    if ( !next )
+        next = popInjected();
+
+    if ( !next )
+        next = steal( slot );
+
+    if ( next )
+        --_pending;
+
+    return next;
+}
+
+TaskRequest*
+WorkStealingTaskRequestQueue::get()
+{
+    TaskThread* thread = dynamic_cast<TaskThread*>( OpenThreads::Thread::CurrentThread() );
+    int slot = thread && thread->getQueue() == this ? thread->getSlot() : -1;
+
+    while( !_done && !(thread && thread->getDone()) )
+    {
+        TaskRequest* next = tryGet( slot );
+        if ( next )
+            return next;
+
+        // nothing to do; go to sleep until add() wakes us up. Registering as a
+        // sleeper before re-checking the pending count guarantees that any add()
+        // that we miss here will see us and signal.
+        ScopedLock<Mutex> lock(_sleepMutex);
+        ++_sleeping;
+        if ( _pending == 0 && !_done )
+        {
+            // time out periodically so a thread that's been told to quit can exit.
+            _sleepCond.wait( &_sleepMutex, 250 );
+        }
+        --_sleeping;
+    }
+
+    return 0L;
+}
+
+void
+WorkStealingTaskRequestQueue::clear()
+{
+    for( int b = 0; b < NUM_BUCKETS; ++b )
+    {
+        ScopedLock<Mutex> lock(_buckets[b]._mutex);
+        _buckets[b]._requests.clear();
+        _buckets[b]._size = 0;
+    }
+
+    for( int s = 0; s < MAX_SLOTS; ++s )
+    {
+        ScopedLock<Mutex> lock(_slots[s]._mutex);
+        _slots[s]._requests.clear();
+        _slots[s]._size = 0;
+    }
+
+    _pending.exchange( 0 );
+}
+
+unsigned int
+WorkStealingTaskRequestQueue::getNumRequests() const
+{
+    int n = const_cast<WorkStealingTaskRequestQueue*>(this)->_pending;
+    return n > 0 ? (unsigned)n : 0u;
+}
+
+void
+WorkStealingTaskRequestQueue::setDone()
+{
+    ScopedLock<Mutex> lock(_sleepMutex);
+    _done = true;
+    _sleepCond.broadcast();
+}
+
+void
+WorkStealingTaskRequestQueue::threadStarted( TaskThread* thread )
+{
+    ScopedLock<Mutex> lock(_slotsMutex);
+
+    thread->setSlot( -1 );
+    for( int s = 0; s < MAX_SLOTS; ++s )
+    {
+        if ( !_slots[s]._inUse )
+        {
+            _slots[s]._inUse = true;
+            thread->setSlot( s );
+            if ( s >= _numSlots )
+                _numSlots = s+1;
+            break;
+        }
+    }
+}
+
+void
+WorkStealingTaskRequestQueue::threadFinished( TaskThread* thread )
+{
+    int s = thread->getSlot();
+    if ( s < 0 )
+        return;
+
+    // hand any leftover work back to the shared queue so it doesn't get stranded.
+    TaskRequestDeque leftovers;
+    {
+        ScopedLock<Mutex> lock(_slots[s]._mutex);
+        leftovers.swap( _slots[s]._requests );
+        _slots[s]._size = 0;
+    }
+
+    for( TaskRequestDeque::iterator i = leftovers.begin(); i != leftovers.end(); ++i )
+        inject( i->get() );
+
+    {
+        ScopedLock<Mutex> lock(_slotsMutex);
+        _slots[s]._inUse = false;
+        thread->setSlot( -1 );
+    }
+
+    if ( !leftovers.empty() )
+        wake();
+}
+
+//------------------------------------------------------------------------
+
 TaskThread::TaskThread( TaskRequestQueue* queue ) :
 _queue( queue ),
-_done( false )
+_done( false ),
+_slot( -1 )
 {
     //nop
 }
@@ -176,6 +446,8 @@ _done( false )
 void
 TaskThread::run()
 {
+    _queue->threadStarted( this );
+
     while( !_done )
     {
         _request = _queue->get();
@@ -216,6 +488,8 @@ TaskThread::run()
             _request = 0;
         }
     }
+
+    _queue->threadFinished( this );
 }
 
 int
@@ -240,13 +514,26 @@ TaskThread::cancel()
 
 //------------------------------------------------------------------------
 
-TaskService::TaskService( const std::string& name, int numThreads ):
+TaskService::TaskService( const std::string& name, int numThreads, Scheduler scheduler ):
 osg::Referenced( true ),
 _lastRemoveFinishedThreadsStamp(0),
 _name(name),
-_numThreads( 0 )
+_numThreads( 0 ),
+_scheduler( scheduler )
 {
-    _queue = new TaskRequestQueue();
+    if ( _scheduler == SCHEDULER_DEFAULT )
+    {
+        _scheduler = SCHEDULER_PRIORITY_QUEUE;
+        const char* env = ::getenv("OSGEARTH_TASK_SCHEDULER");
+        if ( env && std::string(env) == "work_stealing" )
+            _scheduler = SCHEDULER_WORK_STEALING;
+    }
+
+    if ( _scheduler == SCHEDULER_WORK_STEALING )
+        _queue = new WorkStealingTaskRequestQueue();
+    else
+        _queue = new TaskRequestQueue();
+
     setNumThreads( numThreads );
 }
 
@@ -353,7 +640,8 @@ TaskService::adjustThreadCount()
         }
     }  
 
-    OE_INFO << LC << "TaskService [" << _name << "] using " << _numThreads << " threads" << std::endl;
+    OE_INFO << LC << "TaskService [" << _name << "] using " << _numThreads << " threads"
+        << (_scheduler == SCHEDULER_WORK_STEALING ? " (work stealing)" : "") << std::endl;
 }
 
 void
@@ -384,7 +672,8 @@ TaskService::removeFinishedThreads()
 
 TaskServiceManager::TaskServiceManager( int numThreads ) :
 _numThreads( 0 ),
-_targetNumThreads( numThreads )
+_targetNumThreads( numThreads ),
+_scheduler( TaskService::SCHEDULER_DEFAULT )
 {
     //nop
 }
@@ -412,7 +701,7 @@ TaskServiceManager::add( UID uid, float weight )
     }
     else
     {
-        TaskService* newService = new TaskService( "", 1 );
+        TaskService* newService = new TaskService( "", 1, _scheduler );
         _services[uid] = WeightedTaskService( newService, weight );
         reallocate( _targetNumThreads );
         return newService;
@@ -19,6 +19,8 @@
 
 #include <osgEarth/Terrain>
 #include <osgEarth/DPLineSegmentIntersector>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/VerticalDatum>
 #include <osgUtil/IntersectionVisitor>
 #include <osgUtil/LineSegmentIntersector>
 #include <osgViewer/View>
@@ -87,6 +89,25 @@ Terrain::getHeight(osg::Node*              patch,
     if ( !getProfile()->getExtent().contains(x, y) )
         return 0L;
 
+    // try the live tile grids first; a patch isn't in the index.
+    if ( !patch )
+    {
+        double hae;
+        bool found;
+        {
+            Threading::ScopedReadLock sharedLock( _heightFieldsMutex );
+            found = getIndexedHeight( x, y, hae );
+        }
+        if ( found )
+        {
+            if ( out_hamsl )
+                *out_hamsl = toMSL( x, y, hae );
+            if ( out_hae )
+                *out_hae = hae;
+            return true;
+        }
+    }
+
     const osg::EllipsoidModel* em = getSRS()->getEllipsoid();
     double r = std::min( em->getRadiusEquator(), em->getRadiusPolar() );
 
@@ -141,6 +162,155 @@ Terrain::getHeight(const SpatialReference* srs,
 }
 
 
+unsigned
+Terrain::getHeights(const SpatialReference* srs,
+                    std::vector<osg::Vec3d>& points ) const
+{
+    const GeoExtent& extent = getProfile()->getExtent();
+    bool transform = srs && !srs->isHorizEquivalentTo(getSRS());
+
+    std::vector<unsigned> misses;
+    unsigned count = 0;
+
+    {
+        Threading::ScopedReadLock sharedLock( _heightFieldsMutex );
+
+        for( unsigned i=0; i<points.size(); ++i )
+        {
+            double x = points[i].x(), y = points[i].y();
+            if ( transform )
+                srs->transform2D( x, y, getSRS(), x, y );
+
+            if ( !extent.contains(x, y) )
+                continue;
+
+            double hae;
+            if ( getIndexedHeight(x, y, hae) )
+            {
+                points[i].z() = toMSL( x, y, hae );
+                ++count;
+            }
+            else
+            {
+                misses.push_back( i );
+            }
+        }
+    }
+
+    // anything the grids don't cover goes the long way:
+    for( unsigned i=0; i<misses.size(); ++i )
+    {
+        osg::Vec3d& p = points[misses[i]];
+        double hamsl;
+        if ( getHeight( srs, p.x(), p.y(), &hamsl ) )
+        {
+            p.z() = hamsl;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+
+void
+Terrain::addTileHeightField( const TileKey& key, const osg::HeightField* hf )
+{
+    if ( !hf || !key.valid() )
+        return;
+
+    unsigned lod = key.getLOD();
+
+    Threading::ScopedWriteLock exclusiveLock( _heightFieldsMutex );
+
+    osg::ref_ptr<const osg::HeightField>& entry = _heightFields[key.getPackedKey()];
+    if ( !entry.valid() )
+    {
+        if ( _heightFieldsPerLOD.size() <= lod )
+            _heightFieldsPerLOD.resize( lod+1, 0 );
+        _heightFieldsPerLOD[lod]++;
+    }
+    entry = hf;
+}
+
+
+void
+Terrain::removeTileHeightField( const TileKey& key )
+{
+    if ( !key.valid() )
+        return;
+
+    Threading::ScopedWriteLock exclusiveLock( _heightFieldsMutex );
+
+    HeightFieldIndex::iterator i = _heightFields.find( key.getPackedKey() );
+    if ( i != _heightFields.end() )
+    {
+        _heightFields.erase( i );
+        _heightFieldsPerLOD[key.getLOD()]--;
+    }
+}
+
+
+bool
+Terrain::getIndexedHeight( double x, double y, double& out_hae ) const
+{
+    const GeoExtent& extent = getProfile()->getExtent();
+
+    // highest LOD first; each LOD costs one lookup.
+    for( int lod = (int)_heightFieldsPerLOD.size()-1; lod >= 0; --lod )
+    {
+        if ( _heightFieldsPerLOD[lod] == 0 )
+            continue;
+
+        double width, height;
+        getProfile()->getTileDimensions( lod, width, height );
+
+        double fx = (x - extent.xMin()) / width;
+        double fy = (extent.yMax() - y) / height;
+
+        unsigned tilesWide, tilesHigh;
+        getProfile()->getNumTiles( lod, tilesWide, tilesHigh );
+        unsigned tx = osg::minimum( (unsigned)osg::maximum(fx, 0.0), tilesWide-1 );
+        unsigned ty = osg::minimum( (unsigned)osg::maximum(fy, 0.0), tilesHigh-1 );
+
+        HeightFieldIndex::const_iterator i = _heightFields.find( TileKey::pack(lod, tx, ty) );
+        if ( i != _heightFields.end() )
+        {
+            // grid rows run south to north.
+            double nx = osg::clampBetween( fx - (double)tx, 0.0, 1.0 );
+            double ny = osg::clampBetween( 1.0 - (fy - (double)ty), 0.0, 1.0 );
+
+            out_hae =
+                HeightFieldUtils::getHeightAtNormalizedLocation( i->second.get(), nx, ny ) *
+                _terrainOptions.verticalScale().value();
+
+            // undo HeightFieldUtils::scaleHeightFieldToDegrees.
+            if ( getSRS()->isPlateCarre() )
+                out_hae *= 111319.0;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+double
+Terrain::toMSL( double x, double y, double hae ) const
+{
+    const VerticalDatum* vdatum = getSRS()->getVerticalDatum();
+    if ( !vdatum )
+        return hae;
+
+    double lon = x, lat = y;
+    if ( !getSRS()->isGeographic() )
+        getSRS()->transform2D( x, y, getSRS()->getGeographicSRS(), lon, lat );
+
+    return vdatum->hae2msl( lat, lon, hae );
+}
+
+
 bool
 Terrain::getWorldCoordsUnderMouse(osg::View* view, float x, float y, osg::Vec3d& out_coords ) const
 {
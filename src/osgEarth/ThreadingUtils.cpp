@@ -20,9 +20,15 @@
 
 #ifdef _WIN32
     extern "C" unsigned long __stdcall GetCurrentThreadId();
+    extern "C" unsigned long __stdcall FlsAlloc(void (__stdcall *)(void*));
+    extern "C" int           __stdcall FlsFree(unsigned long);
+    extern "C" void*         __stdcall FlsGetValue(unsigned long);
+    extern "C" int           __stdcall FlsSetValue(unsigned long, void*);
+#   define FLS_OUT_OF_INDEXES 0xFFFFFFFF
 #else
 #   include <unistd.h>
 #   include <sys/syscall.h>
+#   include <pthread.h>
 #endif
 
 using namespace osgEarth::Threading;
@@ -40,3 +46,98 @@ unsigned osgEarth::Threading::getCurrentThreadId()
         return (unsigned)::syscall(SYS_gettid);
 #endif
 }
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // The native slot holds one of these, so a single exit callback can
+    // find the cleanup function that goes with the value.
+    struct SlotEntry
+    {
+        ThreadLocalSlot::Cleanup _cleanup;
+        void*                    _value;
+    };
+
+#ifdef _WIN32
+    void __stdcall cleanupSlotEntry( void* ptr )
+#else
+    void cleanupSlotEntry( void* ptr )
+#endif
+    {
+        SlotEntry* entry = static_cast<SlotEntry*>( ptr );
+        if ( entry )
+        {
+            if ( entry->_cleanup && entry->_value )
+                entry->_cleanup( entry->_value );
+            delete entry;
+        }
+    }
+}
+
+ThreadLocalSlot::ThreadLocalSlot( Cleanup cleanup ) :
+_key    ( 0 ),
+_valid  ( false ),
+_cleanup( cleanup )
+{
+#ifdef _WIN32
+    _key   = ::FlsAlloc( &cleanupSlotEntry );
+    _valid = _key != FLS_OUT_OF_INDEXES;
+#else
+    pthread_key_t key;
+    _valid = ::pthread_key_create( &key, &cleanupSlotEntry ) == 0;
+    _key   = (unsigned long)key;
+#endif
+}
+
+ThreadLocalSlot::~ThreadLocalSlot()
+{
+    // FlsFree would run the callback on every thread's value, including those
+    // of threads still running, so on Windows the index stays allocated.
+#ifndef _WIN32
+    if ( _valid )
+        ::pthread_key_delete( (pthread_key_t)_key );
+#endif
+}
+
+void*
+ThreadLocalSlot::get() const
+{
+    if ( !_valid )
+        return 0L;
+#ifdef _WIN32
+    SlotEntry* entry = static_cast<SlotEntry*>( ::FlsGetValue(_key) );
+#else
+    SlotEntry* entry = static_cast<SlotEntry*>( ::pthread_getspecific((pthread_key_t)_key) );
+#endif
+    return entry ? entry->_value : 0L;
+}
+
+bool
+ThreadLocalSlot::set( void* value )
+{
+    if ( !_valid )
+        return false;
+#ifdef _WIN32
+    SlotEntry* entry = static_cast<SlotEntry*>( ::FlsGetValue(_key) );
+#else
+    SlotEntry* entry = static_cast<SlotEntry*>( ::pthread_getspecific((pthread_key_t)_key) );
+#endif
+    if ( !entry )
+    {
+        entry = new SlotEntry();
+        entry->_cleanup = _cleanup;
+#ifdef _WIN32
+        bool ok = ::FlsSetValue( _key, entry ) != 0;
+#else
+        bool ok = ::pthread_setspecific( (pthread_key_t)_key, entry ) == 0;
+#endif
+        if ( !ok )
+        {
+            delete entry;
+            return false;
+        }
+    }
+    entry->_value = value;
+    return true;
+}
@@ -19,6 +19,9 @@
 
 #include <osgEarth/TileKey>
 #include <osgEarth/StringUtils>
+#include <osgEarth/Notify>
+
+#define LC "[TileKey] "
 
 using namespace osgEarth;
 
@@ -28,43 +31,99 @@ TileKey TileKey::INVALID( 0, 0, 0, 0L );
 
 //------------------------------------------------------------------------
 
-TileKey::TileKey( unsigned int lod, unsigned int tile_x, unsigned int tile_y, const Profile* profile)
+namespace
 {
-    _x = tile_x;
-    _y = tile_y;
-    _lod = lod;
-    _profile = profile;
+    // spreads the low 29 bits of v into the even bits of the result.
+    inline unsigned long long spreadBits( unsigned long long v )
+    {
+        v &= 0x1FFFFFFFULL;
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+        v = (v | (v <<  8)) & 0x00FF00FF00FF00FFULL;
+        v = (v | (v <<  4)) & 0x0F0F0F0F0F0F0F0FULL;
+        v = (v | (v <<  2)) & 0x3333333333333333ULL;
+        v = (v | (v <<  1)) & 0x5555555555555555ULL;
+        return v;
+    }
+}
+
+//------------------------------------------------------------------------
+
+TileKey::TileKey( unsigned int lod, unsigned int tile_x, unsigned int tile_y, const Profile* profile) :
+_packed ( pack(lod, tile_x, tile_y) ),
+_profile( profile )
+{
+    // packing would alias an out-of-range key onto some other tile.
+    if ( _profile.valid() && !isPackable(lod, tile_x, tile_y) )
+    {
+        OE_WARN << LC << "Tile key " << lod << "/" << tile_x << "/" << tile_y
+            << " is beyond the supported range; using an invalid key" << std::endl;
+        _packed  = 0;
+        _profile = 0L;
+    }
 
     double width, height;
     if ( _profile.valid() )
     {
         _profile->getTileDimensions(lod, width, height);
 
-        double xmin = _profile->getExtent().xMin() + (width * (double)_x);
-        double ymax = _profile->getExtent().yMax() - (height * (double)_y);
+        double xmin = _profile->getExtent().xMin() + (width * (double)tile_x);
+        double ymax = _profile->getExtent().yMax() - (height * (double)tile_y);
         double xmax = xmin + width;
         double ymin = ymax - height;
 
         _extent = GeoExtent( _profile->getSRS(), xmin, ymin, xmax, ymax );
-
-        _key = Stringify() << _lod << "/" << _x << "/" << _y;
     }
     else
     {
         _extent = GeoExtent::INVALID;
-        _key = "invalid";
     }
 }
 
-TileKey::TileKey( const TileKey& rhs ) :
-_key( rhs._key ),
-_lod(rhs._lod),
-_x(rhs._x),
-_y(rhs._y),
-_profile( rhs._profile.get() ),
-_extent( rhs._extent )
+std::string
+TileKey::str() const
+{
+    if ( !valid() )
+        return "invalid";
+
+    return Stringify() << getLevelOfDetail() << "/" << getTileX() << "/" << getTileY();
+}
+
+unsigned long long
+TileKey::getMortonCode() const
 {
-    //NOP
+    return
+        (_packed & ((unsigned long long)0x3F << LOD_SHIFT)) |
+        (spreadBits(getTileY()) << 1) |
+        spreadBits(getTileX());
+}
+
+std::string
+TileKey::getQuadKey() const
+{
+    if ( !valid() )
+        return "";
+
+    unsigned lod = getLevelOfDetail();
+    unsigned x   = getTileX();
+    unsigned y   = getTileY();
+
+    std::string quadkey;
+
+    unsigned rootsX, rootsY;
+    _profile->getNumTiles( 0, rootsX, rootsY );
+    if ( rootsX > 1 || rootsY > 1 )
+    {
+        quadkey = Stringify() << (x >> lod) << "_" << (y >> lod) << ":";
+    }
+
+    quadkey.reserve( quadkey.size() + lod );
+    for( int i = (int)lod-1; i >= 0; --i )
+    {
+        char digit = '0' + (char)( ((x >> i) & 1) + (((y >> i) & 1) << 1) );
+        quadkey.push_back( digit );
+    }
+
+    return quadkey;
 }
 
 const Profile*
@@ -77,8 +136,8 @@ void
 TileKey::getTileXY(unsigned int& out_tile_x,
                    unsigned int& out_tile_y) const
 {
-    out_tile_x = _x;
-    out_tile_y = _y;
+    out_tile_x = getTileX();
+    out_tile_y = getTileY();
 }
 
 osgTerrain::TileID
@@ -86,7 +145,7 @@ TileKey::getTileId() const
 {
     //TODO: will this be an issue with multi-face? perhaps not since each face will
     // exist within its own scene graph.. ?
-    return osgTerrain::TileID(_lod, _x, _y);
+    return osgTerrain::TileID(getLevelOfDetail(), getTileX(), getTileY());
 }
 
 void
@@ -96,8 +155,8 @@ TileKey::getPixelExtents(unsigned int& xmin,
                          unsigned int& ymax,
                          const unsigned int &tile_size) const
 {
-    xmin = _x * tile_size;
-    ymin = _y * tile_size;
+    xmin = getTileX() * tile_size;
+    ymin = getTileY() * tile_size;
     xmax = xmin + tile_size;
     ymax = ymin + tile_size; 
 }
@@ -105,9 +164,9 @@ TileKey::getPixelExtents(unsigned int& xmin,
 TileKey
 TileKey::createChildKey( unsigned int quadrant ) const
 {
-    unsigned int lod = _lod + 1;
-    unsigned int x = _x * 2;
-    unsigned int y = _y * 2;
+    unsigned int lod = getLevelOfDetail() + 1;
+    unsigned int x = getTileX() * 2;
+    unsigned int y = getTileY() * 2;
 
     if (quadrant == 1)
     {
@@ -129,25 +188,23 @@ TileKey::createChildKey( unsigned int quadrant ) const
 TileKey
 TileKey::createParentKey() const
 {
-    if (_lod == 0) return TileKey::INVALID;
+    unsigned int lod = getLevelOfDetail();
+    if (lod == 0) return TileKey::INVALID;
 
-    unsigned int lod = _lod - 1;
-    unsigned int x = _x / 2;
-    unsigned int y = _y / 2;
+    unsigned int x = getTileX() / 2;
+    unsigned int y = getTileY() / 2;
+    --lod;
     return TileKey( lod, x, y, _profile.get());
 }
 
 TileKey
 TileKey::createAncestorKey( int ancestorLod ) const
 {
-    if ( ancestorLod > (int)_lod ) return TileKey::INVALID;
+    int lod = (int)getLevelOfDetail();
+    if ( ancestorLod > lod ) return TileKey::INVALID;
 
-    unsigned int x = _x, y = _y;
-    for( int i=_lod; i > ancestorLod; i-- )
-    {
-        x /= 2;
-        y /= 2;
-    }
+    unsigned int x = getTileX() >> (lod - ancestorLod);
+    unsigned int y = getTileY() >> (lod - ancestorLod);
     return TileKey( ancestorLod, x, y, _profile.get() );
 }
 
@@ -155,15 +212,16 @@ TileKey
 TileKey::createNeighborKey( int xoffset, int yoffset ) const
 {
     unsigned tx, ty;
-    getProfile()->getNumTiles( _lod, tx, ty );
+    unsigned lod = getLevelOfDetail();
+    getProfile()->getNumTiles( lod, tx, ty );
 
-    int sx = (int)_x + xoffset;
+    int sx = (int)getTileX() + xoffset;
     unsigned x =
         sx < 0        ? (unsigned)((int)tx + sx) :
         sx >= (int)tx ? (unsigned)sx - tx :
         (unsigned)sx;
 
-    int sy = (int)_y + yoffset;
+    int sy = (int)getTileY() + yoffset;
     unsigned y =
         sy < 0        ? (unsigned)((int)ty + sy) :
         sy >= (int)ty ? (unsigned)sy - ty :
@@ -171,5 +229,5 @@ TileKey::createNeighborKey( int xoffset, int yoffset ) const
 
     //OE_NOTICE << "Returning neighbor " << x << ", " << y << " for tile " << str() << " offset=" << xoffset << ", " << yoffset << std::endl;
 
-    return TileKey( _lod, x, y, _profile.get() );
+    return TileKey( lod, x, y, _profile.get() );
 }
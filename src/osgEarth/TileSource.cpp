@@ -150,6 +150,8 @@ _noDataValue          ( (float)SHRT_MIN ),
 _noDataMinValue       ( -32000.0f ),
 _noDataMaxValue       (  32000.0f ),
 _L2CacheSize          ( 16 ),
+_L2CacheMaxBytes      ( 0 ),
+_L2CacheShared        ( false ),
 _bilinearReprojection ( true )
 { 
     fromConfig( _conf );
@@ -166,6 +168,8 @@ TileSourceOptions::getConfig() const
     conf.updateIfSet( "nodata_max", _noDataMaxValue );
     conf.updateIfSet( "blacklist_filename", _blacklistFilename);
     conf.updateIfSet( "l2_cache_size", _L2CacheSize );
+    conf.updateIfSet( "l2_cache_max_bytes", _L2CacheMaxBytes );
+    conf.updateIfSet( "l2_cache_shared", _L2CacheShared );
     conf.updateIfSet( "bilinear_reprojection", _bilinearReprojection );
     conf.updateObjIfSet( "profile", _profileOptions );
     return conf;
@@ -189,6 +193,8 @@ TileSourceOptions::fromConfig( const Config& conf )
     conf.getIfSet( "nodata_max", _noDataMaxValue );
     conf.getIfSet( "blacklist_filename", _blacklistFilename);
     conf.getIfSet( "l2_cache_size", _L2CacheSize );
+    conf.getIfSet( "l2_cache_max_bytes", _L2CacheMaxBytes );
+    conf.getIfSet( "l2_cache_shared", _L2CacheShared );
     conf.getIfSet( "bilinear_reprojection", _bilinearReprojection );
     conf.getObjIfSet( "profile", _profileOptions );
 
@@ -222,6 +228,8 @@ _status ( Status::Error("Not initialized") )
     if ( *options.L2CacheSize() > 0 )
     {
         _memCache = new MemCache( *options.L2CacheSize() );
+        _memCache->setMaxBinBytes( *options.L2CacheMaxBytes() );
+        _memCache->setShareObjects( *options.L2CacheShared() );
     }
     else
     {
@@ -326,6 +334,10 @@ TileSource::createImage(const TileKey&        key,
 
     if ( newImage.valid() && _memCache.valid() )
     {
+        // normalize before caching; a shared L2 cache hands this very image
+        // to every later caller, who must not have to modify it.
+        ImageUtils::normalizeImage( newImage.get() );
+
         // cache it to the memory cache.
         _memCache->getOrCreateDefaultBin()->write( key.str(), newImage.get() );
     }
@@ -359,6 +371,10 @@ TileSource::createHeightField(const TileKey&        key,
         _memCache->getOrCreateDefaultBin()->write( key.str(), newHF.get() );
     }
 
+    // a shared L2 cache hands out the cached object itself, so no copy is needed.
+    if ( _memCache.valid() && _memCache->getShareObjects() )
+        return newHF.release();
+
     //TODO: why not just newHF.release()? -gw
     return newHF.valid() ? new osg::HeightField( *newHF.get() ) : 0L;
 }
@@ -21,12 +21,17 @@
 #include <osgEarth/CacheBin>
 #include <osgEarth/HTTPClient>
 #include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/ReaderWriter>
 #include <osgDB/Archive>
 #include <fstream>
 #include <sstream>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 
 #define LC "[URI] "
 
@@ -271,6 +276,100 @@ namespace
     }
 
 
+    //--------------------------------------------------------------------
+    // HTTP cache freshness, from the response headers stored with each
+    // cache entry (see RFC 2616 section 13).
+
+    // parses an RFC 1123 date ("Sun, 06 Nov 1994 08:49:37 GMT") into
+    // seconds since the epoch.
+    bool parseHTTPDate( const std::string& input, double& out_time )
+    {
+        static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+        char mon[4] = { 0 };
+        int  day, year, h, m, s;
+        if ( ::sscanf(input.c_str(), "%*3s, %d %3s %d %d:%d:%d", &day, mon, &year, &h, &m, &s) != 6 )
+            return false;
+
+        const char* p = ::strlen(mon) == 3 ? ::strstr(months, mon) : 0L;
+        if ( !p || (p - months) % 3 != 0 )
+            return false;
+        int month = (int)(p - months) / 3 + 1;
+
+        // days since 1970-01-01 in the proleptic Gregorian calendar:
+        int y   = month <= 2 ? year - 1 : year;
+        int era = (y >= 0 ? y : y - 399) / 400;
+        int yoe = y - era * 400;
+        int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        double days = (double)era * 146097.0 + (double)doe - 719468.0;
+
+        out_time = days * 86400.0 + h * 3600.0 + m * 60.0 + s;
+        return true;
+    }
+
+    // how long (in seconds) a response stays fresh once cached; the cache
+    // policy's max age caps whatever the server says.
+    double getFreshnessLifetime( const Config& meta, double maxAge )
+    {
+        std::string cc = toLower( meta.value(IOMetadata::CACHE_CONTROL) );
+        if ( cc.find("no-cache") != std::string::npos || cc.find("no-store") != std::string::npos )
+            return 0.0;
+
+        std::string::size_type pos = cc.find( "max-age=" );
+        if ( pos != std::string::npos )
+            return osg::clampBetween( as<double>(cc.substr(pos+8), 0.0), 0.0, maxAge );
+
+        if ( meta.hasValue(IOMetadata::EXPIRES) )
+        {
+            // an Expires header we can't parse (like "0") means "already expired".
+            double expires, date;
+            if ( !parseHTTPDate(meta.value(IOMetadata::EXPIRES), expires) ||
+                 !parseHTTPDate(meta.value(IOMetadata::DATE), date) )
+                return 0.0;
+            return osg::clampBetween( expires - date, 0.0, maxAge );
+        }
+
+        return maxAge;
+    }
+
+    // whether a cache entry can be used without asking the server.
+    bool isFresh( const Config& meta, double maxAge, double now )
+    {
+        // entries cached before we kept the time have no known age.
+        if ( !meta.hasValue(IOMetadata::CACHE_TIME) )
+            return maxAge == DBL_MAX;
+
+        double cacheTime = meta.value<double>( IOMetadata::CACHE_TIME, 0.0 );
+        return now - cacheTime < getFreshnessLifetime( meta, maxAge );
+    }
+
+    // whether the server allows the response to be cached at all.
+    bool isStorable( const Config& meta )
+    {
+        return toLower( meta.value(IOMetadata::CACHE_CONTROL) ).find("no-store") == std::string::npos;
+    }
+
+    // turns a stale entry's validators into a conditional request.
+    void addValidators( HTTPRequest& request, const Config& meta )
+    {
+        if ( meta.hasValue(IOMetadata::ETAG) )
+            request.addHeader( "If-None-Match", meta.value(IOMetadata::ETAG) );
+        if ( meta.hasValue(IOMetadata::LAST_MODIFIED) )
+            request.addHeader( "If-Modified-Since", meta.value(IOMetadata::LAST_MODIFIED) );
+    }
+
+    // metadata for an entry the server just revalidated: the 304's headers
+    // replace the stored ones, and the entry's age starts over.
+    Config refreshMetadata( const Config& staleMeta, const Config& newMeta, double now )
+    {
+        Config meta = staleMeta;
+        for( ConfigSet::const_iterator i = newMeta.children().begin(); i != newMeta.children().end(); ++i )
+            meta.set( i->key(), i->value() );
+        meta.set( IOMetadata::CACHE_TIME, (long long)now );
+        return meta;
+    }
+
     //--------------------------------------------------------------------
     // Read functors (used by the doRead method)
 
@@ -279,7 +378,7 @@ namespace
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_OBJECTS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readObject(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key, double maxAge ) { return bin->readObject(key, maxAge); }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readObject(uri, opt, p); }
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readObject(req, opt, p); }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return ReadResult(osgDB::readObjectFile(uri, opt)); }
     };
 
@@ -288,7 +387,7 @@ namespace
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_NODES) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readNode(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key, double maxAge ) { return bin->readObject(key, maxAge); }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readNode(uri, opt, p); }
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readNode(req, opt, p); }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return ReadResult(osgDB::readNodeFile(uri, opt)); }
     };
 
@@ -307,9 +406,9 @@ namespace
             if ( r.getImage() ) r.getImage()->setFileName( key );
             return r;
         }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p ) { 
-            ReadResult r = HTTPClient::readImage(uri, opt, p);
-            if ( r.getImage() ) r.getImage()->setFileName( uri );
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { 
+            ReadResult r = HTTPClient::readImage(req, opt, p);
+            if ( r.getImage() ) r.getImage()->setFileName( req.getURL() );
             return r;
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { 
@@ -324,7 +423,7 @@ namespace
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_STRINGS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readString(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key, double maxAge ) { return bin->readString(key, maxAge); }
-        ReadResult fromHTTP( const std::string& uri, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readString(uri, opt, p); }
+        ReadResult fromHTTP( const HTTPRequest& req, const osgDB::Options* opt, ProgressCallback* p ) { return HTTPClient::readString(req, opt, p); }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) { return readStringFile(uri, opt); }
     };
 
@@ -414,12 +513,23 @@ namespace
                         bin = s_getCacheBin( dbOptions );
                     }
 
-                    // first try to go to the cache if there is one:
+                    // first try to go to the cache if there is one. Freshness comes from
+                    // the HTTP headers stored with the entry; a stale entry is kept so we
+                    // can revalidate it instead of downloading it again.
+                    ReadResult stale;
+                    double     now = (double)::time(0L);
                     if ( bin && cp->isCacheReadable() )
                     {
-                        result = reader.fromCache( bin, uri.cacheKey(), *cp->maxAge() );
+                        result = reader.fromCache( bin, uri.cacheKey(), DBL_MAX );
                         if ( result.succeeded() )
+                        {
                             result.setIsFromCache(true);
+                            if ( !isFresh(result.metadata(), *cp->maxAge(), now) )
+                            {
+                                stale  = result;
+                                result = ReadResult();
+                            }
+                        }
                     }
 
                     // not in the cache, so proceed to read it from the network.
@@ -440,15 +550,46 @@ namespace
                         if ( !gotResultFromCallback )
                         {
                             // still no data, go to the source:
+                            bool fetched = false;
                             if ( result.empty() && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
                             {
-                                result = reader.fromHTTP( uri.full(), localOptions, progress );
+                                HTTPRequest request( uri.full() );
+                                if ( !stale.empty() )
+                                    addValidators( request, stale.metadata() );
+
+                                result  = reader.fromHTTP( request, localOptions, progress );
+                                fetched = true;
+                            }
+
+                            if ( result.code() == ReadResult::RESULT_NOT_MODIFIED && !stale.empty() )
+                            {
+                                // the cached copy is still good; update its headers and age
+                                // without rewriting the data if the bin can do that.
+                                Config meta = refreshMetadata( stale.metadata(), result.metadata(), now );
+                                if ( bin && cp->isCacheWriteable() && !bin->touch(uri.cacheKey(), meta) )
+                                {
+                                    bin->write( uri.cacheKey(), stale.getObject(), meta );
+                                }
+                                result = stale;
                             }
 
                             // write the result to the cache if possible:
-                            if ( result.succeeded() && bin && cp->isCacheWriteable() )
+                            else if ( result.succeeded() )
+                            {
+                                if ( bin && cp->isCacheWriteable() && isStorable(result.metadata()) )
+                                {
+                                    Config meta = result.metadata();
+                                    meta.set( IOMetadata::CACHE_TIME, (long long)now );
+                                    bin->write( uri.cacheKey(), result.getObject(), meta );
+                                }
+                            }
+
+                            // offline, or the server failed: a stale copy beats nothing.
+                            else if ( !stale.empty() &&
+                                      (!fetched || (result.code() != ReadResult::RESULT_CANCELED &&
+                                                    result.code() != ReadResult::RESULT_NOT_FOUND)) )
                             {
-                                bin->write( uri.cacheKey(), result.getObject(), result.metadata() );
+                                result = stale;
                             }
                         }
                     }
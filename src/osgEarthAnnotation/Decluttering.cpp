@@ -88,6 +88,138 @@ namespace
     
     typedef std::pair<const osg::Node*, osg::BoundingBox> RenderLeafBox;
 
+    // Uniform screen-space grid of the boxes placed so far in a pass. Each box is
+    // listed in every cell it touches, so testing a new box only visits the boxes
+    // in the cells it covers instead of every box placed so far. Boxes off the
+    // viewport go in the edge cells. The cell lists keep their storage from one
+    // pass to the next, and only the cells used in a pass get cleared.
+    class DeclutterGrid
+    {
+    public:
+        DeclutterGrid() : _x0(0.0f), _y0(0.0f), _cols(0), _rows(0) { }
+
+        // size (pixels) of a grid cell.
+        enum { CELL_SIZE = 64 };
+
+        /** Empties the grid and fits it to the viewport. */
+        void reset( const osg::Viewport* vp )
+        {
+            for( std::vector<unsigned>::const_iterator i = _usedCells.begin(); i != _usedCells.end(); ++i )
+                _cells[*i].clear();
+            _usedCells.clear();
+            _boxes.clear();
+
+            _x0   = vp->x();
+            _y0   = vp->y();
+            _cols = osg::maximum( 1u, (unsigned)ceil(vp->width() / CELL_SIZE) );
+            _rows = osg::maximum( 1u, (unsigned)ceil(vp->height() / CELL_SIZE) );
+            if ( _cells.size() < _cols*_rows )
+                _cells.resize( _cols*_rows );
+        }
+
+        /**
+         * Whether the box is clear of all boxes in the grid, except for boxes
+         * with the same parent (which are allowed to overlap).
+         */
+        bool isClear( const osg::BoundingBox& box, const osg::Node* parent ) const
+        {
+            unsigned c0, c1, r0, r1;
+            if ( !getCellRange(box, c0, c1, r0, r1) )
+            {
+                // can't place it in the grid; test the slow way.
+                for( std::vector<RenderLeafBox>::const_iterator j = _boxes.begin(); j != _boxes.end(); ++j )
+                    if ( overlaps(box, j->second) && parent != j->first )
+                        return false;
+                return true;
+            }
+
+            for( unsigned r = r0; r <= r1; ++r )
+            {
+                for( unsigned c = c0; c <= c1; ++c )
+                {
+                    const std::vector<unsigned>& cell = _cells[r*_cols + c];
+                    for( std::vector<unsigned>::const_iterator j = cell.begin(); j != cell.end(); ++j )
+                    {
+                        const RenderLeafBox& used = _boxes[*j];
+                        if ( overlaps(box, used.second) && parent != used.first )
+                            return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        /** Adds a box to the grid. */
+        void insert( const osg::BoundingBox& box, const osg::Node* parent )
+        {
+            unsigned index = _boxes.size();
+            _boxes.push_back( std::make_pair(parent, box) );
+
+            unsigned c0, c1, r0, r1;
+            if ( !getCellRange(box, c0, c1, r0, r1) )
+            {
+                // a box that can't be placed still has to block everything
+                // (it would in a brute-force test), so list it everywhere.
+                c0 = 0; c1 = _cols-1; r0 = 0; r1 = _rows-1;
+            }
+
+            for( unsigned r = r0; r <= r1; ++r )
+            {
+                for( unsigned c = c0; c <= c1; ++c )
+                {
+                    std::vector<unsigned>& cell = _cells[r*_cols + c];
+                    if ( cell.empty() )
+                        _usedCells.push_back( r*_cols + c );
+                    cell.push_back( index );
+                }
+            }
+        }
+
+    private:
+        // 2D test only, since we're in window space. Touching boxes overlap.
+        static bool overlaps( const osg::BoundingBox& a, const osg::BoundingBox& b )
+        {
+            return !(
+                a.xMin() > b.xMax() ||
+                a.xMax() < b.xMin() ||
+                a.yMin() > b.yMax() ||
+                a.yMax() < b.yMin() );
+        }
+
+        // Range of cells a box covers; false if the box has NaN coordinates.
+        // An inverted box (min > max) covers no cells, and never overlaps
+        // anything, as in the direct test.
+        bool getCellRange( const osg::BoundingBox& box, unsigned& c0, unsigned& c1, unsigned& r0, unsigned& r1 ) const
+        {
+            if ( osg::isNaN(box.xMin()) || osg::isNaN(box.xMax()) || osg::isNaN(box.yMin()) || osg::isNaN(box.yMax()) )
+                return false;
+
+            c0 = toCell( box.xMin(), _x0, _cols );
+            c1 = toCell( box.xMax(), _x0, _cols );
+            r0 = toCell( box.yMin(), _y0, _rows );
+            r1 = toCell( box.yMax(), _y0, _rows );
+
+            if ( box.xMin() > box.xMax() || box.yMin() > box.yMax() )
+            {
+                c0 = 1; c1 = 0;
+            }
+            return true;
+        }
+
+        // clamping keeps the mapping monotonic, so overlapping boxes always share a cell.
+        static unsigned toCell( float v, float origin, unsigned count )
+        {
+            double cell = floor( ((double)v - origin) / CELL_SIZE );
+            return (unsigned)osg::clampBetween( cell, 0.0, (double)(count-1) );
+        }
+
+        float                                _x0, _y0;
+        unsigned                             _cols, _rows;
+        std::vector<RenderLeafBox>           _boxes;
+        std::vector< std::vector<unsigned> > _cells;
+        std::vector<unsigned>                _usedCells;
+    };
+
     // Data structure stored one-per-View.
     struct PerViewInfo
     {
@@ -99,7 +231,7 @@ namespace
         // re-usable structures (to avoid unnecessary re-allocation)
         osgUtil::RenderBin::RenderLeafList _passed;
         osgUtil::RenderBin::RenderLeafList _failed;
-        std::vector<RenderLeafBox>         _used;
+        DeclutterGrid                      _used;
 
         // time stamp of the previous pass, for calculating animation speed
         double _lastTimeStamp;
@@ -217,12 +349,13 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
         // Reset the local re-usable containers
         local._passed.clear();          // drawables that pass occlusion test
         local._failed.clear();          // drawables that fail occlusion test
-        local._used.clear();            // list of occupied bounding boxes in screen space
 
         // compute a window matrix so we can do window-space culling:
         const osg::Viewport* vp = cam->getViewport();
         osg::Matrix windowMatrix = vp->computeWindowMatrix();
 
+        local._used.reset( vp );        // occupied bounding boxes in screen space
+
         // Track the parent nodes of drawables that are obscured (and culled). Drawables
         // with the same parent node (typically a Geode) are considered to be grouped and
         // will be culled as a group.
@@ -267,26 +400,9 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
                 }
                 else
                 {
-                    // weed out any drawables that are obscured by closer drawables.
-                    // TODO: think about a more efficient algorithm - right now we are just using
-                    // brute force to compare all bbox's
-                    for( std::vector<RenderLeafBox>::const_iterator j = local._used.begin(); j != local._used.end(); ++j )
-                    {
-                        // only need a 2D test since we're in clip space
-                        bool isClear =
-                            box.xMin() > j->second.xMax() ||
-                            box.xMax() < j->second.xMin() ||
-                            box.yMin() > j->second.yMax() ||
-                            box.yMax() < j->second.yMin();
-
-                        // if there's an overlap (and the conflict isn't from the same drawable
-                        // parent, which is acceptable), then the leaf is culled.
-                        if ( !isClear && drawableParent != j->first )
-                        {
-                            visible = false;
-                            break;
-                        }
-                    }
+                    // weed out any drawables that are obscured by closer drawables. An overlap
+                    // with a drawable of the same parent is acceptable.
+                    visible = local._used.isClear( box, drawableParent );
                 }
             }
 
@@ -294,7 +410,7 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
             {
                 // passed the test, so add the leaf's bbox to the "used" list, and add the leaf
                 // to the final draw list.
-                local._used.push_back( std::make_pair(drawableParent, box) );
+                local._used.insert( box, drawableParent );
                 local._passed.push_back( leaf );
             }
 
@@ -25,7 +25,15 @@
 #include <osgEarth/Registry>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <osg/Timer>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Condition>
+#include <OpenThreads/Atomic>
 #include <fstream>
+#include <sstream>
+#include <deque>
+#include <map>
+#include <string.h>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
@@ -33,11 +41,20 @@ using namespace osgEarth::Threading;
 
 #ifndef _WIN32
 #   include <unistd.h>
+#else
+#   include <process.h>
 #endif
 
+#undef  LC
+#define LC "[FileSystemCache] "
+
 namespace
 {
-    /** 
+    class WriteQueue;
+    class BinState;
+    struct EntryBuffer;
+
+    /**
      * Cache that stores data in the local file system.
      */
     class FileSystemCache : public Cache
@@ -49,7 +66,7 @@ namespace
 
         /**
          * Constructs a new file system cache.
-         * @param options Options structure that comes from a serialized description of 
+         * @param options Options structure that comes from a serialized description of
          *        the object.
          */
         FileSystemCache( const CacheOptions& options );
@@ -64,17 +81,23 @@ namespace
 
         void init();
 
-        std::string            _rootPath;
+        std::string                _rootPath;
+        osg::ref_ptr<WriteQueue>   _writeQueue;
     };
 
-    /** 
+    /**
      * Cache bin implementation for a FileSystemCache.
      * You don't need to create this object directly; use FileSystemCache::createBin instead.
+     *
+     * Each entry is one file holding the metadata and the serialized object.
+     * Files are written to a temporary name and renamed into place, so
+     * readers never see a partial entry and don't need a lock. touch()
+     * updates the metadata in place, in a slot reserved in the header.
     */
     class FileSystemCacheBin : public CacheBin
     {
     public:
-        FileSystemCacheBin( const std::string& name, const std::string& rootPath );
+        FileSystemCacheBin( const std::string& name, const std::string& rootPath, WriteQueue* writeQueue );
 
     public: // CacheBin interface
 
@@ -88,6 +111,8 @@ namespace
 
         bool write( const std::string& key, const osg::Object* object, const Config& meta );
 
+        bool touch( const std::string& key, const Config& meta );
+
         bool isCached( const std::string& key, double maxAge =DBL_MAX );
 
         bool purge();
@@ -96,27 +121,340 @@ namespace
 
         bool writeMetadata( const Config& meta );
 
+        Config getStats();
+
     protected:
+        enum ObjectType { TYPE_OBJECT, TYPE_IMAGE, TYPE_NODE };
+
+        ReadResult read( const std::string& key, ObjectType type );
+
         bool purgeDirectory( const std::string& dir );
 
+        bool store( const std::string& path, EntryBuffer* entry );
+
         bool                              _ok;
         std::string                       _metaPath;
         osg::ref_ptr<osgDB::ReaderWriter> _rw;
         osg::ref_ptr<osgDB::Options>      _rwOptions;
-        Threading::ReadWriteMutex         _rwmutex;
+        osg::ref_ptr<WriteQueue>          _writeQueue;
+        osg::ref_ptr<BinState>            _state;
+    };
+
+    //------------------------------------------------------------------------
+
+    // header of an entry file; followed by the metadata length and the size of
+    // the metadata slot (4 bytes each, little-endian), the slot holding the
+    // metadata JSON padded with spaces, and the osgb data. The slot leaves room
+    // for touch() to rewrite the metadata in place.
+    const char     ENTRY_MAGIC[8] = { 'O','E','C','A','C','H','E','2' };
+    const unsigned ENTRY_HEADER_SIZE = 16;
+
+    void appendUInt32( std::string& out, unsigned value )
+    {
+        out.push_back( (char)(value & 0xFF) );
+        out.push_back( (char)((value >> 8) & 0xFF) );
+        out.push_back( (char)((value >> 16) & 0xFF) );
+        out.push_back( (char)((value >> 24) & 0xFF) );
+    }
+
+    unsigned parseUInt32( const char* in )
+    {
+        const unsigned char* p = (const unsigned char*)in;
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+    }
+
+    /** Encodes the part of the header after the magic: lengths and the metadata slot. */
+    std::string encodeMetadataSlot( const std::string& metaJSON, unsigned slotSize )
+    {
+        std::string out;
+        out.reserve( 8 + slotSize );
+        appendUInt32( out, metaJSON.size() );
+        appendUInt32( out, slotSize );
+        out.append( metaJSON );
+        out.append( slotSize - metaJSON.size(), ' ' );
+        return out;
+    }
+
+    /** Writes the header of an entry file: magic, lengths, metadata slot. */
+    void writeEntryHeader( std::ostream& out, const Config& meta )
+    {
+        std::string metaJSON = meta.empty() ? std::string() : meta.toJSON();
+
+        // room for refreshed headers to grow, rounded up to 256 bytes.
+        unsigned slotSize = ((metaJSON.size() + 128 + 255) / 256) * 256;
+
+        std::string slot = encodeMetadataSlot( metaJSON, slotSize );
+        out.write( ENTRY_MAGIC, 8 );
+        out.write( slot.data(), slot.size() );
+    }
+
+    /** Serialized entry, shared by the write queue and the pending table. */
+    struct EntryBuffer : public osg::Referenced
+    {
+        std::string _data;
+    };
+
+    /**
+     * Per-bin state that the writer thread touches: entries not yet on
+     * disk (so reads see them right away) and write statistics.
+     */
+    class BinState : public osg::Referenced
+    {
+    public:
+        BinState() : _numWrites(0), _numFailures(0), _totalLatency(0.0), _maxLatency(0.0), _totalDiskTime(0.0) { }
+
+        typedef std::map< std::string, osg::ref_ptr<EntryBuffer> > PendingTable;
+
+        Threading::Mutex _mutex;
+        PendingTable     _pending;
+        unsigned         _numWrites;
+        unsigned         _numFailures;
+        double           _totalLatency;
+        double           _maxLatency;
+        double           _totalDiskTime;
+    };
+
+    // makes temporary file names unique within the process.
+    OpenThreads::Atomic s_tempCounter;
+
+    /** Writes a buffer to a temporary file and renames it into place. */
+    bool writeFileAtomic( const std::string& path, const std::string& data )
+    {
+#ifdef _WIN32
+        int pid = ::_getpid();
+#else
+        int pid = ::getpid();
+#endif
+        std::string tempPath = Stringify() << path << "." << pid << "_" << (++s_tempCounter) << ".tmp";
+
+        {
+            std::ofstream out( tempPath.c_str(), std::ios::out | std::ios::binary );
+            if ( !out.is_open() )
+            {
+                // the folder may not exist yet.
+                osgDB::makeDirectoryForFile( path );
+                out.open( tempPath.c_str(), std::ios::out | std::ios::binary );
+                if ( !out.is_open() )
+                    return false;
+            }
+            out.write( data.c_str(), data.size() );
+            out.close();
+            if ( out.fail() )
+            {
+                ::remove( tempPath.c_str() );
+                return false;
+            }
+        }
+
+#ifdef _WIN32
+        // rename() won't replace an existing file on Windows.
+        ::remove( path.c_str() );
+#endif
+        if ( ::rename( tempPath.c_str(), path.c_str() ) != 0 )
+        {
+            ::remove( tempPath.c_str() );
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Read-only stream buffer over an entry still in memory, so it can be
+     * deserialized without copying it.
+     */
+    class EntryStreamBuffer : public std::streambuf
+    {
+    public:
+        EntryStreamBuffer( const EntryBuffer* entry )
+        {
+            char* p = entry ? const_cast<char*>( entry->_data.data() ) : 0L;
+            setg( p, p, entry ? p + entry->_data.size() : p );
+        }
+
+    protected:
+        pos_type seekoff( off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which )
+        {
+            char* target =
+                dir == std::ios_base::beg ? eback() + off :
+                dir == std::ios_base::cur ? gptr()  + off :
+                                            egptr() + off;
+            if ( !(which & std::ios_base::in) || target < eback() || target > egptr() )
+                return pos_type( off_type(-1) );
+            setg( eback(), target, egptr() );
+            return pos_type( target - eback() );
+        }
+
+        pos_type seekpos( pos_type pos, std::ios_base::openmode which )
+        {
+            return seekoff( off_type(pos), std::ios_base::beg, which );
+        }
     };
 
-    void writeMeta( const std::string& fullPath, const Config& meta )
+    /**
+     * Reads the header of an entry, leaving the stream at the serialized data.
+     * Sets "legacy" and rewinds if the entry predates the header. Returns false
+     * if the header is damaged. Optionally returns the size of the metadata slot.
+     */
+    bool readEntryHeader( std::istream& in, Config& meta, bool& legacy, unsigned* out_slotSize =0L )
     {
-        std::ofstream outmeta( fullPath.c_str() );
-        if ( outmeta.is_open() )
+        char head[ENTRY_HEADER_SIZE];
+        in.read( head, ENTRY_HEADER_SIZE );
+        legacy = !in || ::memcmp( head, ENTRY_MAGIC, 8 ) != 0;
+        if ( legacy )
+        {
+            in.clear();
+            in.seekg( 0, std::ios::beg );
+            return in.good();
+        }
+
+        unsigned metaLen  = parseUInt32( head + 8 );
+        unsigned slotSize = parseUInt32( head + 12 );
+        if ( metaLen > slotSize )
+            return false;
+
+        if ( slotSize > 0 )
         {
-            outmeta << meta.toJSON();
-            outmeta.flush();
-            outmeta.close();
+            std::string metaJSON( slotSize, ' ' );
+            in.read( &metaJSON[0], slotSize );
+            if ( !in )
+                return false;
+            metaJSON.resize( metaLen );
+            if ( metaLen > 0 )
+                meta.fromJSON( metaJSON );
         }
+
+        if ( out_slotSize )
+            *out_slotSize = slotSize;
+        return true;
     }
 
+    /**
+     * Bounded queue of entries to write, serviced by one background thread.
+     * Shared by all the bins of a cache.
+     */
+    class WriteQueue : public osg::Referenced, public OpenThreads::Thread
+    {
+    public:
+        WriteQueue( unsigned capacity ) : _capacity( capacity > 0 ? capacity : 1 ), _busy( false ), _done( false )
+        {
+            start();
+        }
+
+        /** Queues a write; blocks while the queue is full. */
+        void push( BinState* state, const std::string& path, EntryBuffer* buffer )
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            while( _jobs.size() >= _capacity && !_done )
+                _notFull.wait( &_mutex );
+
+            Job job;
+            job._state  = state;
+            job._path   = path;
+            job._buffer = buffer;
+            job._queued = osg::Timer::instance()->tick();
+            _jobs.push_back( job );
+            _notEmpty.signal();
+        }
+
+        /** Waits until every queued write is on disk. */
+        void flush()
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            while( !_jobs.empty() || _busy )
+                _idle.wait( &_mutex );
+        }
+
+        unsigned getDepth()
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            return _jobs.size();
+        }
+
+        unsigned getCapacity() const { return _capacity; }
+
+        void run()
+        {
+            for(;;)
+            {
+                Job job;
+                {
+                    Threading::ScopedMutexLock lock( _mutex );
+                    _busy = false;
+                    if ( _jobs.empty() )
+                        _idle.broadcast();
+                    while( _jobs.empty() && !_done )
+                        _notEmpty.wait( &_mutex );
+                    if ( _jobs.empty() )
+                        break;
+                    job = _jobs.front();
+                    _jobs.pop_front();
+                    _busy = true;
+                    _notFull.signal();
+                }
+
+                osg::Timer_t start = osg::Timer::instance()->tick();
+                bool ok = writeFileAtomic( job._path, job._buffer->_data );
+                osg::Timer_t end = osg::Timer::instance()->tick();
+
+                if ( !ok )
+                {
+                    OE_WARN << LC << "FAILED to write \"" << job._path << "\"" << std::endl;
+                }
+
+                BinState* state = job._state.get();
+                Threading::ScopedMutexLock lock( state->_mutex );
+
+                // drop it from the pending table, unless a newer write replaced it.
+                BinState::PendingTable::iterator i = state->_pending.find( job._path );
+                if ( i != state->_pending.end() && i->second.get() == job._buffer.get() )
+                    state->_pending.erase( i );
+
+                double latency = osg::Timer::instance()->delta_m( job._queued, end );
+                if ( ok ) ++state->_numWrites; else ++state->_numFailures;
+                state->_totalLatency  += latency;
+                state->_totalDiskTime += osg::Timer::instance()->delta_m( start, end );
+                if ( latency > state->_maxLatency )
+                    state->_maxLatency = latency;
+            }
+
+            Threading::ScopedMutexLock lock( _mutex );
+            _busy = false;
+            _idle.broadcast();
+        }
+
+    protected:
+        virtual ~WriteQueue()
+        {
+            // finishes the queued writes before returning.
+            {
+                Threading::ScopedMutexLock lock( _mutex );
+                _done = true;
+                _notEmpty.broadcast();
+                _notFull.broadcast();
+            }
+            join();
+        }
+
+    private:
+        struct Job
+        {
+            osg::ref_ptr<BinState>    _state;
+            std::string               _path;
+            osg::ref_ptr<EntryBuffer> _buffer;
+            osg::Timer_t              _queued;
+        };
+
+        std::deque<Job>        _jobs;
+        unsigned               _capacity;
+        bool                   _busy;
+        bool                   _done;
+        Threading::Mutex       _mutex;
+        OpenThreads::Condition _notEmpty;
+        OpenThreads::Condition _notFull;
+        OpenThreads::Condition _idle;
+    };
+
+    /** Reads the legacy separate metadata file, written by older versions. */
     void readMeta( const std::string& fullPath, Config& meta )
     {
         std::ifstream inmeta( fullPath.c_str() );
@@ -135,9 +473,6 @@ namespace
 
 //------------------------------------------------------------------------
 
-#undef  LC
-#define LC "[FileSystemCache] "
-
 //#undef  OE_DEBUG
 //#define OE_DEBUG OE_INFO
 
@@ -148,6 +483,10 @@ namespace
     {
         FileSystemCacheOptions fsco( options );
         _rootPath = URI( *fsco.rootPath(), options.referrer() ).full();
+
+        if ( *fsco.writeBehind() )
+            _writeQueue = new WriteQueue( *fsco.writeQueueSize() );
+
         init();
     }
 
@@ -165,7 +504,7 @@ namespace
     CacheBin*
     FileSystemCache::addBin( const std::string& name )
     {
-        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath ) );
+        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath, _writeQueue.get() ) );
     }
 
     CacheBin*
@@ -177,7 +516,7 @@ namespace
             Threading::ScopedMutexLock lock( s_defaultBinMutex );
             if ( !_defaultBin.valid() ) // double-check
             {
-                _defaultBin = new FileSystemCacheBin( "__default", _rootPath );
+                _defaultBin = new FileSystemCacheBin( "__default", _rootPath, _writeQueue.get() );
             }
         }
         return _defaultBin.get();
@@ -186,9 +525,12 @@ namespace
     //------------------------------------------------------------------------
 
     FileSystemCacheBin::FileSystemCacheBin(const std::string&   binID,
-                                           const std::string&   rootPath) :
-    CacheBin ( binID ),
-    _ok      ( true )
+                                           const std::string&   rootPath,
+                                           WriteQueue*          writeQueue) :
+    CacheBin   ( binID ),
+    _ok        ( true ),
+    _writeQueue( writeQueue ),
+    _state     ( new BinState() )
     {
         std::string binPath = osgDB::concatPaths( rootPath, binID );
         _metaPath = osgDB::concatPaths( binPath, "osgearth_cacheinfo.json" );
@@ -212,91 +554,80 @@ namespace
     }
 
     ReadResult
-    FileSystemCacheBin::readImage(const std::string& key, double maxAge)
+    FileSystemCacheBin::read( const std::string& key, ObjectType type )
     {
-        if ( !_ok ) return 0L;
+        if ( !_ok ) return ReadResult();
 
         //todo: handle maxAge
 
         // mangle "key" into a legal path name
         URI fileURI( toLegalFileName(key), _metaPath );
+        std::string path = fileURI.full() + ".osgb";
 
-        osgDB::ReaderWriter::ReadResult r;
+        // a write still in the queue is the freshest copy. Hold a reference
+        // and read it in place; the buffer is never modified once queued.
+        osg::ref_ptr<EntryBuffer> pending;
         {
-            ScopedReadLock sharedLock( _rwmutex );
-            r = _rw->readImage( fileURI.full() + ".osgb", _rwOptions.get() );
-            if ( r.success() )
-            {
-                // read metadata
-                Config meta;
-                std::string metafile = fileURI.full() + ".meta";
-                if ( osgDB::fileExists(metafile) )
-                    readMeta( metafile, meta );
-
-                return ReadResult( r.getImage(), meta );
-            }
+            Threading::ScopedMutexLock lock( _state->_mutex );
+            BinState::PendingTable::const_iterator i = _state->_pending.find( path );
+            if ( i != _state->_pending.end() )
+                pending = i->second.get();
         }
 
-        return ReadResult(); //error
-    }
-
-    ReadResult
-    FileSystemCacheBin::readObject(const std::string& key, double maxAge)
-    {
-        if ( !_ok ) return 0L;
-
-        //todo: handle maxAge
+        EntryStreamBuffer pendingBuf( pending.get() );
+        std::istream      pendingIn( &pendingBuf );
+        std::ifstream     fileIn;
+        if ( !pending.valid() )
+        {
+            fileIn.open( path.c_str(), std::ios::in | std::ios::binary );
+            if ( !fileIn.is_open() )
+                return ReadResult();
+        }
+        std::istream& in = pending.valid() ? pendingIn : fileIn;
 
-        // mangle "key" into a legal path name
-        URI fileURI( toLegalFileName(key), _metaPath );
+        Config meta;
+        bool   legacy;
+        if ( !readEntryHeader(in, meta, legacy) )
+            return ReadResult();
 
-        osgDB::ReaderWriter::ReadResult r;
+        if ( legacy )
         {
-            ScopedReadLock sharedLock( _rwmutex );
-            r = _rw->readObject( fileURI.full() + ".osgb", _rwOptions.get() );
-            if ( r.success() )
-            {
-                // read metadata
-                Config meta;
-                std::string metafile = fileURI.full() + ".meta";
-                if ( osgDB::fileExists(metafile) )
-                    readMeta( metafile, meta );
-
-                // TODO: read metadata
-                return ReadResult( r.getObject(), meta );
-            }
+            // written by an older version, with the metadata beside it.
+            std::string metafile = fileURI.full() + ".meta";
+            if ( osgDB::fileExists(metafile) )
+                readMeta( metafile, meta );
         }
 
-        return ReadResult();
+        osgDB::ReaderWriter::ReadResult r =
+            type == TYPE_IMAGE ? _rw->readImage ( in, _rwOptions.get() ) :
+            type == TYPE_NODE  ? _rw->readNode  ( in, _rwOptions.get() ) :
+                                 _rw->readObject( in, _rwOptions.get() );
+
+        if ( !r.success() )
+            return ReadResult();
+
+        return
+            type == TYPE_IMAGE ? ReadResult( r.getImage(), meta ) :
+            type == TYPE_NODE  ? ReadResult( r.getNode(), meta ) :
+                                 ReadResult( r.getObject(), meta );
     }
 
     ReadResult
-    FileSystemCacheBin::readNode(const std::string& key, double maxAge)
+    FileSystemCacheBin::readImage(const std::string& key, double maxAge)
     {
-        if ( !_ok ) return 0L;
-
-        //todo: handle maxAge
-
-        // mangle "key" into a legal path name
-        URI fileURI( toLegalFileName(key), _metaPath );
-
-        osgDB::ReaderWriter::ReadResult r;
-        {
-            ScopedReadLock sharedLock( _rwmutex );
-            r = _rw->readNode( fileURI.full() + ".osgb", _rwOptions.get() );
-            if ( r.success() )
-            {            
-                // read metadata
-                Config meta;
-                std::string metafile = fileURI.full() + ".meta";
-                if ( osgDB::fileExists(metafile) )
-                    readMeta( metafile, meta );
+        return read( key, TYPE_IMAGE );
+    }
 
-                return ReadResult( r.getNode(), meta );
-            }
-        }
+    ReadResult
+    FileSystemCacheBin::readObject(const std::string& key, double maxAge)
+    {
+        return read( key, TYPE_OBJECT );
+    }
 
-        return ReadResult();
+    ReadResult
+    FileSystemCacheBin::readNode(const std::string& key, double maxAge)
+    {
+        return read( key, TYPE_NODE );
     }
 
     ReadResult
@@ -313,44 +644,34 @@ namespace
 
         // convert the key into a legal filename:
         URI fileURI( toLegalFileName(key), _metaPath );
+        std::string path = fileURI.full() + ".osgb";
 
-        bool objWriteOK = false;
-        {
-            // prevent cache contention:
-            ScopedWriteLock exclusiveLock( _rwmutex );
+        // serialize it here, so the queue never holds on to the caller's object.
+        std::stringstream buf;
+        writeEntryHeader( buf, meta );
 
-            // make a home for it..
-            if ( !osgDB::fileExists( osgDB::getFilePath(fileURI.full()) ) )
-                osgDB::makeDirectoryForFile( fileURI.full() );
+        osgDB::ReaderWriter::WriteResult r;
 
-            // write it.  
-            osgDB::ReaderWriter::WriteResult r;      
+        if ( dynamic_cast<const osg::Image*>(object) )
+        {
+            r = _rw->writeImage( *static_cast<const osg::Image*>(object), buf, _rwOptions.get() );
+        }
+        else if ( dynamic_cast<const osg::Node*>(object) )
+        {
+            r = _rw->writeNode( *static_cast<const osg::Node*>(object), buf, _rwOptions.get() );
+        }
+        else
+        {
+            r = _rw->writeObject( *object, buf );
+        }
 
-            if ( dynamic_cast<const osg::Image*>(object) )
-            {
-                std::string filename = fileURI.full() + ".osgb";
-                r = _rw->writeImage( *static_cast<const osg::Image*>(object), filename, _rwOptions.get() );
-                objWriteOK = r.success();
-            }
-            else if ( dynamic_cast<const osg::Node*>(object) )
-            {
-                std::string filename = fileURI.full() + ".osgb";
-                r = _rw->writeNode( *static_cast<const osg::Node*>(object), filename, _rwOptions.get() );
-                objWriteOK = r.success();
-            }
-            else
-            {
-                std::string filename = fileURI.full() + ".osgb";
-                r = _rw->writeObject( *object, filename );
-                objWriteOK = r.success();
-            }
+        bool objWriteOK = r.success();
 
-            // write metadata
-            if ( !meta.empty() && objWriteOK )
-            {
-                std::string metaname = fileURI.full() + ".meta";
-                writeMeta( metaname, meta );
-            }
+        if ( objWriteOK )
+        {
+            osg::ref_ptr<EntryBuffer> entry = new EntryBuffer();
+            entry->_data = buf.str();
+            objWriteOK = store( path, entry.get() );
         }
 
         if ( objWriteOK )
@@ -365,13 +686,110 @@ namespace
         return objWriteOK;
     }
 
+    bool
+    FileSystemCacheBin::touch( const std::string& key, const Config& meta )
+    {
+        if ( !_ok ) return false;
+
+        URI fileURI( toLegalFileName(key), _metaPath );
+        std::string path = fileURI.full() + ".osgb";
+
+        // an entry still in the queue gets a new buffer; the data is in memory
+        // and its write to disk is still to come.
+        osg::ref_ptr<EntryBuffer> pending;
+        {
+            Threading::ScopedMutexLock lock( _state->_mutex );
+            BinState::PendingTable::const_iterator i = _state->_pending.find( path );
+            if ( i != _state->_pending.end() )
+                pending = i->second.get();
+        }
+
+        Config oldMeta;
+        bool   legacy;
+
+        if ( pending.valid() )
+        {
+            EntryStreamBuffer pendingBuf( pending.get() );
+            std::istream      in( &pendingBuf );
+            if ( !readEntryHeader(in, oldMeta, legacy) || legacy )
+                return false;
+
+            std::string::size_type dataStart = (std::string::size_type)in.tellg();
+
+            std::stringstream buf;
+            writeEntryHeader( buf, meta );
+            buf.write( pending->_data.c_str() + dataStart, pending->_data.size() - dataStart );
+
+            osg::ref_ptr<EntryBuffer> entry = new EntryBuffer();
+            entry->_data = buf.str();
+            return store( path, entry.get() );
+        }
+
+        // on disk, overwrite just the metadata slot. Entries written by an older
+        // version, or metadata that outgrew its slot, make the caller rewrite
+        // the whole entry.
+        std::fstream file( path.c_str(), std::ios::in | std::ios::out | std::ios::binary );
+        if ( !file.is_open() )
+            return false;
+
+        unsigned slotSize = 0;
+        if ( !readEntryHeader(file, oldMeta, legacy, &slotSize) || legacy )
+            return false;
+
+        std::string metaJSON = meta.empty() ? std::string() : meta.toJSON();
+        if ( metaJSON.size() > slotSize )
+            return false;
+
+        // one write, so a concurrent reader almost never sees a partial slot;
+        // if it does, the JSON won't parse and the entry just reads as stale.
+        std::string slot = encodeMetadataSlot( metaJSON, slotSize );
+        file.seekp( 8, std::ios::beg );
+        file.write( slot.data(), slot.size() );
+        file.close();
+        return !file.fail();
+    }
+
+    bool
+    FileSystemCacheBin::store( const std::string& path, EntryBuffer* entry )
+    {
+        if ( _writeQueue.valid() )
+        {
+            {
+                Threading::ScopedMutexLock lock( _state->_mutex );
+                _state->_pending[path] = entry;
+            }
+            _writeQueue->push( _state.get(), path, entry );
+            return true;
+        }
+        else
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            bool ok = writeFileAtomic( path, entry->_data );
+            double t = osg::Timer::instance()->delta_m( start, osg::Timer::instance()->tick() );
+
+            Threading::ScopedMutexLock lock( _state->_mutex );
+            if ( ok ) ++_state->_numWrites; else ++_state->_numFailures;
+            _state->_totalLatency  += t;
+            _state->_totalDiskTime += t;
+            if ( t > _state->_maxLatency )
+                _state->_maxLatency = t;
+            return ok;
+        }
+    }
+
     bool
     FileSystemCacheBin::isCached( const std::string& key, double maxAge )
     {
         if ( !_ok ) return false;
 
         URI fileURI( toLegalFileName(key), _metaPath );
-        return osgDB::fileExists( fileURI.full() + ".osgb" );
+        std::string path = fileURI.full() + ".osgb";
+        {
+            Threading::ScopedMutexLock lock( _state->_mutex );
+            if ( _state->_pending.find(path) != _state->_pending.end() )
+                return true;
+        }
+        return osgDB::fileExists( path );
     }
 
     bool
@@ -384,7 +802,7 @@ namespace
         {
             int ok = 0;
             std::string full = osgDB::concatPaths(dir, *i);
-            
+
             if ( full.find( getID() ) != std::string::npos ) // safety latch
             {
                 osgDB::FileType type = osgDB::fileType( full );
@@ -417,11 +835,13 @@ namespace
     FileSystemCacheBin::purge()
     {
         if ( !_ok ) return false;
-        {
-            ScopedWriteLock exclusiveLock( _rwmutex );
-            std::string binDir = osgDB::getFilePath( _metaPath );
-            return purgeDirectory( binDir );
-        }
+
+        // let queued writes land first, or they'd come back after the purge.
+        if ( _writeQueue.valid() )
+            _writeQueue->flush();
+
+        std::string binDir = osgDB::getFilePath( _metaPath );
+        return purgeDirectory( binDir );
     }
 
     Config
@@ -429,8 +849,6 @@ namespace
     {
         if ( !_ok ) return Config();
 
-        ScopedReadLock sharedLock( _rwmutex );
-        
         Config conf;
         conf.fromJSON( URI(_metaPath).getString(_rwOptions.get()) );
 
@@ -442,17 +860,40 @@ namespace
     {
         if ( !_ok ) return false;
 
-        ScopedWriteLock exclusiveLock( _rwmutex );
+        return writeFileAtomic( _metaPath, conf.toJSON(true) );
+    }
 
-        std::fstream output( _metaPath.c_str(), std::ios_base::out );
-        if ( output.is_open() )
+    Config
+    FileSystemCacheBin::getStats()
+    {
+        Config conf( "stats" );
+
+        unsigned writes, failures;
+        double   totalLatency, maxLatency, totalDiskTime;
+        unsigned pending;
         {
-            output << conf.toJSON(true);
-            output.flush();
-            output.close();
-            return true;
+            Threading::ScopedMutexLock lock( _state->_mutex );
+            writes        = _state->_numWrites;
+            failures      = _state->_numFailures;
+            totalLatency  = _state->_totalLatency;
+            maxLatency    = _state->_maxLatency;
+            totalDiskTime = _state->_totalDiskTime;
+            pending       = _state->_pending.size();
         }
-        return false;
+
+        unsigned completed = writes + failures;
+
+        conf.add( "write_behind",      _writeQueue.valid() );
+        conf.add( "queue_depth",       _writeQueue.valid() ? _writeQueue->getDepth() : 0u );
+        conf.add( "queue_capacity",    _writeQueue.valid() ? _writeQueue->getCapacity() : 0u );
+        conf.add( "pending",           pending );
+        conf.add( "writes",            writes );
+        conf.add( "write_failures",    failures );
+        conf.add( "avg_latency_ms",    completed > 0 ? totalLatency / completed : 0.0 );
+        conf.add( "max_latency_ms",    maxLatency );
+        conf.add( "avg_disk_time_ms",  completed > 0 ? totalDiskTime / completed : 0.0 );
+
+        return conf;
     }
 }
 
@@ -17,1734 +17,1412 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "Sqlite3CacheOptions"
-
-#include <osgEarth/FileUtils>
-#include <osgEarth/TaskService>
+#include <osgEarth/Cache>
+#include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/URI>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
 #include <osgDB/ReaderWriter>
-#if OSG_MIN_VERSION_REQUIRED(2,9,5)
-#  include <osgDB/Options>
-#endif
-#include <OpenThreads/Mutex>
-#include <OpenThreads/ScopedLock>
-#include <cstring>
-#include <fstream>
-
-// for the compressor stuff
-#if OSG_MIN_VERSION_REQUIRED(2,9,8)
-#  define USE_SERIALIZERS
-#  include <osgDB/Serializer>
-#endif
+#include <osgDB/Registry>
+#include <osg/Timer>
+#include <OpenThreads/Atomic>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Condition>
+#include <sstream>
+#include <map>
+#include <vector>
+#include <ctime>
+#include <cmath>
 
 #include <sqlite3.h>
 
 using namespace osgEarth;
 using namespace osgEarth::Drivers;
-using namespace OpenThreads;
+using namespace osgEarth::Threading;
 
 #define LC "[Sqlite3Cache] "
 
-#define USE_TRANSACTIONS
-#define USE_L2_CACHE
+// performance mode: records examined per eviction step, and the fraction
+// of max_size that eviction frees down to.
+#define EVICTION_CHUNK 64
+#define EVICTION_TARGET 0.9
 
-//#define SPLIT_DB_FILE
-//#define SPLIT_LAYER_DB
-#define UPDATE_ACCESS_TIMES
-#define UPDATE_ACCESS_TIMES_POOL
+// normal mode: writes between size checks, and the size (relative to
+// max_size) at which the purge starts.
 #define MAX_REQUEST_TO_RUN_PURGE 100
-
-#define PURGE_GENERAL
-//#define INSERT_POOL
-
-//#define MONITOR_THREAD_HEALTH
+#define PURGE_THRESHOLD 1.2
 
 // --------------------------------------------------------------------------
 
-// opens a database connection with default settings.
-static
-sqlite3* openDatabase( const std::string& path, bool serialized )
+namespace
 {
-    //Try to create the path if it doesn't exist
-    std::string dirPath = osgDB::getFilePath(path);    
-
-    //If the path doesn't currently exist or we can't create the path, don't cache the file
-    if (!osgDB::fileExists(dirPath) && !osgDB::makeDirectory(dirPath))
+    /**
+     * Statements used on every bin table. In performance mode each connection
+     * keeps its prepared statements for reuse.
+     */
+    enum StatementType
     {
-        OE_WARN << LC << "Couldn't create path " << dirPath << std::endl;
-    }
-
-    sqlite3* db = 0L;
-
-    // not sure if SHAREDCACHE is necessary or wise 
-    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
-    flags |= serialized ? SQLITE_OPEN_FULLMUTEX : SQLITE_OPEN_NOMUTEX;
-
-    int rc = sqlite3_open_v2( path.c_str(), &db, flags, 0L );
+        STMT_SELECT,
+        STMT_EXISTS,
+        STMT_ENTRY_SIZE,
+        STMT_INSERT,
+        STMT_UPDATE_TIME,
+        STMT_UPDATE_META,
+        STMT_LRU_SELECT,
+        STMT_DELETE_KEY,
+        NUM_STATEMENT_TYPES
+    };
 
-    if ( rc != 0 )
+    // opens a database connection with default settings, or tuned for
+    // throughput in performance mode.
+    sqlite3* openDatabase( const std::string& path, const Sqlite3CacheOptions& options )
     {
-        OE_WARN << LC << "Failed to open cache \"" << path << "\": " << sqlite3_errmsg(db) << std::endl;
-        return 0L;
-    }
+        bool serialized = options.serialized().value();
 
-    // make sure that writes actually finish
-    sqlite3_busy_timeout( db, 60000 );
+        //Try to create the path if it doesn't exist
+        std::string dirPath = osgDB::getFilePath(path);
 
-    return db;
-}
+        //If the path doesn't currently exist or we can't create the path, don't cache the file
+        if (!dirPath.empty() && !osgDB::fileExists(dirPath) && !osgDB::makeDirectory(dirPath))
+        {
+            OE_WARN << LC << "Couldn't create path " << dirPath << std::endl;
+        }
 
-// --------------------------------------------------------------------------
+        sqlite3* db = 0L;
 
-// a slightly customized Cache class that will support asynchronous writes
-struct AsyncCache : public Cache
-{
-public:
-    AsyncCache(const CacheOptions& options =CacheOptions()): Cache(options) { }
-    virtual void setImageSync(
-        const TileKey& key,
-        const CacheSpec& spec,
-        const osg::Image* image ) =0;
-};
+        int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+        flags |= serialized ? SQLITE_OPEN_FULLMUTEX : SQLITE_OPEN_NOMUTEX;
 
+        int rc = sqlite3_open_v2( path.c_str(), &db, flags, 0L );
 
-// --------------------------------------------------------------------------
+        if ( rc != 0 )
+        {
+            OE_WARN << LC << "Failed to open cache \"" << path << "\": " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_close( db );
+            return 0L;
+        }
 
-struct MetadataRecord
-{
-    std::string   _layerName;
-    std::string   _format;
-    int           _tileSize;
-    osg::ref_ptr<const Profile> _profile;
-    std::string   _compressor;
-};
+        // make sure that writes actually finish
+        sqlite3_busy_timeout( db, 60000 );
 
-/**
- * This database table holds one record for each cached layer in the database.
- */
-struct MetadataTable
-{
-    MetadataTable() { }
+        if ( options.performanceMode() == true )
+        {
+            // WAL lets readers run alongside the writer; with WAL, synchronous=NORMAL
+            // only syncs at checkpoints and is still safe against corruption.
+            std::stringstream buf;
+            buf << "PRAGMA journal_mode=WAL; "
+                << "PRAGMA synchronous=NORMAL; "
+                << "PRAGMA temp_store=MEMORY; "
+                << "PRAGMA mmap_size=" << (sqlite3_int64)options.mmapSize().value() * 1024 * 1024 << ";";
+            std::string sql = buf.str();
+
+            char* errMsg = 0L;
+            if ( sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg ) != SQLITE_OK )
+            {
+                OE_WARN << LC << "Failed to set performance pragmas on \"" << path << "\": " << errMsg << std::endl;
+                sqlite3_free( errMsg );
+            }
+        }
 
-    bool initialize( sqlite3* db )
-    {
-        std::string sql =
-            "CREATE TABLE IF NOT EXISTS metadata ("
-            "layer varchar(255) PRIMARY KEY UNIQUE, "
-            "format varchar(255), "
-            "compressor varchar(64), "
-            "tilesize int, "
-            "srs varchar(1024), "
-            "xmin double, "
-            "ymin double, "
-            "xmax double, "
-            "ymax double, "
-            "tw int, "
-            "th int )";
-
-        OE_DEBUG << LC << "SQL = " << sql << std::endl;
+        return db;
+    }
 
+    bool exec( sqlite3* db, const std::string& sql )
+    {
         char* errMsg = 0L;
-        int err = sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg );
-        if ( err != SQLITE_OK )
+        if ( sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg ) != SQLITE_OK )
         {
-            OE_WARN << LC << "[Sqlite3Cache] Creating metadata: " << errMsg << std::endl;
+            OE_WARN << LC << "SQL failed: " << sql << "; " << (errMsg ? errMsg : "") << std::endl;
             sqlite3_free( errMsg );
             return false;
         }
-
-        // prep the insert/select statement SQL strings:
-        _insertSQL = 
-            "INSERT OR REPLACE INTO metadata "
-            "(layer,format,compressor,tilesize,srs,xmin,ymin,xmax,ymax,tw,th) "
-            "VALUES (?,?,?,?,?,?,?,?,?,?,?)";
-
-        _selectSQL =
-            "SELECT layer,format,compressor,tilesize,srs,xmin,ymin,xmax,ymax,tw,th "
-            "FROM metadata WHERE layer = ?";
-
         return true;
     }
 
-    bool store( const MetadataRecord& rec, sqlite3* db )
+    //------------------------------------------------------------------------
+
+    /**
+     * A database connection and, in performance mode, the statements prepared
+     * on it. A connection is used by one thread at a time (it is checked out
+     * of the Database's pool), so neither needs a lock.
+     */
+    class Connection
     {
-        sqlite3_stmt* insert = 0;
-        int rc = sqlite3_prepare_v2( db, _insertSQL.c_str(), _insertSQL.length(), &insert, 0L );
-        if ( rc != SQLITE_OK )
+    public:
+        Connection( sqlite3* db, bool reuseStatements ) : _db(db), _reuse(reuseStatements) { }
+
+        ~Connection()
         {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
+            for( StatementTable::iterator i = _statements.begin(); i != _statements.end(); ++i )
+                sqlite3_finalize( i->second );
+            sqlite3_close( _db );
         }
 
-        sqlite3_bind_text( insert, 1, rec._layerName.c_str(), -1, 0L );
-        sqlite3_bind_text( insert, 2, rec._format.c_str(), -1, 0L );
-        sqlite3_bind_text( insert, 3, rec._compressor.c_str(), -1, 0L );
-        sqlite3_bind_int ( insert, 4, rec._tileSize );
-        sqlite3_bind_text( insert, 5, rec._profile->getSRS()->getInitString().c_str(), -1, 0L );
-        sqlite3_bind_double( insert, 6, rec._profile->getExtent().xMin() );
-        sqlite3_bind_double( insert, 7, rec._profile->getExtent().yMin() );
-        sqlite3_bind_double( insert, 8, rec._profile->getExtent().xMax() );
-        sqlite3_bind_double( insert, 9, rec._profile->getExtent().yMax() );
-        unsigned int tw, th;
-        rec._profile->getNumTiles( 0, tw, th );
-        sqlite3_bind_int( insert, 10, tw );
-        sqlite3_bind_int( insert, 11, th );
-
-        bool success;
-
-        rc = sqlite3_step(insert);
-        if ( rc != SQLITE_DONE )
+        sqlite3* db() const { return _db; }
+
+        /**
+         * Prepares one of a bin's statements. In performance mode the statement is
+         * prepared once per connection and reused; release() it when done.
+         */
+        sqlite3_stmt* prepare( unsigned binID, StatementType type, const std::string& sql )
         {
-            OE_WARN << LC << "SQL INSERT failed: " << sqlite3_errmsg( db )
-                << "; SQL = " << _insertSQL
-                << std::endl;
-            success = false;
+            StatementTable::key_type key( binID, type );
+            if ( _reuse )
+            {
+                StatementTable::const_iterator i = _statements.find( key );
+                if ( i != _statements.end() )
+                    return i->second;
+            }
+
+            sqlite3_stmt* stmt = 0L;
+            if ( sqlite3_prepare_v2( _db, sql.c_str(), sql.length(), &stmt, 0L ) != SQLITE_OK )
+            {
+                OE_WARN << LC << "Failed to prepare SQL: " << sql << "; " << sqlite3_errmsg(_db) << std::endl;
+                return 0L;
+            }
+
+            if ( _reuse )
+                _statements[key] = stmt;
+
+            return stmt;
         }
-        else
+
+        /** Done with a statement from prepare(): resets a reused one, finalizes otherwise. */
+        void release( sqlite3_stmt* stmt )
         {
-            OE_DEBUG << LC << "Stored metadata record for \"" << rec._layerName << "\"" << std::endl;
-            success = true;
+            if ( _reuse )
+            {
+                sqlite3_reset( stmt );
+                sqlite3_clear_bindings( stmt );
+            }
+            else
+            {
+                sqlite3_finalize( stmt );
+            }
         }
 
-        sqlite3_finalize( insert );
-        return success;
-    }
+    private:
+        typedef std::map<std::pair<unsigned,int>, sqlite3_stmt*> StatementTable;
+
+        sqlite3*       _db;
+        bool           _reuse;
+        StatementTable _statements;
+    };
+
+    //------------------------------------------------------------------------
 
-    bool load( const std::string& key, sqlite3* db, MetadataRecord& output )
+    /** A serialized entry waiting for the writer thread. Never modified once queued. */
+    struct PendingWrite : public osg::Referenced
     {
-        bool success = true;
+        std::string _key;
+        std::string _metadata;
+        std::string _data;
+        int         _time;
+    };
 
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, _selectSQL.c_str(), _selectSQL.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
+    /**
+     * State of one bin table shared by the bin, the writer thread and eviction.
+     */
+    class BinState : public osg::Referenced
+    {
+    public:
+        typedef std::map<std::string, osg::ref_ptr<PendingWrite> > PendingTable;
+
+        BinState( unsigned id ) :
+          _id( id ), _sizeBytes( 0 ), _numWrites( 0 ), _numFailures( 0 ), _numEvicted( 0 )
         {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
+            std::string table = Stringify() << "\"bin_" << id << "\"";
+            _table = table;
+
+            _sql[STMT_SELECT]      = "SELECT created,metadata,data FROM " + table + " WHERE key = ?";
+            _sql[STMT_EXISTS]      = "SELECT created FROM " + table + " WHERE key = ?";
+            _sql[STMT_ENTRY_SIZE]  = "SELECT size FROM " + table + " WHERE key = ?";
+            _sql[STMT_INSERT]      = "INSERT OR REPLACE INTO " + table + " (key,created,accessed,size,metadata,data) VALUES (?,?,?,?,?,?)";
+            _sql[STMT_UPDATE_TIME] = "UPDATE " + table + " SET accessed = ? WHERE key = ?";
+            _sql[STMT_UPDATE_META] = "UPDATE " + table + " SET created = ?, accessed = ?, metadata = ? WHERE key = ?";
+            _sql[STMT_LRU_SELECT]  = "SELECT key,size FROM " + table + " ORDER BY accessed ASC LIMIT ?";
+            _sql[STMT_DELETE_KEY]  = "DELETE FROM " + table + " WHERE key = ?";
+        }
+
+        const unsigned _id;   // row in the "bins" table
+        std::string    _table;
+        std::string    _sql[NUM_STATEMENT_TYPES];
+
+        Threading::Mutex _mutex;      // guards the members below
+        PendingTable     _pending;
+        sqlite3_int64    _sizeBytes;  // running total; performance mode only
+        unsigned         _numWrites;
+        unsigned         _numFailures;
+        unsigned         _numEvicted;
+    };
 
-        sqlite3_bind_text( select, 1, key.c_str(), -1, 0L );
+    class Database;
 
-        rc = sqlite3_step( select );
-        if ( rc == SQLITE_ROW ) 
-        {
-            // got a result            
-            output._layerName = (char*)sqlite3_column_text( select, 0 );
-            output._format = (char*)sqlite3_column_text( select, 1 );
-            output._compressor = (char*)sqlite3_column_text( select, 2 );
-            output._tileSize = sqlite3_column_int( select, 3 );
-            ProfileOptions pconf;
-            pconf.srsString() = (char*)sqlite3_column_text( select, 4 );
-            pconf.bounds() = Bounds(
-                sqlite3_column_double( select, 5 ),
-                sqlite3_column_double( select, 6 ),
-                sqlite3_column_double( select, 7 ),
-                sqlite3_column_double( select, 8 ) );
-            pconf.numTilesWideAtLod0() = sqlite3_column_int( select, 9 );
-            pconf.numTilesHighAtLod0() = sqlite3_column_int( select, 10 );
-            output._profile = Profile::create( pconf );
-            success = true;
-        }
-        else
+    /**
+     * Commits queued inserts and access-time updates on a background thread. In
+     * performance mode a batch is one transaction holding up to max_batch_size
+     * operations, closed when full or when its oldest operation has waited
+     * max_batch_time ms. Otherwise each write commits on its own.
+     */
+    class BatchWriter : public OpenThreads::Thread
+    {
+    public:
+        struct Insert
         {
-            // no result
-            OE_DEBUG << "NO metadata record found for \"" << key << "\"" << std::endl;
-            success = false;
-        }
-
-        sqlite3_finalize( select );
-        return success;
-    }
+            osg::ref_ptr<BinState>     _bin;
+            osg::ref_ptr<PendingWrite> _write;
+        };
+        typedef std::vector<Insert> InsertList;
+
+        // access-time updates, one per record: (bin, key) -> time.
+        typedef std::map< std::pair<osg::ref_ptr<BinState>,std::string>, int > TouchTable;
+
+        BatchWriter( Database* db, unsigned maxBatchSize, unsigned maxBatchTime );
+
+        /** Commits whatever is queued and stops the thread. */
+        virtual ~BatchWriter();
+
+        /** Queues a write; blocks while the queue is full. */
+        void addInsert( BinState* bin, PendingWrite* write );
+
+        void addTouch( BinState* bin, const std::string& key, int timeStamp );
+
+        /** Waits until everything queued so far is committed. */
+        void flush();
+
+        unsigned getNumBatches() const { return _numBatches; }
+        double   getTotalBatchTime() const { return _totalBatchTime; }
+        unsigned getDepth();
+
+        void run();
+
+    private:
+        Database*              _db;
+        unsigned               _maxBatchSize;
+        unsigned               _maxBatchTime;
+        unsigned               _maxQueued;
+        bool                   _done;
+        bool                   _busy;
+        Threading::Mutex       _mutex;
+        OpenThreads::Condition _cond;
+        OpenThreads::Condition _idleCond;
+        InsertList             _inserts;
+        TouchTable             _touches;
+        unsigned               _numBatches;
+        double                 _totalBatchTime;
+    };
 
+    //------------------------------------------------------------------------
 
-    bool loadAllLayers( sqlite3* db, std::vector<std::string>& output )
+    /**
+     * The database file shared by all bins of one cache: a pool of connections,
+     * the bin tables, the writer thread and size-budget eviction.
+     *
+     * Each bin is a table of (key, created, accessed, size, metadata, data)
+     * records indexed on the access time; the "bins" table names them and holds
+     * each bin's own metadata.
+     */
+    class Database : public osg::Referenced
     {
-        bool success = true;
+    public:
+        Database( const std::string& path, const Sqlite3CacheOptions& options );
 
-        sqlite3_stmt* select = 0L;
-        std::string selectLayersSQL = "select layer from \"metadata\"";
-        int rc = sqlite3_prepare_v2( db, selectLayersSQL.c_str(), selectLayersSQL.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
+        bool isOK() const { return _ok; }
 
-        success = true;
-        rc = sqlite3_step( select );
-        while (rc == SQLITE_ROW) {
-            output.push_back((char*)sqlite3_column_text( select, 0 ));
-            rc = sqlite3_step( select );
-        }
+        bool isPerformanceMode() const { return _performance; }
 
-        if (rc != SQLITE_DONE)
-        {
-            // no result
-            OE_WARN << "NO layers found in metadata" << std::endl;
-            success = false;
-        }
+        const Sqlite3CacheOptions& getOptions() const { return _options; }
 
-        sqlite3_finalize( select );
-        return success;
-    }
+        BatchWriter* getWriter() const { return _writer; }
 
-    std::string _insertSQL;
-    std::string _selectSQL;
- };
+        /** Takes a connection for the calling thread's exclusive use. */
+        Connection* checkOut();
 
-// --------------------------------------------------------------------------
+        void checkIn( Connection* conn );
 
-struct ImageRecord
-{
-    ImageRecord( const TileKey& key ) : _key(key) { }
-    TileKey _key;
-    int _created;
-    int _accessed;
-    osg::ref_ptr<const osg::Image> _image;
-};
+        /** The state of the named bin, creating its table if necessary. */
+        BinState* getOrCreateBin( const std::string& name );
 
-#ifdef INSERT_POOL
-class Sqlite3Cache;
-struct AsyncInsertPool : public TaskRequest {
-    struct Entry {
-        TileKey _key;
-        osg::ref_ptr<osg::Image> _image;
-        std::string _format;
-        Entry() {}
-        Entry(const TileKey& key, const std::string& format, osg::Image* img) : _key(key), _format(format), _image(img) {}
-    };
+        Config readBinMetadata( BinState* bin );
 
-    typedef std::map<std::string, Entry> PoolContainer;
+        bool writeBinMetadata( BinState* bin, const Config& conf );
 
-    AsyncInsertPool(const std::string& layerName, Sqlite3Cache* cache );
+        /** Inserts one record on the given connection, keeping the size counter up to date. */
+        bool insert( Connection* conn, BinState* bin, const PendingWrite* write );
 
-    void addEntry( const TileKey& key, const std::string& format, osg::Image* image)
-    {
-        const std::string& keyStr = key.str();
-        if (_pool.find(keyStr) != _pool.end())
-            return;
-        _pool[keyStr] = Entry(key, format, image);
-    }
+        /** Commits one batch in a single transaction (called by the BatchWriter). */
+        void commitBatch( const BatchWriter::InsertList& inserts, const BatchWriter::TouchTable& touches );
 
-    osg::Image* findImage(const std::string& key)
-    {
-        PoolContainer::iterator it = _pool.find(key);
-        if (it != _pool.end()) {
-            return it->second._image.get();
-        }
-        return 0;
-    }
+        /** Frees space when over max_size, in the way the current mode does it. */
+        void evictIfNeeded( Connection* conn );
 
-    void operator()( ProgressCallback* progress );
-    
-    PoolContainer _pool;
-    std::string _layerName;
-    osg::observer_ptr<Sqlite3Cache> _cache;
-};
-#endif
+    protected:
+        virtual ~Database();
 
-/**
- * Database table that holds one record per cached imagery tile in a layer. The layer name
- * is the table name.
- */
-struct LayerTable : public osg::Referenced
-{
-    LayerTable( const MetadataRecord& meta, sqlite3* db )
-        : _meta(meta)
-    {        
-        _tableName = "layer_" + _meta._layerName;
-        // create the table and load the processors.
-        if ( ! initialize( db ) )
-        {
-            return;
-        }
+        sqlite3_int64 evictFromBin( Connection* conn, BinState* bin, sqlite3_int64 bytesToFree );
 
-        // initialize the SELECT statement for fetching records
-        std::stringstream buf;
-#ifdef SPLIT_DB_FILE
-        buf << "SELECT created,accessed,size FROM \"" << tableName << "\" WHERE key = ?";
-#else
-        buf << "SELECT created,accessed,data FROM \"" << _tableName << "\" WHERE key = ?";
-#endif
-        _selectSQL = buf.str();
-
-        // initialize the UPDATE statement for updating the timestamp of an accessed record
-        buf.str("");
-        buf << "UPDATE \"" << _tableName << "\" SET accessed = ? "
-            << "WHERE key = ?";
-        _updateTimeSQL = buf.str();
-
-        buf.str("");
-        buf << "UPDATE \"" << _tableName << "\" SET accessed = ? "
-            << "WHERE key in ( ? )";
-        _updateTimePoolSQL = buf.str();
-        
-        // initialize the INSERT statement for writing records.
-        buf.str("");
-        buf << "INSERT OR REPLACE INTO \"" << _tableName << "\" "
-#ifdef SPLIT_DB_FILE
-            << "(key,created,accessed,size) VALUES (?,?,?,?)";
-#else
-            << "(key,created,accessed,data) VALUES (?,?,?,?)";
-#endif
-        _insertSQL = buf.str();
-
-        // initialize the DELETE statements for purging old records.
-        buf.str("");
-        buf << "DELETE FROM \"" << _tableName << "\" "
-            << "INDEXED BY \"" << _tableName << "_lruindex\" "
-            << "WHERE accessed < ?";
-        _purgeSQL = buf.str();
-        
-        buf.str("");
-        buf << "DELETE FROM \""  << _tableName << "\" WHERE key in (SELECT key FROM \"" << _tableName << "\" WHERE \"accessed\" < ? limit ?)";
-        _purgeLimitSQL = buf.str();          
-
-        buf.str("");
-        buf << "SELECT key FROM \"" << _tableName << "\" WHERE \"accessed\" < ? limit ?";
-        _purgeSelect = buf.str();
-
-        _statsLoaded = 0;
-        _statsStored = 0;
-        _statsDeleted = 0;
-    }
+        void purgeGeneral( Connection* conn );
+
+        sqlite3_int64 queryInt64( Connection* conn, const std::string& sql );
 
+        typedef std::map<std::string, osg::ref_ptr<BinState> > BinTable;
+
+        bool                     _ok;
+        bool                     _performance;
+        std::string              _path;
+        Sqlite3CacheOptions      _options;
+        Threading::Mutex         _poolMutex;
+        std::vector<Connection*> _idle;
+        Threading::Mutex         _binsMutex;
+        BinTable                 _bins;
+        BatchWriter*             _writer;
+        OpenThreads::Atomic      _writesSinceCheck;
+    };
 
-    sqlite3_int64 getTableSize(sqlite3* db)
+    /** Checks a connection out of the pool for the life of the scope. */
+    struct ScopedConnection
     {
-#ifdef SPLIT_DB_FILE
-        std::string query = "select sum(size) from \"" + _tableName + "\";";
-#else
-        std::string query = "select sum(length(data)) from \"" + _tableName + "\";";
-#endif
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, query.c_str(), query.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(db) << std::endl;
-            return -1;
-        }
+        ScopedConnection( Database* db ) : _db(db), _conn(db->checkOut()) { }
+        ~ScopedConnection() { if ( _conn ) _db->checkIn( _conn ); }
+        Connection* operator->() const { return _conn; }
+        Connection* get() const { return _conn; }
+        bool valid() const { return _conn != 0L; }
+    private:
+        Database*   _db;
+        Connection* _conn;
+    };
+
+    //------------------------------------------------------------------------
 
-        rc = sqlite3_step( select );
-        if ( rc != SQLITE_ROW)
+    Database::Database( const std::string& path, const Sqlite3CacheOptions& options ) :
+    _ok         ( false ),
+    _performance( options.performanceMode() == true ),
+    _path       ( path ),
+    _options    ( options ),
+    _writer     ( 0L )
+    {
+        if ( sqlite3_threadsafe() == 0 )
         {
-            OE_WARN << LC << "SQL QUERY failed for " << query << ": " 
-                << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                << ", rc = " << rc << std::endl;
-            sqlite3_finalize( select );
-            return -1;
+            OE_WARN << LC << "SQLITE3 IS NOT COMPILED IN THREAD-SAFE MODE" << std::endl;
+            return;
         }
-        sqlite3_int64 size = sqlite3_column_int(select, 0);
-        sqlite3_finalize( select );
-        return size;
-    }
 
-    int getNbEntry(sqlite3* db) {
-        std::string query = "select count(*) from \"" + _tableName + "\";";
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, query.c_str(), query.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
+        Connection* conn = checkOut();
+        if ( !conn )
+            return;
+
+        _ok = exec( conn->db(),
+            "CREATE TABLE IF NOT EXISTS bins (id INTEGER PRIMARY KEY, name TEXT UNIQUE, metadata TEXT)" );
+        checkIn( conn );
+
+        if ( _ok && (_performance || _options.asyncWrites() == true) )
         {
-            OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(db) << std::endl;
-            return -1;
+            _writer = _performance ?
+                new BatchWriter( this, _options.maxBatchSize().value(), _options.maxBatchTime().value() ) :
+                new BatchWriter( this, 1u, 0u );
+            _writer->start();
         }
 
-        rc = sqlite3_step( select );
-        if ( rc != SQLITE_ROW)
+        if ( _ok && _performance )
         {
-            OE_WARN << LC << "SQL QUERY failed for " << query << ": " 
-                << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                << ", rc = " << rc << std::endl;
-            sqlite3_finalize( select );
-            return -1;
+            OE_INFO << LC << "Performance mode enabled" << std::endl;
         }
-        int nbItems = sqlite3_column_int(select, 0);
-        sqlite3_finalize( select );
-        return nbItems;
     }
 
-    void checkAndPurgeIfNeeded(sqlite3* db, unsigned int maxSize )
+    Database::~Database()
     {
-        int size = getTableSize(db);
-        OE_DEBUG << _meta._layerName <<  std::dec << " : "  << size/1024/1024 << " MB" << std::endl;
-        if (size < 0 || size < 1.2 * maxSize)
-            return;
-            
-        ::time_t t = ::time(0L);
-        int nbElements = getNbEntry(db);
-        float averageSize = size * 1.0 / nbElements;
-        float diffSize = size - maxSize;
-        int maxElementToRemove = static_cast<int>(ceil(diffSize/averageSize));
-        OE_DEBUG << _meta._layerName <<  " try to remove " << std::dec << maxElementToRemove << " / " <<  nbElements << " to save place" << std::endl;
-        purge(t, maxElementToRemove, db);
+        // commits the last batch.
+        delete _writer;
+        _writer = 0L;
+
+        for( std::vector<Connection*>::iterator i = _idle.begin(); i != _idle.end(); ++i )
+            delete *i;
+        _idle.clear();
     }
 
-    bool store( const ImageRecord& rec, sqlite3* db )
+    Connection*
+    Database::checkOut()
     {
-        displayStats();
-
-        sqlite3_stmt* insert = 0L;
-        int rc = sqlite3_prepare_v2( db, _insertSQL.c_str(), _insertSQL.length(), &insert, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
-        }
-
-        // bind the key string:
-        std::string keyStr = rec._key.str();
-        sqlite3_bind_text( insert, 1, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-        sqlite3_bind_int(  insert, 2, rec._created );
-        sqlite3_bind_int(  insert, 3, rec._accessed );
-
-        // serialize the image:
-#ifdef SPLIT_DB_FILE
-        std::stringstream outStream;
-        _rw->writeImage( *rec._image.get(), outStream, _rwOptions.get() );
-        std::string outBuf = outStream.str();
-        std::string fname = _meta._layerName + "_" + keyStr+".osgb";
         {
-            std::ofstream file(fname.c_str(), std::ios::out | std::ios::binary);
-            if (file.is_open()) {
-                file.write(outBuf.c_str(), outBuf.length());
+            Threading::ScopedMutexLock lock( _poolMutex );
+            if ( !_idle.empty() )
+            {
+                Connection* conn = _idle.back();
+                _idle.pop_back();
+                return conn;
             }
         }
-        sqlite3_bind_int( insert, 4, outBuf.length() );
-#else
-        std::stringstream outStream;
-        _rw->writeImage( *rec._image.get(), outStream, _rwOptions.get() );
-        std::string outBuf = outStream.str();
-        sqlite3_bind_blob( insert, 4, outBuf.c_str(), outBuf.length(), SQLITE_STATIC );
-#endif
 
-        // write to the database:
-        rc = sqlite3_step( insert );
+        sqlite3* db = openDatabase( _path, _options );
+        if ( !db )
+            return 0L;
 
-        if ( rc != SQLITE_DONE )
-        {
-            OE_WARN << LC << "SQL INSERT failed for key " << rec._key.str() << ": " 
-                << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                << ", rc = " << rc << std::endl;
-            sqlite3_finalize( insert );
-            return false;
-        }
-        else
-        {
-            OE_DEBUG << LC << "cache INSERT tile " << rec._key.str() << std::endl;
-            sqlite3_finalize( insert );
-            _statsStored++;
-            return true;
-        }
+        OE_DEBUG << LC << "Opened a new connection to \"" << _path << "\"" << std::endl;
+        return new Connection( db, _performance );
     }
 
-#ifdef INSERT_POOL
-    bool beginStore(sqlite3* db, sqlite3_stmt*& insert) 
+    void
+    Database::checkIn( Connection* conn )
     {
-        int rc;
-        rc = sqlite3_exec( db, "BEGIN TRANSACTION", NULL, NULL, NULL);
-        if (rc != 0) {
-            OE_WARN << LC << "Failed to begin transaction batch of insert for " << _meta._layerName << " "  << sqlite3_errmsg(db) << std::endl;
-            return false;
-        }
+        Threading::ScopedMutexLock lock( _poolMutex );
+        _idle.push_back( conn );
+    }
 
-        // prepare for multiple inserts
-        rc = sqlite3_prepare_v2( db, _insertSQL.c_str(), _insertSQL.length(), &insert, 0L );
-        if ( rc != SQLITE_OK )
+    sqlite3_int64
+    Database::queryInt64( Connection* conn, const std::string& sql )
+    {
+        sqlite3_stmt* stmt = 0L;
+        if ( sqlite3_prepare_v2( conn->db(), sql.c_str(), sql.length(), &stmt, 0L ) != SQLITE_OK )
         {
-            OE_WARN 
-                << LC << "Error preparing SQL: " 
-                << sqlite3_errmsg( db )
-                << "(SQL: " << _insertSQL << ")"
-                << std::endl;
-            return false;
+            OE_WARN << LC << "Failed to prepare SQL: " << sql << "; " << sqlite3_errmsg(conn->db()) << std::endl;
+            return -1;
         }
-        return true;
+        sqlite3_int64 value = sqlite3_step( stmt ) == SQLITE_ROW ? sqlite3_column_int64( stmt, 0 ) : -1;
+        sqlite3_finalize( stmt );
+        return value;
     }
 
-    bool storePool(sqlite3* db, const AsyncInsertPool::PoolContainer& entries, sqlite3_stmt* insert)
+    BinState*
+    Database::getOrCreateBin( const std::string& name )
     {
-        ::time_t t = ::time(0L);
-        sqlite3_bind_int(  insert, 2, t );
-        sqlite3_bind_int(  insert, 3, t );
-        int rc;
-        for (AsyncInsertPool::PoolContainer::const_iterator it = entries.begin(); it != entries.end(); ++it) {
-            
-            // bind the key string:
-            std::string keyStr = it->first;
-            sqlite3_bind_text( insert, 1, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-
-            // serialize the image:
-#ifdef SPLIT_DB_FILE
-            std::stringstream outStream;
-            _rw->writeImage( * (it)->second._image.get(), outStream, _rwOptions.get() );
-            std::string outBuf = outStream.str();
-            std::string fname = _meta._layerName + "_" + keyStr+".osgb";
-            {
-                std::ofstream file(fname.c_str(), std::ios::out | std::ios::binary);
-                if (file.is_open()) {
-                    file.write(outBuf.c_str(), outBuf.length());
-                }
-            }
-            sqlite3_bind_int( insert, 4, outBuf.length() );
-#else
-            std::stringstream outStream;
-            _rw->writeImage( * (it)->second._image.get(), outStream, _rwOptions.get() );
-            std::string outBuf = outStream.str();
-            sqlite3_bind_blob( insert, 4, outBuf.c_str(), outBuf.length(), SQLITE_STATIC );
-#endif
-            rc = sqlite3_step(insert);   // executes the INSERT
-            if ( rc != SQLITE_DONE )
-            {
-                OE_WARN << LC << "SQL INSERT failed for key " << keyStr << ": " 
-                        << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                        << ", rc = " << rc << std::endl;
-                sqlite3_finalize(insert); // clean up prepared statement
-                return false;
-            }
-            sqlite3_reset(insert);  // reset the statement 
-        }
+        Threading::ScopedMutexLock lock( _binsMutex );
 
-        _statsStored += entries.size();
-        return true;
-    }
+        BinTable::iterator i = _bins.find( name );
+        if ( i != _bins.end() )
+            return i->second.get();
 
-    bool endStore(sqlite3* db, sqlite3_stmt* insert)
-    {
-        int rc = 0;
-        rc = sqlite3_finalize(insert); // clean up prepared statement
-        rc = sqlite3_exec( db, "COMMIT", NULL, NULL, NULL);  // COMMIT all dirty pages at once
-        if (rc != 0) {
-            OE_WARN << LC << "Failed to commit batch of insert for " << _meta._layerName << " "  << sqlite3_errmsg(db) << std::endl;
-            return false;
+        ScopedConnection conn( this );
+        if ( !conn.valid() )
+            return 0L;
+
+        sqlite3_stmt* stmt = 0L;
+        std::string sql = "INSERT OR IGNORE INTO bins (name) VALUES (?)";
+        if ( sqlite3_prepare_v2( conn->db(), sql.c_str(), sql.length(), &stmt, 0L ) != SQLITE_OK )
+            return 0L;
+        sqlite3_bind_text( stmt, 1, name.c_str(), name.length(), SQLITE_STATIC );
+        sqlite3_step( stmt );
+        sqlite3_finalize( stmt );
+
+        sql = "SELECT id FROM bins WHERE name = ?";
+        if ( sqlite3_prepare_v2( conn->db(), sql.c_str(), sql.length(), &stmt, 0L ) != SQLITE_OK )
+            return 0L;
+        sqlite3_bind_text( stmt, 1, name.c_str(), name.length(), SQLITE_STATIC );
+        int id = sqlite3_step( stmt ) == SQLITE_ROW ? sqlite3_column_int( stmt, 0 ) : 0;
+        sqlite3_finalize( stmt );
+
+        if ( id <= 0 )
+        {
+            OE_WARN << LC << "Failed to register cache bin \"" << name << "\": " << sqlite3_errmsg(conn->db()) << std::endl;
+            return 0L;
         }
-        
-        return true;
-    }
-#endif
 
-    bool updateAccessTime( const TileKey& key, int newTimestamp, sqlite3* db )
-    { 
-        sqlite3_stmt* update = 0L;
-        int rc = sqlite3_prepare_v2( db, _updateTimeSQL.c_str(), _updateTimeSQL.length(), &update, 0L );
-        if ( rc != SQLITE_OK )
+        osg::ref_ptr<BinState> bin = new BinState( (unsigned)id );
+
+        std::string index = Stringify() << "\"bin_" << id << "_lruindex\"";
+        if ( !exec( conn->db(),
+                "CREATE TABLE IF NOT EXISTS " + bin->_table + " ("
+                "key TEXT PRIMARY KEY, created INTEGER, accessed INTEGER, "
+                "size INTEGER, metadata TEXT, data BLOB)" ) ||
+             !exec( conn->db(),
+                "CREATE INDEX IF NOT EXISTS " + index + " ON " + bin->_table + " (accessed)" ) )
         {
-            OE_WARN << LC << "Failed to prepare SQL " << _updateTimeSQL << "; " << sqlite3_errmsg(db) << std::endl;
-            return false;
+            return 0L;
         }
 
-        bool success = true;
-        sqlite3_bind_int( update, 1, newTimestamp );
-        std::string keyStr = key.str();
-        sqlite3_bind_text( update, 2, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-        rc = sqlite3_step( update );
-        if ( rc != SQLITE_DONE )
+        // one scan up front; after that the size is tracked as records come and go.
+        if ( _performance )
         {
-            OE_WARN << LC << "Failed to update timestamp for " << key.str() << " on layer " << _meta._layerName << " rc = " << rc << std::endl;
-            success = false;
+            bin->_sizeBytes = queryInt64( conn.get(), "SELECT sum(size) FROM " + bin->_table );
+            if ( bin->_sizeBytes < 0 )
+                bin->_sizeBytes = 0;
         }
 
-        sqlite3_finalize( update );
-        return success;
+        OE_INFO << LC << "Initialized cache bin \"" << name << "\" in " << _path << std::endl;
+
+        _bins[name] = bin.get();
+        return bin.get();
     }
 
-    bool updateAccessTimePool( const std::string&  keyStr, int newTimestamp, sqlite3* db )
+    Config
+    Database::readBinMetadata( BinState* bin )
     {
-        //OE_WARN << LC << "update access times " << _meta._layerName << " " << keyStr << std::endl;
-        sqlite3_stmt* update = 0L;
-        int rc = sqlite3_prepare_v2( db, _updateTimePoolSQL.c_str(), _updateTimePoolSQL.length(), &update, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL " << _updateTimePoolSQL << "; " << sqlite3_errmsg(db) << std::endl;
+        ScopedConnection conn( this );
+        if ( !conn.valid() )
+            return Config();
+
+        sqlite3_stmt* stmt = 0L;
+        std::string sql = "SELECT metadata FROM bins WHERE id = ?";
+        if ( sqlite3_prepare_v2( conn->db(), sql.c_str(), sql.length(), &stmt, 0L ) != SQLITE_OK )
+            return Config();
+
+        Config conf;
+        sqlite3_bind_int( stmt, 1, bin->_id );
+        if ( sqlite3_step( stmt ) == SQLITE_ROW && sqlite3_column_text( stmt, 0 ) )
+            conf.fromJSON( std::string((const char*)sqlite3_column_text( stmt, 0 )) );
+        sqlite3_finalize( stmt );
+        return conf;
+    }
+
+    bool
+    Database::writeBinMetadata( BinState* bin, const Config& conf )
+    {
+        ScopedConnection conn( this );
+        if ( !conn.valid() )
             return false;
-        }
 
-        bool success = true;
-        sqlite3_bind_int( update, 1, newTimestamp );
-        sqlite3_bind_text( update, 2, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
-        rc = sqlite3_step( update );
-        if ( rc != SQLITE_DONE )
-        {
-            OE_WARN << LC << "Failed to update timestamp for " << keyStr << " on layer " << _meta._layerName << " rc = " << rc << std::endl;
-            success = false;
-        }
+        sqlite3_stmt* stmt = 0L;
+        std::string sql = "UPDATE bins SET metadata = ? WHERE id = ?";
+        if ( sqlite3_prepare_v2( conn->db(), sql.c_str(), sql.length(), &stmt, 0L ) != SQLITE_OK )
+            return false;
 
-        sqlite3_finalize( update );
-        return success;
+        std::string json = conf.toJSON();
+        sqlite3_bind_text( stmt, 1, json.c_str(), json.length(), SQLITE_STATIC );
+        sqlite3_bind_int ( stmt, 2, bin->_id );
+        bool ok = sqlite3_step( stmt ) == SQLITE_DONE;
+        sqlite3_finalize( stmt );
+        return ok;
     }
 
-    bool load( const TileKey& key, ImageRecord& output, sqlite3* db )
+    bool
+    Database::insert( Connection* conn, BinState* bin, const PendingWrite* write )
     {
-        displayStats();
-        int imageBufLen = 0;
-        
-        sqlite3_stmt* select = 0L;
-        int rc = sqlite3_prepare_v2( db, _selectSQL.c_str(), _selectSQL.length(), &select, 0L );
-        if ( rc != SQLITE_OK )
+        // the size of the record being replaced, for the running counter.
+        sqlite3_int64 oldSize = 0;
+        if ( _performance )
         {
-            OE_WARN << LC << "Failed to prepare SQL: " << _selectSQL << "; " << sqlite3_errmsg(db) << std::endl;
-            return false;
+            sqlite3_stmt* select = conn->prepare( bin->_id, STMT_ENTRY_SIZE, bin->_sql[STMT_ENTRY_SIZE] );
+            if ( select )
+            {
+                sqlite3_bind_text( select, 1, write->_key.c_str(), write->_key.length(), SQLITE_STATIC );
+                if ( sqlite3_step( select ) == SQLITE_ROW )
+                    oldSize = sqlite3_column_int64( select, 0 );
+                conn->release( select );
+            }
         }
 
-        std::string keyStr = key.str();
-        sqlite3_bind_text( select, 1, keyStr.c_str(), keyStr.length(), SQLITE_STATIC );
+        sqlite3_stmt* insert = conn->prepare( bin->_id, STMT_INSERT, bin->_sql[STMT_INSERT] );
+        if ( !insert )
+            return false;
+
+        sqlite3_int64 size = write->_data.size();
+        sqlite3_bind_text ( insert, 1, write->_key.c_str(), write->_key.length(), SQLITE_STATIC );
+        sqlite3_bind_int  ( insert, 2, write->_time );
+        sqlite3_bind_int  ( insert, 3, write->_time );
+        sqlite3_bind_int64( insert, 4, size );
+        sqlite3_bind_text ( insert, 5, write->_metadata.c_str(), write->_metadata.length(), SQLITE_STATIC );
+        sqlite3_bind_blob ( insert, 6, write->_data.data(), write->_data.size(), SQLITE_STATIC );
 
-        rc = sqlite3_step( select );
-        if ( rc != SQLITE_ROW ) // == SQLITE_DONE ) // SQLITE_DONE means "no more rows"
+        bool ok = sqlite3_step( insert ) == SQLITE_DONE;
+        if ( !ok )
         {
-            // cache miss
-            OE_DEBUG << LC << "Cache MISS on tile " << key.str() << std::endl;
-            sqlite3_finalize(select);
-            return false;
+            OE_WARN << LC << "Failed to store \"" << write->_key << "\": " << sqlite3_errmsg(conn->db()) << std::endl;
         }
+        conn->release( insert );
 
-        // copy the timestamps:
-        output._created  = sqlite3_column_int( select, 0 );
-        output._accessed = sqlite3_column_int( select, 1 );
-
-#ifdef SPLIT_DB_FILE
-        std::string fname(keyStr);
-        osgDB::ReaderWriter::ReadResult rr = _rw->readImage( _meta._layerName + "_" +fname+".osgb" );
-#else
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
-        const char* data = (const char*)sqlite3_column_blob( select, 2 );
-        imageBufLen = sqlite3_column_bytes( select, 2 );
-
-        // deserialize the image from the buffer:
-        std::string imageString( data, imageBufLen );
-        std::stringstream imageBufStream( imageString );
-        osgDB::ReaderWriter::ReadResult rr = _rw->readImage( imageBufStream );
-#endif
-        if ( rr.error() )
+        Threading::ScopedMutexLock lock( bin->_mutex );
+        if ( ok )
         {
-            OE_WARN << LC << "Failed to read image from database: " << rr.message() << std::endl;
+            ++bin->_numWrites;
+            bin->_sizeBytes += size - oldSize;
         }
         else
         {
-            output._image = rr.takeImage();
-            output._key = key;
-            OE_DEBUG << LC << "Cache HIT on tile " << key.str() << std::endl;
+            ++bin->_numFailures;
         }
-
-        sqlite3_finalize(select);
-
-        _statsLoaded++;
-        return output._image.valid();
+        return ok;
     }
 
-    void displayStats()
+    void
+    Database::commitBatch( const BatchWriter::InsertList& inserts, const BatchWriter::TouchTable& touches )
     {
-        osg::Timer_t t = osg::Timer::instance()->tick();
-        if (osg::Timer::instance()->delta_s( _statsLastCheck, t) > 10.0) {
-            double d = osg::Timer::instance()->delta_s(_statsStartTimer, t);
-            OE_DEBUG << _meta._layerName << " time " << d << " stored " << std::dec << _statsStored << " rate " << _statsStored * 1.0 / d << std::endl;
-            OE_DEBUG << _meta._layerName << " time " << d << " loaded " << std::dec  << _statsLoaded << " rate " << _statsLoaded * 1.0 / d << std::endl;
-            OE_DEBUG << _meta._layerName << " time " << d << " deleted " << std::dec  << _statsDeleted << " rate " << _statsDeleted * 1.0 / d << std::endl;
-            _statsLastCheck = t;
-        }
-    }
+        ScopedConnection conn( this );
+        if ( !conn.valid() )
+            return;
 
-    bool purge( int utcTimeStamp, int maxToRemove, sqlite3* db )
-    {
-        if ( maxToRemove < 0 )
-            return false;
+        bool inTransaction = exec( conn->db(), "BEGIN IMMEDIATE" );
 
-        sqlite3_stmt* purge = 0L;
-        
-        int rc;
+        for( BatchWriter::InsertList::const_iterator i = inserts.begin(); i != inserts.end(); ++i )
         {
-#ifdef SPLIT_DB_FILE
-            {
-                std::vector<std::string> deleteFiles;
-                sqlite3_stmt* selectPurge = 0L;
-                rc = sqlite3_prepare_v2( db, _purgeSelect.c_str(), _purgeSelect.length(), &selectPurge, 0L);
-                if ( rc != SQLITE_OK )
-                {
-                    OE_WARN << LC << "Failed to prepare SQL: " << _purgeSelect << "; " << sqlite3_errmsg(db) << std::endl;
-                    return false;
-                }
-                sqlite3_bind_int( selectPurge, 2, maxToRemove );
-                sqlite3_bind_int( selectPurge, 1, utcTimeStamp );
+            insert( conn.get(), i->_bin.get(), i->_write.get() );
+        }
 
-                rc = sqlite3_step( selectPurge );
-                if ( rc != SQLITE_ROW && rc != SQLITE_DONE)
-                {
-                    OE_WARN << LC << "SQL QUERY failed for " << _purgeSelect << ": " 
-                            << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                            << ", rc = " << rc << std::endl;
-                    sqlite3_finalize( selectPurge );
-                    return false;
-                }
-                while (rc == SQLITE_ROW) {
-                    std::string f((const char*)sqlite3_column_text( selectPurge, 0 ));
-                    deleteFiles.push_back(f);
-                    rc = sqlite3_step( selectPurge );
-                }
-                if (rc != SQLITE_DONE) {
-                    OE_WARN << LC << "SQL QUERY failed for " << _purgeSelect << ": " 
-                            << sqlite3_errmsg( db ) //<< "; tries=" << (1000-tries)
-                            << ", rc = " << rc << std::endl;
-                    sqlite3_finalize( selectPurge );
-                    return false;
-                }
-                sqlite3_finalize( selectPurge );
-                while (!deleteFiles.empty()) {
-                    std::string fname = _meta._layerName + "_" + deleteFiles.back() +".osgb";
-                    int run = unlink(fname.c_str());
-                    if (run) {
-                        OE_WARN << "Error while removing file " << fname << std::endl;
-                    }
-                    deleteFiles.pop_back();
-                }
-            }
-#endif
-            rc = sqlite3_prepare_v2( db, _purgeLimitSQL.c_str(), _purgeLimitSQL.length(), &purge, 0L );
-            if ( rc != SQLITE_OK )
+        for( BatchWriter::TouchTable::const_iterator i = touches.begin(); i != touches.end(); ++i )
+        {
+            BinState* bin = i->first.first.get();
+            sqlite3_stmt* update = conn->prepare( bin->_id, STMT_UPDATE_TIME, bin->_sql[STMT_UPDATE_TIME] );
+            if ( update )
             {
-                OE_WARN << LC << "Failed to prepare SQL: " << _purgeLimitSQL << "; " << sqlite3_errmsg(db) << std::endl;
-                return false;
+                const std::string& key = i->first.second;
+                sqlite3_bind_int ( update, 1, i->second );
+                sqlite3_bind_text( update, 2, key.c_str(), key.length(), SQLITE_STATIC );
+                sqlite3_step( update );
+                conn->release( update );
             }
-            sqlite3_bind_int( purge, 2, maxToRemove );
         }
 
-        sqlite3_bind_int( purge, 1, utcTimeStamp );
+        if ( inserts.size() > 0 )
+            evictIfNeeded( conn.get() );
 
-        rc = sqlite3_step( purge );
-        if ( rc != SQLITE_DONE )
+        if ( inTransaction && !exec( conn->db(), "COMMIT" ) )
         {
-            // cache miss
-            OE_DEBUG << LC << "Error purging records from \"" << _meta._layerName << "\"; " << sqlite3_errmsg(db) << std::endl;
-            sqlite3_finalize(purge);
-            return false;
+            OE_WARN << LC << "Failed to commit batch of " << inserts.size() << " inserts" << std::endl;
+            exec( conn->db(), "ROLLBACK" );
         }
 
-        sqlite3_finalize(purge);
-        _statsDeleted += maxToRemove;
-        return true;
+        // the records are in the database now (or have failed for good). A key
+        // written again meanwhile keeps its newer pending entry.
+        for( BatchWriter::InsertList::const_iterator i = inserts.begin(); i != inserts.end(); ++i )
+        {
+            BinState* bin = i->_bin.get();
+            Threading::ScopedMutexLock lock( bin->_mutex );
+            BinState::PendingTable::iterator p = bin->_pending.find( i->_write->_key );
+            if ( p != bin->_pending.end() && p->second.get() == i->_write.get() )
+                bin->_pending.erase( p );
+        }
     }
 
-    /** Initializes the layer by creating the layer's table (if necessary), loading the
-        appropriate reader-writer for the image data, and initializing the compressor
-        if necessary. */
-    bool initialize( sqlite3* db )
+    void
+    Database::evictIfNeeded( Connection* conn )
     {
-        // first create the table if it does not already exist:
-        std::stringstream buf;
-        buf << "CREATE TABLE IF NOT EXISTS \"" << _tableName << "\" ("
-            << "key char(64) PRIMARY KEY UNIQUE, "
-            << "created int, "
-            << "accessed int, "
-#ifdef SPLIT_DB_FILE
-            << "size int )";
-#else
-            << "data blob )";
-#endif
-        std::string sql = buf.str();
-
-        OE_DEBUG << LC << "SQL = " << sql << std::endl;
+        if ( _options.maxSize().value() == 0 )
+            return;
 
-        char* errMsg = 0L;
-        int rc = sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg );
-        if ( rc != SQLITE_OK )
+        if ( !_performance )
         {
-            OE_WARN << LC << "Creating layer \"" << _meta._layerName << "\": " << errMsg << std::endl;
-            sqlite3_free( errMsg );
-            return false;
+            // the original cadence: a full size scan every so many writes.
+            if ( ++_writesSinceCheck < MAX_REQUEST_TO_RUN_PURGE )
+                return;
+            _writesSinceCheck.exchange( 0 );
+            purgeGeneral( conn );
+            return;
         }
 
-        // create an index on the time-last-accessed column
-        buf.str("");
-        buf << "CREATE INDEX IF NOT EXISTS \"" 
-            << _tableName << "_lruindex\" "
-            << "ON \"" << _tableName << "\" (accessed)";
-        sql = buf.str();
-
-        OE_DEBUG << LC << "SQL = " << sql << std::endl;
-
-        rc = sqlite3_exec( db, sql.c_str(), 0L, 0L, &errMsg );
-        if ( rc != SQLITE_OK )
+        // performance mode: the running size counters instead of table scans.
+        // Over max_size, free down to EVICTION_TARGET of it, taking from each
+        // bin in proportion to its size.
+        std::vector< osg::ref_ptr<BinState> > bins;
         {
-            OE_WARN << LC << "Creating index for layer \"" << _meta._layerName << "\": " << errMsg << std::endl;
-            sqlite3_free( errMsg );
-            //return false;
+            Threading::ScopedMutexLock lock( _binsMutex );
+            for( BinTable::const_iterator i = _bins.begin(); i != _bins.end(); ++i )
+                bins.push_back( i->second.get() );
         }
 
-        // next load the appropriate ReaderWriter:
-
-#if OSG_MIN_VERSION_REQUIRED(2,9,5)
-        _rw = osgDB::Registry::instance()->getReaderWriterForMimeType( _meta._format );
-        if ( !_rw.valid() )
-#endif
-            _rw = osgDB::Registry::instance()->getReaderWriterForExtension( _meta._format );
-        if ( !_rw.valid() )
+        std::vector<sqlite3_int64> sizes( bins.size() );
+        sqlite3_int64 totalSize = 0;
+        for( unsigned i=0; i<bins.size(); ++i )
         {
-            OE_WARN << LC << "Creating layer: Cannot initialize ReaderWriter for format \"" 
-                << _meta._format << "\"" << std::endl;
-            return false;
+            Threading::ScopedMutexLock lock( bins[i]->_mutex );
+            sizes[i] = bins[i]->_sizeBytes;
+            totalSize += sizes[i];
         }
 
-        if ( !_meta._compressor.empty() )
-            _rwOptions = new osgDB::ReaderWriter::Options( "Compressor=" + _meta._compressor );
-
-        _statsLastCheck = _statsStartTimer = osg::Timer::instance()->tick();
-        return true;
-    }
-
-    std::string _selectSQL;
-    std::string _insertSQL;
-    std::string _updateTimeSQL;
-    std::string _updateTimePoolSQL;
- 
-    std::string _purgeSelect;
-    std::string _purgeSQL;
-    std::string _purgeLimitSQL;
-    MetadataRecord _meta;
-    std::string _tableName;
-
-    osg::ref_ptr<osgDB::ReaderWriter> _rw;
-    osg::ref_ptr<osgDB::ReaderWriter::Options> _rwOptions;
-
-    osg::Timer_t _statsStartTimer;
-    osg::Timer_t _statsLastCheck;
-
-    int _statsLoaded;
-    int _statsStored;
-    int _statsDeleted;
-
-};
-
-// --------------------------------------------------------------------------
-
-typedef std::map<std::string,osg::ref_ptr<LayerTable> > LayerTablesByName;
-
-// --------------------------------------------------------------------------
-
-//TODO: might want to move this up out of this plugin at some point.
-
-struct AsyncPurge : public TaskRequest {
-    AsyncPurge( const std::string& layerName, int olderThanUTC, Cache* cache )
-        : _layerName(layerName), _olderThanUTC(olderThanUTC), _cache(cache) { }
-
-    void operator()( ProgressCallback* progress ) { 
-        osg::ref_ptr<Cache> cache = _cache.get();
-        if ( cache.valid() )
-            cache->purge( _layerName, _olderThanUTC, false );
-    }
-
-    std::string _layerName;
-    int _olderThanUTC;
-    osg::observer_ptr<Cache> _cache;
-};
+        sqlite3_int64 limit = (sqlite3_int64)_options.maxSize().value() * 1024 * 1024;
+        if ( totalSize <= limit )
+            return;
 
-struct AsyncInsert : public TaskRequest {
-    AsyncInsert( const TileKey& key, const CacheSpec& spec, const osg::Image* image, AsyncCache* cache )
-        : _cacheSpec(spec), _key(key), _image(image), _cache(cache) { }
+        sqlite3_int64 excess = totalSize - (sqlite3_int64)(EVICTION_TARGET * limit);
+        OE_DEBUG << LC << "Cache size " << totalSize/(1024*1024) << " MB; evicting "
+            << excess/1024 << " KB" << std::endl;
 
-    void operator()( ProgressCallback* progress ) {
-        osg::ref_ptr<AsyncCache> cache = _cache.get();
-        if ( cache.valid() )
-            cache->setImageSync( _key, _cacheSpec, _image.get() );
+        for( unsigned i=0; i<bins.size(); ++i )
+        {
+            sqlite3_int64 share = (sqlite3_int64)ceil( (double)excess * (double)sizes[i] / (double)totalSize );
+            if ( share > 0 )
+                evictFromBin( conn, bins[i].get(), share );
+        }
     }
 
-    CacheSpec _cacheSpec;
-    TileKey _key;
-    osg::ref_ptr<const osg::Image> _image;
-    osg::observer_ptr<AsyncCache> _cache;
-};
-
-class Sqlite3Cache;
-struct AsyncUpdateAccessTime : public TaskRequest
-{
-    AsyncUpdateAccessTime( const TileKey& key, const std::string& cacheId, int timeStamp, Sqlite3Cache* cache );
-    void operator()( ProgressCallback* progress );
-
-    TileKey _key;
-    std::string _cacheId;
-    int _timeStamp;
-    osg::observer_ptr<Sqlite3Cache> _cache;
-};
+    sqlite3_int64
+    Database::evictFromBin( Connection* conn, BinState* bin, sqlite3_int64 bytesToFree )
+    {
+        sqlite3_int64 freed   = 0;
+        unsigned      removed = 0;
 
+        while( freed < bytesToFree )
+        {
+            // least recently used records, straight off the access-time index.
+            sqlite3_stmt* select = conn->prepare( bin->_id, STMT_LRU_SELECT, bin->_sql[STMT_LRU_SELECT] );
+            if ( !select )
+                break;
+
+            std::vector< std::pair<std::string,sqlite3_int64> > victims;
+            sqlite3_bind_int( select, 1, EVICTION_CHUNK );
+            sqlite3_int64 chunkBytes = freed;
+            int rows = 0;
+            while( chunkBytes < bytesToFree && sqlite3_step( select ) == SQLITE_ROW )
+            {
+                ++rows;
+                sqlite3_int64 size = sqlite3_column_int64( select, 1 );
+                victims.push_back( std::make_pair(std::string((const char*)sqlite3_column_text( select, 0 )), size) );
+                chunkBytes += size;
+            }
+            conn->release( select );
 
+            if ( victims.empty() )
+                break;
 
-struct AsyncUpdateAccessTimePool : public TaskRequest
-{
-    AsyncUpdateAccessTimePool( const std::string& cacheId, Sqlite3Cache* cache );
-    void addEntry(const TileKey& key, int timeStamp);
-    void addEntryInternal(const TileKey& key);
-
-    void operator()( ProgressCallback* progress );
-    const std::string& getCacheId() { return _cacheId; }
-    int getNbEntry() const { return _keys.size(); }
-    std::map<std::string, int> _keys;
-    std::string _cacheId;
-    std::string _keyStr;
-    int _timeStamp;
-    osg::observer_ptr<Sqlite3Cache> _cache;
-};
+            unsigned removedBefore = removed;
 
+            sqlite3_stmt* del = conn->prepare( bin->_id, STMT_DELETE_KEY, bin->_sql[STMT_DELETE_KEY] );
+            if ( !del )
+                break;
 
+            for( unsigned i=0; i<victims.size(); ++i )
+            {
+                const std::string& key = victims[i].first;
+                sqlite3_bind_text( del, 1, key.c_str(), key.length(), SQLITE_STATIC );
+                if ( sqlite3_step( del ) == SQLITE_DONE )
+                {
+                    freed += victims[i].second;
+                    ++removed;
+                }
+                else
+                {
+                    OE_WARN << LC << "Failed to evict " << key << "; " << sqlite3_errmsg(conn->db()) << std::endl;
+                }
+                sqlite3_reset( del );
+            }
+            conn->release( del );
 
-// --------------------------------------------------------------------------
+            // nothing more to remove, or nothing removable:
+            if ( (rows < EVICTION_CHUNK && chunkBytes < bytesToFree) || removed == removedBefore )
+                break;
+        }
 
-struct ThreadTable {
-    ThreadTable(LayerTable* table, sqlite3* db) : _table(table), _db(db) { }
-    LayerTable* _table;
-    sqlite3* _db;
-};
+        Threading::ScopedMutexLock lock( bin->_mutex );
+        bin->_sizeBytes  -= freed;
+        if ( bin->_sizeBytes < 0 )
+            bin->_sizeBytes = 0;
+        bin->_numEvicted += removed;
+        return freed;
+    }
 
-class Sqlite3Cache : public AsyncCache
-{
-public:
-    Sqlite3Cache( const CacheOptions& options ) 
-      : AsyncCache(options), _options(options),  _db(0L)
-    {                
-        if ( _options.path().get().empty() || options.getReferenceURI().empty() )
-            _databasePath = _options.path().get();
-        else
+    void
+    Database::purgeGeneral( Connection* conn )
+    {
+        std::vector< osg::ref_ptr<BinState> > bins;
         {
-           _databasePath = osgEarth::getFullPath( options.getReferenceURI(), _options.path().get() );
+            Threading::ScopedMutexLock lock( _binsMutex );
+            for( BinTable::const_iterator i = _bins.begin(); i != _bins.end(); ++i )
+                bins.push_back( i->second.get() );
         }
 
-        
-        setName( "sqlite3" );
+        sqlite3_int64 limit = (sqlite3_int64)_options.maxSize().value() * 1024 * 1024;
 
-        _nbRequest = 0;
+        std::vector<sqlite3_int64> sizes( bins.size() );
+        sqlite3_int64 totalSize = 0;
+        for( unsigned i=0; i<bins.size(); ++i )
+        {
+            sizes[i] = osg::maximum( queryInt64(conn, "SELECT sum(size) FROM " + bins[i]->_table), (sqlite3_int64)0 );
+            totalSize += sizes[i];
+        }
 
-        //_settings = dynamic_cast<const Sqlite3CacheOptions*>( options );
-        //if ( !_settings.valid() )
-        //    _settings = new Sqlite3CacheOptions( options );
+        if ( totalSize < PURGE_THRESHOLD * limit )
+            return;
 
-        OE_INFO << LC << "options: " << _options.getConfig().toString() << std::endl;
+        int now = (int)::time(0L);
 
-        if ( sqlite3_threadsafe() == 0 )
+        // remove an estimated number of records from each bin, in proportion to
+        // its size, using the bin's average record size.
+        for( unsigned i=0; i<bins.size(); ++i )
         {
-            OE_WARN << LC << "SQLITE3 IS NOT COMPILED IN THREAD-SAFE MODE" << std::endl;
-            // TODO: something in this unlikely condition
-        }
+            sqlite3_int64 count = queryInt64( conn, "SELECT count(*) FROM " + bins[i]->_table );
+            if ( count <= 0 || sizes[i] <= 0 )
+                continue;
 
-        // enabled shared cache mode.
-        //sqlite3_enable_shared_cache( 1 );
+            double share   = (double)(totalSize - limit) * (double)sizes[i] / (double)totalSize;
+            double average = (double)sizes[i] / (double)count;
+            int    toRemove = (int)ceil( share / average );
 
-#ifdef USE_L2_CACHE
-        _L2cache = new MemCache();
-        _L2cache->setMaxNumTilesInCache( 64 );
-        OE_INFO << LC << "Using L2 memory cache" << std::endl;
-#endif
-        
-        _db = openDatabase( _databasePath, _options.serialized().value() );
+            std::string sql = Stringify()
+                << "DELETE FROM " << bins[i]->_table << " WHERE key IN "
+                << "(SELECT key FROM " << bins[i]->_table << " WHERE accessed < " << now << " LIMIT " << toRemove << ")";
 
-        if ( _db )
-        {
-            if ( ! _metadata.initialize( _db ) )
-                _db = 0L;
+            if ( exec(conn->db(), sql) )
+            {
+                Threading::ScopedMutexLock lock( bins[i]->_mutex );
+                bins[i]->_numEvicted += sqlite3_changes( conn->db() );
+            }
         }
+    }
 
-        if ( _db && _options.asyncWrites() == true )
-        {
-            _writeService = new osgEarth::TaskService( "Sqlite3Cache Write Service", 1 );
-        }
+    //------------------------------------------------------------------------
 
-        
-        if (!_metadata.loadAllLayers( _db, _layersList )) {
-            OE_WARN << "can't read layers in meta data" << std::endl;
+    BatchWriter::BatchWriter( Database* db, unsigned maxBatchSize, unsigned maxBatchTime ) :
+    _db            ( db ),
+    _maxBatchSize  ( osg::maximum(maxBatchSize, 1u) ),
+    _maxBatchTime  ( maxBatchTime ),
+    _done          ( false ),
+    _busy          ( false ),
+    _numBatches    ( 0 ),
+    _totalBatchTime( 0.0 )
+    {
+        // bound the serialized data held in memory.
+        _maxQueued = osg::maximum( 4u * _maxBatchSize, 64u );
+    }
+
+    BatchWriter::~BatchWriter()
+    {
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            _done = true;
+            _cond.broadcast();
         }
+        join();
+    }
 
+    void
+    BatchWriter::addInsert( BinState* bin, PendingWrite* write )
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        while( !_done && _inserts.size() >= _maxQueued )
+            _idleCond.wait( &_mutex );
+
+        Insert insert;
+        insert._bin   = bin;
+        insert._write = write;
+        _inserts.push_back( insert );
+        _cond.broadcast();
     }
 
-    // just here to satisfy the osg::Object requirements
-    Sqlite3Cache() { }
-    Sqlite3Cache( const Sqlite3Cache& rhs, const osg::CopyOp& op ) { }
-    META_Object(osgEarth,Sqlite3Cache);
+    void
+    BatchWriter::addTouch( BinState* bin, const std::string& key, int timeStamp )
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        _touches[ std::make_pair(osg::ref_ptr<BinState>(bin), key) ] = timeStamp;
+        _cond.broadcast();
+    }
 
-public: // Cache interface
-    
-    /**
-     * Gets whether the given TileKey is cached or not
-     */
-    bool isCached( const TileKey& key, const CacheSpec& spec ) const
+    void
+    BatchWriter::flush()
     {
-        // this looks ineffecient, but usually when isCached() is called, getImage() will be
-        // called soon thereafter. And this call will load it into the L2 cache so the subsequent
-        // getImage call will not hit the DB again.
-        osg::ref_ptr<const osg::Image> temp;
-        return const_cast<Sqlite3Cache*>(this)->getImage( key, spec, temp );
+        Threading::ScopedMutexLock lock( _mutex );
+        while( _busy || !_inserts.empty() || !_touches.empty() )
+            _idleCond.wait( &_mutex );
     }
 
-    /**
-     * Store the cache profile for the given profile.
-     */
-    virtual void storeProperties( const CacheSpec& spec, const Profile* profile, unsigned int tileSize ) 
+    unsigned
+    BatchWriter::getDepth()
     {
-        if ( !_db ) return;
+        Threading::ScopedMutexLock lock( _mutex );
+        return _inserts.size() + _touches.size();
+    }
 
-        if ( spec.cacheId().empty() || profile == 0L || spec.format().empty() )
+    void
+    BatchWriter::run()
+    {
+        for(;;)
         {
-            OE_WARN << "ILLEGAL: cannot cache a layer without a layer id" << std::endl;
-            return;
-        }
+            InsertList inserts;
+            TouchTable touches;
+            {
+                Threading::ScopedMutexLock lock( _mutex );
 
-        ScopedLock<Mutex> lock( _tableListMutex ); // b/c we're using the base db handle
-#ifdef SPLIT_LAYER_DB
-        sqlite3* db = getOrCreateMetaDbForThread();
-#else
-        sqlite3* db = getOrCreateDbForThread();
-#endif
-        if ( !db )
-            return;
+                while( _inserts.empty() && _touches.empty() && !_done )
+                    _cond.wait( &_mutex );
 
-        //OE_INFO << "Storing metadata for layer \"" << layerName << "\"" << std::endl;
+                if ( _inserts.empty() && _touches.empty() )
+                    break;
 
-        MetadataRecord rec;
-        rec._layerName = spec.cacheId();
-        rec._profile = profile;
-        rec._tileSize = tileSize;
+                // give the batch until the time limit to fill up.
+                osg::Timer_t start = osg::Timer::instance()->tick();
+                while( !_done && _inserts.size() + _touches.size() < _maxBatchSize )
+                {
+                    double remaining = (double)_maxBatchTime - osg::Timer::instance()->delta_m( start, osg::Timer::instance()->tick() );
+                    if ( remaining <= 0.0 )
+                        break;
+                    _cond.wait( &_mutex, (unsigned long)ceil(remaining) );
+                }
 
-#ifdef USE_SERIALIZERS
-        rec._format = "osgb";
-        rec._compressor = "zlib";
-#else
-        rec._format = spec.format();
-#endif
+                // a batch takes at most _maxBatchSize inserts; touches are cheap and go along.
+                if ( _inserts.size() > _maxBatchSize )
+                {
+                    inserts.assign( _inserts.begin(), _inserts.begin() + _maxBatchSize );
+                    _inserts.erase( _inserts.begin(), _inserts.begin() + _maxBatchSize );
+                }
+                else
+                {
+                    inserts.swap( _inserts );
+                }
+                touches.swap( _touches );
+                _busy = true;
+                _idleCond.broadcast(); // room in the queue
+            }
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            _db->commitBatch( inserts, touches );
+            double t = osg::Timer::instance()->delta_m( start, osg::Timer::instance()->tick() );
 
-        _metadata.store( rec, db );
+            OE_DEBUG << LC << "Committed batch: " << inserts.size() << " inserts, " << touches.size()
+                << " touches in " << t << " ms" << std::endl;
+
+            Threading::ScopedMutexLock lock( _mutex );
+            _busy = false;
+            ++_numBatches;
+            _totalBatchTime += t;
+            _idleCond.broadcast();
+        }
     }
 
+    //------------------------------------------------------------------------
+
     /**
-     * Loads the cache profile for the given layer.
+     * Cache that stores data in a single sqlite3 database file.
      */
-    virtual bool loadProperties( 
-        const std::string&           cacheId, 
-        CacheSpec&                   out_spec, 
-        osg::ref_ptr<const Profile>& out_profile,
-        unsigned int&                out_tileSize ) 
+    class Sqlite3Cache : public Cache
     {
-        if ( !_db ) return 0L;
+    public:
+        Sqlite3Cache() { } // unused
+        Sqlite3Cache( const Sqlite3Cache& rhs, const osg::CopyOp& op ) { } // unused
+        META_Object( osgEarth, Sqlite3Cache );
 
-        ScopedLock<Mutex> lock( _tableListMutex ); // b/c we're using the base db handle
+        Sqlite3Cache( const CacheOptions& options );
 
-#ifdef SPLIT_LAYER_DB
-        sqlite3* db = getOrCreateMetaDbForThread();
-#else
-        sqlite3* db = getOrCreateDbForThread();
-#endif
-        if ( !db )
-            return 0L;
+    public: // Cache interface
 
-        OE_DEBUG << LC << "Loading metadata for layer \"" << cacheId << "\"" << std::endl;
+        CacheBin* addBin( const std::string& binID );
 
-        MetadataRecord rec;
-        if ( _metadata.load( cacheId, db, rec ) )
-        {
-            out_spec = CacheSpec( rec._layerName, rec._format );
-            out_tileSize = rec._tileSize;
-            out_profile = rec._profile;
-        }
-        return 0L;
-    }
+        CacheBin* getOrCreateDefaultBin();
+
+    protected:
+        osg::ref_ptr<Database> _db;
+        Threading::Mutex       _defaultBinMutex;
+    };
 
     /**
-     * Gets the cached image for the given TileKey
+     * Cache bin implementation for a Sqlite3Cache: one table in the database.
+     * Entries are serialized with the osgb plugin, like the file system cache.
      */
-    bool getImage( const TileKey& key, const CacheSpec& spec, osg::ref_ptr<const osg::Image>& out_image )
+    class Sqlite3CacheBin : public CacheBin
     {
-        if ( !_db ) return false;
-
-        // wait if we are purging the db
-        ScopedLock<Mutex> lock2( _pendingPurgeMutex );
+    public:
+        Sqlite3CacheBin( const std::string& binID, Database* db );
 
-        // first try the L2 cache.
-        if ( _L2cache.valid() )
-        {
-            if ( _L2cache->getImage( key, spec, out_image ) )
-                return true;
-        }
+    public: // CacheBin interface
 
-        // next check the deferred-write queue.
-        if ( _options.asyncWrites() == true )
-        {
-#ifdef INSERT_POOL
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-            std::string name = layerName;
-            std::map<std::string, osg::ref_ptr<AsyncInsertPool> >::iterator it = _pendingWrites.find(name);
-            if (it != _pendingWrites.end()) {
-                AsyncInsertPool* p = it->second.get();
-                if (p) {
-                    osg::Image* img = p->findImage(key.str());
-                    if (img) {
-                        // todo: update the access time, or let it slide?
-                        OE_DEBUG << LC << "Got key that is write-queued: " << key.str() << std::endl;
-                        return img;
-                    }
-                }
-            }
-#else
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-            std::string name = key.str() + spec.cacheId(); //layerName;
-            std::map<std::string,osg::ref_ptr<AsyncInsert> >::iterator i = _pendingWrites.find(name);
-            if ( i != _pendingWrites.end() )
-            {
-                // todo: update the access time, or let it slide?
-                OE_DEBUG << LC << "Got key that is write-queued: " << key.str() << std::endl;
-                out_image = i->second->_image.get();
-                return out_image.valid();
-                //return i->second->_image.get();
-            }
-#endif
-        }
+        ReadResult readObject( const std::string& key, double maxAge =DBL_MAX );
 
-        // finally, try to query the database.
-        ThreadTable tt = getTable( spec.cacheId() ); //layerName);
-        if ( tt._table )
-        {
-            ImageRecord rec( key );
-            if (!tt._table->load( key, rec, tt._db ))
-                return false;
+        ReadResult readImage( const std::string& key, double maxAge =DBL_MAX );
 
-            // load it into the L2 cache
-            out_image = rec._image.release();
+        ReadResult readString( const std::string& key, double maxAge =DBL_MAX );
 
-            if ( out_image.valid() && _L2cache.valid() )
-                _L2cache->setImage( key, spec, out_image.get() );
+        bool write( const std::string& key, const osg::Object* object, const Config& meta );
 
-#ifdef UPDATE_ACCESS_TIMES
+        bool touch( const std::string& key, const Config& meta );
 
-#ifdef UPDATE_ACCESS_TIMES_POOL
-            // update the last-access time
-            int t = (int)::time(0L);
-            {
-                ScopedLock<Mutex> lock( _pendingUpdateMutex );
-                osg::ref_ptr<AsyncUpdateAccessTimePool> pool;
-                std::map<std::string,osg::ref_ptr<AsyncUpdateAccessTimePool> >::iterator i = _pendingUpdates.find( spec.cacheId() ); //layerName);
-                if ( i != _pendingUpdates.end() )
-                {
-                    i->second->addEntry(key, t);
-                    pool = i->second;
-                    OE_DEBUG << LC << "Add key " << key.str() << " to existing layer batch " << spec.name() << std::endl;
-                } else {
-                    pool = new AsyncUpdateAccessTimePool(spec.cacheId(), this);
-                    pool->addEntry(key, t);
-                    _pendingUpdates[spec.cacheId()] = pool.get();
-                    _writeService->add(pool.get());
-                }
-            }
-#else
-            // update the last-access time
-            int t = (int)::time(0L);
-            _writeService->add( new AsyncUpdateAccessTime(  key, layerName, t, this ) );
-#endif
+        bool isCached( const std::string& key, double maxAge =DBL_MAX );
 
-#endif // UPDATE_ACCESS_TIMES
+        bool purge();
 
-            return out_image.valid();
-        }
-        else
-        {
-            OE_DEBUG << LC << "What, no layer table?" << std::endl;
-        }
-        return false;
-    }
+        Config readMetadata();
 
-    /**
-     * Sets the cached image for the given TileKey
-     */
-    void setImage( const TileKey& key, const CacheSpec& spec, const osg::Image* image )
-    {        
-        if ( !_db ) return;
+        bool writeMetadata( const Config& meta );
 
-        if ( _options.asyncWrites() == true )
-        {
-            // the "pending writes" table is here so that we don't try to write data to
-            // the cache more than once when using an asynchronous write service.
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-#ifdef INSERT_POOL
-            std::string name = layerName;
-            std::map<std::string, osg::ref_ptr<AsyncInsertPool> >::iterator it = _pendingWrites.find(name);
-            if ( it == _pendingWrites.end() )
-            {
-                AsyncInsertPool* req = new AsyncInsertPool(layerName, this);
-                req->addEntry(key, format, image);
-                _pendingWrites[name] = req;
-                _writeService->add( req );
-            }
-            else
-            {
-                it->second->addEntry(key, format, image);
-            }
-#else
-            std::string name = key.str() + spec.cacheId();
-            if ( _pendingWrites.find(name) == _pendingWrites.end() )
-            {
-                AsyncInsert* req = new AsyncInsert(key, spec, image, this);
-                _pendingWrites[name] = req;
-                _writeService->add( req );
-            }
-            else
-            {
-                //NOTE: this should probably never happen.
-                OE_WARN << LC << "Tried to setImage; already in queue: " << key.str() << std::endl;
-            }
-#endif
-        }
-        else
-        {
+        Config getStats();
 
-            setImageSync( key, spec, image );
-        }
-    }
+    protected:
+        enum ObjectType { TYPE_OBJECT, TYPE_IMAGE };
 
-    /**
-     * Purges records from the database.
-     */
-    bool purge( const std::string& layerName, int olderThanUTC, bool async )
-    {
-        if ( !_db ) return false;
+        ReadResult read( const std::string& key, double maxAge, ObjectType type );
 
-        // purge the L2 cache first:
-        if ( async == true && _options.asyncWrites() == true )
-        {
-#ifdef PURGE_GENERAL
-            if (!_pendingPurges.empty())
-                return false;
-            ScopedLock<Mutex> lock( _pendingPurgeMutex );
-            AsyncPurge* req = new AsyncPurge(layerName, olderThanUTC, this);
-            _writeService->add( req);
-            _pendingPurges[layerName] = req;
-#else
-            if (_pendingPurges.find(layerName) != _pendingPurges.end()) {
-                return false;
-            } else {
-                ScopedLock<Mutex> lock( _pendingPurgeMutex );
-                AsyncPurge* req = new AsyncPurge(layerName, olderThanUTC, this);
-                _writeService->add( req);
-                _pendingPurges[layerName] = req;
-            }
-#endif
+        bool isExpired( int created, double maxAge ) const {
+            return maxAge < DBL_MAX && (double)((int)::time(0L) - created) > maxAge;
         }
-        else
-        {
-#ifdef PURGE_GENERAL
-            ScopedLock<Mutex> lock( _pendingPurgeMutex );
-
-            sqlite3_int64 limit = _options.maxSize().value() * 1024 * 1024;
-            std::map<std::string, std::pair<sqlite3_int64,int> > layers;
-            sqlite3_int64 totalSize = 0;
-            for (unsigned int i = 0; i < _layersList.size(); ++i) {
-                ThreadTable tt = getTable( _layersList[i] );
-                if ( tt._table ) {
-                    sqlite3_int64 size = tt._table->getTableSize(tt._db);
-                    layers[_layersList[i] ].first = size;
-                    layers[_layersList[i] ].second = tt._table->getNbEntry(tt._db);
-                    totalSize += size;
-                }
-            }
-            OE_INFO << LC << "SQlite cache size " << totalSize/(1024*1024) << " MB" << std::endl;
-            if (totalSize > 1.2 * limit) {
-                sqlite3_int64 diff = totalSize - limit;
-                for (unsigned int i = 0; i < _layersList.size(); ++i) {
-                    float ratio = layers[_layersList[i] ].first * 1.0 / (float)(totalSize);
-                    int sizeToRemove = (int)floor(ratio * diff);
-                    if (sizeToRemove > 0) {
-                        if (sizeToRemove / 1024 > 1024) {
-                            OE_DEBUG << "Try to remove " << sizeToRemove/(1024*1024) << " MB in " << _layersList[i] << std::endl;
-                        } else {
-                            OE_DEBUG << "Try to remove " << sizeToRemove/1024 << " KB in " << _layersList[i] << std::endl;
-                        }
-
-                        if ( _L2cache.valid() )
-                            _L2cache->purge( _layersList[i], olderThanUTC, async );
-                        ThreadTable tt = getTable(_layersList[i]);
-                        if ( tt._table ) {
-                            float averageSizePerElement = layers[_layersList[i] ].first * 1.0 /layers[_layersList[i] ].second;
-                            int nb = (int)floor(sizeToRemove / averageSizePerElement);
-                            if (nb ) {
-                                OE_DEBUG << "remove " << nb << " / " << layers[_layersList[i] ].second << " elements in " << _layersList[i] << std::endl;
-                                tt._table->purge(olderThanUTC, nb, tt._db);
-                            }
-                        }
-                    }
-                }
-            }
-            _pendingPurges.clear();
-            displayPendingOperations();
-
-#else
-            ScopedLock<Mutex> lock( _pendingPurgeMutex );
-            if ( _L2cache.valid() )
-                _L2cache->purge( layerName, olderThanUTC, async );
 
-            ThreadTable tt = getTable( layerName );
-            if ( tt._table )
-            {
-                _pendingPurges.erase( layerName );
+        bool                              _ok;
+        osg::ref_ptr<Database>            _db;
+        osg::ref_ptr<BinState>            _state;
+        osg::ref_ptr<osgDB::ReaderWriter> _rw;
+        osg::ref_ptr<osgDB::Options>      _rwOptions;
+    };
 
-                unsigned int maxsize = _options.getSize(layerName);
-                tt._table->checkAndPurgeIfNeeded(tt._db, maxsize * 1024 * 1024);
-                displayPendingOperations();
-            }
-#endif
-        }
-        return true;
-    }
+    //------------------------------------------------------------------------
 
-    /**
-     * updateAccessTime records on the database.
-     */
-    bool updateAccessTimeSync( const std::string& layerName, const TileKey& key, int newTimestamp )
+    Sqlite3Cache::Sqlite3Cache( const CacheOptions& options ) :
+    Cache( options )
     {
-        if ( !_db ) return false;
+        Sqlite3CacheOptions sqlOptions( options );
 
-        ThreadTable tt = getTable(layerName);
-        if ( tt._table )
+        if ( !sqlOptions.path().isSet() || sqlOptions.path()->empty() )
         {
-            tt._table->updateAccessTime( key, newTimestamp, tt._db );
+            OE_WARN << LC << "No database path set" << std::endl;
+            _ok = false;
+            return;
         }
-        return true;
-    }
 
-    /**
-     * updateAccessTime records on the database.
-     */
-    bool updateAccessTimeSyncPool( const std::string& layerName, const std::string& keys, int newTimestamp )
-    {
-        if ( !_db ) return false;
+        std::string path = URI( *sqlOptions.path(), options.referrer() ).full();
 
-        ThreadTable tt = getTable(layerName);
-        if ( tt._table )
-        {
-            tt._table->updateAccessTimePool( keys, newTimestamp, tt._db );
-        }
+        OE_INFO << LC << "options: " << sqlOptions.getConfig().toJSON() << std::endl;
 
+        _db = new Database( path, sqlOptions );
+        _ok = _db->isOK();
+        if ( !_ok )
         {
-            ScopedLock<Mutex> lock( _pendingUpdateMutex );
-            _pendingUpdates.erase( layerName );
-            displayPendingOperations();
+            OE_WARN << LC << "FAILED to open cache database at \"" << path << "\"" << std::endl;
         }
-        return true;
     }
 
-#ifdef INSERT_POOL
-    void setImageSyncPool( AsyncInsertPool* pool, const std::string& layerName)
+    CacheBin*
+    Sqlite3Cache::addBin( const std::string& name )
     {
-        ScopedLock<Mutex> lock( _pendingWritesMutex );
-        const AsyncInsertPool::PoolContainer& entries = pool->_pool;
-        OE_WARN << "write " << entries.size() << std::endl;
-        ThreadTable tt = getTable(layerName);
-        if ( tt._table )
+        if ( !_ok ) return 0L;
+        return _bins.getOrCreate( name, new Sqlite3CacheBin( name, _db.get() ) );
+    }
+
+    CacheBin*
+    Sqlite3Cache::getOrCreateDefaultBin()
+    {
+        if ( !_ok ) return 0L;
+        if ( !_defaultBin.valid() )
         {
-            sqlite3_stmt* insert;
-            if (!tt._table->beginStore( tt._db, insert )) {
-                return;
-            }
-            if (!tt._table->storePool( tt._db, entries, insert )) {
-                return;
-            }
-            if (!tt._table->endStore( tt._db, insert )) {
-                return;
+            Threading::ScopedMutexLock lock( _defaultBinMutex );
+            if ( !_defaultBin.valid() ) // double-check
+            {
+                _defaultBin = new Sqlite3CacheBin( "__default", _db.get() );
             }
         }
-        _pendingWrites.erase( layerName );
-        displayPendingOperations();
+        return _defaultBin.get();
     }
-#endif
 
-private:
-
-    void displayPendingOperations() {
-        if (_pendingWrites.size())
-            OE_DEBUG<< LC << "pending insert " << _pendingWrites.size() << std::endl;
-        if (_pendingUpdates.size())
-            OE_DEBUG << LC << "pending update " << _pendingUpdates.size() << std::endl;
-        if (_pendingPurges.size())
-            OE_DEBUG << LC << "pending purge " << _pendingPurges.size() << std::endl;
-        //OE_INFO << LC << "Pending writes: " << std::dec << _writeService->getNumRequests() << std::endl;
-    }
+    //------------------------------------------------------------------------
 
-    void setImageSync( const TileKey& key, const CacheSpec& spec, const osg::Image* image )
+    Sqlite3CacheBin::Sqlite3CacheBin( const std::string& binID, Database* db ) :
+    CacheBin( binID ),
+    _ok     ( false ),
+    _db     ( db )
     {
-        if (_options.maxSize().value() > 0 && _nbRequest > MAX_REQUEST_TO_RUN_PURGE) {
-            int t = (int)::time(0L);
-            purge(spec.cacheId(), t, _options.asyncWrites().value() );
-            _nbRequest = 0;
-        }
-        _nbRequest++;
+        _state = _db->getOrCreateBin( binID );
+        _rw    = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+        _ok    = _state.valid() && _rw.valid();
 
-        ThreadTable tt = getTable( spec.cacheId() );
-        if ( tt._table )
+        if ( !_rw.valid() )
         {
-            ::time_t t = ::time(0L);
-            ImageRecord rec( key );
-            rec._created = (int)t;
-            rec._accessed = (int)t;
-            rec._image = image;
-
-            tt._table->store( rec, tt._db );
+            OE_WARN << LC << "The osgb plugin is not available; cache bin \"" << binID << "\" is disabled" << std::endl;
         }
 
-        if ( _options.asyncWrites() == true )
-        {
-            ScopedLock<Mutex> lock( _pendingWritesMutex );
-            std::string name = key.str() + spec.cacheId();
-            _pendingWrites.erase( name );
-            displayPendingOperations();
-        }
+        _rwOptions = Registry::instance()->cloneOrCreateOptions();
+#ifdef OSGEARTH_HAVE_ZLIB
+        _rwOptions->setOptionString( "Compressor=zlib" );
+#endif
+        CachePolicy::NO_CACHE.apply( _rwOptions.get() );
     }
 
-
-#ifdef SPLIT_LAYER_DB
-    sqlite3* getOrCreateDbForThread(const std::string& layer)
+    ReadResult
+    Sqlite3CacheBin::read( const std::string& key, double maxAge, ObjectType type )
     {
-        sqlite3* db = 0L;
+        if ( !_ok ) return ReadResult();
 
-        // this method assumes the thread already holds a lock on _tableListMutex, which
-        // doubles to protect _dbPerThread
+        std::string data;
+        Config      meta;
+        int         created = 0;
 
-        Thread* thread = Thread::CurrentThread();
-        std::map<Thread*,sqlite3*>::const_iterator k = _dbPerThreadLayers[layer].find(thread);
-        if ( k == _dbPerThreadLayers[layer].end() )
+        // a write still in the queue is the freshest copy; its buffer is never
+        // modified once queued, so hold a reference and read it in place.
+        osg::ref_ptr<PendingWrite> pending;
         {
-            db = openDatabase( layer + _options.path().value(), _options.serialized().value() );
-            if ( db )
-            {
-                _dbPerThreadLayers[layer][thread] = db;
-                OE_INFO << LC << "Created DB handle " << std::hex << db << " for thread " << thread << std::endl;
-            }
-            else
-            {
-                OE_WARN << LC << "Failed to open DB on thread " << thread << std::endl;
-            }
+            Threading::ScopedMutexLock lock( _state->_mutex );
+            BinState::PendingTable::const_iterator i = _state->_pending.find( key );
+            if ( i != _state->_pending.end() )
+                pending = i->second.get();
+        }
+
+        if ( pending.valid() )
+        {
+            created = pending->_time;
+            if ( !pending->_metadata.empty() )
+                meta.fromJSON( pending->_metadata );
         }
         else
         {
-            db = k->second;
+            ScopedConnection conn( _db.get() );
+            if ( !conn.valid() )
+                return ReadResult();
+
+            sqlite3_stmt* select = conn->prepare( _state->_id, STMT_SELECT, _state->_sql[STMT_SELECT] );
+            if ( !select )
+                return ReadResult();
+
+            sqlite3_bind_text( select, 1, key.c_str(), key.length(), SQLITE_STATIC );
+            bool found = sqlite3_step( select ) == SQLITE_ROW;
+            if ( found )
+            {
+                created = sqlite3_column_int( select, 0 );
+                if ( sqlite3_column_text( select, 1 ) )
+                    meta.fromJSON( std::string((const char*)sqlite3_column_text( select, 1 )) );
+
+                const char* blob = (const char*)sqlite3_column_blob( select, 2 );
+                int         size = sqlite3_column_bytes( select, 2 );
+                if ( blob && size > 0 )
+                    data.assign( blob, size );
+            }
+            conn->release( select );
+
+            if ( !found || data.empty() )
+                return ReadResult();
         }
 
-        return db;
-    }
+        if ( isExpired(created, maxAge) )
+            return ReadResult();
 
+        std::istringstream pendingIn;
+        std::istringstream dataIn( data );
+        if ( pending.valid() )
+            pendingIn.str( pending->_data );
+        std::istream& in = pending.valid() ? (std::istream&)pendingIn : (std::istream&)dataIn;
 
-    sqlite3* getOrCreateMetaDbForThread()
-    {
-        sqlite3* db = 0L;
+        osgDB::ReaderWriter::ReadResult r =
+            type == TYPE_IMAGE ? _rw->readImage ( in, _rwOptions.get() ) :
+                                 _rw->readObject( in, _rwOptions.get() );
 
-        // this method assumes the thread already holds a lock on _tableListMutex, which
-        // doubles to protect _dbPerThread
+        if ( !r.success() )
+            return ReadResult();
 
-        Thread* thread = Thread::CurrentThread();
-        std::map<Thread*,sqlite3*>::const_iterator k = _dbPerThreadMeta.find(thread);
-        if ( k == _dbPerThreadMeta.end() )
+        // record the access for LRU eviction: batched in performance mode.
+        int now = (int)::time(0L);
+        if ( _db->isPerformanceMode() )
         {
-            db = openDatabase( _options.path().value(), _options.serialized().value() );
-            if ( db )
-            {
-                _dbPerThreadMeta[thread] = db;
-                OE_INFO << LC << "Created DB handle " << std::hex << db << " for thread " << thread << std::endl;
-            }
-            else
-            {
-                OE_WARN << LC << "Failed to open DB on thread " << thread << std::endl;
-            }
+            _db->getWriter()->addTouch( _state.get(), key, now );
         }
-        else
+        else if ( !pending.valid() )
         {
-            db = k->second;
+            ScopedConnection conn( _db.get() );
+            sqlite3_stmt* update = conn.valid() ? conn->prepare( _state->_id, STMT_UPDATE_TIME, _state->_sql[STMT_UPDATE_TIME] ) : 0L;
+            if ( update )
+            {
+                sqlite3_bind_int ( update, 1, now );
+                sqlite3_bind_text( update, 2, key.c_str(), key.length(), SQLITE_STATIC );
+                sqlite3_step( update );
+                conn->release( update );
+            }
         }
 
-        return db;
+        return
+            type == TYPE_IMAGE ? ReadResult( r.getImage(), meta ) :
+                                 ReadResult( r.getObject(), meta );
     }
 
-#else
-    sqlite3* getOrCreateDbForThread()
+    ReadResult
+    Sqlite3CacheBin::readImage( const std::string& key, double maxAge )
     {
-        sqlite3* db = 0L;
+        return read( key, maxAge, TYPE_IMAGE );
+    }
+
+    ReadResult
+    Sqlite3CacheBin::readObject( const std::string& key, double maxAge )
+    {
+        return read( key, maxAge, TYPE_OBJECT );
+    }
+
+    ReadResult
+    Sqlite3CacheBin::readString( const std::string& key, double maxAge )
+    {
+        ReadResult r = readObject( key, maxAge );
+        return r.succeeded() && r.get<StringObject>() ? r : ReadResult();
+    }
+
+    bool
+    Sqlite3CacheBin::write( const std::string& key, const osg::Object* object, const Config& meta )
+    {
+        if ( !_ok || !object ) return false;
 
-        // this method assumes the thread already holds a lock on _tableListMutex, which
-        // doubles to protect _dbPerThread
+        // serialize it here, so the queue never holds on to the caller's object.
+        std::stringstream buf;
+        osgDB::ReaderWriter::WriteResult r;
 
-        Thread* thread = Thread::CurrentThread();
-        std::map<Thread*,sqlite3*>::const_iterator k = _dbPerThread.find(thread);
-        if ( k == _dbPerThread.end() )
+        if ( dynamic_cast<const osg::Image*>(object) )
         {
-            db = openDatabase( _databasePath, _options.serialized().value() );
-            if ( db )
-            {
-                _dbPerThread[thread] = db;
-                OE_DEBUG << LC << "Created DB handle " << std::hex << db << " for thread " << thread << std::endl;
-            }
-            else
-            {
-                OE_WARN << LC << "Failed to open DB on thread " << thread << std::endl;
-            }
+            r = _rw->writeImage( *static_cast<const osg::Image*>(object), buf, _rwOptions.get() );
+        }
+        else if ( dynamic_cast<const osg::Node*>(object) )
+        {
+            r = _rw->writeNode( *static_cast<const osg::Node*>(object), buf, _rwOptions.get() );
         }
         else
         {
-            db = k->second;
+            r = _rw->writeObject( *object, buf );
         }
 
-        return db;
-    }
-#endif
-
-    // gets the layer table for the specified layer name, creating it if it does
-    // not already exist...
-    ThreadTable getTable( const std::string& tableName )
-    {
-        ScopedLock<Mutex> lock( _tableListMutex );
+        if ( !r.success() )
+        {
+            OE_WARN << LC << "FAILED to serialize \"" << key << "\" for cache bin " << getID() << std::endl;
+            return false;
+        }
 
-#ifdef SPLIT_LAYER_DB
-        sqlite3* db = getOrCreateDbForThread(tableName);
-#else
-        sqlite3* db = getOrCreateDbForThread();
-#endif
-        if ( !db )
-            return ThreadTable( 0L, 0L );
+        osg::ref_ptr<PendingWrite> write = new PendingWrite();
+        write->_key      = key;
+        write->_metadata = meta.empty() ? std::string() : meta.toJSON();
+        write->_data     = buf.str();
+        write->_time     = (int)::time(0L);
 
-        LayerTablesByName::iterator i = _tables.find(tableName);
-        if ( i == _tables.end() )
+        BatchWriter* writer = _db->getWriter();
+        if ( writer && (_db->isPerformanceMode() || _db->getOptions().asyncWrites() == true) )
         {
-            MetadataRecord meta;
-#ifdef SPLIT_LAYER_DB
-            sqlite3* metadb = getOrCreateMetaDbForThread();
-            if ( !_metadata.load( tableName, metadb, meta ) )
-#else
-            if ( !_metadata.load( tableName, db, meta ) )
-#endif
             {
-                OE_WARN << LC << "Cannot operate on \"" << tableName << "\" because metadata does not exist."
-                    << std::endl;
-                return ThreadTable( 0L, 0L );
+                Threading::ScopedMutexLock lock( _state->_mutex );
+                _state->_pending[key] = write.get();
             }
-
-            _tables[tableName] = new LayerTable( meta, db );
-            OE_DEBUG << LC << "New LayerTable for " << tableName << std::endl;
+            writer->addInsert( _state.get(), write.get() );
+            return true;
         }
-        return ThreadTable( _tables[tableName].get(), db );
-    }
 
-private:
+        ScopedConnection conn( _db.get() );
+        if ( !conn.valid() )
+            return false;
 
-    const Sqlite3CacheOptions _options;
-    //osg::ref_ptr<const Sqlite3CacheOptions> _settings;
-    osg::ref_ptr<osgDB::ReaderWriter> _defaultRW;
-    Mutex             _tableListMutex;
-    MetadataTable     _metadata;
-    LayerTablesByName _tables;
+        bool ok = _db->insert( conn.get(), _state.get(), write.get() );
+        if ( ok )
+            _db->evictIfNeeded( conn.get() );
+        return ok;
+    }
 
-    bool _useAsyncWrites;
-    osg::ref_ptr<TaskService> _writeService;
-    Mutex _pendingWritesMutex;
+    bool
+    Sqlite3CacheBin::touch( const std::string& key, const Config& meta )
+    {
+        if ( !_ok ) return false;
 
-#ifdef INSERT_POOL
-    std::map<std::string, osg::ref_ptr<AsyncInsertPool> > _pendingWrites;
-#else
-    std::map<std::string, osg::ref_ptr<AsyncInsert> > _pendingWrites;
-#endif
-    Mutex _pendingUpdateMutex;
-    std::map<std::string, osg::ref_ptr<AsyncUpdateAccessTimePool> > _pendingUpdates;
+        std::string metaJSON = meta.empty() ? std::string() : meta.toJSON();
+        int         now      = (int)::time(0L);
 
-    Mutex _pendingPurgeMutex;
-    std::map<std::string, osg::ref_ptr<AsyncPurge> > _pendingPurges;
+        // an entry still in the queue gets requeued with the new metadata.
+        osg::ref_ptr<PendingWrite> pending;
+        {
+            Threading::ScopedMutexLock lock( _state->_mutex );
+            BinState::PendingTable::const_iterator i = _state->_pending.find( key );
+            if ( i != _state->_pending.end() )
+                pending = i->second.get();
+        }
 
-    sqlite3* _db;
-    std::map<Thread*,sqlite3*> _dbPerThread;
+        if ( pending.valid() )
+        {
+            osg::ref_ptr<PendingWrite> write = new PendingWrite();
+            write->_key      = key;
+            write->_metadata = metaJSON;
+            write->_data     = pending->_data;
+            write->_time     = now;
+            {
+                Threading::ScopedMutexLock lock( _state->_mutex );
+                _state->_pending[key] = write.get();
+            }
+            _db->getWriter()->addInsert( _state.get(), write.get() );
+            return true;
+        }
 
-    std::map<std::string, std::map<Thread*,sqlite3*> > _dbPerThreadLayers;
-    std::map<Thread*,sqlite3*> _dbPerThreadMeta;
+        ScopedConnection conn( _db.get() );
+        if ( !conn.valid() )
+            return false;
 
-    osg::ref_ptr<MemCache> _L2cache;
+        sqlite3_stmt* update = conn->prepare( _state->_id, STMT_UPDATE_META, _state->_sql[STMT_UPDATE_META] );
+        if ( !update )
+            return false;
 
-    int _count;
-    int _nbRequest;
+        sqlite3_bind_int ( update, 1, now );
+        sqlite3_bind_int ( update, 2, now );
+        sqlite3_bind_text( update, 3, metaJSON.c_str(), metaJSON.length(), SQLITE_STATIC );
+        sqlite3_bind_text( update, 4, key.c_str(), key.length(), SQLITE_STATIC );
+        bool ok = sqlite3_step( update ) == SQLITE_DONE && sqlite3_changes( conn->db() ) > 0;
+        conn->release( update );
+        return ok;
+    }
 
-    std::vector<std::string> _layersList;
-    std::string _databasePath;
-};
+    bool
+    Sqlite3CacheBin::isCached( const std::string& key, double maxAge )
+    {
+        if ( !_ok ) return false;
 
+        {
+            Threading::ScopedMutexLock lock( _state->_mutex );
+            BinState::PendingTable::const_iterator i = _state->_pending.find( key );
+            if ( i != _state->_pending.end() )
+                return !isExpired( i->second->_time, maxAge );
+        }
 
+        ScopedConnection conn( _db.get() );
+        if ( !conn.valid() )
+            return false;
 
-AsyncUpdateAccessTime::AsyncUpdateAccessTime( const TileKey& key, const std::string& cacheId, int timeStamp, Sqlite3Cache* cache ) : 
-_key(key), _cacheId(cacheId), _timeStamp(timeStamp), _cache(cache)
-{
-    //nop
-}
+        sqlite3_stmt* select = conn->prepare( _state->_id, STMT_EXISTS, _state->_sql[STMT_EXISTS] );
+        if ( !select )
+            return false;
 
-void AsyncUpdateAccessTime::operator()( ProgressCallback* progress ) 
-{ 
-    osg::ref_ptr<Sqlite3Cache> cache = _cache.get();
-    if ( cache.valid() ) {
-        //OE_WARN << "AsyncUpdateAccessTime will process " << _key << std::endl;
-        cache->updateAccessTimeSync( _cacheId, _key , _timeStamp );
+        sqlite3_bind_text( select, 1, key.c_str(), key.length(), SQLITE_STATIC );
+        bool found = sqlite3_step( select ) == SQLITE_ROW && !isExpired( sqlite3_column_int(select, 0), maxAge );
+        conn->release( select );
+        return found;
     }
-}
 
+    bool
+    Sqlite3CacheBin::purge()
+    {
+        if ( !_ok ) return false;
 
-AsyncUpdateAccessTimePool::AsyncUpdateAccessTimePool(const std::string& cacheId, Sqlite3Cache* cache) :
-_cacheId(cacheId), _cache(cache)
-{
-    //nop
-}
+        // let queued writes land first, or they'd come back after the purge.
+        if ( _db->getWriter() )
+            _db->getWriter()->flush();
 
-void AsyncUpdateAccessTimePool::addEntry(const TileKey& key, int timeStamp)
-{
-    unsigned int lod = key.getLevelOfDetail();
-    addEntryInternal(key);
-    if (lod > 0) {
-        TileKey previous = key;
-        for (int i = (int)lod-1; i >= 0; --i) {
-            TileKey ancestor = previous.createAncestorKey(i);
-            if (ancestor.valid())
-                addEntryInternal(ancestor);
-            previous = ancestor;
+        ScopedConnection conn( _db.get() );
+        if ( !conn.valid() )
+            return false;
+
+        bool ok = exec( conn->db(), "DELETE FROM " + _state->_table );
+        if ( ok )
+        {
+            Threading::ScopedMutexLock lock( _state->_mutex );
+            _state->_sizeBytes = 0;
         }
+        return ok;
     }
-    _timeStamp = timeStamp;
-}
 
-void AsyncUpdateAccessTimePool::addEntryInternal(const TileKey& key)
-{
-    const std::string& keyStr = key.str();
-    if (_keys.find(keyStr) == _keys.end()) {
-        _keys[keyStr] = 1;
-        if (_keyStr.empty())
-            _keyStr = keyStr;
-        else
-            _keyStr += ", " + keyStr;
+    Config
+    Sqlite3CacheBin::readMetadata()
+    {
+        if ( !_ok ) return Config();
+        return _db->readBinMetadata( _state.get() );
     }
-}
 
-void AsyncUpdateAccessTimePool::operator()( ProgressCallback* progress ) 
-{ 
-    osg::ref_ptr<Sqlite3Cache> cache = _cache.get();
-    if ( cache.valid() ) {
-        //OE_INFO << "AsyncUpdateAccessTimePool will process " << _keys.size() << std::endl;
-        cache->updateAccessTimeSyncPool( _cacheId, _keyStr , _timeStamp );
+    bool
+    Sqlite3CacheBin::writeMetadata( const Config& conf )
+    {
+        if ( !_ok ) return false;
+        return _db->writeBinMetadata( _state.get(), conf );
     }
-}
 
+    Config
+    Sqlite3CacheBin::getStats()
+    {
+        Config conf( "stats" );
+        if ( !_ok ) return conf;
 
-#ifdef INSERT_POOL
-AsyncInsertPool::AsyncInsertPool(const std::string& layerName, Sqlite3Cache* cache ) : _layerName(layerName), _cache(cache) { }
-void AsyncInsertPool::operator()( ProgressCallback* progress )
-{
-    osg::ref_ptr<Sqlite3Cache> cache = _cache.get();
-    if ( cache.valid() ) {
-        cache->setImageSyncPool( this, _layerName );
+        unsigned      writes, failures, evicted, pending;
+        sqlite3_int64 sizeBytes;
+        {
+            Threading::ScopedMutexLock lock( _state->_mutex );
+            writes    = _state->_numWrites;
+            failures  = _state->_numFailures;
+            evicted   = _state->_numEvicted;
+            pending   = _state->_pending.size();
+            sizeBytes = _state->_sizeBytes;
+        }
+
+        BatchWriter* writer  = _db->getWriter();
+        unsigned     batches = writer ? writer->getNumBatches() : 0u;
+
+        conf.add( "performance_mode", _db->isPerformanceMode() );
+        conf.add( "write_behind",     writer != 0L );
+        conf.add( "queue_depth",      writer ? writer->getDepth() : 0u );
+        conf.add( "pending",          pending );
+        conf.add( "writes",           writes );
+        conf.add( "write_failures",   failures );
+        conf.add( "evicted",          evicted );
+        conf.add( "batches",          batches );
+        conf.add( "avg_batch_ms",     batches > 0 ? writer->getTotalBatchTime() / batches : 0.0 );
+        if ( _db->isPerformanceMode() )
+            conf.add( "size_mb",      (double)sizeBytes / (1024.0*1024.0) );
+
+        return conf;
     }
 }
-#endif
 
 //------------------------------------------------------------------------
 
@@ -1778,4 +1456,3 @@ public:
 };
 
 REGISTER_OSGPLUGIN(osgearth_cache_sqlite3, Sqlite3CacheFactory)
-
@@ -0,0 +1,112 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include "ParallelKeyNodeFactory"
+#include <osgEarth/Registry>
+
+using namespace osgEarth_engine_quadtree;
+using namespace osgEarth;
+using namespace OpenThreads;
+
+#define LC "[ParallelKeyNodeFactory] "
+
+// how often to check whether a pending request has gone stale
+#define STALE_CHECK_INTERVAL_MS 100
+
+
+ParallelKeyNodeFactory::ParallelKeyNodeFactory(TileModelFactory*        modelFactory,
+                                               TileModelCompiler*       modelCompiler,
+                                               TileNodeRegistry*        liveTiles,
+                                               TileNodeRegistry*        deadTiles,
+                                               const QuadTreeTerrainEngineOptions& options,
+                                               const MapInfo&           mapInfo,
+                                               TerrainNode*             terrain,
+                                               UID                      engineUID,
+                                               TaskService*             service ) :
+SerialKeyNodeFactory( modelFactory, modelCompiler, liveTiles, deadTiles, options, mapInfo, terrain, engineUID ),
+_service            ( service )
+{
+    //nop
+}
+
+osg::Node*
+ParallelKeyNodeFactory::createNode( const TileKey& parentKey )
+{
+    // If the parent tile is in the scene graph now but gets paged out while we are
+    // working, the pager will discard our result; so use that to cancel the request.
+    osg::ref_ptr<TileNode> parentTile;
+    bool parentIsLive = _liveTiles->get( parentKey, parentTile );
+    parentTile = 0L;
+
+    osg::ref_ptr<ProgressCallback> progress = new ProgressCallback();
+
+    // An event for synchronizing the completion of all requests:
+    Threading::MultiEvent semaphore;
+
+    // Collect all the tasks that can run in parallel (from all 4 subtiles)
+    osg::ref_ptr<TileModelFactory::Job> jobs[4];
+    unsigned numTasks = 0;
+    for( unsigned i=0; i<4; ++i )
+    {
+        jobs[i] = _modelFactory->createJob( parentKey.createChildKey(i), &semaphore, progress.get() );
+        numTasks += jobs[i]->_tasks.size();
+    }
+
+    if ( numTasks > 0 )
+    {
+        // Set up the semaphore to block for the correct number of tasks:
+        semaphore.reset( numTasks );
+
+        // Run all the tasks in parallel:
+        for( unsigned i=0; i<4; ++i )
+        {
+            for( TaskRequestVector::iterator t = jobs[i]->_tasks.begin(); t != jobs[i]->_tasks.end(); ++t )
+                _service->add( t->get() );
+        }
+
+        // Wait for them to complete, canceling them if the request goes stale. Canceled
+        // tasks still notify the semaphore, so we always wait for all of them.
+        while( !semaphore.wait(STALE_CHECK_INTERVAL_MS) )
+        {
+            if ( parentIsLive && !progress->isCanceled() && !_liveTiles->get(parentKey, parentTile) )
+            {
+                OE_DEBUG << LC << "Canceled stale request for children of " << parentKey.str() << std::endl;
+                progress->cancel();
+            }
+            parentTile = 0L;
+        }
+    }
+
+    if ( progress->isCanceled() )
+    {
+        // Return an empty group rather than NULL so the tile doesn't get blacklisted.
+        return new TileNodeGroup();
+    }
+
+    // Now assemble the models into a tile group.
+    osg::ref_ptr<TileModel> models[4];
+    bool                    realData[4];
+    bool                    lodBlending[4];
+
+    for( unsigned i=0; i<4; ++i )
+    {
+        _modelFactory->finalizeJob( jobs[i].get(), models[i], realData[i], lodBlending[i] );
+    }
+
+    return assembleChildren( parentKey, models, realData, lodBlending );
+}
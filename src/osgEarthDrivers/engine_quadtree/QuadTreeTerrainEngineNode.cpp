@@ -18,6 +18,7 @@
 */
 #include "QuadTreeTerrainEngineNode"
 #include "SerialKeyNodeFactory"
+#include "ParallelKeyNodeFactory"
 #include "TerrainNode"
 #include "TileModelFactory"
 #include "TileModelCompiler"
@@ -172,6 +173,9 @@ QuadTreeTerrainEngineNode::postInitialize( const Map* map, const TerrainOptions&
     // a shared registry for tile nodes in the scene graph.
     _liveTiles = new TileNodeRegistry("live");
 
+    // live tiles publish their elevation grids for fast height queries:
+    _liveTiles->setTerrain( getTerrain() );
+
     // set up a registry for quick release:
     if ( _terrainOptions.quickReleaseGLObjects() == true )
     {
@@ -181,6 +185,14 @@ QuadTreeTerrainEngineNode::postInitialize( const Map* map, const TerrainOptions&
     // initialize the model factory:
     _tileModelFactory = new TileModelFactory(getMap(), _liveTiles.get(), _terrainOptions );
 
+    // in parallel mode, build the layers of each tile concurrently:
+    if ( _terrainOptions.loadingPolicy()->mode() == LoadingPolicy::MODE_PARALLEL )
+    {
+        int numThreads = computeLoadingThreads( *_terrainOptions.loadingPolicy() );
+        _tileService = new TaskService( "QuadTreeTileBuilder", numThreads );
+        OE_INFO << LC << "Parallel tile loading with " << numThreads << " threads" << std::endl;
+    }
+
 
     // handle an already-established map profile:
     if ( _update_mapf->getProfile() )
@@ -337,15 +349,31 @@ QuadTreeTerrainEngineNode::getKeyNodeFactory()
             _terrainOptions );
 
         // initialize a key node factory.
-        knf = new SerialKeyNodeFactory( 
-            _tileModelFactory.get(),
-            compiler,
-            _liveTiles.get(),
-            _deadTiles.get(),
-            _terrainOptions, 
-            MapInfo( getMap() ),
-            _terrain, 
-            _uid );
+        if ( _tileService.valid() )
+        {
+            knf = new ParallelKeyNodeFactory(
+                _tileModelFactory.get(),
+                compiler,
+                _liveTiles.get(),
+                _deadTiles.get(),
+                _terrainOptions, 
+                MapInfo( getMap() ),
+                _terrain, 
+                _uid,
+                _tileService.get() );
+        }
+        else
+        {
+            knf = new SerialKeyNodeFactory( 
+                _tileModelFactory.get(),
+                compiler,
+                _liveTiles.get(),
+                _deadTiles.get(),
+                _terrainOptions, 
+                MapInfo( getMap() ),
+                _terrain, 
+                _uid );
+        }
     }
 
     return knf.get();
@@ -597,9 +625,10 @@ namespace
     class UpdateElevationVisitor : public osg::NodeVisitor
     {
     public:
-        UpdateElevationVisitor( TileModelCompiler* compiler ):
+        UpdateElevationVisitor( TileModelCompiler* compiler, TileNodeRegistry* liveTiles ):
           osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
-          _compiler(compiler)
+          _compiler(compiler),
+          _liveTiles(liveTiles)
           {}
 
           void apply(osg::Node& node)
@@ -607,7 +636,9 @@ namespace
               TileNode* tile = dynamic_cast<TileNode*>(&node);
               if (tile)
               {
-                  tile->compile( _compiler );
+                  // a recompiled tile has a new height field; keep the terrain's index current.
+                  if ( tile->compile( _compiler ) && _liveTiles )
+                      _liveTiles->refresh( tile );
                   //tile->applyImmediateTileUpdate(TileUpdate::UPDATE_ELEVATION);
               }
 
@@ -615,6 +646,7 @@ namespace
           }
 
           TileModelCompiler* _compiler;
+          TileNodeRegistry*  _liveTiles;
     };
 }
 
@@ -624,6 +656,6 @@ QuadTreeTerrainEngineNode::onVerticalScaleChanged()
 {
 //    _terrain->setVerticalScale(getVerticalScale());
     _terrainOptions.verticalScale() = getVerticalScale();
-    UpdateElevationVisitor visitor( getKeyNodeFactory()->getCompiler() );
+    UpdateElevationVisitor visitor( getKeyNodeFactory()->getCompiler(), _liveTiles.get() );
     this->accept(visitor);
 }
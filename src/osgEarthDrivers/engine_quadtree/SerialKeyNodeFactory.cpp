@@ -189,14 +189,27 @@ SerialKeyNodeFactory::createNode( const TileKey& parentKey )
     osg::ref_ptr<TileModel> models[4];
     bool                   realData[4];
     bool                   lodBlending[4];
-    bool                   tileHasAnyRealData = false;
 
     for( unsigned i = 0; i < 4; ++i )
     {
         TileKey child = parentKey.createChildKey( i );
 
         _modelFactory->createTileModel( child, models[i], realData[i], lodBlending[i] );
+    }
+
+    return assembleChildren( parentKey, models, realData, lodBlending );
+}
+
+osg::Node*
+SerialKeyNodeFactory::assembleChildren(const TileKey&          parentKey,
+                                       osg::ref_ptr<TileModel> models[4],
+                                       bool                    realData[4],
+                                       bool                    lodBlending[4] )
+{
+    bool tileHasAnyRealData = false;
 
+    for( unsigned i = 0; i < 4; ++i )
+    {
         if ( models[i].valid() && realData[i] )
         {
             tileHasAnyRealData = true;
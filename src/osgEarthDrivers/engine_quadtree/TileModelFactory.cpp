@@ -39,18 +39,27 @@ namespace
                    ImageLayer*                         layer, 
                    const MapInfo&                      mapInfo,
                    const QuadTreeTerrainEngineOptions& opt, 
-                   TileModel*                          model )
+                   TileModel::ColorData*               result,
+                   ProgressCallback*                   progress )
         {
             _key      = key;
             _layer    = layer;
             _mapInfo  = &mapInfo;
             _opt      = &opt;
-            _model    = model;
-            //_repo     = &repo;
+            _result   = result;
+            _progress = progress;
+        }
+
+        bool canceled() const
+        {
+            return _progress.valid() && _progress->isCanceled();
         }
 
         void execute()
         {
+            if ( canceled() )
+                return;
+
             GeoImage geoImage;
             bool isFallbackData = false;
 
@@ -83,12 +92,12 @@ namespace
             
             if (hasDataInExtent)
             {
-                while( !geoImage.valid() && imageKey.valid() && _layer->isKeyValid(imageKey) )
+                while( !geoImage.valid() && imageKey.valid() && _layer->isKeyValid(imageKey) && !canceled() )
                 {
                     if ( useMercatorFastPath )
                     {
                         bool mercFallbackData = false;
-                        geoImage = _layer->createImageInNativeProfile( imageKey, 0L, autoFallback, mercFallbackData );
+                        geoImage = _layer->createImageInNativeProfile( imageKey, _progress.get(), autoFallback, mercFallbackData );
                         if ( geoImage.valid() && mercFallbackData )
                         {
                             isFallbackData = true;
@@ -96,7 +105,7 @@ namespace
                     }
                     else
                     {
-                        geoImage = _layer->createImage( imageKey, 0L, autoFallback );
+                        geoImage = _layer->createImage( imageKey, _progress.get(), autoFallback );
                     }
 
                     if ( !geoImage.valid() )
@@ -107,6 +116,9 @@ namespace
                 }
             }
 
+            if ( canceled() )
+                return;
+
             GeoLocator* locator = 0L;
 
             if ( !geoImage.valid() )
@@ -124,8 +136,8 @@ namespace
                     locator = GeoLocator::createForExtent(geoImage.getExtent(), *_mapInfo);
             }
 
-            // add the color layer to the repo.
-            _model->_colorData[_layer->getUID()] = TileModel::ColorData(
+            // hand the color layer back to the job.
+            *_result = TileModel::ColorData(
                 _layer,
                 geoImage.getImage(),
                 locator,
@@ -134,11 +146,12 @@ namespace
                 isFallbackData );
         }
 
-        TileKey        _key;
-        const MapInfo* _mapInfo;
-        ImageLayer*    _layer;
-        TileModel*     _model;
+        TileKey               _key;
+        const MapInfo*        _mapInfo;
+        ImageLayer*           _layer;
+        TileModel::ColorData* _result;
         const QuadTreeTerrainEngineOptions* _opt;
+        osg::ref_ptr<ProgressCallback> _progress;
     };
 }
 
@@ -148,18 +161,21 @@ namespace
 {
     struct BuildElevationData
     {
-        void init(const TileKey& key, const MapFrame& mapf, const QuadTreeTerrainEngineOptions& opt, TileModel* model, HeightFieldCache* hfCache) //sourceTileNodeBuilder::SourceRepo& repo)
+        void init(const TileKey& key, const MapFrame& mapf, const QuadTreeTerrainEngineOptions& opt, TileModel* model, HeightFieldCache* hfCache, ProgressCallback* progress)
         {
             _key   = key;
             _mapf  = &mapf;
             _opt   = &opt;
             _model = model;
             _hfCache = hfCache;
-            //_repo = &repo;
+            _progress = progress;
         }
 
         void execute()
         {            
+            if ( _progress.valid() && _progress->isCanceled() )
+                return;
+
             const MapInfo& mapInfo = _mapf->getMapInfo();
 
             // Request a heightfield from the map, falling back on lower resolution tiles
@@ -168,7 +184,7 @@ namespace
             bool isFallback = false;
 
             //if ( _mapf->getHeightField( _key, true, hf, &isFallback ) )
-            if (_hfCache->getOrCreateHeightField( *_mapf, _key, true, hf, &isFallback) )
+            if (_hfCache->getOrCreateHeightField( *_mapf, _key, true, hf, &isFallback, true, SAMPLE_FIRST_VALID, _progress.get()) )
             {                
 
                 // Put it in the repo
@@ -193,12 +209,8 @@ namespace
                                 {
                                     if (_hfCache->getOrCreateHeightField( *_mapf, nk, true, hf, &isFallback) )
                                     //if ( _mapf->getHeightField(nk, true, hf, &isFallback) )
-                                    {               
-                                        if ( mapInfo.isPlateCarre() )
-                                        {
-                                            HeightFieldUtils::scaleHeightFieldToDegrees( hf.get() );
-                                        }
-
+                                    {
+                                        // already scaled for Plate Carre by the cache.
                                         _model->_elevationData.setNeighbor( x, y, hf.get() );
                                     }
                                 }
@@ -214,6 +226,7 @@ namespace
         const QuadTreeTerrainEngineOptions* _opt;
         TileModel* _model;
         osg::ref_ptr< HeightFieldCache> _hfCache;
+        osg::ref_ptr<ProgressCallback> _progress;
     };
 }
 
@@ -236,49 +249,115 @@ TileModelFactory::getHeightFieldCache() const
 }
 
 
-void
-TileModelFactory::createTileModel(const TileKey&           key, 
-                                  osg::ref_ptr<TileModel>& out_model,
-                                  bool&                    out_hasRealData,
-                                  bool&                    out_hasLodBlendedLayers )
+TileModelFactory::Job::Job( const TileKey& key, const Map* map ) :
+_key                ( key ),
+_mapf               ( map, Map::MASKED_TERRAIN_LAYERS ),
+_hasLodBlendedLayers( false )
 {
-    MapFrame mapf( _map, Map::MASKED_TERRAIN_LAYERS );
-    
-    const MapInfo& mapInfo = mapf.getMapInfo();
+    //nop
+}
 
-    osg::ref_ptr<TileModel> model = new TileModel();
-    model->_tileKey = key;
-    model->_tileLocator = GeoLocator::createForKey(key, mapInfo);
+TileModelFactory::Job*
+TileModelFactory::createJob(const TileKey&         key,
+                            Threading::MultiEvent* semaphore,
+                            ProgressCallback*      progress )
+{
+    Job* job = new Job( key, _map );
+    job->_progress = progress;
+
+    const MapInfo& mapInfo = job->_mapf.getMapInfo();
+
+    job->_model = new TileModel();
+    job->_model->_tileKey = key;
+    job->_model->_tileLocator = GeoLocator::createForKey(key, mapInfo);
+
+    // Size the color data first, since the tasks hold pointers into it.
+    unsigned numColorLayers = 0;
+    for( ImageLayerVector::const_iterator i = job->_mapf.imageLayers().begin(); i != job->_mapf.imageLayers().end(); ++i )
+    {
+        if ( i->get()->getEnabled() )
+            ++numColorLayers;
+    }
+    job->_colorData.resize( numColorLayers );
 
-    // init this to false, then search for real data. "Real data" is data corresponding
-    // directly to the key, as opposed to fallback data, which is derived from a lower
-    // LOD key.
-    out_hasRealData = false;
-    out_hasLodBlendedLayers = false;
-    
     // Fetch the image data and make color layers.
-    for( ImageLayerVector::const_iterator i = mapf.imageLayers().begin(); i != mapf.imageLayers().end(); ++i )
+    unsigned slot = 0;
+    for( ImageLayerVector::const_iterator i = job->_mapf.imageLayers().begin(); i != job->_mapf.imageLayers().end(); ++i )
     {
         ImageLayer* layer = i->get();
 
         if ( layer->getEnabled() )
         {
-            BuildColorData build;
-            build.init( key, layer, mapInfo, _terrainOptions, model.get() );
-            build.execute();
+            ParallelTask<BuildColorData>* task = new ParallelTask<BuildColorData>( semaphore );
+            task->init( key, layer, mapInfo, _terrainOptions, &job->_colorData[slot++], progress );
+            task->setPriority( -(float)key.getLevelOfDetail() );
+            job->_tasks.push_back( task );
 
             if ( layer->getImageLayerOptions().lodBlending() == true )
             {
-                out_hasLodBlendedLayers = true;
+                job->_hasLodBlendedLayers = true;
             }
         }
     }
 
     // make an elevation layer.
-    BuildElevationData build;
-    build.init( key, mapf, _terrainOptions, model.get(), _hfCache );
-    build.execute();
+    ParallelTask<BuildElevationData>* task = new ParallelTask<BuildElevationData>( semaphore );
+    task->init( key, job->_mapf, _terrainOptions, job->_model.get(), _hfCache, progress );
+    task->setPriority( -(float)key.getLevelOfDetail() );
+    job->_tasks.push_back( task );
+
+    return job;
+}
+
+void
+TileModelFactory::createTileModel(const TileKey&           key, 
+                                  osg::ref_ptr<TileModel>& out_model,
+                                  bool&                    out_hasRealData,
+                                  bool&                    out_hasLodBlendedLayers )
+{
+    osg::ref_ptr<Job> job = createJob( key, 0L, 0L );
+
+    // run all the tasks in this thread.
+    for( TaskRequestVector::iterator i = job->_tasks.begin(); i != job->_tasks.end(); ++i )
+    {
+        (*i->get())( 0L );
+    }
+
+    finalizeJob( job.get(), out_model, out_hasRealData, out_hasLodBlendedLayers );
+}
+
+void
+TileModelFactory::finalizeJob(TileModelFactory::Job*   job,
+                              osg::ref_ptr<TileModel>& out_model,
+                              bool&                    out_hasRealData,
+                              bool&                    out_hasLodBlendedLayers )
+{
+    const TileKey&  key     = job->_key;
+    const MapFrame& mapf    = job->_mapf;
+    const MapInfo&  mapInfo = mapf.getMapInfo();
+    osg::ref_ptr<TileModel> model = job->_model.get();
 
+    // init this to false, then search for real data. "Real data" is data corresponding
+    // directly to the key, as opposed to fallback data, which is derived from a lower
+    // LOD key.
+    out_hasRealData = false;
+    out_hasLodBlendedLayers = job->_hasLodBlendedLayers;
+
+    // A canceled job may be missing some of its data; don't build anything.
+    if ( job->_progress.valid() && job->_progress->isCanceled() )
+    {
+        return;
+    }
+
+    // Collect the color layers that the tasks built.
+    for( unsigned i=0; i<job->_colorData.size(); ++i )
+    {
+        const TileModel::ColorData& colorData = job->_colorData[i];
+        if ( colorData.getMapLayer() )
+        {
+            model->_colorData[colorData.getUID()] = colorData;
+        }
+    }
 
     // Bail out now if there's no data to be had.
     if ( model->_colorData.size() == 0 && !model->_elevationData.getHFLayer() )
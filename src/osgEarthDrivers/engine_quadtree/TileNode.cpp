@@ -70,6 +70,9 @@ TileNode::compile( TileModelCompiler* compiler, bool releaseModel )
     this->removeChildren( 0, this->getNumChildren() );
     this->addChild( node );
 
+    osgTerrain::HeightFieldLayer* hfLayer = _model->_elevationData.getHFLayer();
+    _heightField = hfLayer ? hfLayer->getHeightField() : 0L;
+
     // release the memory associated with the tile model.
     if ( releaseModel )
         _model = 0L;
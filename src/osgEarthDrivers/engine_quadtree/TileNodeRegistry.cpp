@@ -44,6 +44,10 @@ TileNodeRegistry::add( TileNode* tile )
         Threading::ScopedWriteLock exclusive( _tilesMutex );
         _tiles[ tile->getKey() ] = tile;
         OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+
+        osg::ref_ptr<Terrain> terrain = _terrain.get();
+        if ( terrain.valid() )
+            terrain->addTileHeightField( tile->getKey(), tile->getHeightField() );
     }
 }
 
@@ -54,9 +58,12 @@ TileNodeRegistry::add( const TileNodeVector& tiles )
     if ( tiles.size() > 0 )
     {
         Threading::ScopedWriteLock exclusive( _tilesMutex );
+        osg::ref_ptr<Terrain> terrain = _terrain.get();
         for( TileNodeVector::const_iterator i = tiles.begin(); i != tiles.end(); ++i )
         {
             _tiles[ i->get()->getKey() ] = i->get();
+            if ( terrain.valid() )
+                terrain->addTileHeightField( i->get()->getKey(), i->get()->getHeightField() );
         }
         OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
     }
@@ -71,6 +78,33 @@ TileNodeRegistry::remove( TileNode* tile )
         Threading::ScopedWriteLock exclusive( _tilesMutex );
         _tiles.erase( tile->getKey() );
         OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+
+        osg::ref_ptr<Terrain> terrain = _terrain.get();
+        if ( terrain.valid() )
+            terrain->removeTileHeightField( tile->getKey() );
+    }
+}
+
+
+void
+TileNodeRegistry::refresh( TileNode* tile )
+{
+    if ( tile )
+    {
+        Threading::ScopedReadLock shared( _tilesMutex );
+
+        TileNodeMap::iterator i = _tiles.find( tile->getKey() );
+        if ( i == _tiles.end() || i->second.get() != tile )
+            return;
+
+        osg::ref_ptr<Terrain> terrain = _terrain.get();
+        if ( !terrain.valid() )
+            return;
+
+        if ( tile->getHeightField() )
+            terrain->addTileHeightField( tile->getKey(), tile->getHeightField() );
+        else
+            terrain->removeTileHeightField( tile->getKey() );
     }
 }
 
@@ -101,6 +135,10 @@ TileNodeRegistry::take( const TileKey& key, osg::ref_ptr<TileNode>& out_tile )
         out_tile = i->second.get();
         _tiles.erase( i );
         OE_TEST << LC << _name << ": tiles=" << _tiles.size() << std::endl;
+
+        osg::ref_ptr<Terrain> terrain = _terrain.get();
+        if ( terrain.valid() )
+            terrain->removeTileHeightField( key );
         return true;
     }
     return false;
@@ -45,7 +45,9 @@ _query            ( query ),
 _chunkSize        ( 500 ),
 _nextHandleToQueue( 0L ),
 _profile          ( profile ),
-_filters          ( filters )
+_filters          ( filters ),
+_nextFid          ( 0 ),
+_readByFid        ( false )
 {
     {
         OGR_SCOPED_LOCK;
@@ -136,6 +138,27 @@ _filters          ( filters )
     readChunk();
 }
 
+FeatureCursorOGR::FeatureCursorOGR(OGRLayerH                     layerHandle,
+                                   const FeatureSource*          source,
+                                   const FeatureProfile*         profile,
+                                   const std::vector<FeatureID>& fids,
+                                   const FeatureFilterList&      filters ) :
+_source           ( source ),
+_dsHandle         ( 0L ),
+_layerHandle      ( layerHandle ),
+_resultSetHandle  ( 0L ),
+_spatialFilter    ( 0L ),
+_chunkSize        ( 500 ),
+_nextHandleToQueue( 0L ),
+_profile          ( profile ),
+_filters          ( filters ),
+_fids             ( fids ),
+_nextFid          ( 0 ),
+_readByFid        ( true )
+{
+    readChunk();
+}
+
 FeatureCursorOGR::~FeatureCursorOGR()
 {
     OGR_SCOPED_LOCK;
@@ -143,7 +166,7 @@ FeatureCursorOGR::~FeatureCursorOGR()
     if ( _nextHandleToQueue )
         OGR_F_Destroy( _nextHandleToQueue );
 
-    if ( _resultSetHandle != _layerHandle )
+    if ( _resultSetHandle && _resultSetHandle != _layerHandle )
         OGR_DS_ReleaseResultSet( _dsHandle, _resultSetHandle );
 
     if ( _spatialFilter )
@@ -156,6 +179,9 @@ FeatureCursorOGR::~FeatureCursorOGR()
 bool
 FeatureCursorOGR::hasMore() const
 {
+    if ( _readByFid )
+        return _queue.size() > 0;
+
     return _resultSetHandle && ( _queue.size() > 0 || _nextHandleToQueue != 0L );
 }
 
@@ -174,6 +200,11 @@ FeatureCursorOGR::nextFeature()
     _lastFeatureReturned = _queue.front();
     _queue.pop();
 
+    // read ahead when reading by FID, so hasMore() stays exact even if some
+    // of the remaining FIDs turn out to be missing or blacklisted.
+    if ( _readByFid && _queue.size() == 0 )
+        readChunk();
+
     return _lastFeatureReturned.get();
 }
 
@@ -183,6 +214,12 @@ FeatureCursorOGR::nextFeature()
 void
 FeatureCursorOGR::readChunk()
 {
+    if ( _readByFid )
+    {
+        readChunkByFid();
+        return;
+    }
+
     if ( !_resultSetHandle )
         return;
     
@@ -192,7 +229,7 @@ FeatureCursorOGR::readChunk()
 
     if ( _nextHandleToQueue )
     {
-        osg::ref_ptr<Feature> f = OgrUtils::createFeature( _nextHandleToQueue, _profile->getSRS() );
+        osg::ref_ptr<Feature> f = OgrUtils::createFeature( _nextHandleToQueue, _profile->getSRS(), _profile->getAttributeLayout() );
         if ( f.valid() && !_source->isBlacklisted(f->getFID()) )
         {
             _queue.push( f );
@@ -212,7 +249,7 @@ FeatureCursorOGR::readChunk()
         OGRFeatureH handle = OGR_L_GetNextFeature( _resultSetHandle );
         if ( handle )
         {
-            osg::ref_ptr<Feature> f = OgrUtils::createFeature( handle, _profile->getSRS() );
+            osg::ref_ptr<Feature> f = OgrUtils::createFeature( handle, _profile->getSRS(), _profile->getAttributeLayout() );
             if ( f.valid() && !_source->isBlacklisted(f->getFID()) )
             {
                 _queue.push( f );
@@ -230,17 +267,7 @@ FeatureCursorOGR::readChunk()
     }
 
     // preprocess the features using the filter list:
-    if ( preProcessList.size() > 0 )
-    {
-        FilterContext cx;
-        cx.profile() = _profile.get();
-
-        for( FeatureFilterList::const_iterator i = _filters.begin(); i != _filters.end(); ++i )
-        {
-            FeatureFilter* filter = i->get();
-            cx = filter->push( preProcessList, cx );
-        }
-    }
+    preProcess( preProcessList );
 
     // read one more for "more" detection:
     if (!resultSetEndReached)
@@ -251,3 +278,53 @@ FeatureCursorOGR::readChunk()
     //OE_NOTICE << "read " << _queue.size() << " features ... " << std::endl;
 }
 
+
+// reads the next chunk of features from the FID list, using random access
+// on the source's layer handle.
+void
+FeatureCursorOGR::readChunkByFid()
+{
+    FeatureList preProcessList;
+
+    OGR_SCOPED_LOCK;
+
+    while( _queue.size() < _chunkSize && _nextFid < _fids.size() )
+    {
+        FeatureID fid = _fids[_nextFid++];
+        if ( _source->isBlacklisted(fid) )
+            continue;
+
+        OGRFeatureH handle = OGR_L_GetFeature( _layerHandle, fid );
+        if ( handle )
+        {
+            osg::ref_ptr<Feature> f = OgrUtils::createFeature( handle, _profile->getSRS(), _profile->getAttributeLayout() );
+            if ( f.valid() )
+            {
+                _queue.push( f );
+
+                if ( _filters.size() > 0 )
+                    preProcessList.push_back( f.release() );
+            }
+            OGR_F_Destroy( handle );
+        }
+    }
+
+    preProcess( preProcessList );
+}
+
+
+void
+FeatureCursorOGR::preProcess( FeatureList& features )
+{
+    if ( features.size() > 0 )
+    {
+        FilterContext cx;
+        cx.profile() = _profile.get();
+
+        for( FeatureFilterList::const_iterator i = _filters.begin(); i != _filters.end(); ++i )
+        {
+            FeatureFilter* filter = i->get();
+            cx = filter->push( features, cx );
+        }
+    }
+}
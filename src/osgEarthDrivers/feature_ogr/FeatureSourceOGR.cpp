@@ -19,11 +19,13 @@
 
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
+#include <osgEarth/StringUtils>
 #include <osgEarthFeatures/FeatureSource>
 #include <osgEarthFeatures/Filter>
 #include <osgEarthFeatures/BufferFilter>
 #include <osgEarthFeatures/ScaleFilter>
 #include <osgEarthFeatures/GeometryUtils>
+#include <osgEarthFeatures/FeatureSpatialIndex>
 #include "OGRFeatureOptions"
 #include "FeatureCursorOGR"
 #include <osgEarthFeatures/OgrUtils>
@@ -32,6 +34,7 @@
 #include <osgDB/FileUtils>
 #include <list>
 #include <ogr_api.h>
+#include <cpl_vsi.h>
 
 #define LC "[OGR FeatureSource] "
 
@@ -213,8 +216,21 @@ public:
                     //Get the feature count
                     _featureCount = OGR_L_GetFeatureCount( _layerHandle, 1 );
 
+                    // load or build our own spatial index for bounded queries. The index
+                    // is resolved by FID, so the layer must support random reads.
+                    if ( _options.featureIndex() == true && !_writable )
+                    {
+                        if ( OGR_L_TestCapability( _layerHandle, OLCRandomRead ) )
+                            initFeatureIndex();
+                        else
+                            OE_INFO << LC << "Layer does not support random reads; not indexing " << _source << std::endl;
+                    }
+
                     initSchema();
 
+                    if ( result && _layout.valid() )
+                        result->setAttributeLayout( _layout.get() );
+
                     OGRwkbGeometryType wkbType = OGR_FD_GetGeomType( OGR_L_GetLayerDefn( _layerHandle ) );
                     if (
                         wkbType == wkbPolygon ||
@@ -281,6 +297,21 @@ public:
         }
         else
         {
+            // Resolve a bounded query through the spatial index, and read just those
+            // features by FID from the layer. Queries with SQL go to OGR.
+            if ( _index.valid() && query.bounds().isSet() && !query.expression().isSet() && !query.orderby().isSet() )
+            {
+                std::vector<FeatureID> fids;
+                _index->query( query.bounds().get(), fids );
+
+                return new FeatureCursorOGR(
+                    _layerHandle,
+                    this,
+                    getFeatureProfile(),
+                    fids,
+                    _options.filters() );
+            }
+
             OGR_SCOPED_LOCK;
 
             // Each cursor requires its own DS handle so that multi-threaded access will work.
@@ -336,7 +367,7 @@ public:
             {
                 const FeatureProfile* p = getFeatureProfile();
                 const SpatialReference* srs = p ? p->getSRS() : 0L;
-                result = OgrUtils::createFeature( handle, srs );
+                result = OgrUtils::createFeature( handle, srs, p ? p->getAttributeLayout() : 0L );
                 OGR_F_Destroy( handle );
             }
         }
@@ -458,6 +489,68 @@ protected:
             OGRFieldType ogrType = OGR_Fld_GetType( fieldDef );
             _schema[ name ] = OgrUtils::getAttributeType( ogrType );
         }
+
+        // intern the field names once so features can store attributes by column;
+        // skip it if two fields differ only in case.
+        osg::ref_ptr<AttributeLayout> layout = new AttributeLayout();
+        for (int i = 0; i < OGR_FD_GetFieldCount( layerDef ); i++)
+        {
+            layout->add( OGR_Fld_GetNameRef( OGR_FD_GetFieldDefn(layerDef, i) ) );
+        }
+        if ( (int)layout->size() == OGR_FD_GetFieldCount( layerDef ) )
+            _layout = layout.get();
+    }
+
+    // Loads the spatial index saved next to the data, or builds it from the
+    // layer's feature envelopes (and saves it). Call under the OGR lock.
+    void initFeatureIndex()
+    {
+        // the source's size and timestamp catch edits that keep the feature count.
+        VSIStatBufL stat;
+        std::string signature = Stringify() << "layer=" << _layerIndex << ";count=" << _featureCount;
+        if ( VSIStatL( _source.c_str(), &stat ) == 0 )
+            signature = Stringify() << signature << ";size=" << (long long)stat.st_size << ";mtime=" << (long long)stat.st_mtime;
+        std::string indexPath = _options.url().isSet() ? _source + ".oeidx" : "";
+
+        if ( !indexPath.empty() )
+        {
+            osg::ref_ptr<FeatureSpatialIndex> index = FeatureSpatialIndex::read( indexPath );
+            if ( index.valid() && index->getSignature() == signature )
+            {
+                OE_INFO << LC << "Loaded spatial index (" << index->size() << " features) from " << indexPath << std::endl;
+                _index = index.get();
+                return;
+            }
+        }
+
+        OE_INFO << LC << "Indexing features in " << _source << std::endl;
+
+        osg::ref_ptr<FeatureSpatialIndex> index = new FeatureSpatialIndex();
+        index->setSignature( signature );
+
+        // envelopes only; no need to build osgEarth features to index them.
+        OGR_L_ResetReading( _layerHandle );
+        OGRFeatureH handle;
+        while( (handle = OGR_L_GetNextFeature(_layerHandle)) != 0L )
+        {
+            OGRGeometryH geom = OGR_F_GetGeometryRef( handle );
+            if ( geom )
+            {
+                OGREnvelope env;
+                OGR_G_GetEnvelope( geom, &env );
+                index->add( OGR_F_GetFID(handle), Bounds(env.MinX, env.MinY, env.MaxX, env.MaxY) );
+            }
+            OGR_F_Destroy( handle );
+        }
+        OGR_L_ResetReading( _layerHandle );
+
+        index->build();
+        _index = index.get();
+
+        if ( !indexPath.empty() && !index->write(indexPath) )
+        {
+            OE_INFO << LC << "Could not save spatial index to " << indexPath << "; it will be rebuilt next time" << std::endl;
+        }
     }
 
 
@@ -476,7 +569,9 @@ private:
     bool _needsSync;
     bool _writable;
     FeatureSchema _schema;
+    osg::ref_ptr<const AttributeLayout> _layout;
     Geometry::Type _geometryType;
+    osg::ref_ptr<FeatureSpatialIndex> _index;
 };
 
 
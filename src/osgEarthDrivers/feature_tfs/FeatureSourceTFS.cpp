@@ -26,6 +26,7 @@
 #include <osgEarthFeatures/BufferFilter>
 #include <osgEarthFeatures/ScaleFilter>
 #include <osgEarthFeatures/OgrUtils>
+#include <osgEarthFeatures/GeoJSON>
 #include <osgEarthUtil/TFS>
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
@@ -124,12 +125,32 @@ public:
 
     bool getFeatures( const std::string& buffer, const std::string& mimeType, FeatureList& features )
     {        
+        // GeoJSON is parsed directly, so tiles don't serialize on the OGR lock.
+        if ( isJSON(mimeType) )
+        {
+            GeoJSONReader reader( buffer, _layer.getSRS() );
+            osg::ref_ptr<Feature> f;
+            while( reader.next(f) )
+            {
+                if ( f.valid() && !isBlacklisted(f->getFID()) )
+                {
+                    features.push_back( f.get() );
+                }
+            }
+
+            if ( reader.hasError() )
+            {
+                OE_WARN << LC << "Error reading TFS response: " << reader.getError() << std::endl;
+                return false;
+            }
+            return true;
+        }
+
         // find the right driver for the given mime type
         OGR_SCOPED_LOCK;
                 
         // find the right driver for the given mime type
         OGRSFDriverH ogrDriver =
-            isJSON(mimeType) ? OGRGetDriverByName( "GeoJSON" ) :
             isGML(mimeType)  ? OGRGetDriverByName( "GML" ) :
             0L;
 
@@ -26,6 +26,7 @@
 #include <osgEarthFeatures/ScaleFilter>
 #include <osgEarthUtil/WFS>
 #include <osgEarthFeatures/OgrUtils>
+#include <osgEarthFeatures/GeoJSON>
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -190,16 +191,33 @@ public:
 
     bool getFeatures( const std::string& buffer, const std::string& mimeType, FeatureList& features )
     {
-        OGR_SCOPED_LOCK;        
+        // GeoJSON is parsed directly, so tiles don't serialize on the OGR lock.
+        if ( isJSON(mimeType) )
+        {
+            FeatureProfile* fp = getFeatureProfile();
+            GeoJSONReader reader( buffer, fp ? fp->getSRS() : 0L );
+            osg::ref_ptr<Feature> f;
+            while( reader.next(f) )
+            {
+                if ( f.valid() && !isBlacklisted(f->getFID()) )
+                {
+                    features.push_back( f.get() );
+                }
+            }
 
-        bool json = isJSON( mimeType );
-        bool gml  = isGML( mimeType );
+            if ( reader.hasError() )
+            {
+                OE_WARN << LC << "Error reading WFS response: " << reader.getError() << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        OGR_SCOPED_LOCK;        
 
         // find the right driver for the given mime type
         OGRSFDriverH ogrDriver =
-            json ? OGRGetDriverByName( "GeoJSON" ) :
-            gml  ? OGRGetDriverByName( "GML" ) :
-            0L;        
+            isGML(mimeType) ? OGRGetDriverByName( "GML" ) : 0L;
 
         // fail if we can't find an appropriate OGR driver:
         if ( !ogrDriver )
@@ -209,24 +227,12 @@ public:
             return false;
         }
 
-        std::string tmpName;
-
-        OGRDataSourceH ds = 0;
-        //GML needs to be saved to a temp file to load from disk.  GeoJSON can be loaded directly from memory
-        if (gml)
-        {
-            std::string ext = getExtensionForMimeType( mimeType );
-            //Save the response to a temp file            
-            std::string tmpPath = getTempPath();        
-            tmpName = getTempName(tmpPath, ext);
-            saveResponse(buffer, tmpName );
-            ds = OGROpen( tmpName.c_str(), FALSE, &ogrDriver );
-        }
-        else if (json)
-        {
-            //Open GeoJSON directly from memory
-            ds = OGROpen( buffer.c_str(), FALSE, &ogrDriver );
-        }        
+        //GML needs to be saved to a temp file to load from disk.
+        std::string ext = getExtensionForMimeType( mimeType );
+        std::string tmpPath = getTempPath();        
+        std::string tmpName = getTempName(tmpPath, ext);
+        saveResponse(buffer, tmpName );
+        OGRDataSourceH ds = OGROpen( tmpName.c_str(), FALSE, &ogrDriver );
 
         
         if ( !ds )
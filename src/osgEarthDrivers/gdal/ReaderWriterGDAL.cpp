@@ -22,6 +22,9 @@
 #include <osgEarth/Registry>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/URI>
+#include <osgEarth/ThreadingUtils>
+
+#include <OpenThreads/Thread>
 
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -31,6 +34,9 @@
 #include <osgDB/ImageOptions>
 
 #include <sstream>
+#include <map>
+#include <vector>
+#include <float.h>
 #include <stdlib.h>
 #include <memory.h>
 
@@ -609,6 +615,31 @@ GDALDatasetH GDALAutoCreateWarpedVRTforPolarStereographic(
 }
 
 
+namespace
+{
+    // Largest source window, in pixels, that a tile reads in one piece. Bigger
+    // windows (low LODs over high resolution data) fall back to per-sample reads.
+    const double MAX_WINDOW_PIXELS = 2048.0 * 2048.0;
+
+    // Holds the process-wide GDAL lock for the life of the scope, if asked to.
+    struct OptionalGDALLock
+    {
+        OptionalGDALLock( bool lock ) :
+            _mutex( lock ? &osgEarth::Registry::instance()->getGDALMutex() : 0L )
+        {
+            if ( _mutex ) _mutex->lock();
+        }
+
+        ~OptionalGDALLock()
+        {
+            if ( _mutex ) _mutex->unlock();
+        }
+
+        OpenThreads::ReentrantMutex* _mutex;
+    };
+}
+
+
 class GDALTileSource : public TileSource
 {
 public:
@@ -616,6 +647,9 @@ public:
       TileSource( options ),
       _srcDS(NULL),
       _warpedDS(NULL),
+      _rasterXSize(0),
+      _rasterYSize(0),
+      _warpPolar(false),
       _options(options),
       _maxDataLevel(30)
     {    
@@ -625,6 +659,16 @@ public:
     {                     
         GDAL_SCOPED_LOCK;
 
+        // Close the per-thread handles.
+        for( ThreadDatasets::iterator i = _threadDatasets.begin(); i != _threadDatasets.end(); ++i )
+        {
+            if ( i->second.warped && i->second.warped != i->second.src )
+                GDALClose( i->second.warped );
+            if ( i->second.src )
+                GDALClose( i->second.src );
+        }
+        _threadDatasets.clear();
+
         // Close the _warpedDS dataset if :
         // - it exists
         // - and is different from _srcDS
@@ -765,6 +809,7 @@ public:
                         if (_srcDS)
                         {
                             OE_INFO << LC << "Read VRT from cache!" << std::endl;
+                            _reopenPath = result.getString();
                         }
                     }
                 }
@@ -820,6 +865,7 @@ public:
                 //If we couldn't build a VRT, just try opening the file directly
                 //Open the dataset
                 _srcDS = (GDALDataset*)GDALOpen( files[0].c_str(), GA_ReadOnly );
+                _reopenPath = files[0];
 
                 if (_srcDS)
                 {
@@ -837,6 +883,7 @@ public:
                         char *pszSubdatasetName = CPLStrdup( CSLFetchNameValue( subDatasets, buf.str().c_str() ) );
                         GDALClose( _srcDS );
                         _srcDS = (GDALDataset*)GDALOpen( pszSubdatasetName, GA_ReadOnly ) ;
+                        _reopenPath = pszSubdatasetName;
                         CPLFree( pszSubdatasetName );
                     }
                 }
@@ -949,26 +996,11 @@ public:
         {
             std::string destWKT = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
 
-            if ( profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar()) )
-            {
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    profile->getSRS()->getWKT().c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    NULL);
-            }
-            else
-            {                                
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRT(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    destWKT.c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    0);
-            }
+            _warpPolar  = profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar());
+            _warpSrcWKT = src_srs->getWKT();
+            _warpDstWKT = _warpPolar ? profile->getSRS()->getWKT() : destWKT;
+
+            _warpedDS = createWarpedDataset( _srcDS );
 
             if ( _warpedDS )
             {
@@ -981,6 +1013,9 @@ public:
             warpedSRSWKT = src_srs->getWKT();
         }
 
+        _rasterXSize = _warpedDS->GetRasterXSize();
+        _rasterYSize = _warpedDS->GetRasterYSize();
+
         //Get the _geotransform
         if ( getProfile() )
         {
@@ -1099,8 +1134,6 @@ public:
     */
     static GDALRasterBand* findBandByColorInterp(GDALDataset *ds, GDALColorInterp colorInterp)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetColorInterpretation() == colorInterp) return ds->GetRasterBand(i);
@@ -1110,8 +1143,6 @@ public:
 
     static GDALRasterBand* findBandByDataType(GDALDataset *ds, GDALDataType dataType)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetRasterDataType() == dataType) return ds->GetRasterBand(i);
@@ -1203,6 +1234,92 @@ public:
         geoY = _geotransform[3] + _geotransform[4] * x + _geotransform[5] * y;
     }
 
+    /** Creates a warped VRT over a source dataset, with the warp set up in initialize(). */
+    GDALDataset* createWarpedDataset(GDALDataset* src)
+    {
+        if ( _warpPolar )
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
+                src,
+                _warpSrcWKT.c_str(),
+                _warpDstWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                NULL);
+        }
+        else
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRT(
+                src,
+                _warpSrcWKT.c_str(),
+                _warpDstWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                0);
+        }
+    }
+
+    /**
+     * Gets the dataset to read from on the calling thread. That's the thread's
+     * own handle if we can make one, in which case out_shared is false and no
+     * lock is needed; otherwise it's the shared handle, which must be read
+     * under the GDAL lock.
+     */
+    GDALDataset* getDataset(bool& out_shared)
+    {
+        out_shared = true;
+
+        if ( _options.threadLocalDatasets() != true || _reopenPath.empty() )
+            return _warpedDS;
+
+        // threads that OpenThreads doesn't know about can't be told apart.
+        OpenThreads::Thread* thread = OpenThreads::Thread::CurrentThread();
+        if ( !thread )
+            return _warpedDS;
+
+        {
+            Threading::ScopedMutexLock lock( _threadDatasetsMutex );
+            ThreadDatasets::const_iterator i = _threadDatasets.find( thread );
+            if ( i != _threadDatasets.end() )
+            {
+                // a null entry means the reopen failed; use the shared handle.
+                out_shared = i->second.warped == 0L;
+                return out_shared ? _warpedDS : i->second.warped;
+            }
+        }
+
+        // first read on this thread: open its handles.
+        GDAL_SCOPED_LOCK;
+
+        ThreadDataset td;
+        td.src    = (GDALDataset*)GDALOpen( _reopenPath.c_str(), GA_ReadOnly );
+        td.warped = !td.src ? 0L : _warpedDS == _srcDS ? td.src : createWarpedDataset( td.src );
+
+        if ( td.warped &&
+            (td.warped->GetRasterXSize() != _rasterXSize || td.warped->GetRasterYSize() != _rasterYSize) )
+        {
+            if ( td.warped != td.src )
+                GDALClose( td.warped );
+            td.warped = 0L;
+        }
+
+        if ( !td.warped )
+        {
+            OE_INFO << LC << "Could not reopen the dataset for this thread; using the shared handle" << std::endl;
+            if ( td.src )
+                GDALClose( td.src );
+            td.src = 0L;
+        }
+
+        {
+            Threading::ScopedMutexLock lock( _threadDatasetsMutex );
+            _threadDatasets[thread] = td;
+        }
+
+        out_shared = td.warped == 0L;
+        return out_shared ? _warpedDS : td.warped;
+    }
+
     osg::Image* createImage( const TileKey&        key,
                              ProgressCallback*     progress)
     {
@@ -1213,7 +1330,9 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        bool sharedDS;
+        GDALDataset* ds = getDataset( sharedDS );
+        OptionalGDALLock lock( sharedDS );
 
         int tileSize = _options.tileSize().value();
 
@@ -1224,10 +1343,6 @@ public:
             double xmin, ymin, xmax, ymax;
             key.getExtent().getBounds(xmin, ymin, xmax, ymax);
 
-            double dx       = (xmax - xmin) / (tileSize-1); 
-            double dy       = (ymax - ymin) / (tileSize-1); 
-
-
             int target_width = tileSize;
             int target_height = tileSize;
             int tile_offset_left = 0;
@@ -1238,11 +1353,11 @@ public:
             int width = int(((xmax - _geotransform[0]) / _geotransform[1]) - off_x);
             int height = int(((ymin - _geotransform[3]) / _geotransform[5]) - off_y);
 
-            if (off_x + width > _warpedDS->GetRasterXSize())
+            if (off_x + width > ds->GetRasterXSize())
             {
-                int oversize_right = off_x + width - _warpedDS->GetRasterXSize();
+                int oversize_right = off_x + width - ds->GetRasterXSize();
                 target_width = target_width - int(float(oversize_right) / width * target_width);
-                width = _warpedDS->GetRasterXSize() - off_x;
+                width = ds->GetRasterXSize() - off_x;
             }
 
             if (off_x < 0)
@@ -1254,11 +1369,11 @@ public:
                 off_x = 0;
             }
 
-            if (off_y + height > _warpedDS->GetRasterYSize())
+            if (off_y + height > ds->GetRasterYSize())
             {
-                int oversize_bottom = off_y + height - _warpedDS->GetRasterYSize();
+                int oversize_bottom = off_y + height - ds->GetRasterYSize();
                 target_height = target_height - (int)osg::round(float(oversize_bottom) / height * target_height);
-                height = _warpedDS->GetRasterYSize() - off_y;
+                height = ds->GetRasterYSize() - off_y;
             }
 
 
@@ -1281,44 +1396,44 @@ public:
 
 
 
-            GDALRasterBand* bandRed = findBandByColorInterp(_warpedDS, GCI_RedBand);
-            GDALRasterBand* bandGreen = findBandByColorInterp(_warpedDS, GCI_GreenBand);
-            GDALRasterBand* bandBlue = findBandByColorInterp(_warpedDS, GCI_BlueBand);
-            GDALRasterBand* bandAlpha = findBandByColorInterp(_warpedDS, GCI_AlphaBand);
+            GDALRasterBand* bandRed = findBandByColorInterp(ds, GCI_RedBand);
+            GDALRasterBand* bandGreen = findBandByColorInterp(ds, GCI_GreenBand);
+            GDALRasterBand* bandBlue = findBandByColorInterp(ds, GCI_BlueBand);
+            GDALRasterBand* bandAlpha = findBandByColorInterp(ds, GCI_AlphaBand);
 
-            GDALRasterBand* bandGray = findBandByColorInterp(_warpedDS, GCI_GrayIndex);
+            GDALRasterBand* bandGray = findBandByColorInterp(ds, GCI_GrayIndex);
 
-            GDALRasterBand* bandPalette = findBandByColorInterp(_warpedDS, GCI_PaletteIndex);
+            GDALRasterBand* bandPalette = findBandByColorInterp(ds, GCI_PaletteIndex);
 
             if (!bandRed && !bandGreen && !bandBlue && !bandAlpha && !bandGray && !bandPalette)
             {
                 OE_DEBUG << LC << "Could not determine bands based on color interpretation, using band count" << std::endl;
                 //We couldn't find any valid bands based on the color interp, so just make an educated guess based on the number of bands in the file
                 //RGB = 3 bands
-                if (_warpedDS->GetRasterCount() == 3)
+                if (ds->GetRasterCount() == 3)
                 {
-                    bandRed   = _warpedDS->GetRasterBand( 1 );
-                    bandGreen = _warpedDS->GetRasterBand( 2 );
-                    bandBlue  = _warpedDS->GetRasterBand( 3 );
+                    bandRed   = ds->GetRasterBand( 1 );
+                    bandGreen = ds->GetRasterBand( 2 );
+                    bandBlue  = ds->GetRasterBand( 3 );
                 }
                 //RGBA = 4 bands
-                else if (_warpedDS->GetRasterCount() == 4)
+                else if (ds->GetRasterCount() == 4)
                 {
-                    bandRed   = _warpedDS->GetRasterBand( 1 );
-                    bandGreen = _warpedDS->GetRasterBand( 2 );
-                    bandBlue  = _warpedDS->GetRasterBand( 3 );
-                    bandAlpha = _warpedDS->GetRasterBand( 4 );
+                    bandRed   = ds->GetRasterBand( 1 );
+                    bandGreen = ds->GetRasterBand( 2 );
+                    bandBlue  = ds->GetRasterBand( 3 );
+                    bandAlpha = ds->GetRasterBand( 4 );
                 }
                 //Gray = 1 band
-                else if (_warpedDS->GetRasterCount() == 1)
+                else if (ds->GetRasterCount() == 1)
                 {
-                    bandGray = _warpedDS->GetRasterBand( 1 );
+                    bandGray = ds->GetRasterBand( 1 );
                 }
                 //Gray + alpha = 2 bands
-                else if (_warpedDS->GetRasterCount() == 2)
+                else if (ds->GetRasterCount() == 2)
                 {
-                    bandGray  = _warpedDS->GetRasterBand( 1 );
-                    bandAlpha = _warpedDS->GetRasterBand( 2 );
+                    bandGray  = ds->GetRasterBand( 1 );
+                    bandAlpha = ds->GetRasterBand( 2 );
                 }
             }
 
@@ -1354,6 +1469,11 @@ public:
                         bandAlpha->RasterIO(GF_Read, off_x, off_y, width, height, alpha, target_width, target_height, GDT_Byte, 0, 0);
                     }
 
+                    float noDataRed   = getBandNoData(bandRed);
+                    float noDataGreen = getBandNoData(bandGreen);
+                    float noDataBlue  = getBandNoData(bandBlue);
+                    float noDataAlpha = bandAlpha ? getBandNoData(bandAlpha) : 0.0f;
+
                     for (int src_row = 0, dst_row = tile_offset_top;
                         src_row < target_height;
                         src_row++, dst_row++)
@@ -1369,10 +1489,10 @@ public:
                             *(image->data(dst_col, dst_row) + 0) = r;
                             *(image->data(dst_col, dst_row) + 1) = g;
                             *(image->data(dst_col, dst_row) + 2) = b;                            
-                            if (!isValidValue( r, bandRed)    ||
-                                !isValidValue( g, bandGreen)  || 
-                                !isValidValue( b, bandBlue)   ||
-                                (bandAlpha && !isValidValue( a, bandAlpha )))
+                            if (!isValidValue( r, noDataRed)    ||
+                                !isValidValue( g, noDataGreen)  || 
+                                !isValidValue( b, noDataBlue)   ||
+                                (bandAlpha && !isValidValue( a, noDataAlpha )))
                             {
                                 a = 0.0f;
                             }                            
@@ -1384,18 +1504,27 @@ public:
                 }
                 else
                 {
-                    //Sample each point exactly
-                    for (unsigned int c = 0; c < (unsigned int)tileSize; ++c)
+                    //Sample each point exactly, from the source window covering the tile
+                    SampleGrid grid;
+                    initSampleGrid(xmin, ymin, xmax, ymax, tileSize, false, grid);
+
+                    std::vector<float> redValues, greenValues, blueValues, alphaValues;
+                    sampleBand(bandRed,   grid, redValues);
+                    sampleBand(bandGreen, grid, greenValues);
+                    sampleBand(bandBlue,  grid, blueValues);
+                    if (bandAlpha != NULL)
+                        sampleBand(bandAlpha, grid, alphaValues);
+
+                    for (unsigned int r = 0; r < (unsigned int)tileSize; ++r)
                     {
-                        double geoX = xmin + (dx * (double)c); 
-                        for (unsigned int r = 0; r < (unsigned int)tileSize; ++r)
+                        for (unsigned int c = 0; c < (unsigned int)tileSize; ++c)
                         {
-                            double geoY = ymin + (dy * (double)r); 
-                            *(image->data(c,r) + 0) = (unsigned char)getInterpolatedValue(bandRed,  geoX,geoY,false); 
-                            *(image->data(c,r) + 1) = (unsigned char)getInterpolatedValue(bandGreen,geoX,geoY,false); 
-                            *(image->data(c,r) + 2) = (unsigned char)getInterpolatedValue(bandBlue, geoX,geoY,false); 
+                            unsigned int i = r * tileSize + c;
+                            *(image->data(c,r) + 0) = (unsigned char)redValues[i]; 
+                            *(image->data(c,r) + 1) = (unsigned char)greenValues[i]; 
+                            *(image->data(c,r) + 2) = (unsigned char)blueValues[i]; 
                             if (bandAlpha != NULL) 
-                                *(image->data(c,r) + 3) = (unsigned char)getInterpolatedValue(bandAlpha,geoX, geoY, false); 
+                                *(image->data(c,r) + 3) = (unsigned char)alphaValues[i]; 
                             else 
                                 *(image->data(c,r) + 3) = 255; 
                         }
@@ -1429,6 +1558,9 @@ public:
                         bandAlpha->RasterIO(GF_Read, off_x, off_y, width, height, alpha, target_width, target_height, GDT_Byte, 0, 0);
                     }
 
+                    float noDataGray  = getBandNoData(bandGray);
+                    float noDataAlpha = bandAlpha ? getBandNoData(bandAlpha) : 0.0f;
+
                     for (int src_row = 0, dst_row = tile_offset_top;
                         src_row < target_height;
                         src_row++, dst_row++)
@@ -1442,8 +1574,8 @@ public:
                             *(image->data(dst_col, dst_row) + 0) = g;
                             *(image->data(dst_col, dst_row) + 1) = g;
                             *(image->data(dst_col, dst_row) + 2) = g;                            
-                            if (!isValidValue( g, bandGray) ||
-                               (bandAlpha && !isValidValue( a, bandAlpha)))
+                            if (!isValidValue( g, noDataGray) ||
+                               (bandAlpha && !isValidValue( a, noDataAlpha)))
                             {
                                 a = 0.0f;
                             }
@@ -1455,20 +1587,26 @@ public:
                 }
                 else
                 {
-                    for (int c = 0; c < tileSize; ++c) 
-                    { 
-                        double geoX = xmin + (dx * (double)c); 
+                    SampleGrid grid;
+                    initSampleGrid(xmin, ymin, xmax, ymax, tileSize, false, grid);
+
+                    std::vector<float> grayValues, alphaValues;
+                    sampleBand(bandGray, grid, grayValues);
+                    if (bandAlpha != NULL)
+                        sampleBand(bandAlpha, grid, alphaValues);
 
-                        for (int r = 0; r < tileSize; ++r) 
+                    for (int r = 0; r < tileSize; ++r) 
+                    { 
+                        for (int c = 0; c < tileSize; ++c) 
                         { 
-                            double geoY   = ymin + (dy * (double)r); 
-                            float  color = getInterpolatedValue(bandGray,geoX,geoY,false); 
+                            unsigned int i = r * tileSize + c;
+                            float color = grayValues[i]; 
 
                             *(image->data(c,r) + 0) = (unsigned char)color; 
                             *(image->data(c,r) + 1) = (unsigned char)color; 
                             *(image->data(c,r) + 2) = (unsigned char)color; 
                             if (bandAlpha != NULL) 
-                                *(image->data(c,r) + 3) = (unsigned char)getInterpolatedValue(bandAlpha,geoX,geoY,false); 
+                                *(image->data(c,r) + 3) = (unsigned char)alphaValues[i]; 
                             else 
                                 *(image->data(c,r) + 3) = 255; 
                         }
@@ -1491,6 +1629,8 @@ public:
 
                 bandPalette->RasterIO(GF_Read, off_x, off_y, width, height, palette, target_width, target_height, GDT_Byte, 0, 0);
 
+                float noDataPalette = getBandNoData(bandPalette);
+
                 for (int src_row = 0, dst_row = tile_offset_top;
                     src_row < target_height;
                     src_row++, dst_row++)
@@ -1503,7 +1643,7 @@ public:
                         unsigned char p = palette[src_col + src_row * target_width];
                         osg::Vec4ub color;
                         getPalleteIndexColor( bandPalette, p, color );                        
-                        if (!isValidValue( p, bandPalette))
+                        if (!isValidValue( p, noDataPalette))
                         {
                             color.a() = 0.0f;
                         }
@@ -1545,10 +1685,8 @@ public:
         return image.release();
     }
 
-    bool isValidValue(float v, GDALRasterBand* band)
+    float getBandNoData(GDALRasterBand* band)
     {
-        GDAL_SCOPED_LOCK;
-
         float bandNoData = -32767.0f;
         int success;
         float value = band->GetNoDataValue(&success);
@@ -1556,7 +1694,16 @@ public:
         {
             bandNoData = value;
         }
+        return bandNoData;
+    }
 
+    bool isValidValue(float v, GDALRasterBand* band)
+    {
+        return isValidValue(v, getBandNoData(band));
+    }
+
+    bool isValidValue(float v, float bandNoData)
+    {
         //Check to see if the value is equal to the bands specified no data
         if (bandNoData == v) return false;
         //Check to see if the value is equal to the user specified nodata value
@@ -1574,17 +1721,20 @@ public:
     }
 
 
-    float getInterpolatedValue(GDALRasterBand *band, double x, double y, bool applyOffset=true)
+    /**
+     * Converts a map location to a pixel location in the dataset. Returns false
+     * if the location falls outside the dataset.
+     */
+    bool getPixelLocation(double x, double y, bool applyOffset, double& c, double& r)
     {
-        double r, c;
         GDALApplyGeoTransform(_invtransform, x, y, &c, &r);
 
         //Account for slight rounding errors.  If we are right on the edge of the dataset, clamp to the edge
         double eps = 0.0001;
         if (osg::equivalent(c, 0, eps)) c = 0;
         if (osg::equivalent(r, 0, eps)) r = 0;
-        if (osg::equivalent(c, (double)_warpedDS->GetRasterXSize(), eps)) c = _warpedDS->GetRasterXSize();
-        if (osg::equivalent(r, (double)_warpedDS->GetRasterYSize(), eps)) r = _warpedDS->GetRasterYSize();
+        if (osg::equivalent(c, (double)_rasterXSize, eps)) c = _rasterXSize;
+        if (osg::equivalent(r, (double)_rasterYSize, eps)) r = _rasterYSize;
 
         if (applyOffset)
         {
@@ -1599,31 +1749,39 @@ public:
             {
                 c = 0;
             }
-            else if (c > _warpedDS->GetRasterXSize()-1 && c <= _warpedDS->GetRasterXSize()-0.5)
+            else if (c > _rasterXSize-1 && c <= _rasterXSize-0.5)
             {
-                c = _warpedDS->GetRasterXSize()-1;
+                c = _rasterXSize-1;
             }
 
             if (r < 0 && r >= -0.5)
             {
                 r = 0;
             }
-            else if (r > _warpedDS->GetRasterYSize()-1 && r <= _warpedDS->GetRasterYSize()-0.5)
+            else if (r > _rasterYSize-1 && r <= _rasterYSize-0.5)
             {
-                r = _warpedDS->GetRasterYSize()-1;
+                r = _rasterYSize-1;
             }
         }
 
-        float result = 0.0f;
+        //If the location is outside of the pixel values of the dataset, there's no value
+        return !(c < 0 || r < 0 || c > _rasterXSize-1 || r > _rasterYSize-1);
+    }
+
 
-        //If the location is outside of the pixel values of the dataset, just return 0
-        if (c < 0 || r < 0 || c > _warpedDS->GetRasterXSize()-1 || r > _warpedDS->GetRasterYSize()-1)
-            return NO_DATA_VALUE;
+    /**
+     * Interpolates a value at a pixel location that lies within the dataset.
+     * The reader supplies pixel values (get) and validates them (valid).
+     */
+    template<typename READER>
+    float interpolate(READER& reader, double c, double r)
+    {
+        float result = 0.0f;
 
         if ( _options.interpolation() == INTERP_NEAREST )
         {
-            band->RasterIO(GF_Read, (int)osg::round(c), (int)osg::round(r), 1, 1, &result, 1, 1, GDT_Float32, 0, 0);
-            if (!isValidValue( result, band))
+            result = reader.get((int)osg::round(c), (int)osg::round(r));
+            if (!reader.valid(result))
             {
                 return NO_DATA_VALUE;
             }
@@ -1631,27 +1789,19 @@ public:
         else
         {
             int rowMin = osg::maximum((int)floor(r), 0);
-            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(_warpedDS->GetRasterYSize()-1)), 0);
+            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(_rasterYSize-1)), 0);
             int colMin = osg::maximum((int)floor(c), 0);
-            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(_warpedDS->GetRasterXSize()-1)), 0);
+            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(_rasterXSize-1)), 0);
 
             if (rowMin > rowMax) rowMin = rowMax;
             if (colMin > colMax) colMin = colMax;
 
-            float urHeight, llHeight, ulHeight, lrHeight;
-
-            band->RasterIO(GF_Read, colMin, rowMin, 1, 1, &llHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMin, rowMax, 1, 1, &ulHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMax, rowMin, 1, 1, &lrHeight, 1, 1, GDT_Float32, 0, 0);
-            band->RasterIO(GF_Read, colMax, rowMax, 1, 1, &urHeight, 1, 1, GDT_Float32, 0, 0);
+            float llHeight = reader.get(colMin, rowMin);
+            float ulHeight = reader.get(colMin, rowMax);
+            float lrHeight = reader.get(colMax, rowMin);
+            float urHeight = reader.get(colMax, rowMax);
 
-            /*
-            if (!isValidValue(urHeight, band)) urHeight = 0.0f;
-            if (!isValidValue(llHeight, band)) llHeight = 0.0f;
-            if (!isValidValue(ulHeight, band)) ulHeight = 0.0f;
-            if (!isValidValue(lrHeight, band)) lrHeight = 0.0f;
-            */
-            if (!isValidValue(urHeight, band) || (!isValidValue(llHeight, band)) ||(!isValidValue(ulHeight, band)) || (!isValidValue(lrHeight, band)))
+            if (!reader.valid(urHeight) || (!reader.valid(llHeight)) ||(!reader.valid(ulHeight)) || (!reader.valid(lrHeight)))
             {
                 return NO_DATA_VALUE;
             }
@@ -1673,29 +1823,24 @@ public:
                 //Check for exact value
                 if ((colMax == colMin) && (rowMax == rowMin))
                 {
-                    //OE_NOTICE << "Exact value" << std::endl;
                     result = llHeight;
                 }
                 else if (colMax == colMin)
                 {
-                    //OE_NOTICE << "Vertically" << std::endl;
                     //Linear interpolate vertically
                     result = ((float)rowMax - r) * llHeight + (r - (float)rowMin) * ulHeight;
                 }
                 else if (rowMax == rowMin)
                 {
-                    //OE_NOTICE << "Horizontally" << std::endl;
                     //Linear interpolate horizontally
                     result = ((float)colMax - c) * llHeight + (c - (float)colMin) * lrHeight;
                 }
                 else
                 {
-                    //OE_NOTICE << "Bilinear" << std::endl;
                     //Bilinear interpolate
                     float r1 = ((float)colMax - c) * llHeight + (c - (float)colMin) * lrHeight;
                     float r2 = ((float)colMax - c) * ulHeight + (c - (float)colMin) * urHeight;
 
-                    //OE_INFO << "r1, r2 = " << r1 << " , " << r2 << std::endl;
                     result = ((float)rowMax - r) * r1 + (r - (float)rowMin) * r2;
                 }
             }
@@ -1705,6 +1850,130 @@ public:
     }
 
 
+    /** Reads pixel values straight from a band, one RasterIO per pixel. */
+    struct BandReader
+    {
+        BandReader(GDALTileSource* source, GDALRasterBand* band) :
+            _source(source), _band(band), _noData(source->getBandNoData(band)) { }
+
+        float get(int col, int row)
+        {
+            float value = 0.0f;
+            _band->RasterIO(GF_Read, col, row, 1, 1, &value, 1, 1, GDT_Float32, 0, 0);
+            return value;
+        }
+
+        bool valid(float v) { return _source->isValidValue(v, _noData); }
+
+        GDALTileSource* _source;
+        GDALRasterBand* _band;
+        float           _noData;
+    };
+
+    /** Reads pixel values from a window of a band already read into memory. */
+    struct WindowReader
+    {
+        WindowReader(GDALTileSource* source, const float* data, int col0, int row0, int width, float noData) :
+            _source(source), _data(data), _col0(col0), _row0(row0), _width(width), _noData(noData) { }
+
+        float get(int col, int row) { return _data[(row-_row0)*_width + (col-_col0)]; }
+
+        bool valid(float v) { return _source->isValidValue(v, _noData); }
+
+        GDALTileSource* _source;
+        const float*    _data;
+        int             _col0, _row0, _width;
+        float           _noData;
+    };
+
+    /**
+     * Pixel locations of a tile's samples (row-major, south row first) and
+     * the source window that covers them, with a 1-pixel apron.
+     */
+    struct SampleGrid
+    {
+        std::vector<double>        cols;
+        std::vector<double>        rows;
+        std::vector<unsigned char> inside;
+        bool                       windowed;
+        int                        col0, row0, width, height;
+    };
+
+    void initSampleGrid(double xmin, double ymin, double xmax, double ymax, int tileSize, bool applyOffset, SampleGrid& grid)
+    {
+        unsigned int numSamples = tileSize * tileSize;
+        grid.cols.resize( numSamples );
+        grid.rows.resize( numSamples );
+        grid.inside.resize( numSamples );
+        grid.windowed = false;
+
+        double dx = (xmax - xmin) / (tileSize-1);
+        double dy = (ymax - ymin) / (tileSize-1);
+
+        double cmin = DBL_MAX, cmax = -DBL_MAX, rmin = DBL_MAX, rmax = -DBL_MAX;
+
+        for (int r = 0; r < tileSize; ++r)
+        {
+            double geoY = ymin + (dy * (double)r);
+            for (int c = 0; c < tileSize; ++c)
+            {
+                double geoX = xmin + (dx * (double)c);
+                unsigned int i = r * tileSize + c;
+                grid.inside[i] = getPixelLocation(geoX, geoY, applyOffset, grid.cols[i], grid.rows[i]) ? 1 : 0;
+                if ( grid.inside[i] )
+                {
+                    cmin = osg::minimum(cmin, grid.cols[i]);
+                    cmax = osg::maximum(cmax, grid.cols[i]);
+                    rmin = osg::minimum(rmin, grid.rows[i]);
+                    rmax = osg::maximum(rmax, grid.rows[i]);
+                }
+            }
+        }
+
+        if ( cmin > cmax )
+            return;
+
+        grid.col0   = osg::maximum((int)floor(cmin) - 1, 0);
+        grid.row0   = osg::maximum((int)floor(rmin) - 1, 0);
+        grid.width  = osg::minimum((int)ceil(cmax) + 1, _rasterXSize-1) - grid.col0 + 1;
+        grid.height = osg::minimum((int)ceil(rmax) + 1, _rasterYSize-1) - grid.row0 + 1;
+
+        grid.windowed =
+            grid.width > 0 && grid.height > 0 &&
+            (double)grid.width * (double)grid.height <= MAX_WINDOW_PIXELS;
+    }
+
+    /**
+     * Samples a band at each location in the grid. Reads the covering window
+     * in one RasterIO when it's small enough, and samples it in memory.
+     */
+    void sampleBand(GDALRasterBand* band, const SampleGrid& grid, std::vector<float>& output)
+    {
+        unsigned int numSamples = grid.inside.size();
+        output.resize( numSamples );
+
+        if ( grid.windowed )
+        {
+            std::vector<float> window( grid.width * grid.height );
+            if ( band->RasterIO(GF_Read, grid.col0, grid.row0, grid.width, grid.height, &window[0], grid.width, grid.height, GDT_Float32, 0, 0) == CE_None )
+            {
+                WindowReader reader( this, &window[0], grid.col0, grid.row0, grid.width, getBandNoData(band) );
+                for (unsigned int i = 0; i < numSamples; ++i)
+                {
+                    output[i] = grid.inside[i] ? interpolate(reader, grid.cols[i], grid.rows[i]) : NO_DATA_VALUE;
+                }
+                return;
+            }
+        }
+
+        BandReader reader( this, band );
+        for (unsigned int i = 0; i < numSamples; ++i)
+        {
+            output[i] = grid.inside[i] ? interpolate(reader, grid.cols[i], grid.rows[i]) : NO_DATA_VALUE;
+        }
+    }
+
+
     osg::HeightField* createHeightField( const TileKey&        key,
                                          ProgressCallback*     progress)
     {
@@ -1714,7 +1983,9 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        bool sharedDS;
+        GDALDataset* ds = getDataset( sharedDS );
+        OptionalGDALLock lock( sharedDS );
 
         int tileSize = _options.tileSize().value();
 
@@ -1729,24 +2000,24 @@ public:
             key.getExtent().getBounds(xmin, ymin, xmax, ymax);
 
             // Try to find a FLOAT band
-            GDALRasterBand* band = findBandByDataType(_warpedDS, GDT_Float32);
+            GDALRasterBand* band = findBandByDataType(ds, GDT_Float32);
             if (band == NULL)
             {
                 // Just get first band
-                band = _warpedDS->GetRasterBand(1);
+                band = ds->GetRasterBand(1);
             }
 
-            double dx = (xmax - xmin) / (tileSize-1);
-            double dy = (ymax - ymin) / (tileSize-1);
+            SampleGrid grid;
+            initSampleGrid(xmin, ymin, xmax, ymax, tileSize, true, grid);
 
-            for (int c = 0; c < tileSize; ++c)
+            std::vector<float> heights;
+            sampleBand(band, grid, heights);
+
+            for (int r = 0; r < tileSize; ++r)
             {
-                double geoX = xmin + (dx * (double)c);
-                for (int r = 0; r < tileSize; ++r)
+                for (int c = 0; c < tileSize; ++c)
                 {
-                    double geoY = ymin + (dy * (double)r);
-                    float h = getInterpolatedValue(band, geoX, geoY);
-                    hf->setHeight(c, r, h);
+                    hf->setHeight(c, r, heights[r * tileSize + c]);
                 }
             }
         }
@@ -1769,6 +2040,22 @@ private:
     GDALDataset* _warpedDS;
     double       _geotransform[6];
     double       _invtransform[6];
+    int          _rasterXSize;
+    int          _rasterYSize;
+
+    // how to reopen the source and warp it again, for per-thread handles.
+    std::string  _reopenPath;
+    bool         _warpPolar;
+    std::string  _warpSrcWKT;
+    std::string  _warpDstWKT;
+
+    struct ThreadDataset {
+        GDALDataset* src;
+        GDALDataset* warped;
+    };
+    typedef std::map<OpenThreads::Thread*, ThreadDataset> ThreadDatasets;
+    ThreadDatasets   _threadDatasets;
+    Threading::Mutex _threadDatasetsMutex;
 
     GeoExtent _extents;
 
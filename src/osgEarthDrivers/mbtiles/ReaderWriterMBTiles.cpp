@@ -23,6 +23,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
 #include <osgEarth/ImageUtils>
+#include <osgEarth/StringUtils>
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
@@ -55,28 +56,31 @@ public:
     }
 
     // override
-      void initialize( const osgDB::Options* dbOptions, const Profile* overrideProfile)
+    Status initialize( const osgDB::Options* dbOptions )
     {
-        //Set the profile
-        setProfile( osgEarth::Registry::instance()->getGlobalMercatorProfile() );
-
-#if 0
-        //Open the database
-        std::string filename = _options.filename().value();
+        // keep a profile from the options (the packager writes one); MBTiles are
+        // spherical mercator otherwise.
+        if ( !getProfile() )
+        {
+            setProfile( osgEarth::Registry::instance()->getGlobalMercatorProfile() );
+        }
 
-        //Get the absolute filename
-        if (!osgDB::containsServerAddress(filename))
+        if ( !_options.filename().isSet() || _options.filename()->empty() )
         {
-            filename = osgEarth::getFullPath(referenceURI, filename);
+            return Status::Error( "MBTiles driver requires a valid \"filename\" property" );
         }
-#endif
+
+        //Open the database; a relative filename is relative to the earth file.
+        std::string filename = osgEarth::getFullPath( _options.referrer(), _options.filename().value() );
 
         int flags = SQLITE_OPEN_READONLY;
-        int rc = sqlite3_open_v2( _options.filename()->c_str(), &_database, flags, 0L );
+        int rc = sqlite3_open_v2( filename.c_str(), &_database, flags, 0L );
         if ( rc != 0 )
         {
-            OE_WARN << LC << "Failed to open database \"" << *_options.filename() << "\": " << sqlite3_errmsg(_database) << std::endl;
-            return;
+            std::string error = Stringify() << "Failed to open database \"" << filename << "\": " << sqlite3_errmsg(_database);
+            sqlite3_close( _database );
+            _database = NULL;
+            return Status::Error( error );
         }
 
         //Print out some metadata
@@ -113,9 +117,15 @@ public:
 
         //Get the ReaderWriter
         _rw = osgDB::Registry::instance()->getReaderWriterForExtension( _tileFormat );
+        if ( !_rw.valid() )
+        {
+            return Status::Error( Stringify() << "No plugin available to read \"" << _tileFormat << "\" tiles" );
+        }
 
         computeLevels();
-    }    
+
+        return STATUS_OK;
+    }
 
     // override
     osg::Image* createImage( const TileKey& key,
@@ -19,7 +19,7 @@
 #include <osgEarthFeatures/Feature>
 #include <osgEarth/StringUtils>
 #include <osgEarthFeatures/GeometryUtils>
-#include <osgEarth/JsonUtils>
+#include <osgEarthFeatures/GeoJSON>
 #include <algorithm>
 
 using namespace osgEarth;
@@ -30,6 +30,29 @@ using namespace osgEarth::Symbology;
 
 //----------------------------------------------------------------------------
 
+unsigned
+AttributeLayout::add( const std::string& name )
+{
+    std::string key = toLower(name);
+    std::map<std::string, unsigned>::const_iterator i = _indices.find( key );
+    if ( i != _indices.end() )
+        return i->second;
+
+    unsigned index = _names.size();
+    _names.push_back( key );
+    _indices[key] = index;
+    return index;
+}
+
+int
+AttributeLayout::indexOf( const std::string& name ) const
+{
+    std::map<std::string, unsigned>::const_iterator i = _indices.find( name );
+    return i != _indices.end() ? (int)i->second : -1;
+}
+
+//----------------------------------------------------------------------------
+
 FeatureProfile::FeatureProfile( const GeoExtent& extent ) :
 _extent    ( extent ),
 _firstLevel( 0 ),
@@ -87,6 +110,18 @@ FeatureProfile::setProfile( const osgEarth::Profile* profile )
     _profile = profile;
 }
 
+const AttributeLayout*
+FeatureProfile::getAttributeLayout() const
+{
+    return _layout.get();
+}
+
+void
+FeatureProfile::setAttributeLayout( const AttributeLayout* layout )
+{
+    _layout = layout;
+}
+
 //----------------------------------------------------------------------------
 
 std::string
@@ -145,7 +180,9 @@ AttributeValue::getBool( bool defaultValue ) const
 
 Feature::Feature( FeatureID fid ) :
 _fid( fid ),
-_srs( 0L )
+_srs( 0L ),
+_allAttrs( 0L ),
+_allAttrsValid( false )
 //_cachedBoundingPolytopeValid( false )
 {
     //NOP
@@ -154,7 +191,9 @@ _srs( 0L )
 Feature::Feature( Geometry* geom, const SpatialReference* srs, const Style& style, FeatureID fid ) :
 _geom ( geom ),
 _srs  ( srs ),
-_fid  ( fid )
+_fid  ( fid ),
+_allAttrs( 0L ),
+_allAttrsValid( false )
 {
     if ( !style.empty() )
         _style = style;
@@ -165,6 +204,11 @@ _fid  ( fid )
 Feature::Feature( const Feature& rhs, const osg::CopyOp& copyOp ) :
 _fid      ( rhs._fid ),
 _attrs    ( rhs._attrs ),
+_layout   ( rhs._layout.get() ),
+_values   ( rhs._values ),
+_present  ( rhs._present ),
+_allAttrs ( 0L ),
+_allAttrsValid( false ),
 _style    ( rhs._style ),
 _geoInterp( rhs._geoInterp ),
 _srs      ( rhs._srs.get() )
@@ -175,6 +219,11 @@ _srs      ( rhs._srs.get() )
     dirty();
 }
 
+Feature::~Feature()
+{
+    delete _allAttrs;
+}
+
 FeatureID
 Feature::getFID() const 
 {
@@ -203,10 +252,151 @@ Feature::dirty()
     //_cachedBoundingPolytopeValid = false;
 }
 
+namespace
+{
+    // resolves expression variable names to attribute layout columns.
+    template<typename VARS>
+    std::vector<int> resolveColumns( const VARS& vars, const AttributeLayout* layout )
+    {
+        std::vector<int> columns( vars.size() );
+        for( unsigned i=0; i<vars.size(); ++i )
+            columns[i] = layout->indexOf( toLower(vars[i].first) );
+        return columns;
+    }
+
+    // guards building the getAttrs() tables. Striped by feature address so
+    // a feature doesn't have to carry a mutex of its own.
+    const unsigned   NUM_ALL_ATTRS_MUTEXES = 16;
+    Threading::Mutex s_allAttrsMutexes[NUM_ALL_ATTRS_MUTEXES];
+
+    inline Threading::Mutex& allAttrsMutex( const Feature* feature )
+    {
+        return s_allAttrsMutexes[ (((size_t)feature) >> 4) % NUM_ALL_ATTRS_MUTEXES ];
+    }
+}
+
+const AttributeTable&
+Feature::getAttrs() const
+{
+    if ( !_layout.valid() )
+        return _attrs;
+
+    // build the full table once; the columns stay in place for the fast paths.
+    // the table object is kept once created, so references handed out
+    // earlier stay valid when it is rebuilt.
+    Threading::ScopedMutexLock lock( allAttrsMutex(this) );
+    if ( !_allAttrs )
+        _allAttrs = new AttributeTable();
+
+    if ( !_allAttrsValid )
+    {
+        *_allAttrs = _attrs;
+        for( unsigned i=0; i<_values.size(); ++i )
+        {
+            if ( _present[i] )
+                (*_allAttrs)[_layout->getName(i)] = _values[i];
+        }
+        _allAttrsValid = true;
+    }
+    return *_allAttrs;
+}
+
+void
+Feature::setAttributeLayout( const AttributeLayout* layout )
+{
+    _layout = layout;
+    _values.clear();
+    _present.clear();
+    if ( layout )
+    {
+        _values.resize( layout->size() );
+        _present.resize( layout->size(), 0 );
+    }
+    _allAttrsValid = false;
+}
+
+AttributeValue&
+Feature::getOrCreate( const std::string& name )
+{
+    _allAttrsValid = false;
+    if ( _layout.valid() )
+    {
+        int column = _layout->indexOf( name );
+        if ( column >= 0 )
+            return getOrCreateColumn( column );
+    }
+    return _attrs[name];
+}
+
+AttributeValue&
+Feature::getOrCreateColumn( unsigned column )
+{
+    _allAttrsValid = false;
+    _present[column] = 1;
+    return _values[column];
+}
+
+const AttributeValue*
+Feature::find( const std::string& lowerName ) const
+{
+    if ( _layout.valid() )
+    {
+        int column = _layout->indexOf( lowerName );
+        if ( column >= 0 )
+            return _present[column] ? &_values[column] : 0L;
+    }
+    AttributeTable::const_iterator i = _attrs.find( lowerName );
+    return i != _attrs.end() ? &i->second : 0L;
+}
+
+void
+Feature::setColumn( unsigned column, const std::string& value )
+{
+    AttributeValue& a = getOrCreateColumn( column );
+    a.first = ATTRTYPE_STRING;
+    a.second.stringValue = value;
+    a.second.set = true;
+}
+
+void
+Feature::setColumn( unsigned column, double value )
+{
+    AttributeValue& a = getOrCreateColumn( column );
+    a.first = ATTRTYPE_DOUBLE;
+    a.second.doubleValue = value;
+    a.second.set = true;
+}
+
+void
+Feature::setColumn( unsigned column, int value )
+{
+    AttributeValue& a = getOrCreateColumn( column );
+    a.first = ATTRTYPE_INT;
+    a.second.intValue = value;
+    a.second.set = true;
+}
+
+void
+Feature::setColumn( unsigned column, bool value )
+{
+    AttributeValue& a = getOrCreateColumn( column );
+    a.first = ATTRTYPE_BOOL;
+    a.second.boolValue = value;
+    a.second.set = true;
+}
+
+void
+Feature::setColumnNull( unsigned column, AttributeType type )
+{
+    AttributeValue& a = getOrCreateColumn( column );
+    a.first = type;
+    a.second.set = false;
+}
+
 void
 Feature::set( const std::string& name, const std::string& value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = getOrCreate(name);
     a.first = ATTRTYPE_STRING;
     a.second.stringValue = value;
     a.second.set = true;
@@ -215,7 +405,7 @@ Feature::set( const std::string& name, const std::string& value )
 void
 Feature::set( const std::string& name, double value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = getOrCreate(name);
     a.first = ATTRTYPE_DOUBLE;
     a.second.doubleValue = value;
     a.second.set = true;
@@ -224,7 +414,7 @@ Feature::set( const std::string& name, double value )
 void
 Feature::set( const std::string& name, int value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = getOrCreate(name);
     a.first = ATTRTYPE_INT;
     a.second.intValue = value;
     a.second.set = true;
@@ -233,7 +423,7 @@ Feature::set( const std::string& name, int value )
 void
 Feature::set( const std::string& name, bool value )
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = getOrCreate(name);
     a.first = ATTRTYPE_BOOL;
     a.second.boolValue = value;
     a.second.set = true;
@@ -242,14 +432,14 @@ Feature::set( const std::string& name, bool value )
 void
 Feature::setNull( const std::string& name)
 {
-    AttributeValue& a = _attrs[name];    
+    AttributeValue& a = getOrCreate(name);
     a.second.set = false;
 }
 
 void
 Feature::setNull( const std::string& name, AttributeType type)
 {
-    AttributeValue& a = _attrs[name];
+    AttributeValue& a = getOrCreate(name);
     a.first = type;    
     a.second.set = false;
 }
@@ -260,55 +450,80 @@ Feature::setNull( const std::string& name, AttributeType type)
 bool
 Feature::hasAttr( const std::string& name ) const
 {
-    return _attrs.find(toLower(name)) != _attrs.end();
+    return find(toLower(name)) != 0L;
 }
 
 std::string
 Feature::getString( const std::string& name ) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getString() : EMPTY_STRING;
+    const AttributeValue* a = find(toLower(name));
+    return a ? a->getString() : EMPTY_STRING;
 }
 
 double
 Feature::getDouble( const std::string& name, double defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getDouble(defaultValue) : defaultValue;
+    const AttributeValue* a = find(toLower(name));
+    return a ? a->getDouble(defaultValue) : defaultValue;
 }
 
 int
 Feature::getInt( const std::string& name, int defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getInt(defaultValue) : defaultValue;
+    const AttributeValue* a = find(toLower(name));
+    return a ? a->getInt(defaultValue) : defaultValue;
 }
 
 bool
 Feature::getBool( const std::string& name, bool defaultValue ) const 
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.getBool(defaultValue) : defaultValue;
+    const AttributeValue* a = find(toLower(name));
+    return a ? a->getBool(defaultValue) : defaultValue;
 }
 
 bool
 Feature::isSet( const std::string& name) const
 {
-    AttributeTable::const_iterator i = _attrs.find(toLower(name));
-    return i != _attrs.end()? i->second.second.set : false;
+    const AttributeValue* a = find(toLower(name));
+    return a ? a->second.set : false;
 }
 
 double
 Feature::eval( NumericExpression& expr, FilterContext const* context ) const
 {
     const NumericExpression::Variables& vars = expr.variables();
-    for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
+
+    // with a layout, variable names resolve to columns once per layout.
+    const std::vector<int>* columns = 0L;
+    if ( _layout.valid() )
     {
+        if ( !expr.isBoundTo(_layout.get()) )
+            expr.bind( _layout.get(), resolveColumns(vars, _layout.get()) );
+        columns = &expr.getBinding();
+    }
+
+    for( unsigned v = 0; v < vars.size(); ++v )
+    {
+      const NumericExpression::Variable& var = vars[v];
       double val = 0.0;
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+
+      const AttributeValue* attr = 0L;
+      int column = columns ? (*columns)[v] : -1;
+      if ( column >= 0 )
+      {
+        if ( _present[column] )
+          attr = &_values[column];
+      }
+      else
+      {
+        AttributeTable::const_iterator ai = _attrs.find(toLower(var.first));
+        if (ai != _attrs.end())
+          attr = &ai->second;
+      }
+
+      if (attr)
       {
-        val = ai->second.getDouble(0.0);
+        val = attr->getDouble(0.0);
       }
       else if (context)
       {
@@ -316,7 +531,7 @@ Feature::eval( NumericExpression& expr, FilterContext const* context ) const
         ScriptEngine* engine = context->getSession()->getScriptEngine();
         if (engine)
         {
-          ScriptResult result = engine->run(i->first, this, context);
+          ScriptResult result = engine->run(var.first, this, context);
           if (result.success())
             val = result.asDouble();
           else
@@ -324,7 +539,7 @@ Feature::eval( NumericExpression& expr, FilterContext const* context ) const
         }
       }
 
-      expr.set( *i, val); //osgEarth::as<double>(getAttr(i->first),0.0) );
+      expr.set( var, val); //osgEarth::as<double>(getAttr(i->first),0.0) );
     }
 
     return expr.eval();
@@ -334,13 +549,48 @@ const std::string&
 Feature::eval( StringExpression& expr, FilterContext const* context ) const
 {
     const StringExpression::Variables& vars = expr.variables();
-    for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
+
+    // with a layout, variable names resolve to columns once per layout.
+    const std::vector<int>* columns = 0L;
+    if ( _layout.valid() )
     {
-      std::string val = "";
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
-      if (ai != _attrs.end())
+        if ( !expr.isBoundTo(_layout.get()) )
+            expr.bind( _layout.get(), resolveColumns(vars, _layout.get()) );
+        columns = &expr.getBinding();
+    }
+
+    for( unsigned v = 0; v < vars.size(); ++v )
+    {
+      const StringExpression::Variable& var = vars[v];
+
+      const AttributeValue* attr = 0L;
+      int column = columns ? (*columns)[v] : -1;
+      if ( column >= 0 )
+      {
+        if ( _present[column] )
+          attr = &_values[column];
+      }
+      else
+      {
+        AttributeTable::const_iterator ai = _attrs.find(toLower(var.first));
+        if (ai != _attrs.end())
+          attr = &ai->second;
+      }
+
+      if (attr)
       {
-        val = ai->second.getString();
+        // string attributes go in without a temporary copy.
+        if ( attr->first == ATTRTYPE_STRING )
+        {
+          if ( !attr->second.stringValue.empty() )
+            expr.set( var, attr->second.stringValue );
+        }
+        else
+        {
+          std::string val = attr->getString();
+          if ( !val.empty() )
+            expr.set( var, val );
+        }
       }
       else if (context)
       {
@@ -348,16 +598,17 @@ Feature::eval( StringExpression& expr, FilterContext const* context ) const
         ScriptEngine* engine = context->getSession()->getScriptEngine();
         if (engine)
         {
-          ScriptResult result = engine->run(i->first, this, context);
+          ScriptResult result = engine->run(var.first, this, context);
           if (result.success())
-            val = result.asString();
+          {
+            std::string val = result.asString();
+            if (!val.empty())
+              expr.set( var, val );
+          }
           else
               OE_WARN << LC << "Script error:" << result.message() << std::endl;
         }
       }
-
-      if (!val.empty())
-        expr.set( *i, val );
     }
 
     return expr.eval();
@@ -447,100 +698,16 @@ Feature::getWorldBoundingPolytope(const SpatialReference* srs,
 std::string
 Feature::getGeoJSON()
 {
-    std::string geometry = GeometryUtils::geometryToGeoJSON( getGeometry() );
-
-    Json::Value root(Json::objectValue);
-    root["type"] = "Feature";
-    root["id"] = (unsigned int)getFID(); //TODO:  Update JSON to use unsigned longs
-    
-    Json::Reader reader;
-    Json::Value geometryValue( Json::objectValue );
-    if ( reader.parse( geometry, geometryValue ) )
-    {
-        root["geometry"] = geometryValue;
-    }
-
-    //Write out all the properties         
-    Json::Value props(Json::objectValue);    
-    if (getAttrs().size() > 0)
-    {
-
-        for (AttributeTable::const_iterator itr = getAttrs().begin(); itr != getAttrs().end(); ++itr)
-        {
-            if (itr->second.first == ATTRTYPE_INT)
-            {
-                if (itr->second.second.set)
-                {
-                    props[itr->first] = itr->second.getInt();
-                }
-                else
-                {
-                    props[itr->first] = Json::nullValue;
-                }
-            }
-            else if (itr->second.first == ATTRTYPE_DOUBLE)
-            {
-                if (itr->second.second.set)
-                {
-                    props[itr->first] = itr->second.getDouble();
-                }
-                else
-                {
-                    props[itr->first] = Json::nullValue;
-                }
-            }
-            else if (itr->second.first == ATTRTYPE_BOOL)
-            {
-                if (itr->second.second.set)
-                {
-                    props[itr->first] = itr->second.getBool();
-                }
-                else
-                {
-                    props[itr->first] = Json::nullValue;
-                }
-            }
-            else
-            {
-                if (itr->second.second.set)
-                {
-                    props[itr->first] = itr->second.getString();
-                }
-                else
-                {
-                    props[itr->first] = Json::nullValue;
-                }
-            }            
-        }
-    } 
-
-    root["properties"] = props;
-    return Json::FastWriter().write( root );
-    //return Json::StyledWriter().write( root );
+    std::stringstream buf;
+    GeoJSONWriter::writeFeature( buf, this );
+    return buf.str();
 }
 
 std::string Feature::featuresToGeoJSON( FeatureList& features)
 {
     std::stringstream buf;
-
-    buf << "{\"type\": \"FeatureCollection\", \"features\": [";
-
-    FeatureList::iterator last = features.end();
-    last--;
-
-    for (FeatureList::iterator i = features.begin(); i != features.end(); i++)
-    {
-        buf << i->get()->getGeoJSON();
-        if (i != last)
-        {
-            buf << ",";
-        }
-    }
-
-    buf << "]}";
-
+    GeoJSONWriter::writeFeatureCollection( buf, features );
     return buf.str();
-
 }
 
 void Feature::transform( const SpatialReference* srs )
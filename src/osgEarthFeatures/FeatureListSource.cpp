@@ -39,6 +39,36 @@ FeatureListSource::createFeatureCursor( const Symbology::Query& query )
     //Create a copy of all of the features before returning the cursor.
     //The processing filters in osgEarth can modify the features as they are operating and we don't want our original data destroyed.
     FeatureList cursorFeatures;
+
+    // With a bounds query, copy only the features whose bounds intersect it.
+    if ( query.bounds().isSet() )
+    {
+        Threading::ScopedMutexLock lock( _indexMutex );
+
+        if ( !_index.valid() || outOfSyncWith(_indexRevision) || _indexedFeatures.size() != _features.size() )
+        {
+            _index = new FeatureSpatialIndex();
+            _indexedFeatures.assign( _features.begin(), _features.end() );
+            for( unsigned i = 0; i < _indexedFeatures.size(); ++i )
+            {
+                Feature* feature = _indexedFeatures[i].get();
+                if ( feature && feature->getGeometry() )
+                    _index->add( i, feature->getGeometry()->getBounds() );
+            }
+            _index->build();
+            sync( _indexRevision );
+        }
+
+        std::vector<FeatureID> hits;
+        _index->query( query.bounds().get(), hits );
+        for( std::vector<FeatureID>::const_iterator i = hits.begin(); i != hits.end(); ++i )
+        {
+            Feature* feature = new osgEarth::Features::Feature(*_indexedFeatures[*i].get(), osg::CopyOp::DEEP_COPY_ALL);
+            cursorFeatures.push_back( feature );
+        }
+        return new FeatureListCursor( cursorFeatures );
+    }
+
     for (FeatureList::iterator itr = _features.begin(); itr != _features.end(); ++itr)
     {
         Feature* feature = new osgEarth::Features::Feature(*(itr->get()), osg::CopyOp::DEEP_COPY_ALL);        
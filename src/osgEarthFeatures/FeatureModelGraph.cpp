@@ -49,6 +49,15 @@ using namespace osgEarth::Symbology;
 #define OE_TEST OE_NULL
 //#define OE_TEST OE_NOTICE
 
+namespace
+{
+    // Upper limit on the threads used to compile one tile's style bins.
+    const unsigned STYLE_COMPILE_MAX_THREADS = 4;
+
+    // Number of resolved styles to keep, keyed by style string.
+    const unsigned STYLE_CACHE_SIZE = 256;
+}
+
 //---------------------------------------------------------------------------
 
 // pseudo-loader for paging in feature tiles for a FeatureModelGraph.
@@ -215,7 +224,8 @@ _overlayInstalled  ( 0L ),
 _overlayPlaceholder( 0L ),
 _clampable         ( 0L ),
 _drapeable         ( 0L ),
-_overlayChange     ( OVERLAY_NO_CHANGE )
+_overlayChange     ( OVERLAY_NO_CHANGE ),
+_styleCache        ( true, STYLE_CACHE_SIZE )
 {
     _uid = osgEarthFeatureModelPseudoLoader::registerGraph( this );
 
@@ -223,6 +233,11 @@ _overlayChange     ( OVERLAY_NO_CHANGE )
     // scene graph by the pager.
     _postMergeOperations = new RefNodeOperationVector();
 
+    // compiles the style bins of a tile in parallel.
+    _compileService = new TaskService(
+        "FeatureModelGraph style compiler",
+        (int)osg::minimum( (unsigned)OpenThreads::GetNumberOfProcessors(), STYLE_COMPILE_MAX_THREADS ) );
+
     // install the stylesheet in the session if it doesn't already have one.
     if ( !session->styles() )
         session->setStyles( _options.styles().get() );
@@ -941,11 +956,35 @@ FeatureModelGraph::buildStyleGroups(const StyleSelector* selector,
 }
 
 
+/**
+ * Compiles one style bin into a style group; run by the style compiler
+ * service. The working set belongs to this bin alone, and the filter
+ * context is copied before use.
+ */
+struct FeatureModelGraph::CompileStyleBin
+{
+    CompileStyleBin() : _fmg(0L), _workingSet(0L), _context(0L), _hasFeatures(false) { }
+
+    void execute()
+    {
+        _styleGroup  = _fmg->compileStyleGroup( _style, *_workingSet, *_context );
+        _hasFeatures = _workingSet->size() > 0;
+    }
+
+    FeatureModelGraph*       _fmg;
+    Style                    _style;
+    FeatureList*             _workingSet;
+    const FilterContext*     _context;
+    osg::ref_ptr<osg::Group> _styleGroup;
+    bool                     _hasFeatures;
+};
+
+
 /**
  * Querys the feature source;
  * Visits each feature and uses the Style Expression to resolve its style class;
  * Sorts the features into bins based on style class;
- * Compiles each bin into a separate style group;
+ * Compiles each bin into a separate style group, in parallel when there are several;
  * Adds the resulting style groups to the provided parent.
  */
 void
@@ -982,36 +1021,89 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
         }
     }
 
-    // next create a style group per bin.
+    if ( styleBins.size() == 0 )
+        return;
+
+    // a single bin compiles in place; there's nothing to run in parallel.
+    if ( styleBins.size() == 1 )
+    {
+        std::map<std::string,FeatureList>::iterator i = styleBins.begin();
+        Style combinedStyle;
+        resolveStyle( i->first, combinedStyle );
+
+        osg::Group* styleGroup = createStyleGroup(combinedStyle, i->second, context);
+        if ( styleGroup )
+            parent->addChild( styleGroup );
+        return;
+    }
+
+    // otherwise compile each bin on its own pass, in parallel.
+    Threading::MultiEvent semaphore( (int)styleBins.size() );
+    std::vector< osg::ref_ptr< ParallelTask<CompileStyleBin> > > tasks;
+    tasks.reserve( styleBins.size() );
+
     for( std::map<std::string,FeatureList>::iterator i = styleBins.begin(); i != styleBins.end(); ++i )
     {
-        const std::string& styleString = i->first;
-        FeatureList&       workingSet  = i->second;
+        ParallelTask<CompileStyleBin>* task = new ParallelTask<CompileStyleBin>( &semaphore );
+        task->_fmg        = this;
+        task->_workingSet = &i->second;
+        task->_context    = &context;
+        resolveStyle( i->first, task->_style );
+        tasks.push_back( task );
+        _compileService->add( task );
+    }
 
-        // resolve the style:
-        Style combinedStyle;
+    semaphore.wait();
 
-        // if the style string begins with an open bracket, it's an inline style definition.
-        if ( styleString.length() > 0 && styleString.at(0) == '{' )
-        {
-            Config conf( "style", styleString );
-            conf.set( "type", "text/css" );
-            combinedStyle = Style(conf);
-        }
+    // merge the results in bin order, so the graph doesn't depend on which
+    // task finished first.
+    for( unsigned i = 0; i < tasks.size(); ++i )
+    {
+        CompileStyleBin* bin = tasks[i].get();
+        if ( bin->_hasFeatures )
+            checkForGlobalAltitudeStyles( bin->_style );
+        if ( bin->_styleGroup.valid() )
+            parent->addChild( bin->_styleGroup.get() );
+    }
+}
 
-        // otherwise, look up the style in the stylesheet:
-        else
-        {
-            const Style* selectedStyle = _session->styles()->getStyle(styleString);
-            if ( selectedStyle )
-                combinedStyle = *selectedStyle;
-        }
 
-        // create the node and add it.
-        osg::Group* styleGroup = createStyleGroup(combinedStyle, workingSet, context);
-        if ( styleGroup )
-            parent->addChild( styleGroup );
+/**
+ * Resolves a style string to a Style: an inline CSS definition if the
+ * string begins with an open bracket, otherwise the name of a style in
+ * the stylesheet. Results are cached across tiles so each string is
+ * parsed or looked up once.
+ */
+void
+FeatureModelGraph::resolveStyle(const std::string& styleString,
+                                Style&             out_style)
+{
+    LRUCache<std::string, Style>::Record rec;
+    if ( _styleCache.get(styleString, rec) )
+    {
+        out_style = rec.value();
+        return;
+    }
+
+    out_style = Style();
+
+    // if the style string begins with an open bracket, it's an inline style definition.
+    if ( styleString.length() > 0 && styleString.at(0) == '{' )
+    {
+        Config conf( "style", styleString );
+        conf.set( "type", "text/css" );
+        out_style = Style(conf);
     }
+
+    // otherwise, look up the style in the stylesheet:
+    else
+    {
+        const Style* selectedStyle = _session->styles()->getStyle(styleString);
+        if ( selectedStyle )
+            out_style = *selectedStyle;
+    }
+
+    _styleCache.insert( styleString, out_style );
 }
 
 
@@ -1019,6 +1111,26 @@ osg::Group*
 FeatureModelGraph::createStyleGroup(const Style&         style, 
                                     FeatureList&         workingSet, 
                                     const FilterContext& contextPrototype)
+{
+    osg::Group* styleGroup = compileStyleGroup( style, workingSet, contextPrototype );
+
+    // Check the style and see if we need to active GPU clamping. GPU clamping
+    // is currently all-or-nothing for a single FMG.
+    if ( workingSet.size() > 0 )
+        checkForGlobalAltitudeStyles( style );
+
+    return styleGroup;
+}
+
+
+/**
+ * Crops a working set and compiles it into a style group. Touches no
+ * graph state, so separate working sets may compile concurrently.
+ */
+osg::Group*
+FeatureModelGraph::compileStyleGroup(const Style&         style, 
+                                     FeatureList&         workingSet, 
+                                     const FilterContext& contextPrototype)
 {
     osg::Group* styleGroup = 0L;
 
@@ -1057,10 +1169,6 @@ FeatureModelGraph::createStyleGroup(const Style&         style,
             if ( node.valid() )
                 styleGroup->addChild( node.get() );
         }
-
-        // Check the style and see if we need to active GPU clamping. GPU clamping
-        // is currently all-or-nothing for a single FMG.
-        checkForGlobalAltitudeStyles( style );
     }
 
     return styleGroup;
@@ -1247,6 +1355,9 @@ FeatureModelGraph::redraw()
     // clear it out
     removeChildren( 0, getNumChildren() );
 
+    // the stylesheet may have changed.
+    _styleCache.clear();
+
     // zero out any decorators
     _clampable          = 0L;
     _drapeable          = 0L;
@@ -0,0 +1,352 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/FeatureSpatialIndex>
+#include <osgEarthFeatures/FeatureSource>
+#include <osgEarth/Notify>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+#define LC "[FeatureSpatialIndex] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+namespace
+{
+    // children per node.
+    const unsigned NODE_SIZE = 16;
+
+    // resolution of the Hilbert curve along each axis.
+    const unsigned HILBERT_SIZE = 1 << 16;
+
+    const char     FILE_MAGIC[8] = { 'O','E','F','I','D','X','0','1' };
+    const unsigned BYTE_ORDER    = 0x01020304;
+
+    // distance along a Hilbert curve filling an HILBERT_SIZE^2 grid.
+    unsigned long long hilbert( unsigned x, unsigned y )
+    {
+        unsigned long long d = 0;
+        for( unsigned s = HILBERT_SIZE/2; s > 0; s /= 2 )
+        {
+            unsigned rx = (x & s) > 0 ? 1 : 0;
+            unsigned ry = (y & s) > 0 ? 1 : 0;
+            d += (unsigned long long)s * (unsigned long long)s * ((3 * rx) ^ ry);
+            if ( ry == 0 )
+            {
+                if ( rx == 1 )
+                {
+                    x = HILBERT_SIZE-1 - x;
+                    y = HILBERT_SIZE-1 - y;
+                }
+                std::swap( x, y );
+            }
+        }
+        return d;
+    }
+
+    unsigned toGrid( double v, double vmin, double vmax )
+    {
+        if ( vmax <= vmin )
+            return 0;
+        double t = (v - vmin) / (vmax - vmin);
+        return (unsigned)osg::clampBetween( t * (double)(HILBERT_SIZE-1), 0.0, (double)(HILBERT_SIZE-1) );
+    }
+
+    struct SortByHilbert
+    {
+        SortByHilbert( const std::vector<unsigned long long>& values ) : _values(values) { }
+        bool operator()( unsigned lhs, unsigned rhs ) const { return _values[lhs] < _values[rhs]; }
+        const std::vector<unsigned long long>& _values;
+    };
+}
+
+//------------------------------------------------------------------------
+
+FeatureSpatialIndex::FeatureSpatialIndex() :
+_numItems( 0 ),
+_built   ( false )
+{
+    //nop
+}
+
+FeatureSpatialIndex*
+FeatureSpatialIndex::create( FeatureSource* source )
+{
+    if ( !source )
+        return 0L;
+
+    osg::ref_ptr<FeatureSpatialIndex> index = new FeatureSpatialIndex();
+
+    osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor( Symbology::Query() );
+    if ( cursor.valid() )
+    {
+        while( cursor->hasMore() )
+        {
+            Feature* f = cursor->nextFeature();
+            if ( f && f->getGeometry() )
+                index->add( f->getFID(), f->getGeometry()->getBounds() );
+        }
+    }
+
+    index->build();
+    return index.release();
+}
+
+void
+FeatureSpatialIndex::add( FeatureID fid, const Bounds& bounds )
+{
+    if ( _built || !bounds.isValid() )
+        return;
+
+    Box box;
+    box.xmin = bounds.xMin();
+    box.ymin = bounds.yMin();
+    box.xmax = bounds.xMax();
+    box.ymax = bounds.yMax();
+
+    _boxes.push_back( box );
+    _ids.push_back( fid );
+    _bounds.expandBy( bounds );
+}
+
+void
+FeatureSpatialIndex::build()
+{
+    if ( _built )
+        return;
+
+    _numItems = _ids.size();
+
+    // sort the entries along a Hilbert curve through their centers, so that
+    // entries close on the map land in the same nodes.
+    if ( _numItems > NODE_SIZE )
+    {
+        std::vector<unsigned long long> values( _numItems );
+        std::vector<unsigned>           order( _numItems );
+        for( unsigned i = 0; i < _numItems; ++i )
+        {
+            const Box& b = _boxes[i];
+            values[i] = hilbert(
+                toGrid( 0.5*(b.xmin+b.xmax), _bounds.xMin(), _bounds.xMax() ),
+                toGrid( 0.5*(b.ymin+b.ymax), _bounds.yMin(), _bounds.yMax() ) );
+            order[i] = i;
+        }
+
+        std::sort( order.begin(), order.end(), SortByHilbert(values) );
+
+        std::vector<Box>       boxes( _numItems );
+        std::vector<FeatureID> ids  ( _numItems );
+        for( unsigned i = 0; i < _numItems; ++i )
+        {
+            boxes[i] = _boxes[order[i]];
+            ids[i]   = _ids[order[i]];
+        }
+        _boxes.swap( boxes );
+        _ids.swap( ids );
+    }
+
+    pack();
+}
+
+void
+FeatureSpatialIndex::pack()
+{
+    // leaves are sorted; build each level above them from runs of NODE_SIZE
+    // boxes in the level below, until one node (the root) remains.
+    _boxes.resize( _numItems );
+    _levelStarts.clear();
+    _levelStarts.push_back( 0 );
+
+    unsigned start = 0;
+    unsigned count = _numItems;
+    while( count > 1 )
+    {
+        unsigned end = start + count;
+        for( unsigned first = start; first < end; first += NODE_SIZE )
+        {
+            unsigned last = osg::minimum( first + NODE_SIZE, end );
+            Box node = _boxes[first];
+            for( unsigned i = first+1; i < last; ++i )
+            {
+                const Box& b = _boxes[i];
+                node.xmin = osg::minimum( node.xmin, b.xmin );
+                node.ymin = osg::minimum( node.ymin, b.ymin );
+                node.xmax = osg::maximum( node.xmax, b.xmax );
+                node.ymax = osg::maximum( node.ymax, b.ymax );
+            }
+            _boxes.push_back( node );
+        }
+
+        start = end;
+        count = _boxes.size() - start;
+        _levelStarts.push_back( start );
+    }
+
+    _built = true;
+}
+
+void
+FeatureSpatialIndex::query( const Bounds& bounds, std::vector<FeatureID>& output ) const
+{
+    if ( !_built || _numItems == 0 || !bounds.isValid() )
+        return;
+
+    const double xmin = bounds.xMin(), ymin = bounds.yMin();
+    const double xmax = bounds.xMax(), ymax = bounds.yMax();
+
+    // depth-first walk from the root: (node index, level) pairs.
+    std::vector< std::pair<unsigned, unsigned> > stack;
+    unsigned top = _levelStarts.size()-1;
+    stack.push_back( std::make_pair((unsigned)_boxes.size()-1, top) );
+
+    while( !stack.empty() )
+    {
+        unsigned node  = stack.back().first;
+        unsigned level = stack.back().second;
+        stack.pop_back();
+
+        const Box& b = _boxes[node];
+        if ( b.xmax < xmin || b.xmin > xmax || b.ymax < ymin || b.ymin > ymax )
+            continue;
+
+        if ( level == 0 )
+        {
+            output.push_back( _ids[node] );
+        }
+        else
+        {
+            unsigned first = _levelStarts[level-1] + (node - _levelStarts[level]) * NODE_SIZE;
+            unsigned last  = osg::minimum( first + NODE_SIZE, _levelStarts[level] );
+
+            // push in reverse so children pop in Hilbert order.
+            for( unsigned i = last; i > first; --i )
+                stack.push_back( std::make_pair(i-1, level-1) );
+        }
+    }
+}
+
+bool
+FeatureSpatialIndex::write( const std::string& path ) const
+{
+    if ( !_built )
+        return false;
+
+    std::string dir = osgDB::getFilePath( path );
+    if ( !dir.empty() && !osgDB::fileExists(dir) && !osgDB::makeDirectory(dir) )
+        return false;
+
+    // write to a temporary file and rename it, so a reader never sees a partial index.
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out( temp.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+        if ( !out.is_open() )
+            return false;
+
+        unsigned sigLen = _signature.size();
+
+        out.write( FILE_MAGIC, sizeof(FILE_MAGIC) );
+        out.write( (const char*)&BYTE_ORDER, sizeof(BYTE_ORDER) );
+        out.write( (const char*)&sigLen,     sizeof(sigLen) );
+        out.write( _signature.data(),        sigLen );
+        out.write( (const char*)&_numItems,  sizeof(_numItems) );
+
+        for( unsigned i = 0; i < _numItems; ++i )
+        {
+            unsigned long long id = (unsigned long long)_ids[i];
+            out.write( (const char*)&id,        sizeof(id) );
+            out.write( (const char*)&_boxes[i], sizeof(Box) );
+        }
+
+        if ( out.fail() )
+        {
+            out.close();
+            ::remove( temp.c_str() );
+            return false;
+        }
+    }
+
+    ::remove( path.c_str() );
+    if ( ::rename( temp.c_str(), path.c_str() ) != 0 )
+    {
+        ::remove( temp.c_str() );
+        return false;
+    }
+
+    OE_INFO << LC << "Wrote " << _numItems << " entries to " << path << std::endl;
+    return true;
+}
+
+FeatureSpatialIndex*
+FeatureSpatialIndex::read( const std::string& path )
+{
+    std::ifstream in( path.c_str(), std::ios::in | std::ios::binary );
+    if ( !in.is_open() )
+        return 0L;
+
+    char     magic[8];
+    unsigned byteOrder = 0, sigLen = 0, numItems = 0;
+
+    in.read( magic, sizeof(magic) );
+    in.read( (char*)&byteOrder, sizeof(byteOrder) );
+    if ( in.fail() || ::memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0 || byteOrder != BYTE_ORDER )
+    {
+        OE_WARN << LC << "Ignoring index file with a bad header: " << path << std::endl;
+        return 0L;
+    }
+
+    osg::ref_ptr<FeatureSpatialIndex> index = new FeatureSpatialIndex();
+
+    in.read( (char*)&sigLen, sizeof(sigLen) );
+    if ( in.fail() || sigLen > 4096 )
+        return 0L;
+    index->_signature.resize( sigLen );
+    if ( sigLen > 0 )
+        in.read( &index->_signature[0], sigLen );
+
+    in.read( (char*)&numItems, sizeof(numItems) );
+    if ( in.fail() )
+        return 0L;
+
+    index->_ids.resize( numItems );
+    index->_boxes.resize( numItems );
+    for( unsigned i = 0; i < numItems; ++i )
+    {
+        unsigned long long id;
+        Box& b = index->_boxes[i];
+        in.read( (char*)&id, sizeof(id) );
+        in.read( (char*)&b,  sizeof(Box) );
+        if ( in.fail() )
+        {
+            OE_WARN << LC << "Ignoring truncated index file: " << path << std::endl;
+            return 0L;
+        }
+        index->_ids[i] = (FeatureID)id;
+        index->_bounds.expandBy( b.xmin, b.ymin );
+        index->_bounds.expandBy( b.xmax, b.ymax );
+    }
+
+    // entries were saved in Hilbert order, so only the upper levels need rebuilding.
+    index->_numItems = numItems;
+    index->pack();
+    return index.release();
+}
@@ -0,0 +1,1102 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2008-2012 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#include <osgEarthFeatures/GeoJSON>
+#include <osgEarth/StringUtils>
+#include <osg/Math>
+#include <ostream>
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+
+#define LC "[GeoJSON] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    void writeString( std::ostream& out, const std::string& s )
+    {
+        static const char* hex = "0123456789abcdef";
+
+        out << '"';
+        for( std::string::const_iterator i = s.begin(); i != s.end(); ++i )
+        {
+            unsigned char c = (unsigned char)*i;
+            switch( c )
+            {
+            case '"':  out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n";  break;
+            case '\r': out << "\\r";  break;
+            case '\t': out << "\\t";  break;
+            case '\b': out << "\\b";  break;
+            case '\f': out << "\\f";  break;
+            default:
+                if ( c < 0x20 )
+                    out << "\\u00" << hex[c >> 4] << hex[c & 0xF];
+                else
+                    out << (char)c;
+            }
+        }
+        out << '"';
+    }
+
+    // Geometry carries no dimension flag, so treat it as 3D if any point has a z.
+    bool hasZ( const Geometry* geom )
+    {
+        ConstGeometryIterator i( geom );
+        while( i.hasMore() )
+        {
+            const Geometry* part = i.next();
+            for( Geometry::const_iterator p = part->begin(); p != part->end(); ++p )
+            {
+                if ( p->z() != 0.0 )
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    inline void writePosition( std::ostream& out, const osg::Vec3d& p, bool withZ )
+    {
+        out << '[' << p.x() << ',' << p.y();
+        if ( withZ ) out << ',' << p.z();
+        out << ']';
+    }
+
+    // writes the points of a part. Rings repeat their first point at the end.
+    void writePositions( std::ostream& out, const Geometry* geom, bool closeRing, bool withZ )
+    {
+        out << '[';
+        for( unsigned i=0; i<geom->size(); ++i )
+        {
+            if ( i > 0 ) out << ',';
+            writePosition( out, (*geom)[i], withZ );
+        }
+        if ( closeRing && geom->size() > 1 && geom->front() != geom->back() )
+        {
+            out << ',';
+            writePosition( out, geom->front(), withZ );
+        }
+        out << ']';
+    }
+
+    // writes the boundary ring and any holes of a ring or polygon.
+    void writeRings( std::ostream& out, const Geometry* geom, bool withZ )
+    {
+        out << '[';
+        writePositions( out, geom, true, withZ );
+
+        const Polygon* poly = dynamic_cast<const Polygon*>( geom );
+        if ( poly )
+        {
+            for( RingCollection::const_iterator h = poly->getHoles().begin(); h != poly->getHoles().end(); ++h )
+            {
+                out << ',';
+                writePositions( out, h->get(), true, withZ );
+            }
+        }
+        out << ']';
+    }
+
+    // 1=points, 2=lines, 3=polygons, 0=anything else
+    int kindOf( const Geometry* geom )
+    {
+        switch( geom->getType() )
+        {
+        case Geometry::TYPE_POINTSET:   return 1;
+        case Geometry::TYPE_LINESTRING: return 2;
+        case Geometry::TYPE_RING:
+        case Geometry::TYPE_POLYGON:    return 3;
+        default:                        return 0;
+        }
+    }
+
+    void writeGeometryObject( std::ostream& out, const Geometry* geom )
+    {
+        if ( !geom )
+        {
+            out << "null";
+            return;
+        }
+
+        bool withZ = hasZ( geom );
+
+        switch( geom->getType() )
+        {
+        case Geometry::TYPE_POINTSET:
+            if ( geom->size() == 1 )
+            {
+                out << "{\"type\":\"Point\",\"coordinates\":";
+                writePosition( out, geom->front(), withZ );
+            }
+            else
+            {
+                out << "{\"type\":\"MultiPoint\",\"coordinates\":";
+                writePositions( out, geom, false, withZ );
+            }
+            out << '}';
+            break;
+
+        case Geometry::TYPE_LINESTRING:
+            out << "{\"type\":\"LineString\",\"coordinates\":";
+            writePositions( out, geom, false, withZ );
+            out << '}';
+            break;
+
+        case Geometry::TYPE_RING:
+        case Geometry::TYPE_POLYGON:
+            out << "{\"type\":\"Polygon\",\"coordinates\":";
+            writeRings( out, geom, withZ );
+            out << '}';
+            break;
+
+        case Geometry::TYPE_MULTI:
+            {
+                const GeometryCollection& parts = static_cast<const MultiGeometry*>(geom)->getComponents();
+
+                // parts all of one simple kind map onto a Multi* type.
+                int kind = parts.size() > 0 ? kindOf( parts.front().get() ) : 0;
+                for( GeometryCollection::const_iterator i = parts.begin(); i != parts.end() && kind != 0; ++i )
+                {
+                    if ( kindOf(i->get()) != kind )
+                        kind = 0;
+                }
+
+                if ( kind == 1 )
+                {
+                    out << "{\"type\":\"MultiPoint\",\"coordinates\":[";
+                    bool first = true;
+                    for( GeometryCollection::const_iterator i = parts.begin(); i != parts.end(); ++i )
+                    {
+                        for( unsigned p=0; p<(*i)->size(); ++p )
+                        {
+                            if ( !first ) out << ',';
+                            writePosition( out, (**i)[p], withZ );
+                            first = false;
+                        }
+                    }
+                    out << "]}";
+                }
+                else if ( kind == 2 || kind == 3 )
+                {
+                    out << (kind == 2 ? "{\"type\":\"MultiLineString\",\"coordinates\":[" : "{\"type\":\"MultiPolygon\",\"coordinates\":[");
+                    for( GeometryCollection::const_iterator i = parts.begin(); i != parts.end(); ++i )
+                    {
+                        if ( i != parts.begin() ) out << ',';
+                        if ( kind == 2 )
+                            writePositions( out, i->get(), false, withZ );
+                        else
+                            writeRings( out, i->get(), withZ );
+                    }
+                    out << "]}";
+                }
+                else
+                {
+                    out << "{\"type\":\"GeometryCollection\",\"geometries\":[";
+                    for( GeometryCollection::const_iterator i = parts.begin(); i != parts.end(); ++i )
+                    {
+                        if ( i != parts.begin() ) out << ',';
+                        writeGeometryObject( out, i->get() );
+                    }
+                    out << "]}";
+                }
+            }
+            break;
+
+        default:
+            out << "null";
+        }
+    }
+
+    void writeFeatureObject( std::ostream& out, const Feature* feature )
+    {
+        out << "{\"type\":\"Feature\",\"id\":" << feature->getFID() << ",\"geometry\":";
+        writeGeometryObject( out, feature->getGeometry() );
+        out << ",\"properties\":{";
+
+        const AttributeTable& attrs = feature->getAttrs();
+        for( AttributeTable::const_iterator i = attrs.begin(); i != attrs.end(); ++i )
+        {
+            if ( i != attrs.begin() ) out << ',';
+            writeString( out, i->first );
+            out << ':';
+
+            const AttributeValue& value = i->second;
+            if ( !value.second.set )
+            {
+                out << "null";
+            }
+            else if ( value.first == ATTRTYPE_INT )
+            {
+                out << value.second.intValue;
+            }
+            else if ( value.first == ATTRTYPE_DOUBLE )
+            {
+                // JSON has no NaN or infinity.
+                double d = value.second.doubleValue;
+                if ( osg::isNaN(d) || d - d != 0.0 )
+                    out << "null";
+                else
+                    out << d;
+            }
+            else if ( value.first == ATTRTYPE_BOOL )
+            {
+                out << (value.second.boolValue ? "true" : "false");
+            }
+            else
+            {
+                writeString( out, value.getString() );
+            }
+        }
+        out << "}}";
+    }
+
+    inline bool parseHex4( const char* p, const char* end, unsigned& out )
+    {
+        if ( end - p < 4 )
+            return false;
+        out = 0;
+        for( int i=0; i<4; ++i )
+        {
+            char c = p[i];
+            out <<= 4;
+            if      ( c >= '0' && c <= '9' ) out |= (unsigned)(c - '0');
+            else if ( c >= 'a' && c <= 'f' ) out |= (unsigned)(c - 'a' + 10);
+            else if ( c >= 'A' && c <= 'F' ) out |= (unsigned)(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    void appendUTF8( std::string& out, unsigned cp )
+    {
+        if ( cp < 0x80 ) {
+            out += (char)cp;
+        }
+        else if ( cp < 0x800 ) {
+            out += (char)(0xC0 | (cp >> 6));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+        else if ( cp < 0x10000 ) {
+            out += (char)(0xE0 | (cp >> 12));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+        else {
+            out += (char)(0xF0 | (cp >> 18));
+            out += (char)(0x80 | ((cp >> 12) & 0x3F));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+}
+
+//------------------------------------------------------------------------
+
+void
+GeoJSONWriter::writeGeometry( std::ostream& out, const Geometry* geometry )
+{
+    std::streamsize precision = out.precision( 15 );
+    writeGeometryObject( out, geometry );
+    out.precision( precision );
+}
+
+void
+GeoJSONWriter::writeFeature( std::ostream& out, const Feature* feature )
+{
+    std::streamsize precision = out.precision( 15 );
+    writeFeatureObject( out, feature );
+    out.precision( precision );
+}
+
+void
+GeoJSONWriter::writeFeatureCollection( std::ostream& out, const FeatureList& features )
+{
+    std::streamsize precision = out.precision( 15 );
+
+    out << "{\"type\":\"FeatureCollection\",\"features\":[";
+    for( FeatureList::const_iterator i = features.begin(); i != features.end(); ++i )
+    {
+        if ( i != features.begin() ) out << ',';
+        writeFeatureObject( out, i->get() );
+    }
+    out << "]}";
+
+    out.precision( precision );
+}
+
+//------------------------------------------------------------------------
+
+GeoJSONReader::GeoJSONReader( const std::string& buffer, const SpatialReference* srs ) :
+_begin  ( buffer.c_str() ),
+_end    ( buffer.c_str() + buffer.size() ),
+_p      ( buffer.c_str() ),
+_state  ( STATE_START ),
+_nextFID( 0 ),
+_srs    ( srs )
+{
+    //nop
+}
+
+bool
+GeoJSONReader::read( const std::string& buffer, const SpatialReference* srs, FeatureList& out_features )
+{
+    GeoJSONReader reader( buffer, srs );
+
+    osg::ref_ptr<Feature> feature;
+    while( reader.next(feature) )
+    {
+        if ( feature.valid() )
+            out_features.push_back( feature.get() );
+    }
+
+    if ( reader.hasError() )
+    {
+        OE_WARN << LC << reader.getError() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool
+GeoJSONReader::next( osg::ref_ptr<Feature>& out_feature )
+{
+    out_feature = 0L;
+
+    if ( _state == STATE_START )
+    {
+        // find out what the top-level object is.
+        skipWS();
+        const char* top = _p;
+        if ( !expect('{') )
+            return false;
+
+        std::string key, type;
+        if ( !peek('}') )
+        {
+            for(;;)
+            {
+                if ( !parseString(key) || !expect(':') )
+                    return false;
+
+                if ( key == "features" )
+                {
+                    if ( !expect('[') )
+                        return false;
+                    _state = STATE_COLLECTION;
+                    break;
+                }
+                else if ( key == "type" )
+                {
+                    if ( !parseString(type) )
+                        return false;
+
+                    if ( type != "FeatureCollection" )
+                    {
+                        // a lone Feature or geometry.
+                        _p     = top;
+                        _state = STATE_DONE;
+
+                        if ( type == "Feature" )
+                            return parseFeature( out_feature );
+
+                        osg::ref_ptr<Geometry> geom;
+                        if ( !parseGeometry(geom) )
+                            return false;
+                        out_feature = new Feature( geom.get(), _srs.get(), Style(), _nextFID++ );
+                        return true;
+                    }
+                }
+                else if ( !skipValue() )
+                {
+                    return false;
+                }
+
+                if ( !peek(',') )
+                    break;
+                ++_p;
+            }
+        }
+
+        if ( _state != STATE_COLLECTION || peek(']') )
+        {
+            _state = STATE_DONE;
+            return false;
+        }
+
+        return parseFeature( out_feature );
+    }
+
+    else if ( _state == STATE_COLLECTION )
+    {
+        if ( peek(',') )
+        {
+            ++_p;
+            return parseFeature( out_feature );
+        }
+
+        _state = STATE_DONE;
+        if ( !peek(']') )
+            return fail( "expected ',' or ']' in the features array" );
+    }
+
+    return false;
+}
+
+bool
+GeoJSONReader::fail( const std::string& msg )
+{
+    if ( _error.empty() )
+        _error = Stringify() << msg << " (offset " << (unsigned)(_p - _begin) << ")";
+    _state = STATE_DONE;
+    return false;
+}
+
+void
+GeoJSONReader::skipWS()
+{
+    while( _p < _end && (*_p == ' ' || *_p == '\n' || *_p == '\r' || *_p == '\t') )
+        ++_p;
+}
+
+bool
+GeoJSONReader::expect( char c )
+{
+    skipWS();
+    if ( _p < _end && *_p == c )
+    {
+        ++_p;
+        return true;
+    }
+    return fail( Stringify() << "expected '" << c << "'" );
+}
+
+bool
+GeoJSONReader::peek( char c )
+{
+    skipWS();
+    return _p < _end && *_p == c;
+}
+
+bool
+GeoJSONReader::parseString( std::string& out )
+{
+    skipWS();
+    if ( _p >= _end || *_p != '"' )
+        return fail( "expected a string" );
+    ++_p;
+
+    out.clear();
+    const char* run = _p;
+    while( _p < _end )
+    {
+        char c = *_p;
+        if ( c == '"' )
+        {
+            out.append( run, _p );
+            ++_p;
+            return true;
+        }
+        else if ( c == '\\' )
+        {
+            out.append( run, _p );
+            if ( ++_p >= _end )
+                break;
+
+            switch( *_p )
+            {
+            case '"':  out += '"';  break;
+            case '\\': out += '\\'; break;
+            case '/':  out += '/';  break;
+            case 'b':  out += '\b'; break;
+            case 'f':  out += '\f'; break;
+            case 'n':  out += '\n'; break;
+            case 'r':  out += '\r'; break;
+            case 't':  out += '\t'; break;
+            case 'u':
+                {
+                    unsigned cp;
+                    if ( !parseHex4(_p+1, _end, cp) )
+                        return fail( "bad \\u escape" );
+                    _p += 4;
+
+                    // combine a UTF-16 surrogate pair:
+                    unsigned lo;
+                    if ( cp >= 0xD800 && cp <= 0xDBFF && _end - _p > 6 && _p[1] == '\\' && _p[2] == 'u' &&
+                         parseHex4(_p+3, _end, lo) && lo >= 0xDC00 && lo <= 0xDFFF )
+                    {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        _p += 6;
+                    }
+                    appendUTF8( out, cp );
+                }
+                break;
+            default:
+                return fail( "bad escape in string" );
+            }
+
+            ++_p;
+            run = _p;
+        }
+        else
+        {
+            ++_p;
+        }
+    }
+    return fail( "unterminated string" );
+}
+
+bool
+GeoJSONReader::parseNumber( double& out_value, bool& out_isInt )
+{
+    skipWS();
+    const char* start = _p;
+    out_isInt = true;
+
+    if ( _p < _end && (*_p == '-' || *_p == '+') )
+        ++_p;
+
+    while( _p < _end )
+    {
+        char c = *_p;
+        if ( c >= '0' && c <= '9' )
+            ++_p;
+        else if ( c == '.' || c == 'e' || c == 'E' || c == '-' || c == '+' )
+            out_isInt = false, ++_p;
+        else
+            break;
+    }
+
+    // copy out the token; the buffer isn't guaranteed to stop after it.
+    unsigned len = (unsigned)(_p - start);
+    char buf[64];
+    if ( len == 0 || len >= sizeof(buf) )
+        return fail( "expected a number" );
+    ::memcpy( buf, start, len );
+    buf[len] = 0;
+
+    out_value = osg::asciiToDouble( buf );
+    if ( out_isInt && (out_value < (double)INT_MIN || out_value > (double)INT_MAX) )
+        out_isInt = false;
+
+    return true;
+}
+
+bool
+GeoJSONReader::parseLiteral( const char* word )
+{
+    skipWS();
+    unsigned len = ::strlen( word );
+    if ( (unsigned)(_end - _p) >= len && ::strncmp(_p, word, len) == 0 )
+    {
+        _p += len;
+        return true;
+    }
+    return fail( Stringify() << "expected '" << word << "'" );
+}
+
+bool
+GeoJSONReader::skipValue()
+{
+    skipWS();
+    if ( _p >= _end )
+        return fail( "unexpected end of input" );
+
+    char c = *_p;
+    if ( c == '"' )
+    {
+        // scan to the closing quote without decoding.
+        for( ++_p; _p < _end; ++_p )
+        {
+            if ( *_p == '\\' )
+                ++_p;
+            else if ( *_p == '"' )
+            {
+                ++_p;
+                return true;
+            }
+        }
+        return fail( "unterminated string" );
+    }
+    else if ( c == '{' || c == '[' )
+    {
+        char close = c == '{' ? '}' : ']';
+        ++_p;
+        if ( peek(close) )
+        {
+            ++_p;
+            return true;
+        }
+        for(;;)
+        {
+            if ( c == '{' )
+            {
+                if ( !skipValue() || !expect(':') )
+                    return false;
+            }
+            if ( !skipValue() )
+                return false;
+            if ( !peek(',') )
+                break;
+            ++_p;
+        }
+        return expect( close );
+    }
+    else if ( c == 't' )
+    {
+        return parseLiteral( "true" );
+    }
+    else if ( c == 'f' )
+    {
+        return parseLiteral( "false" );
+    }
+    else if ( c == 'n' )
+    {
+        return parseLiteral( "null" );
+    }
+    else
+    {
+        double value;
+        bool   isInt;
+        return parseNumber( value, isInt );
+    }
+}
+
+bool
+GeoJSONReader::parseFeature( osg::ref_ptr<Feature>& out )
+{
+    if ( !expect('{') )
+        return false;
+
+    FeatureID              fid      = _nextFID;
+    osg::ref_ptr<Geometry> geom;
+    const char*            propsPos = 0L;
+    std::string            key;
+
+    if ( !peek('}') )
+    {
+        for(;;)
+        {
+            if ( !parseString(key) || !expect(':') )
+                return false;
+
+            if ( key == "geometry" )
+            {
+                if ( peek('n') ) {
+                    if ( !parseLiteral("null") ) return false;
+                }
+                else if ( !parseGeometry(geom) ) {
+                    return false;
+                }
+            }
+            else if ( key == "properties" )
+            {
+                // the Feature needs its ID before it can take attributes, and
+                // the ID may come later; so come back for these.
+                skipWS();
+                propsPos = _p;
+                if ( !skipValue() )
+                    return false;
+            }
+            else if ( key == "id" )
+            {
+                if ( peek('"') )
+                {
+                    std::string value;
+                    if ( !parseString(value) )
+                        return false;
+                    fid = as<long>( value, (long)fid );
+                }
+                else if ( peek('n') )
+                {
+                    if ( !parseLiteral("null") )
+                        return false;
+                }
+                else
+                {
+                    double value;
+                    bool   isInt;
+                    if ( !parseNumber(value, isInt) )
+                        return false;
+                    fid = (FeatureID)value;
+                }
+            }
+            else if ( !skipValue() )
+            {
+                return false;
+            }
+
+            if ( !peek(',') )
+                break;
+            ++_p;
+        }
+    }
+
+    if ( !expect('}') )
+        return false;
+
+    ++_nextFID;
+    out = new Feature( geom.get(), _srs.get(), Style(), fid );
+
+    if ( propsPos && *propsPos == '{' )
+    {
+        const char* endPos = _p;
+        _p = propsPos;
+        if ( !parseProperties(out.get()) )
+            return false;
+        _p = endPos;
+    }
+
+    return true;
+}
+
+bool
+GeoJSONReader::parseProperties( Feature* feature )
+{
+    if ( !expect('{') )
+        return false;
+
+    if ( peek('}') )
+    {
+        ++_p;
+        return true;
+    }
+
+    std::string key, value;
+    for(;;)
+    {
+        if ( !parseString(key) || !expect(':') )
+            return false;
+
+        // attribute names are lower case, as with the OGR readers.
+        for( std::string::iterator i = key.begin(); i != key.end(); ++i )
+            *i = ::tolower( *i );
+
+        skipWS();
+        char c = _p < _end ? *_p : 0;
+
+        if ( c == '"' )
+        {
+            if ( !parseString(value) )
+                return false;
+            feature->set( key, value );
+        }
+        else if ( c == 't' || c == 'f' )
+        {
+            if ( !parseLiteral(c == 't' ? "true" : "false") )
+                return false;
+            feature->set( key, c == 't' );
+        }
+        else if ( c == 'n' )
+        {
+            if ( !parseLiteral("null") )
+                return false;
+            feature->setNull( key );
+        }
+        else if ( c == '{' || c == '[' )
+        {
+            // nested values are kept as their JSON text.
+            const char* start = _p;
+            if ( !skipValue() )
+                return false;
+            feature->set( key, std::string(start, _p) );
+        }
+        else
+        {
+            double number;
+            bool   isInt;
+            if ( !parseNumber(number, isInt) )
+                return false;
+            if ( isInt )
+                feature->set( key, (int)number );
+            else
+                feature->set( key, number );
+        }
+
+        if ( !peek(',') )
+            break;
+        ++_p;
+    }
+
+    return expect('}');
+}
+
+bool
+GeoJSONReader::parseGeometry( osg::ref_ptr<Geometry>& out )
+{
+    if ( !expect('{') )
+        return false;
+
+    std::string type, key;
+    const char* coordsPos = 0L;
+    const char* partsPos  = 0L;
+
+    if ( !peek('}') )
+    {
+        for(;;)
+        {
+            if ( !parseString(key) || !expect(':') )
+                return false;
+
+            if ( key == "type" )
+            {
+                if ( !parseString(type) )
+                    return false;
+            }
+            else if ( key == "coordinates" && !type.empty() )
+            {
+                if ( !parseGeometryCoords(type, out) )
+                    return false;
+            }
+            else if ( key == "coordinates" || key == "geometries" )
+            {
+                // type not known yet (or a collection); come back for these.
+                skipWS();
+                (key == "coordinates" ? coordsPos : partsPos) = _p;
+                if ( !skipValue() )
+                    return false;
+            }
+            else if ( !skipValue() )
+            {
+                return false;
+            }
+
+            if ( !peek(',') )
+                break;
+            ++_p;
+        }
+    }
+
+    if ( !expect('}') )
+        return false;
+
+    const char* endPos = _p;
+
+    if ( coordsPos && !out.valid() )
+    {
+        _p = coordsPos;
+        if ( !parseGeometryCoords(type, out) )
+            return false;
+    }
+
+    else if ( partsPos && type == "GeometryCollection" )
+    {
+        _p = partsPos;
+        MultiGeometry* multi = new MultiGeometry();
+        out = multi;
+
+        if ( !expect('[') )
+            return false;
+        if ( !peek(']') )
+        {
+            for(;;)
+            {
+                osg::ref_ptr<Geometry> part;
+                if ( !parseGeometry(part) )
+                    return false;
+                if ( part.valid() )
+                    multi->getComponents().push_back( part.get() );
+                if ( !peek(',') )
+                    break;
+                ++_p;
+            }
+        }
+        if ( !expect(']') )
+            return false;
+    }
+
+    _p = endPos;
+    return true;
+}
+
+bool
+GeoJSONReader::parseGeometryCoords( const std::string& type, osg::ref_ptr<Geometry>& out )
+{
+    if ( type == "Point" )
+    {
+        osg::Vec3d p;
+        if ( !parsePosition(p) )
+            return false;
+        out = new PointSet();
+        out->push_back( p );
+        return true;
+    }
+    else if ( type == "MultiPoint" )
+    {
+        out = new PointSet();
+        return parsePositions( out.get() );
+    }
+    else if ( type == "LineString" )
+    {
+        out = new LineString();
+        return parsePositions( out.get() );
+    }
+    else if ( type == "Polygon" )
+    {
+        return parsePolygon( out );
+    }
+    else if ( type == "MultiLineString" || type == "MultiPolygon" )
+    {
+        MultiGeometry* multi = new MultiGeometry();
+        out = multi;
+        return parseParts( type == "MultiPolygon" ? "Polygon" : "LineString", multi );
+    }
+    else
+    {
+        OE_DEBUG << LC << "Unsupported geometry type \"" << type << "\"" << std::endl;
+        return skipValue();
+    }
+}
+
+bool
+GeoJSONReader::parsePosition( osg::Vec3d& out )
+{
+    if ( !expect('[') )
+        return false;
+
+    out.set( 0.0, 0.0, 0.0 );
+    if ( peek(']') )
+    {
+        ++_p;
+        return true;
+    }
+
+    double value;
+    bool   isInt;
+    for( unsigned i=0; ; ++i )
+    {
+        if ( !parseNumber(value, isInt) )
+            return false;
+        if ( i < 3 )
+            out[i] = value;
+        if ( !peek(',') )
+            break;
+        ++_p;
+    }
+
+    return expect(']');
+}
+
+bool
+GeoJSONReader::parsePositions( Geometry* target )
+{
+    if ( !expect('[') )
+        return false;
+
+    if ( peek(']') )
+    {
+        ++_p;
+        return true;
+    }
+
+    osg::Vec3d p;
+    for(;;)
+    {
+        if ( !parsePosition(p) )
+            return false;
+        if ( target->size() == 0 || p != target->back() ) // remove dupes
+            target->push_back( p );
+        if ( !peek(',') )
+            break;
+        ++_p;
+    }
+
+    return expect(']');
+}
+
+bool
+GeoJSONReader::parsePolygon( osg::ref_ptr<Geometry>& out )
+{
+    if ( !expect('[') )
+        return false;
+
+    Polygon* poly = new Polygon();
+    out = poly;
+
+    if ( peek(']') )
+    {
+        ++_p;
+        return true;
+    }
+
+    for( unsigned i=0; ; ++i )
+    {
+        if ( i == 0 )
+        {
+            if ( !parsePositions(poly) )
+                return false;
+            poly->rewind( Ring::ORIENTATION_CCW );
+        }
+        else
+        {
+            Ring* hole = new Ring();
+            poly->getHoles().push_back( hole );
+            if ( !parsePositions(hole) )
+                return false;
+            hole->rewind( Ring::ORIENTATION_CW );
+        }
+
+        if ( !peek(',') )
+            break;
+        ++_p;
+    }
+
+    return expect(']');
+}
+
+bool
+GeoJSONReader::parseParts( const std::string& partType, MultiGeometry* multi )
+{
+    if ( !expect('[') )
+        return false;
+
+    if ( peek(']') )
+    {
+        ++_p;
+        return true;
+    }
+
+    for(;;)
+    {
+        osg::ref_ptr<Geometry> part;
+        if ( partType == "Polygon" )
+        {
+            if ( !parsePolygon(part) )
+                return false;
+        }
+        else
+        {
+            part = new LineString();
+            if ( !parsePositions(part.get()) )
+                return false;
+        }
+        multi->getComponents().push_back( part.get() );
+
+        if ( !peek(',') )
+            break;
+        ++_p;
+    }
+
+    return expect(']');
+}
@@ -19,6 +19,8 @@
 
 #include <osgEarthFeatures/GeometryUtils>
 #include <osgEarthFeatures/OgrUtils>
+#include <osgEarthFeatures/GeoJSON>
+#include <sstream>
 
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
@@ -44,20 +46,12 @@ osgEarth::Features::GeometryUtils::geometryToWKT( Geometry* geometry )
 std::string 
 osgEarth::Features::GeometryUtils::geometryToGeoJSON( Geometry* geometry )
 {
-    OGRGeometryH g = OgrUtils::createOgrGeometry( geometry );
-    std::string result;
-    if (g)
-    {
-        char* buf;   
-        buf = OGR_G_ExportToJson( g );
-        if (buf)
-        {
-            result = std::string(buf);
-            OGRFree( buf );
-        }
-        OGR_G_DestroyGeometry( g );
-    }
-    return result;
+    if ( !geometry )
+        return "";
+
+    std::stringstream buf;
+    GeoJSONWriter::writeGeometry( buf, geometry );
+    return buf.str();
 }
 
 std::string 
@@ -261,7 +261,7 @@ OGRGeometryH
 }
 
 Feature*
-    OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs )
+    OgrUtils::createFeature( OGRFeatureH handle, const SpatialReference* srs, const AttributeLayout* layout )
 {
     long fid = OGR_F_GetFID( handle );
 
@@ -277,6 +277,38 @@ Feature*
     Feature* feature = new Feature( geom, srs, Style(), fid );
 
     int numAttrs = OGR_F_GetFieldCount(handle); 
+
+    // fast path: the layout matches the OGR fields one-to-one, so there
+    // are no names to build or look up.
+    if ( layout && (int)layout->size() == numAttrs )
+    {
+        feature->setAttributeLayout( layout );
+
+        for (int i = 0; i < numAttrs; ++i)
+        {
+            OGRFieldDefnH field_handle_ref = OGR_F_GetFieldDefnRef( handle, i );
+            OGRFieldType  field_type       = OGR_Fld_GetType( field_handle_ref );
+            bool          isSet            = OGR_F_IsFieldSet( handle, i ) != 0;
+
+            switch( field_type )
+            {
+            case OFTInteger:
+                if ( isSet ) feature->setColumn( i, (int)OGR_F_GetFieldAsInteger(handle, i) );
+                else         feature->setColumnNull( i, ATTRTYPE_INT );
+                break;
+            case OFTReal:
+                if ( isSet ) feature->setColumn( i, (double)OGR_F_GetFieldAsDouble(handle, i) );
+                else         feature->setColumnNull( i, ATTRTYPE_DOUBLE );
+                break;
+            default:
+                if ( isSet ) feature->setColumn( i, std::string(OGR_F_GetFieldAsString(handle, i)) );
+                else         feature->setColumnNull( i, ATTRTYPE_STRING );
+            }
+        }
+
+        return feature;
+    }
+
     for (int i = 0; i < numAttrs; ++i) 
     { 
         OGRFieldDefnH field_handle_ref = OGR_F_GetFieldDefnRef( handle, i ); 
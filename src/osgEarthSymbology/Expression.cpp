@@ -38,7 +38,10 @@ _src  ( rhs._src ),
 _rpn  ( rhs._rpn ),
 _vars ( rhs._vars ),
 _value( rhs._value ),
-_dirty( rhs._dirty )
+_dirty( rhs._dirty ),
+_stack( rhs._stack ),
+_bindingLayout( rhs._bindingLayout.get() ),
+_binding( rhs._binding )
 {
     //nop
 }
@@ -78,6 +81,8 @@ NumericExpression::init()
 {
     _vars.clear();
     _rpn.clear();
+    _binding.clear();
+    _bindingLayout = 0L;
 
     StringTokenizer variablesTokenizer( "", "" );
     variablesTokenizer.addDelims( "[]", true );
@@ -243,6 +248,17 @@ NumericExpression::init()
         _rpn.push_back( s.top() );
         s.pop();
     }
+
+    // size the evaluation stack once, so eval() never allocates.
+    unsigned depth = 0, maxDepth = 1;
+    for( unsigned i=0; i<_rpn.size(); ++i )
+    {
+        if ( _rpn[i].first == OPERAND || _rpn[i].first == VARIABLE )
+            maxDepth = std::max( maxDepth, ++depth );
+        else if ( depth >= 2 )
+            --depth;
+    }
+    _stack.resize( maxDepth );
 }
 
 void 
@@ -261,82 +277,37 @@ NumericExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stack<double> s;
+        double*  s  = _stack.size() > 0 ? const_cast<double*>(&_stack[0]) : 0L;
+        unsigned sp = 0;
 
         for( unsigned i=0; i<_rpn.size(); ++i )
         {
             const Atom& a = _rpn[i];
 
-            if ( a.first == ADD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 + op2 );
-                }
-            }
-            else if ( a.first == SUB )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 - op2 );
-                }
-            }
-            else if ( a.first == MULT )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 * op2 );
-                }
-            }
-            else if ( a.first == DIV )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 / op2 );
-                }
-            }
-            else if ( a.first == MOD )
+            if ( a.first == OPERAND || a.first == VARIABLE )
             {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( fmod(op1, op2) );
-                }
+                s[sp++] = a.second;
             }
-            else if ( a.first == MIN )
+            else if ( sp >= 2 )
             {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( std::min(op1, op2) );
-                }
-            }
-            else if ( a.first == MAX )
-            {
-                if ( s.size() >= 2 )
+                double op2 = s[--sp];
+                double& op1 = s[sp-1];
+
+                switch( a.first )
                 {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( std::max(op1, op2) );
+                case ADD:  op1 = op1 + op2; break;
+                case SUB:  op1 = op1 - op2; break;
+                case MULT: op1 = op1 * op2; break;
+                case DIV:  op1 = op1 / op2; break;
+                case MOD:  op1 = fmod(op1, op2); break;
+                case MIN:  op1 = std::min(op1, op2); break;
+                case MAX:  op1 = std::max(op1, op2); break;
+                default:   ++sp; break; // not a binary operator; leave the stack alone
                 }
             }
-            else // OPERAND or VARIABLE
-            {
-                s.push( a.second );
-            }
         }
 
-        const_cast<NumericExpression*>(this)->_value = s.size() > 0 ? s.top() : 0.0;
+        const_cast<NumericExpression*>(this)->_value = sp > 0 ? s[sp-1] : 0.0;
         const_cast<NumericExpression*>(this)->_dirty = false;
     }
 
@@ -367,7 +338,9 @@ _vars( rhs._vars ),
 _value( rhs._value ),
 _infix( rhs._infix ),
 _dirty( rhs._dirty ),
-_uriContext( rhs._uriContext )
+_uriContext( rhs._uriContext ),
+_bindingLayout( rhs._bindingLayout.get() ),
+_binding( rhs._binding )
 {
     //nop
 }
@@ -413,6 +386,9 @@ StringExpression::getConfig() const
 void
 StringExpression::init()
 {
+    _binding.clear();
+    _bindingLayout = 0L;
+
     bool inQuotes = false;
     int inVar = 0;
     int startPos = 0;
@@ -523,11 +499,12 @@ StringExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stringstream buf;
+        // concatenate in place; _value keeps its capacity between evals.
+        std::string& value = const_cast<StringExpression*>(this)->_value;
+        value.clear();
         for( AtomVector::const_iterator i = _infix.begin(); i != _infix.end(); ++i )
-            buf << i->second;
+            value.append( i->second );
 
-        const_cast<StringExpression*>(this)->_value = buf.str();
         const_cast<StringExpression*>(this)->_dirty = false;
     }
 
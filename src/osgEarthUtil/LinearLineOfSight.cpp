@@ -160,6 +160,11 @@ void
 LinearLineOfSightNode::terrainChanged( const osgEarth::TileKey& tileKey, osg::Node* terrain )
 {
     OE_DEBUG << "LineOfSightNode::terrainChanged" << std::endl;
+
+    // the analyzer reads the map's elevation data, which paging doesn't change.
+    if ( _analyzer.valid() )
+        return;
+
     //Make a temporary group that contains both the old MapNode as well as the new incoming terrain.
     //Because this function is called from the database pager thread we need to include both b/c 
     //the new terrain isn't yet merged with the new terrain.
@@ -291,25 +296,39 @@ LinearLineOfSightNode::compute(osg::Node* node, bool backgroundThread)
 
       //Computes the LOS and redraws the scene
 
-      _start.transform(mapSRS).toWorld( _startWorld, terrain );
-      _end.transform(mapSRS).toWorld( _endWorld, terrain );
-
-
-      DPLineSegmentIntersector* lsi = new DPLineSegmentIntersector(_startWorld, _endWorld);
-      osgUtil::IntersectionVisitor iv( lsi );
-
-      node->accept( iv );
-
-      DPLineSegmentIntersector::Intersections& hits = lsi->getIntersections();
-      if ( hits.size() > 0 )
+      if ( _analyzer.valid() )
       {
-          _hasLOS = false;
-          _hitWorld = hits.begin()->getWorldIntersectPoint();
-          _hit.fromWorld( mapSRS, _hitWorld );
+          _start.transform(mapSRS).toWorld( _startWorld, _analyzer.get() );
+          _end.transform(mapSRS).toWorld( _endWorld, _analyzer.get() );
+
+          _hasLOS = _analyzer->computeLineOfSight( _start, _end, &_hit );
+          if ( !_hasLOS )
+          {
+              _hit.toWorld( _hitWorld );
+          }
       }
       else
       {
-          _hasLOS = true;
+          _start.transform(mapSRS).toWorld( _startWorld, terrain );
+          _end.transform(mapSRS).toWorld( _endWorld, terrain );
+
+
+          DPLineSegmentIntersector* lsi = new DPLineSegmentIntersector(_startWorld, _endWorld);
+          osgUtil::IntersectionVisitor iv( lsi );
+
+          node->accept( iv );
+
+          DPLineSegmentIntersector::Intersections& hits = lsi->getIntersections();
+          if ( hits.size() > 0 )
+          {
+              _hasLOS = false;
+              _hitWorld = hits.begin()->getWorldIntersectPoint();
+              _hit.fromWorld( mapSRS, _hitWorld );
+          }
+          else
+          {
+              _hasLOS = true;
+          }
       }
     }
 
@@ -463,6 +482,16 @@ LinearLineOfSightNode::setTerrainOnly( bool terrainOnly )
     }
 }
 
+void
+LinearLineOfSightNode::setTerrainAnalyzer( TerrainAnalyzer* analyzer )
+{
+    if (_analyzer.get() != analyzer)
+    {
+        _analyzer = analyzer;
+        compute(getNode());
+    }
+}
+
 osg::Node*
 LinearLineOfSightNode::getNode()
 {
@@ -251,6 +251,16 @@ void RadialLineOfSightNode::setTerrainOnly( bool terrainOnly )
     }
 }
 
+void
+RadialLineOfSightNode::setTerrainAnalyzer( TerrainAnalyzer* analyzer )
+{
+    if (_analyzer.get() != analyzer)
+    {
+        _analyzer = analyzer;
+        compute(getNode());
+    }
+}
+
 osg::Node*
 RadialLineOfSightNode::getNode()
 {
@@ -263,6 +273,11 @@ void
 RadialLineOfSightNode::terrainChanged( const osgEarth::TileKey& tileKey, osg::Node* terrain )
 {
     OE_DEBUG << "RadialLineOfSightNode::terrainChanged" << std::endl;
+
+    // the analyzer reads the map's elevation data, which paging doesn't change.
+    if ( _analyzer.valid() )
+        return;
+
     //Make a temporary group that contains both the old MapNode as well as the new incoming terrain.
     //Because this function is called from the database pager thread we need to include both b/c 
     //the new terrain isn't yet merged with the new terrain.
@@ -286,16 +301,18 @@ RadialLineOfSightNode::compute(osg::Node* node, bool backgroundThread)
 }
 
 void
-RadialLineOfSightNode::compute_line(osg::Node* node, bool backgroundThread)
-{    
-    if ( !getMapNode() )
-        return;
+RadialLineOfSightNode::computeSpokes(osg::Node* node, std::vector<osg::Vec3d>& out_ends, std::vector<bool>& out_hasLOS, std::vector<osg::Vec3d>& out_hits)
+{
+    const SpatialReference* mapSRS = getMapNode()->getMapSRS();
 
     GeoPoint centerMap;
-    _center.transform( getMapNode()->getMapSRS(), centerMap );
-    centerMap.toWorld( _centerWorld, getMapNode()->getTerrain() );
+    _center.transform( mapSRS, centerMap );
+    if ( _analyzer.valid() )
+        centerMap.toWorld( _centerWorld, _analyzer.get() );
+    else
+        centerMap.toWorld( _centerWorld, getMapNode()->getTerrain() );
 
-    bool isProjected = getMapNode()->getMapSRS()->isProjected();
+    bool isProjected = mapSRS->isProjected();
     osg::Vec3d up = isProjected ? osg::Vec3d(0,0,1) : osg::Vec3d(_centerWorld);
     up.normalize();
 
@@ -304,32 +321,44 @@ RadialLineOfSightNode::compute_line(osg::Node* node, bool backgroundThread)
 
     //Get the number of spokes
     double delta = osg::PI * 2.0 / (double)_numSpokes;
-    
-    osg::Geometry* geometry = new osg::Geometry;
-    geometry->setUseVertexBufferObjects(true);
 
-    osg::Vec3Array* verts = new osg::Vec3Array();
-    verts->reserve(_numSpokes * 5);
-    geometry->setVertexArray( verts );
+    out_ends.resize( _numSpokes );
+    out_hasLOS.assign( _numSpokes, true );
+    out_hits.assign( _numSpokes, osg::Vec3d() );
 
-    osg::Vec4Array* colors = new osg::Vec4Array();
-    colors->reserve( _numSpokes * 5 );
+    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
+    {
+        double angle = delta * (double)i;
+        osg::Quat quat(angle, up );
+        osg::Vec3d spoke = quat * (side * _radius);
+        out_ends[i] = _centerWorld + spoke;
+    }
 
-    geometry->setColorArray( colors );
-    geometry->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
+    if ( _analyzer.valid() )
+    {
+        GeoPoint start;
+        start.fromWorld( mapSRS, _centerWorld );
 
-    osg::Vec3d previousEnd;
-    osg::Vec3d firstEnd;
+        for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
+        {
+            GeoPoint end;
+            end.fromWorld( mapSRS, out_ends[i] );
+
+            double ratio;
+            if ( !_analyzer->computeLineOfSight(start, end, 0L, &ratio) )
+            {
+                out_hasLOS[i] = false;
+                out_hits[i] = _centerWorld + (out_ends[i] - _centerWorld) * ratio;
+            }
+        }
+        return;
+    }
 
     osg::ref_ptr<osgUtil::IntersectorGroup> ivGroup = new osgUtil::IntersectorGroup();
 
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
-        double angle = delta * (double)i;
-        osg::Quat quat(angle, up );
-        osg::Vec3d spoke = quat * (side * _radius);
-        osg::Vec3d end = _centerWorld + spoke;
-        osg::ref_ptr<DPLineSegmentIntersector> dplsi = new DPLineSegmentIntersector( _centerWorld, end );
+        osg::ref_ptr<DPLineSegmentIntersector> dplsi = new DPLineSegmentIntersector( _centerWorld, out_ends[i] );
         ivGroup->addIntersector( dplsi.get() );
     }
 
@@ -342,16 +371,46 @@ RadialLineOfSightNode::compute_line(osg::Node* node, bool backgroundThread)
     {
         DPLineSegmentIntersector* los = dynamic_cast<DPLineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
         DPLineSegmentIntersector::Intersections& hits = los->getIntersections();
-
-        osg::Vec3d start = los->getStart();
-        osg::Vec3d end = los->getEnd();
-
-        osg::Vec3d hit;
-        bool hasLOS = hits.empty();
-        if (!hasLOS)
+        if ( !hits.empty() )
         {
-            hit = hits.begin()->getWorldIntersectPoint();
+            out_hasLOS[i] = false;
+            out_hits[i] = hits.begin()->getWorldIntersectPoint();
         }
+    }
+}
+
+void
+RadialLineOfSightNode::compute_line(osg::Node* node, bool backgroundThread)
+{    
+    if ( !getMapNode() )
+        return;
+
+    std::vector<osg::Vec3d> ends, hits;
+    std::vector<bool>       hasLOSs;
+    computeSpokes( node, ends, hasLOSs, hits );
+    
+    osg::Geometry* geometry = new osg::Geometry;
+    geometry->setUseVertexBufferObjects(true);
+
+    osg::Vec3Array* verts = new osg::Vec3Array();
+    verts->reserve(_numSpokes * 5);
+    geometry->setVertexArray( verts );
+
+    osg::Vec4Array* colors = new osg::Vec4Array();
+    colors->reserve( _numSpokes * 5 );
+
+    geometry->setColorArray( colors );
+    geometry->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
+
+    osg::Vec3d previousEnd;
+    osg::Vec3d firstEnd;
+
+    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
+    {
+        osg::Vec3d start = _centerWorld;
+        osg::Vec3d end = ends[i];
+        osg::Vec3d hit = hits[i];
+        bool hasLOS = hasLOSs[i];
 
         if (hasLOS)
         {
@@ -440,20 +499,9 @@ RadialLineOfSightNode::compute_fill(osg::Node* node, bool backgroundThread)
     if ( !getMapNode() )
         return;
 
-    GeoPoint centerMap;
-    _center.transform( getMapNode()->getMapSRS(), centerMap );
-    centerMap.toWorld( _centerWorld, getMapNode()->getTerrain() );
-
-    bool isProjected = getMapNode()->getMapSRS()->isProjected();
-
-    osg::Vec3d up = isProjected ? osg::Vec3d(0,0,1) : osg::Vec3d(_centerWorld);
-    up.normalize();
-
-    //Get the "side" vector
-    osg::Vec3d side = isProjected ? osg::Vec3d(1,0,0) : up ^ osg::Vec3d(0,0,1);
-
-    //Get the number of spokes
-    double delta = osg::PI * 2.0 / (double)_numSpokes;
+    std::vector<osg::Vec3d> ends, hits;
+    std::vector<bool>       hasLOSs;
+    computeSpokes( node, ends, hasLOSs, hits );
     
     osg::Geometry* geometry = new osg::Geometry;
     geometry->setUseVertexBufferObjects(true);
@@ -468,42 +516,20 @@ RadialLineOfSightNode::compute_fill(osg::Node* node, bool backgroundThread)
     geometry->setColorArray( colors );
     geometry->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
 
-    osg::ref_ptr<osgUtil::IntersectorGroup> ivGroup = new osgUtil::IntersectorGroup();
-
-    for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
-    {
-        double angle = delta * (double)i;
-        osg::Quat quat(angle, up );
-        osg::Vec3d spoke = quat * (side * _radius);
-        osg::Vec3d end = _centerWorld + spoke;        
-        osg::ref_ptr<DPLineSegmentIntersector> dplsi = new DPLineSegmentIntersector( _centerWorld, end );
-        ivGroup->addIntersector( dplsi.get() );
-    }
-
-    osgUtil::IntersectionVisitor iv;
-    iv.setIntersector( ivGroup.get() );
-
-    node->accept( iv );
-
     for (unsigned int i = 0; i < (unsigned int)_numSpokes; i++)
     {
         //Get the current hit
-        DPLineSegmentIntersector* los = dynamic_cast<DPLineSegmentIntersector*>(ivGroup->getIntersectors()[i].get());
-        DPLineSegmentIntersector::Intersections& hits = los->getIntersections();
-
-        osg::Vec3d currEnd = los->getEnd();
-        bool currHasLOS = hits.empty();
-        osg::Vec3d currHit = currHasLOS ? osg::Vec3d() : hits.begin()->getWorldIntersectPoint();
+        osg::Vec3d currEnd = ends[i];
+        bool currHasLOS = hasLOSs[i];
+        osg::Vec3d currHit = hits[i];
 
         //Get the next hit
         unsigned int nextIndex = i + 1;
         if (nextIndex == _numSpokes) nextIndex = 0;
-        DPLineSegmentIntersector* losNext = static_cast<DPLineSegmentIntersector*>(ivGroup->getIntersectors()[nextIndex].get());
-        DPLineSegmentIntersector::Intersections& hitsNext = losNext->getIntersections();
 
-        osg::Vec3d nextEnd = losNext->getEnd();
-        bool nextHasLOS = hitsNext.empty();
-        osg::Vec3d nextHit = nextHasLOS ? osg::Vec3d() : hitsNext.begin()->getWorldIntersectPoint();
+        osg::Vec3d nextEnd = ends[nextIndex];
+        bool nextHasLOS = hasLOSs[nextIndex];
+        osg::Vec3d nextHit = hits[nextIndex];
         
         if (currHasLOS && nextHasLOS)
         {
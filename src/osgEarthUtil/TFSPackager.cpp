@@ -19,6 +19,9 @@
 #include <osgEarthUtil/TFSPackager>
 
 #include <osgEarth/Registry>
+#include <osgEarth/TaskService>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarthFeatures/GeoJSON>
 #include <osgDB/FileNameUtils>
 #include <osgDB/FileUtils>
 
@@ -81,14 +84,27 @@ public:
           }
       }
 
+      /** Features stored by FID, to be fetched from the source at write time */
       FeatureIDList& getFeatures()
       {
           return _features;
       }
 
+      /** Features held in memory (already reprojected and cropped) */
+      FeatureList& getFeatureList()
+      {
+          return _featureList;
+      }
+
+      unsigned int getNumFeatures() const
+      {
+          return _features.size() + _featureList.size();
+      }
+
 
 private:    
     FeatureIDList _features;
+    FeatureList _featureList;
     TileKey _key;   
     osg::ref_ptr<FeatureTile> _children[4];
     bool _isSplit;
@@ -113,7 +129,7 @@ void FeatureTile::accept(FeatureTileVisitor* v)
 class AddFeatureVisitor : public FeatureTileVisitor
 {
 public:
-    AddFeatureVisitor( Feature* feature, int maxFeatures, int firstLevel, int maxLevel, CropFilter::Method cropMethod):
+    AddFeatureVisitor( Feature* feature, int maxFeatures, int firstLevel, int maxLevel, CropFilter::Method cropMethod, bool inMemory):
       _feature( feature ),
           _maxFeatures( maxFeatures ),      
           _maxLevel( maxLevel ),
@@ -121,7 +137,9 @@ public:
           _added(false),
           _numAdded( 0 ),
           _levelAdded(-1),
-          _cropMethod( cropMethod )
+          _cropMethod( cropMethod ),
+          _inMemory( inMemory ),
+          _featureExtent( feature->getSRS(), feature->getGeometry()->getBounds() )
       {
 
       }
@@ -132,17 +150,19 @@ public:
 
           bool traverse = true;
 
-          GeoExtent featureExtent(_feature->getSRS(), _feature->getGeometry()->getBounds());
-          if (featureExtent.intersects( tile->getExtent()))
+          if (_featureExtent.intersects( tile->getExtent()))
           {
               //If the node contains the feature, and it doesn't contain the max number of features add it.  If it's already full then 
               //split it.
               if (tile->getKey().getLevelOfDetail() >= (unsigned int)_firstLevel && 
-                  (tile->getFeatures().size() < (unsigned int)_maxFeatures || tile->getKey().getLevelOfDetail() == _maxLevel || tile->getKey().getLevelOfDetail() == _levelAdded))
+                  (tile->getNumFeatures() < (unsigned int)_maxFeatures || tile->getKey().getLevelOfDetail() == _maxLevel || tile->getKey().getLevelOfDetail() == _levelAdded))
               {
                   if (_levelAdded < 0 || _levelAdded == tile->getKey().getLevelOfDetail())
                   {
-                      osg::ref_ptr< Feature > clone = new Feature( *_feature, osg::CopyOp::DEEP_COPY_ALL );
+                      //The centroid test doesn't touch the geometry, so only a real crop needs a copy.
+                      osg::ref_ptr< Feature > clone = _cropMethod == CropFilter::METHOD_CROPPING ?
+                          new Feature( *_feature, osg::CopyOp::DEEP_COPY_ALL ) :
+                          _feature.get();
                       FeatureList features;
                       features.push_back( clone );
 
@@ -154,8 +174,10 @@ public:
 
                       if (!features.empty() && clone->getGeometry() && clone->getGeometry()->isValid())
                       {
-                          //tile->getFeatures().push_back( clone );
-                          tile->getFeatures().push_back( clone->getFID() );
+                          if (_inMemory)
+                              tile->getFeatureList().push_back( clone );
+                          else
+                              tile->getFeatures().push_back( clone->getFID() );
                           _added = true;
                           _levelAdded = tile->getKey().getLevelOfDetail();
                           _numAdded++;                   
@@ -188,18 +210,37 @@ public:
       int _numAdded;
 
       CropFilter::Method _cropMethod;
-
-
+      bool _inMemory;
 
       osg::ref_ptr< Feature > _feature;
+      GeoExtent _featureExtent;
 };
 
 
 /******************************************************************************************/
-class WriteFeaturesVisitor : public FeatureTileVisitor
+class CollectTilesVisitor : public FeatureTileVisitor
+{
+public:
+    virtual void traverse( FeatureTile* tile )
+    {
+        if (tile->getNumFeatures() > 0)
+        {
+            _tiles.push_back( tile );
+        }
+        tile->traverse( this );
+    }
+
+    std::vector< osg::ref_ptr< FeatureTile > > _tiles;
+};
+
+/**
+ * Writes the features of a tile to its json file. Safe to call from
+ * multiple threads at once.
+ */
+class TileWriter : public osg::Referenced
 {
 public:
-    WriteFeaturesVisitor(FeatureSource* features, const std::string& dest, CropFilter::Method cropMethod, const SpatialReference* srs):
+    TileWriter(FeatureSource* features, const std::string& dest, CropFilter::Method cropMethod, const SpatialReference* srs):
       _dest( dest ),
           _features( features ),
           _cropMethod( cropMethod ),
@@ -208,28 +249,41 @@ public:
 
       }
 
-      virtual void traverse( FeatureTile* tile)
+      void write( FeatureTile* tile )
       {
-          if (tile->getFeatures().size() > 0)
-          {                 
+          FeatureList features;
+
+          if (!tile->getFeatureList().empty())
+          {
+              //In-memory features were reprojected and cropped when they were added.
+              features.swap( tile->getFeatureList() );
+          }
+          else
+          {
               //Actually load up the features
-              FeatureList features;
-              for (FeatureIDList::const_iterator i = tile->getFeatures().begin(); i != tile->getFeatures().end(); i++)
               {
-                  Feature* f = _features->getFeature( *i );                  
-
-                  if (f)
+                  Threading::ScopedMutexLock lock( _sourceMutex );
+                  for (FeatureIDList::const_iterator i = tile->getFeatures().begin(); i != tile->getFeatures().end(); i++)
                   {
-                      //Reproject the feature to the dest SRS if it's not already
-                      if (!f->getSRS()->isEquivalentTo( _srs ) )
+                      Feature* f = _features->getFeature( *i );                  
+
+                      if (f)
                       {
-                          f->transform( _srs );
+                          features.push_back( f );
+                      }
+                      else
+                      {
+                          OE_NOTICE << "couldn't get feature " << *i << std::endl;
                       }
-                      features.push_back( f );
                   }
-                  else
+              }
+
+              for (FeatureList::iterator i = features.begin(); i != features.end(); ++i)
+              {
+                  //Reproject the feature to the dest SRS if it's not already
+                  if (!i->get()->getSRS()->isEquivalentTo( _srs ) )
                   {
-                      OE_NOTICE << "couldn't get feature " << *i << std::endl;
+                      i->get()->transform( _srs );
                   }
               }
 
@@ -238,37 +292,60 @@ public:
               FilterContext context(0);
               context.extent() = tile->getExtent();
               cropFilter.push( features, context );
+          }
 
-              std::string contents = Feature::featuresToGeoJSON( features );
-              std::stringstream buf;
-              int x =  tile->getKey().getTileX();
-              unsigned int numRows, numCols;
-              tile->getKey().getProfile()->getNumTiles(tile->getKey().getLevelOfDetail(), numCols, numRows);
-              int y  = numRows - tile->getKey().getTileY() - 1;
+          std::stringstream buf;
+          int x =  tile->getKey().getTileX();
+          unsigned int numRows, numCols;
+          tile->getKey().getProfile()->getNumTiles(tile->getKey().getLevelOfDetail(), numCols, numRows);
+          int y  = numRows - tile->getKey().getTileY() - 1;
 
-              buf << _dest << "/" << tile->getKey().getLevelOfDetail() << "/" << x << "/" << y << ".json";
-              std::string filename = buf.str();
-              //OE_NOTICE << "Writing " << features.size() << " features to " << filename << std::endl;
+          buf << _dest << "/" << tile->getKey().getLevelOfDetail() << "/" << x << "/" << y << ".json";
+          std::string filename = buf.str();
+          //OE_NOTICE << "Writing " << features.size() << " features to " << filename << std::endl;
 
+          {
+              Threading::ScopedMutexLock lock( _dirMutex );
               if ( !osgDB::fileExists( osgDB::getFilePath(filename) ) )
                   osgDB::makeDirectoryForFile( filename );
-
-
-              std::fstream output( filename.c_str(), std::ios_base::out );
-              if ( output.is_open() )
-              {
-                  output << contents;
-                  output.flush();
-                  output.close();                
-              }            
           }
-          tile->traverse( this );        
+
+          std::fstream output( filename.c_str(), std::ios_base::out );
+          if ( output.is_open() )
+          {
+              GeoJSONWriter::writeFeatureCollection( output, features );
+              output.flush();
+              output.close();                
+          }            
       }
 
       osg::ref_ptr< FeatureSource > _features;
       std::string _dest;      
       CropFilter::Method _cropMethod;
       osg::ref_ptr< const SpatialReference > _srs;
+      Threading::Mutex _sourceMutex;
+      Threading::Mutex _dirMutex;
+};
+
+class WriteTileTask : public TaskRequest
+{
+public:
+    WriteTileTask( TileWriter* writer, FeatureTile* tile, Threading::MultiEvent* done ):
+      _writer( writer ),
+          _tile( tile ),
+          _done( done )
+      {
+      }
+
+      void operator()( ProgressCallback* progress )
+      {
+          _writer->write( _tile.get() );
+          _done->notify();
+      }
+
+      osg::ref_ptr< TileWriter > _writer;
+      osg::ref_ptr< FeatureTile > _tile;
+      Threading::MultiEvent* _done;
 };
 
 
@@ -279,7 +356,9 @@ TFSPackager::TFSPackager():
 _firstLevel( 0 ),
     _maxLevel( 10 ),
     _maxFeatures( 300 ),
-    _method( CropFilter::METHOD_CENTROID )
+    _method( CropFilter::METHOD_CENTROID ),
+    _inMemory( false ),
+    _numThreads( 1 )
 {
 }
 
@@ -326,8 +405,7 @@ void
 
         if (feature->getGeometry() && feature->getGeometry()->getBounds().valid() && feature->getGeometry()->isValid())
         {
-
-            AddFeatureVisitor v(feature.get(), _maxFeatures, _firstLevel, _maxLevel, _method);
+            AddFeatureVisitor v(feature.get(), _maxFeatures, _firstLevel, _maxLevel, _method, _inMemory);
             root->accept( &v );
             if (!v._added)
             {
@@ -352,8 +430,29 @@ void
     }   
     OE_NOTICE << "Added=" << added << " Skipped=" << skipped << " Failed=" << failed << std::endl;
 
-    WriteFeaturesVisitor write(features, destination, _method, _srs);
-    root->accept( &write );
+    CollectTilesVisitor collect;
+    root->accept( &collect );
+
+    osg::ref_ptr< TileWriter > writer = new TileWriter(features, destination, _method, _srs);
+
+    if (_numThreads > 1 && collect._tiles.size() > 1)
+    {
+        osg::ref_ptr< TaskService > service = new TaskService( "TFSPackager", _numThreads );
+        Threading::MultiEvent done( collect._tiles.size() );
+        for (unsigned int i = 0; i < collect._tiles.size(); ++i)
+        {
+            service->add( new WriteTileTask( writer.get(), collect._tiles[i].get(), &done ) );
+        }
+        done.wait();
+    }
+    else
+    {
+        for (unsigned int i = 0; i < collect._tiles.size(); ++i)
+        {
+            writer->write( collect._tiles[i].get() );
+        }
+    }
+    OE_NOTICE << "Wrote " << collect._tiles.size() << " tiles" << std::endl;
 
     //Write out the meta doc
     TFSLayer layer;
@@ -20,263 +20,916 @@
 #include <osgEarthUtil/TMS>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/ImageToHeightFieldConverter>
+#include <osgEarth/ThreadingUtils>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <osgDB/Registry>
 #include <osgDB/WriteFile>
+#include <osg/Timer>
+#include <OpenThreads/Atomic>
+#include <OpenThreads/Condition>
+#include <OpenThreads/Thread>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#ifdef OSGEARTH_HAVE_SQLITE3
+#include <sqlite3.h>
+#endif
 
 #define LC "[TMSPackager] "
 
 using namespace osgEarth::Util;
 using namespace osgEarth;
 
+//------------------------------------------------------------------------
 
-TMSPackager::TMSPackager(const Profile* outProfile, osgDB::Options* imageWriteOptions) :
-_outProfile         ( outProfile ),
-_maxLevel           ( 99 ),
-_verbose            ( false ),
-_overwrite          ( false ),
-_keepEmptyImageTiles( false ),
-_subdivideSingleColorImageTiles ( false ),
-_abortOnError       ( true ),
-_imageWriteOptions  (imageWriteOptions)
+namespace
 {
-    //nop
-}
+    /**
+     * FIFO connecting two pipeline stages. push() blocks while the queue is
+     * full, which keeps a fast producer from running ahead of its consumer;
+     * pop() blocks while it is empty, until setDone() is called.
+     */
+    template<typename T>
+    class BoundedQueue
+    {
+    public:
+        BoundedQueue( unsigned capacity ) : _capacity( capacity ), _done( false ) { }
 
+        void push( const T& item )
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            while( _queue.size() >= _capacity && !_done )
+                _notFull.wait( &_mutex );
+            _queue.push_back( item );
+            _notEmpty.signal();
+        }
 
-void
-TMSPackager::addExtent( const GeoExtent& extent )
-{
-    _extents.push_back(extent);
-}
+        /** Returns false once the queue is done and drained. */
+        bool pop( T& out )
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            while( _queue.empty() && !_done )
+                _notEmpty.wait( &_mutex );
+            if ( _queue.empty() )
+                return false;
+            out = _queue.front();
+            _queue.pop_front();
+            _notFull.signal();
+            return true;
+        }
 
+        /** Signals that nothing more will be pushed. */
+        void setDone()
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            _done = true;
+            _notEmpty.broadcast();
+            _notFull.broadcast();
+        }
 
-bool
-TMSPackager::shouldPackageKey( const TileKey& key ) const
-{
-    // if there are no extent filters, or we're at a sufficiently low level, 
-    // always package the key.
-    if ( _extents.size() == 0 || key.getLevelOfDetail() <= 1 )
-        return true;
+    private:
+        std::deque<T>          _queue;
+        unsigned               _capacity;
+        bool                   _done;
+        Threading::Mutex       _mutex;
+        OpenThreads::Condition _notFull;
+        OpenThreads::Condition _notEmpty;
+    };
 
-    // check for intersection with one of the filter extents.
-    for( std::vector<GeoExtent>::const_iterator i = _extents.begin(); i != _extents.end(); ++i )
+
+    /** Destination for encoded tiles. */
+    class TileSink : public osg::Referenced
     {
-        if ( i->intersects( key.getExtent() ) )
-            return true;
-    }
+    public:
+        /** Whether the tile is already stored. Called from the fetch threads. */
+        virtual bool exists( const TileKey& key ) =0;
 
-    return false;
-}
+        /** Stores a tile. Called from the writer thread only. */
+        virtual bool write( const TileKey& key, const std::string& data ) =0;
 
+        /** Flushes everything written. Called from the writer thread when it's done. */
+        virtual bool flush() { return true; }
 
-TMSPackager::Result
-TMSPackager::packageImageTile(ImageLayer*          layer,
-                              const TileKey&       key,
-                              const std::string&   rootDir,
-                              const std::string&   extension,
-                              unsigned&            out_maxLevel )
-{
-    unsigned minLevel = layer->getImageLayerOptions().minLevel().isSet() ?
-        *layer->getImageLayerOptions().minLevel() : 0;
-    
+    protected:
+        // TMS numbers rows from the bottom.
+        static unsigned flipY( const TileKey& key )
+        {
+            unsigned w, h;
+            key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
+            return h - key.getTileY() - 1;
+        }
+    };
 
-    if ( shouldPackageKey(key) && key.getLevelOfDetail() >= minLevel )
+
+    /** Writes tiles as files in a TMS folder tree. */
+    class TMSFolderSink : public TileSink
     {
-        unsigned w, h;
-        key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
+    public:
+        TMSFolderSink( const std::string& rootDir, const std::string& extension )
+            : _rootDir( rootDir ), _extension( extension ) { }
 
-        std::string path = Stringify() 
-            << rootDir 
-            << "/" << key.getLevelOfDetail() 
-            << "/" << key.getTileX() 
-            << "/" << h - key.getTileY() - 1
-            << "." << extension;
+        bool exists( const TileKey& key )
+        {
+            return osgDB::fileExists( getPath(key) );
+        }
 
-        bool isSingleColor = false;
-        bool tileOK = osgDB::fileExists(path) && !_overwrite;
-        if ( !tileOK )
+        bool write( const TileKey& key, const std::string& data )
         {
-            GeoImage image = layer->createImage( key );
-            if ( image.valid() )
+            std::string path = getPath( key );
+            osgDB::makeDirectoryForFile( path );
+            std::ofstream out( path.c_str(), std::ios::out | std::ios::binary );
+            if ( !out.is_open() )
+                return false;
+            out.write( data.c_str(), data.size() );
+            return out.good();
+        }
+
+    private:
+        std::string getPath( const TileKey& key ) const
+        {
+            return Stringify()
+                << _rootDir
+                << "/" << key.getLevelOfDetail()
+                << "/" << key.getTileX()
+                << "/" << flipY(key)
+                << "." << _extension;
+        }
+
+        std::string _rootDir;
+        std::string _extension;
+    };
+
+
+#ifdef OSGEARTH_HAVE_SQLITE3
+
+    /**
+     * Writes tiles into an MBTiles file. Inserts are grouped into large
+     * transactions, since committing each tile would sync the file every time.
+     */
+    class MBTilesSink : public TileSink
+    {
+    public:
+        enum { BATCH_SIZE = 4096 };
+
+        MBTilesSink( const std::string& filename, bool overwrite )
+            : _filename( filename ), _overwrite( overwrite ), _db( 0L ), _insert( 0L ), _inBatch( 0 ) { }
+
+        virtual ~MBTilesSink()
+        {
+            close();
+        }
+
+        bool open( std::string& out_error )
+        {
+            osgDB::makeDirectoryForFile( _filename );
+
+            if ( sqlite3_open_v2(_filename.c_str(), &_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, 0L) != SQLITE_OK )
             {
-                // Check for single color
-                if ( !_subdivideSingleColorImageTiles )
-                {
-                    isSingleColor = ImageUtils::isSingleColorImage(image.getImage());
-                    if ( _verbose )
-                    {
-                        OE_NOTICE << LC << "Not subdividing single color tile " << key.str() << std::endl;
-                    }
-                }
+                out_error = Stringify() << "Failed to open \"" << _filename << "\": " << sqlite3_errmsg(_db);
+                sqlite3_close( _db );
+                _db = 0L;
+                return false;
+            }
 
-                // check for empty:
-                if ( !_keepEmptyImageTiles && ImageUtils::isEmptyImage(image.getImage()) )
+            // this is a bulk load; a crash means packaging again anyway.
+            if (!exec("PRAGMA synchronous=OFF")                                                 ||
+                !exec("PRAGMA journal_mode=MEMORY")                                             ||
+                !exec("CREATE TABLE IF NOT EXISTS metadata (name text, value text)")            ||
+                !exec("CREATE TABLE IF NOT EXISTS tiles (zoom_level integer, tile_column integer, tile_row integer, tile_data blob)") ||
+                !exec("CREATE UNIQUE INDEX IF NOT EXISTS tile_index on tiles (zoom_level, tile_column, tile_row)") )
+            {
+                out_error = Stringify() << "Failed to create the MBTiles schema: " << sqlite3_errmsg(_db);
+                return false;
+            }
+
+            std::string sql = _overwrite ?
+                "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)" :
+                "INSERT OR IGNORE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
+
+            if ( sqlite3_prepare_v2(_db, sql.c_str(), -1, &_insert, 0L) != SQLITE_OK )
+            {
+                out_error = Stringify() << "Failed to prepare SQL: " << sql << "; " << sqlite3_errmsg(_db);
+                return false;
+            }
+
+            // remember what's already there, so the fetch threads can skip it
+            // without touching the database.
+            if ( !_overwrite )
+            {
+                sqlite3_stmt* select = 0L;
+                if ( sqlite3_prepare_v2(_db, "SELECT zoom_level, tile_column, tile_row FROM tiles", -1, &select, 0L) == SQLITE_OK )
                 {
-                    if ( _verbose )
+                    while( sqlite3_step(select) == SQLITE_ROW )
                     {
-                        OE_NOTICE << LC << "Skipping empty tile " << key.str() << std::endl;
+                        _existing.insert( pack(
+                            sqlite3_column_int(select, 0),
+                            sqlite3_column_int(select, 1),
+                            sqlite3_column_int(select, 2) ) );
                     }
+                    sqlite3_finalize( select );
                 }
-                else
-                {
-                    // convert to RGB if necessary
-                    osg::ref_ptr<osg::Image> final = image.getImage();
-                    if ( extension == "jpg" && final->getPixelFormat() != GL_RGB )
-                        final = ImageUtils::convertToRGB8( image.getImage() );
+            }
 
-                    // dump it to disk
-                    osgDB::makeDirectoryForFile( path );
-                    tileOK = osgDB::writeImageFile( *final.get(), path, _imageWriteOptions);
+            return true;
+        }
 
-                    if ( _verbose )
-                    {
-                        if ( tileOK ) {
-                            OE_NOTICE << LC << "Wrote tile " << key.str() << " (" << key.getExtent().toString() << ")" << std::endl;
-                        }
-                        else {
-                            OE_NOTICE << LC << "Error write tile " << key.str() << std::endl;
-                        }
-                    }
+        bool exists( const TileKey& key )
+        {
+            return _existing.find( pack(key.getLevelOfDetail(), key.getTileX(), flipY(key)) ) != _existing.end();
+        }
 
-                    if ( _abortOnError && !tileOK )
-                    {
-                        return Result( Stringify() << "Aborting, write failed for tile " << key.str() );
-                    }
-                }
+        bool write( const TileKey& key, const std::string& data )
+        {
+            if ( _inBatch == 0 && !exec("BEGIN TRANSACTION") )
+                return false;
+
+            sqlite3_bind_int ( _insert, 1, (int)key.getLevelOfDetail() );
+            sqlite3_bind_int ( _insert, 2, (int)key.getTileX() );
+            sqlite3_bind_int ( _insert, 3, (int)flipY(key) );
+            sqlite3_bind_blob( _insert, 4, data.c_str(), data.size(), SQLITE_STATIC );
+
+            int rc = sqlite3_step( _insert );
+            sqlite3_reset( _insert );
+
+            if ( rc != SQLITE_DONE )
+            {
+                OE_WARN << LC << "Failed to insert tile " << key.str() << ": " << sqlite3_errmsg(_db) << std::endl;
+                return false;
             }
+
+            if ( ++_inBatch >= BATCH_SIZE )
+                return commit();
+
+            return true;
         }
-        else
+
+        /** Sets a value in the metadata table. */
+        bool setMetadata( const std::string& name, const std::string& value )
         {
-            if ( _verbose )
+            if ( !commit() )
+                return false;
+
+            sqlite3_stmt* stmt = 0L;
+            bool ok = false;
+
+            std::string sql = "DELETE FROM metadata WHERE name = ?";
+            if ( sqlite3_prepare_v2(_db, sql.c_str(), -1, &stmt, 0L) == SQLITE_OK )
             {
-                OE_NOTICE << LC << "Tile " << key.str() << " already exists" << std::endl;
+                sqlite3_bind_text( stmt, 1, name.c_str(), name.length(), SQLITE_STATIC );
+                sqlite3_step( stmt );
+                sqlite3_finalize( stmt );
+            }
+
+            sql = "INSERT INTO metadata (name, value) VALUES (?, ?)";
+            if ( sqlite3_prepare_v2(_db, sql.c_str(), -1, &stmt, 0L) == SQLITE_OK )
+            {
+                sqlite3_bind_text( stmt, 1, name.c_str(), name.length(), SQLITE_STATIC );
+                sqlite3_bind_text( stmt, 2, value.c_str(), value.length(), SQLITE_STATIC );
+                ok = sqlite3_step( stmt ) == SQLITE_DONE;
+                sqlite3_finalize( stmt );
             }
+
+            return ok;
         }
 
-        // increment the maximum detected tile level:
-        if ( tileOK && key.getLevelOfDetail() > out_maxLevel )
+        bool flush()
         {
-            out_maxLevel = key.getLevelOfDetail();
+            return commit();
         }
 
-        // see if subdivision should continue.
-        unsigned lod = key.getLevelOfDetail();
-        const ImageLayerOptions& options = layer->getImageLayerOptions();
+        bool close()
+        {
+            bool ok = true;
+            if ( _db )
+            {
+                ok = commit();
+                if ( _insert )
+                    sqlite3_finalize( _insert );
+                _insert = 0L;
+                sqlite3_close( _db );
+                _db = 0L;
+            }
+            return ok;
+        }
 
-        unsigned layerMaxLevel = (options.maxLevel().isSet()? *options.maxLevel() : 99);
-        unsigned maxLevel = std::min(_maxLevel, layerMaxLevel);
-        bool subdivide =
-            (options.minLevel().isSet() && lod < *options.minLevel()) ||
-            (tileOK && lod+1 < maxLevel);
+    private:
+        static unsigned long long pack( unsigned z, unsigned x, unsigned y )
+        {
+            return ((unsigned long long)z << 58) | ((unsigned long long)x << 29) | (unsigned long long)y;
+        }
 
-        // subdivide if necessary:
-        if ( (subdivide == true) && (isSingleColor == false) )
+        bool exec( const char* sql )
         {
-            for( unsigned q=0; q<4; ++q )
+            char* err = 0L;
+            if ( sqlite3_exec(_db, sql, 0L, 0L, &err) != SQLITE_OK )
             {
-                TileKey childKey = key.createChildKey(q);
-                Result r = packageImageTile( layer, childKey, rootDir, extension, out_maxLevel );
-                if ( _abortOnError && !r.ok )
-                    return r;
+                OE_WARN << LC << "SQL failed: " << sql << "; " << (err ? err : "") << std::endl;
+                sqlite3_free( err );
+                return false;
             }
+            return true;
         }
+
+        bool commit()
+        {
+            if ( _inBatch == 0 )
+                return true;
+            _inBatch = 0;
+            return exec( "COMMIT TRANSACTION" );
+        }
+
+        std::string                  _filename;
+        bool                         _overwrite;
+        sqlite3*                     _db;
+        sqlite3_stmt*                _insert;
+        unsigned                     _inBatch;
+        std::set<unsigned long long> _existing;
+    };
+
+#endif // OSGEARTH_HAVE_SQLITE3
+
+
+    struct FetchedTile
+    {
+        TileKey                  _key;
+        osg::ref_ptr<osg::Image> _image;
+    };
+
+    struct EncodedTile
+    {
+        TileKey     _key;
+        std::string _data;
+    };
+
+
+    /**
+     * One packaging run: fetch threads walk the tile tree and read tiles from
+     * the layer, encode threads compress them, and one writer thread stores
+     * them in the sink.
+     */
+    class PackageSession
+    {
+    public:
+        PackageSession(
+            const TMSPackager*   packager,
+            ImageLayer*          imageLayer,
+            ElevationLayer*      elevationLayer,
+            TileSink*            sink,
+            osgDB::ReaderWriter* rw,
+            const std::string&   extension,
+            osgDB::Options*      writeOptions );
+
+        /** Packages the tree below the root keys. Returns false on an aborting error. */
+        bool run( const std::vector<TileKey>& rootKeys, std::string& out_error );
+
+        unsigned getMaxLevel() const { return _maxLevel; }
+
+        void fetchLoop();
+        void encodeLoop();
+        void writeLoop();
+
+    private:
+        void fetch( const TileKey& key );
+        void encode( const FetchedTile& tile );
+
+        void addKey( const TileKey& key );
+        bool nextKey( TileKey& out_key );
+        void keyDone();
+
+        void noteLevel( unsigned lod );
+        void abort( const std::string& msg );
+        void report( const char* when );
+
+        const TMSPackager*            _packager;
+        osg::ref_ptr<ImageLayer>      _imageLayer;
+        osg::ref_ptr<ElevationLayer>  _elevationLayer;
+        osg::ref_ptr<TileSink>        _sink;
+        osg::ref_ptr<osgDB::ReaderWriter> _rw;
+        std::string                   _extension;
+        osg::ref_ptr<osgDB::Options>  _writeOptions;
+        unsigned                      _minLevel;
+        unsigned                      _subdivideMaxLevel;
+
+        // keys waiting to be fetched; a stack, so the walk stays depth-first.
+        std::vector<TileKey>          _keys;
+        unsigned                      _pendingKeys;
+        Threading::Mutex              _keysMutex;
+        OpenThreads::Condition        _keysCond;
+
+        BoundedQueue<FetchedTile>     _encodeQueue;
+        BoundedQueue<EncodedTile>     _writeQueue;
+        OpenThreads::Atomic           _liveFetchers;
+        OpenThreads::Atomic           _liveEncoders;
+        Threading::Event              _finished;
+
+        OpenThreads::Atomic           _numFetched;
+        OpenThreads::Atomic           _numSkipped;
+        OpenThreads::Atomic           _numEncoded;
+        OpenThreads::Atomic           _numWritten;
+        unsigned long long            _bytesWritten;  // guarded by _mutex
+        osg::Timer_t                  _startTime;
+
+        volatile bool                 _aborted;
+        std::string                   _error;
+        unsigned                      _maxLevel;
+        Threading::Mutex              _mutex;
+    };
+
+
+    class StageThread : public OpenThreads::Thread
+    {
+    public:
+        enum Stage { STAGE_FETCH, STAGE_ENCODE, STAGE_WRITE };
+
+        StageThread( PackageSession* session, Stage stage ) : _session( session ), _stage( stage ) { }
+
+        void run()
+        {
+            if      ( _stage == STAGE_FETCH )  _session->fetchLoop();
+            else if ( _stage == STAGE_ENCODE ) _session->encodeLoop();
+            else                               _session->writeLoop();
+        }
+
+    private:
+        PackageSession* _session;
+        Stage           _stage;
+    };
+
+
+    PackageSession::PackageSession(const TMSPackager*   packager,
+                                   ImageLayer*          imageLayer,
+                                   ElevationLayer*      elevationLayer,
+                                   TileSink*            sink,
+                                   osgDB::ReaderWriter* rw,
+                                   const std::string&   extension,
+                                   osgDB::Options*      writeOptions) :
+    _packager      ( packager ),
+    _imageLayer    ( imageLayer ),
+    _elevationLayer( elevationLayer ),
+    _sink          ( sink ),
+    _rw            ( rw ),
+    _extension     ( extension ),
+    _writeOptions  ( writeOptions ),
+    _pendingKeys   ( 0 ),
+    _encodeQueue   ( 4 * packager->getNumEncodeThreads() ),
+    _writeQueue    ( 4 * packager->getNumEncodeThreads() + 16 ),
+    _liveFetchers  ( packager->getNumFetchThreads() ),
+    _liveEncoders  ( packager->getNumEncodeThreads() ),
+    _bytesWritten  ( 0 ),
+    _aborted       ( false ),
+    _maxLevel      ( 0 )
+    {
+        const TerrainLayerOptions& options = imageLayer ?
+            (const TerrainLayerOptions&)imageLayer->getImageLayerOptions() :
+            (const TerrainLayerOptions&)elevationLayer->getElevationLayerOptions();
+
+        _minLevel = options.minLevel().isSet() ? *options.minLevel() : 0;
+
+        unsigned layerMaxLevel = options.maxLevel().isSet() ? *options.maxLevel() : 99;
+        _subdivideMaxLevel = std::min( packager->getMaxLevel(), layerMaxLevel );
     }
 
-    return Result();
-}
+    bool
+    PackageSession::run( const std::vector<TileKey>& rootKeys, std::string& out_error )
+    {
+        _startTime = osg::Timer::instance()->tick();
 
+        for( std::vector<TileKey>::const_iterator i = rootKeys.begin(); i != rootKeys.end(); ++i )
+            addKey( *i );
 
-TMSPackager::Result
-TMSPackager::packageElevationTile(ElevationLayer*      layer,
-                                  const TileKey&       key,
-                                  const std::string&   rootDir,
-                                  const std::string&   extension,
-                                  unsigned&            out_maxLevel)
-{
-    unsigned minLevel = layer->getElevationLayerOptions().minLevel().isSet() ?
-        *layer->getElevationLayerOptions().minLevel() : 0;
+        unsigned numFetch  = _packager->getNumFetchThreads();
+        unsigned numEncode = _packager->getNumEncodeThreads();
+
+        std::vector<StageThread*> threads;
+        for( unsigned i=0; i<numFetch; ++i )
+            threads.push_back( new StageThread(this, StageThread::STAGE_FETCH) );
+        for( unsigned i=0; i<numEncode; ++i )
+            threads.push_back( new StageThread(this, StageThread::STAGE_ENCODE) );
+        threads.push_back( new StageThread(this, StageThread::STAGE_WRITE) );
+
+        for( unsigned i=0; i<threads.size(); ++i )
+            threads[i]->start();
+
+        // report progress while the writer works.
+        while( !_finished.wait(10000) )
+        {
+            if ( _packager->getVerbose() )
+                report( "Progress" );
+        }
 
-    if ( shouldPackageKey(key) && key.getLevelOfDetail() >= minLevel )
+        for( unsigned i=0; i<threads.size(); ++i )
+        {
+            threads[i]->join();
+            delete threads[i];
+        }
+
+        report( "Done" );
+
+        out_error = _error;
+        return !_aborted;
+    }
+
+    void
+    PackageSession::fetchLoop()
     {
-        unsigned w, h;
-        key.getProfile()->getNumTiles( key.getLevelOfDetail(), w, h );
+        TileKey key;
+        while( nextKey(key) )
+        {
+            fetch( key );
+            keyDone();
+        }
 
-        std::string path = Stringify() 
-            << rootDir 
-            << "/" << key.getLevelOfDetail() 
-            << "/" << key.getTileX() 
-            << "/" << h - key.getTileY() - 1
-            << "." << extension;
+        // last one out tells the encoders.
+        if ( --_liveFetchers == 0 )
+            _encodeQueue.setDone();
+    }
 
-        bool tileOK = osgDB::fileExists(path) && !_overwrite;
-        if ( !tileOK )
+    void
+    PackageSession::encodeLoop()
+    {
+        FetchedTile tile;
+        while( _encodeQueue.pop(tile) )
         {
+            if ( !_aborted )
+                encode( tile );
+        }
+
+        if ( --_liveEncoders == 0 )
+            _writeQueue.setDone();
+    }
 
-            GeoHeightField hf = layer->createHeightField( key );
-            if ( hf.valid() )
+    void
+    PackageSession::writeLoop()
+    {
+        EncodedTile tile;
+        while( _writeQueue.pop(tile) )
+        {
+            if ( _aborted )
+                continue;
+
+            bool ok = _sink->write( tile._key, tile._data );
+
+            if ( ok )
             {
-                // convert the HF to an image
-                ImageToHeightFieldConverter conv;
-                osg::ref_ptr<osg::Image> image = conv.convert( hf.getHeightField() );
+                ++_numWritten;
+                {
+                    Threading::ScopedMutexLock lock( _mutex );
+                    _bytesWritten += tile._data.size();
+                }
+                noteLevel( tile._key.getLevelOfDetail() );
+            }
 
-                // dump it to disk
-                osgDB::makeDirectoryForFile( path );
-                tileOK = osgDB::writeImageFile( *image.get(), path );
+            if ( _packager->getVerbose() )
+            {
+                if ( ok ) {
+                    OE_NOTICE << LC << "Wrote tile " << tile._key.str() << " (" << tile._key.getExtent().toString() << ")" << std::endl;
+                }
+                else {
+                    OE_NOTICE << LC << "Error write tile " << tile._key.str() << std::endl;
+                }
+            }
+
+            if ( !ok && _packager->getAbortOnError() )
+            {
+                abort( Stringify() << "Aborting, write failed for tile " << tile._key.str() );
+            }
+        }
 
-                if ( _verbose )
+        if ( !_sink->flush() && !_aborted && _packager->getAbortOnError() )
+        {
+            abort( "Aborting, failed to flush the output" );
+        }
+
+        _finished.set();
+    }
+
+    void
+    PackageSession::fetch( const TileKey& key )
+    {
+        if ( !_packager->shouldPackageKey(key) || key.getLevelOfDetail() < _minLevel )
+            return;
+
+        bool isSingleColor = false;
+        bool tileOK = !_packager->getOverwrite() && _sink->exists(key);
+
+        if ( !tileOK )
+        {
+            osg::ref_ptr<osg::Image> image;
+
+            if ( _imageLayer.valid() )
+            {
+                GeoImage geoImage = _imageLayer->createImage( key );
+                if ( geoImage.valid() )
                 {
-                    if ( tileOK ) {
-                        OE_NOTICE << LC << "Wrote tile " << key.str() << " (" << key.getExtent().toString() << ")" << std::endl;
+                    image = geoImage.getImage();
+
+                    // Check for single color
+                    if ( !_packager->getSubdivideSingleColorImageTiles() )
+                    {
+                        isSingleColor = ImageUtils::isSingleColorImage( image.get() );
+                        if ( isSingleColor && _packager->getVerbose() )
+                        {
+                            OE_NOTICE << LC << "Not subdividing single color tile " << key.str() << std::endl;
+                        }
                     }
-                    else {
-                        OE_NOTICE << LC << "Error write tile " << key.str() << std::endl;
+
+                    // check for empty:
+                    if ( !_packager->getKeepEmptyImageTiles() && ImageUtils::isEmptyImage(image.get()) )
+                    {
+                        if ( _packager->getVerbose() )
+                        {
+                            OE_NOTICE << LC << "Skipping empty tile " << key.str() << std::endl;
+                        }
+                        image = 0L;
                     }
                 }
-
-                if ( _abortOnError && !tileOK )
+            }
+            else
+            {
+                GeoHeightField hf = _elevationLayer->createHeightField( key );
+                if ( hf.valid() )
                 {
-                    return Result( Stringify() << "Aborting, write failed for tile " << key.str() );
+                    // convert the HF to an image
+                    ImageToHeightFieldConverter conv;
+                    image = conv.convert( hf.getHeightField() );
                 }
             }
+
+            if ( image.valid() )
+            {
+                ++_numFetched;
+
+                // the tile counts as packaged once it's handed to the encoders,
+                // so subdivision doesn't wait on the writer.
+                FetchedTile tile;
+                tile._key   = key;
+                tile._image = image.get();
+                _encodeQueue.push( tile );
+                tileOK = true;
+            }
         }
         else
         {
-            if ( _verbose )
+            ++_numSkipped;
+            noteLevel( key.getLevelOfDetail() );
+
+            if ( _packager->getVerbose() )
             {
                 OE_NOTICE << LC << "Tile " << key.str() << " already exists" << std::endl;
             }
         }
 
-        // increment the maximum detected tile level:
-        if ( tileOK && key.getLevelOfDetail() > out_maxLevel )
-        {
-            out_maxLevel = key.getLevelOfDetail();
-        }
-
         // see if subdivision should continue.
         unsigned lod = key.getLevelOfDetail();
-        const ElevationLayerOptions& options = layer->getElevationLayerOptions();
-
-        unsigned layerMaxLevel = (options.maxLevel().isSet()? *options.maxLevel() : 99);
-        unsigned maxLevel = std::min(_maxLevel, layerMaxLevel);
         bool subdivide =
-            (options.minLevel().isSet() && lod < *options.minLevel()) ||
-            (tileOK && lod+1 < maxLevel);
+            (lod < _minLevel) ||
+            (tileOK && lod+1 < _subdivideMaxLevel);
 
         // subdivide if necessary:
-        if ( subdivide )
+        if ( subdivide && !isSingleColor && !_aborted )
+        {
+            // pushed in reverse so quadrant 0 comes off the stack first.
+            for( int q=3; q>=0; --q )
+            {
+                addKey( key.createChildKey(q) );
+            }
+        }
+    }
+
+    void
+    PackageSession::encode( const FetchedTile& tile )
+    {
+        // convert to RGB if necessary
+        osg::ref_ptr<const osg::Image> final = tile._image.get();
+        if ( (_extension == "jpg" || _extension == "jpeg") && final->getPixelFormat() != GL_RGB )
+            final = ImageUtils::convertToRGB8( tile._image.get() );
+
+        std::stringstream buf;
+        osgDB::ReaderWriter::WriteResult wr = _rw->writeImage( *final.get(), buf, _writeOptions.get() );
+
+        if ( wr.success() )
+        {
+            ++_numEncoded;
+
+            EncodedTile encoded;
+            encoded._key  = tile._key;
+            encoded._data = buf.str();
+            _writeQueue.push( encoded );
+        }
+        else
         {
-            for( unsigned q=0; q<4; ++q )
+            OE_NOTICE << LC << "Error encoding tile " << tile._key.str() << std::endl;
+
+            if ( _packager->getAbortOnError() )
             {
-                TileKey childKey = key.createChildKey(q);
-                Result r = packageElevationTile( layer, childKey, rootDir, extension, out_maxLevel );
-                if ( _abortOnError && !r.ok )
-                    return r;
+                abort( Stringify() << "Aborting, encoding failed for tile " << tile._key.str() );
             }
         }
     }
 
+    void
+    PackageSession::addKey( const TileKey& key )
+    {
+        Threading::ScopedMutexLock lock( _keysMutex );
+        _keys.push_back( key );
+        ++_pendingKeys;
+        _keysCond.signal();
+    }
+
+    bool
+    PackageSession::nextKey( TileKey& out_key )
+    {
+        Threading::ScopedMutexLock lock( _keysMutex );
+
+        // an empty stack isn't the end while another fetcher may still add children.
+        while( _keys.empty() && _pendingKeys > 0 && !_aborted )
+            _keysCond.wait( &_keysMutex );
+
+        if ( _keys.empty() || _aborted )
+            return false;
+
+        out_key = _keys.back();
+        _keys.pop_back();
+        return true;
+    }
+
+    void
+    PackageSession::keyDone()
+    {
+        Threading::ScopedMutexLock lock( _keysMutex );
+        if ( --_pendingKeys == 0 )
+            _keysCond.broadcast();
+    }
+
+    void
+    PackageSession::noteLevel( unsigned lod )
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        if ( lod > _maxLevel )
+            _maxLevel = lod;
+    }
+
+    void
+    PackageSession::abort( const std::string& msg )
+    {
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            if ( _aborted )
+                return;
+            _error   = msg;
+            _aborted = true;
+        }
+
+        // wake the fetchers so they stop taking keys.
+        Threading::ScopedMutexLock lock( _keysMutex );
+        _keysCond.broadcast();
+    }
+
+    void
+    PackageSession::report( const char* when )
+    {
+        double t = osg::Timer::instance()->delta_s( _startTime, osg::Timer::instance()->tick() );
+        if ( t <= 0.0 )
+            t = 1e-6;
+
+        unsigned fetched = _numFetched, encoded = _numEncoded, written = _numWritten, skipped = _numSkipped;
+
+        unsigned long long bytes;
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            bytes = _bytesWritten;
+        }
+
+        std::string mbps    = Stringify() << std::fixed << std::setprecision(1) << (double)bytes/1048576.0/t;
+        std::string seconds = Stringify() << std::fixed << std::setprecision(1) << t;
+
+        OE_NOTICE << LC << when << ": "
+            << "fetched " << fetched << " (" << (int)(fetched/t) << "/s), "
+            << "encoded " << encoded << " (" << (int)(encoded/t) << "/s), "
+            << "wrote "   << written << " (" << (int)(written/t) << "/s, "
+            << mbps << " MB/s), "
+            << "existing " << skipped << ", "
+            << seconds << " s"
+            << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------
+
+TMSPackager::TMSPackager(const Profile* outProfile, osgDB::Options* imageWriteOptions) :
+_outProfile         ( outProfile ),
+_maxLevel           ( 99 ),
+_format             ( FORMAT_TMS ),
+_numFetchThreads    ( 1 ),
+_numEncodeThreads   ( 1 ),
+_verbose            ( false ),
+_overwrite          ( false ),
+_keepEmptyImageTiles( false ),
+_subdivideSingleColorImageTiles ( false ),
+_abortOnError       ( true ),
+_imageWriteOptions  (imageWriteOptions)
+{
+    //nop
+}
+
+
+void
+TMSPackager::addExtent( const GeoExtent& extent )
+{
+    _extents.push_back(extent);
+}
+
+
+bool
+TMSPackager::shouldPackageKey( const TileKey& key ) const
+{
+    // if there are no extent filters, or we're at a sufficiently low level, 
+    // always package the key.
+    if ( _extents.size() == 0 || key.getLevelOfDetail() <= 1 )
+        return true;
+
+    // check for intersection with one of the filter extents.
+    for( std::vector<GeoExtent>::const_iterator i = _extents.begin(); i != _extents.end(); ++i )
+    {
+        if ( i->intersects( key.getExtent() ) )
+            return true;
+    }
+
+    return false;
+}
+
+
+TMSPackager::Result
+TMSPackager::packageTiles(ImageLayer*                 imageLayer,
+                          ElevationLayer*             elevationLayer,
+                          const std::vector<TileKey>& rootKeys,
+                          const std::string&          path,
+                          const std::string&          extension,
+                          unsigned&                   out_maxLevel)
+{
+    osg::ref_ptr<osgDB::ReaderWriter> rw = osgDB::Registry::instance()->getReaderWriterForExtension( extension );
+    if ( !rw.valid() )
+        return Result( Stringify() << "No plugin available to write \"" << extension << "\" tiles" );
+
+    osg::ref_ptr<TileSink> sink;
+
+    if ( _format == FORMAT_MBTILES )
+    {
+#ifdef OSGEARTH_HAVE_SQLITE3
+        MBTilesSink* mbtiles = new MBTilesSink( path, _overwrite );
+        sink = mbtiles;
+        std::string error;
+        if ( !mbtiles->open(error) )
+            return Result( error );
+#else
+        return Result( "MBTiles output is not available; osgEarth was built without SQLite3" );
+#endif
+    }
+    else
+    {
+        sink = new TMSFolderSink( path, extension );
+    }
+
+    PackageSession session(
+        this,
+        imageLayer,
+        elevationLayer,
+        sink.get(),
+        rw.get(),
+        extension,
+        imageLayer ? _imageWriteOptions.get() : 0L );
+
+    std::string error;
+    bool ok = session.run( rootKeys, error );
+    out_maxLevel = session.getMaxLevel();
+
+#ifdef OSGEARTH_HAVE_SQLITE3
+    MBTilesSink* mbtiles = dynamic_cast<MBTilesSink*>( sink.get() );
+    if ( mbtiles )
+    {
+        TerrainLayer* layer = imageLayer ? (TerrainLayer*)imageLayer : (TerrainLayer*)elevationLayer;
+        const GeoExtent& ll = _outProfile->getLatLongExtent();
+
+        mbtiles->setMetadata( "name",    layer->getName() );
+        mbtiles->setMetadata( "type",    "baselayer" );
+        mbtiles->setMetadata( "version", "1.0.0" );
+        mbtiles->setMetadata( "format",  extension );
+        mbtiles->setMetadata( "bounds",  Stringify() << ll.xMin() << "," << ll.yMin() << "," << ll.xMax() << "," << ll.yMax() );
+        mbtiles->setMetadata( "minzoom", "0" );
+        mbtiles->setMetadata( "maxzoom", Stringify() << out_maxLevel );
+
+        if ( !mbtiles->close() && ok )
+            return Result( "Failed to close the MBTiles file" );
+    }
+#endif
+
+    if ( !ok && _abortOnError )
+        return Result( error );
+
     return Result();
 }
 
@@ -289,9 +942,13 @@ TMSPackager::package(ImageLayer*        layer,
     if ( !layer || !_outProfile.valid() )
         return Result( "Illegal null layer or profile" );
 
-    // attempt to create the output folder:
-    osgDB::makeDirectory( rootFolder );
-    if ( !osgDB::fileExists( rootFolder ) )
+    // attempt to create the output folder (for MBTiles, the one holding the file):
+    std::string outputFolder = _format == FORMAT_MBTILES ? osgDB::getFilePath(rootFolder) : rootFolder;
+    if ( outputFolder.empty() )
+        outputFolder = ".";
+
+    osgDB::makeDirectory( outputFolder );
+    if ( !osgDB::fileExists( outputFolder ) )
         return Result( "Unable to create output folder" );
 
     // collect the root tile keys in preparation for packaging:
@@ -349,12 +1006,13 @@ TMSPackager::package(ImageLayer*        layer,
 
     // package the tile hierarchy
     unsigned maxLevel = 0;
-    for( std::vector<TileKey>::const_iterator i = rootKeys.begin(); i != rootKeys.end(); ++i )
-    {
-        Result r = packageImageTile( layer, *i, rootFolder, extension, maxLevel );
-        if ( _abortOnError && !r.ok )
-            return r;
-    }
+    Result r = packageTiles( layer, 0L, rootKeys, rootFolder, extension, maxLevel );
+    if ( !r.ok )
+        return r;
+
+    // an MBTiles file carries its own metadata.
+    if ( _format == FORMAT_MBTILES )
+        return Result();
 
     // create the tile map metadata:
     osg::ref_ptr<TMS::TileMap> tileMap = TMS::TileMap::create(
@@ -384,9 +1042,13 @@ TMSPackager::package(ElevationLayer*    layer,
     if ( !layer || !_outProfile.valid() )
         return Result( "Illegal null layer or profile" );
 
-    // attempt to create the output folder:
-    osgDB::makeDirectory( rootFolder );
-    if ( !osgDB::fileExists( rootFolder ) )
+    // attempt to create the output folder (for MBTiles, the one holding the file):
+    std::string outputFolder = _format == FORMAT_MBTILES ? osgDB::getFilePath(rootFolder) : rootFolder;
+    if ( outputFolder.empty() )
+        outputFolder = ".";
+
+    osgDB::makeDirectory( outputFolder );
+    if ( !osgDB::fileExists( outputFolder ) )
         return Result( "Unable to create output folder" );
 
     // collect the root tile keys in preparation for packaging:
@@ -412,12 +1074,13 @@ TMSPackager::package(ElevationLayer*    layer,
         return Result( "Unable to determine heightfield size" );
 
     unsigned maxLevel = 0;
-    for( std::vector<TileKey>::const_iterator i = rootKeys.begin(); i != rootKeys.end(); ++i )
-    {
-        Result r = packageElevationTile( layer, *i, rootFolder, extension, maxLevel );
-        if ( _abortOnError && !r.ok )
-            return r;
-    }
+    Result r = packageTiles( 0L, layer, rootKeys, rootFolder, extension, maxLevel );
+    if ( !r.ok )
+        return r;
+
+    // an MBTiles file carries its own metadata.
+    if ( _format == FORMAT_MBTILES )
+        return Result();
 
     // create the tile map metadata:
     osg::ref_ptr<TMS::TileMap> tileMap = TMS::TileMap::create(
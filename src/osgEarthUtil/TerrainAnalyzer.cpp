@@ -0,0 +1,966 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2008-2012 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthUtil/TerrainAnalyzer>
+#include <osgEarthUtil/TerrainProfile>
+#include <osgEarth/HeightFieldUtils>
+#include <osgEarth/GeoMath>
+#include <osgEarth/VerticalDatum>
+#include <osgEarth/Notify>
+#include <OpenThreads/Thread>
+#include <cmath>
+#include <cfloat>
+#include <climits>
+#include <cstdlib>
+#include <map>
+
+#define LC "[TerrainAnalyzer] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // runs the tasks in parallel and waits for all of them. A single task
+    // runs inline.
+    template<typename T>
+    void runTasks( std::vector< osg::ref_ptr< ParallelTask<T> > >& tasks, TaskService* service )
+    {
+        if ( tasks.size() == 1 || !service )
+        {
+            for( unsigned i = 0; i < tasks.size(); ++i )
+                tasks[i]->execute();
+            return;
+        }
+
+        Threading::MultiEvent semaphore( (int)tasks.size() );
+        for( unsigned i = 0; i < tasks.size(); ++i )
+        {
+            tasks[i]->_mev = &semaphore;
+            service->add( tasks[i].get() );
+        }
+        semaphore.wait();
+    }
+
+    // a/b rounded to the nearest integer, for b > 0.
+    inline int roundDiv( int a, int b )
+    {
+        int n = 2*a + b, d = 2*b;
+        return n >= 0 ? n / d : -((d - 1 - n) / d);
+    }
+
+    /**
+     * Flat east/north frame around an origin, in meters. On a geographic map
+     * it's an equirectangular projection, which is plenty accurate over the
+     * distances the analyzer works with.
+     */
+    struct LocalFrame
+    {
+        LocalFrame( const GeoPoint& origin )
+        {
+            const SpatialReference* srs = origin.getSRS();
+            _x0 = origin.x();
+            _y0 = origin.y();
+            _upmX = _upmY = 1.0;
+            if ( srs->isGeographic() )
+            {
+                double R = srs->getEllipsoid()->getRadiusEquator();
+                _upmY = 180.0 / (osg::PI * R);
+                _upmX = _upmY / osg::maximum( cos(osg::DegreesToRadians(_y0)), 0.01 );
+            }
+            _geographic = srs->isGeographic();
+        }
+
+        // local meters to map coordinates; X is not wrapped.
+        void toMap( double e, double n, double& out_x, double& out_y ) const
+        {
+            out_x = _x0 + e * _upmX;
+            out_y = _y0 + n * _upmY;
+        }
+
+        void toLocal( double x, double y, double& out_e, double& out_n ) const
+        {
+            double dx = x - _x0;
+            if ( _geographic )
+            {
+                if ( dx > 180.0 )       dx -= 360.0;
+                else if ( dx < -180.0 ) dx += 360.0;
+            }
+            out_e = dx / _upmX;
+            out_n = (y - _y0) / _upmY;
+        }
+
+        double _x0, _y0;
+        double _upmX, _upmY;
+        bool   _geographic;
+    };
+}
+
+//------------------------------------------------------------------------
+
+/**
+ * Samples the heightfields of one LOD, by map coordinates. A lazy sampler
+ * fetches tiles as it needs them; otherwise call prefetch() for the area
+ * first, after which copies of the sampler can be used from several threads.
+ */
+struct TerrainAnalyzer::Sampler
+{
+    Sampler( const TerrainAnalyzer* analyzer, bool lazy ) :
+        _analyzer( analyzer ),
+        _profile ( analyzer->_mapf.getProfile() ),
+        _lod     ( analyzer->_lod ),
+        _lazy    ( lazy ),
+        _lastCol ( INT_MIN ),
+        _lastRow ( INT_MIN ),
+        _last    ( 0L )
+    {
+        _profile->getTileDimensions( _lod, _tileWidth, _tileHeight );
+        _profile->getNumTiles( _lod, _tilesWide, _tilesHigh );
+        _wrap = _profile->getSRS()->isGeographic();
+    }
+
+    Sampler( const Sampler& rhs ) :
+        _analyzer  ( rhs._analyzer ),
+        _profile   ( rhs._profile ),
+        _lod       ( rhs._lod ),
+        _lazy      ( rhs._lazy ),
+        _tileWidth ( rhs._tileWidth ),
+        _tileHeight( rhs._tileHeight ),
+        _tilesWide ( rhs._tilesWide ),
+        _tilesHigh ( rhs._tilesHigh ),
+        _wrap      ( rhs._wrap ),
+        _tiles     ( rhs._tiles ),
+        _lastCol   ( INT_MIN ),
+        _lastRow   ( INT_MIN ),
+        _last      ( 0L ) { }
+
+    // column of the tile under x, unwrapped (may fall outside the profile).
+    int column( double x ) const {
+        return (int)floor( (x - _profile->getExtent().xMin()) / _tileWidth );
+    }
+
+    int row( double y ) const {
+        return (int)floor( (_profile->getExtent().yMax() - y) / _tileHeight );
+    }
+
+    // brings a column into the profile, or returns -1 if it's outside.
+    int wrapColumn( int col ) const {
+        int w = (int)_tilesWide;
+        if ( _wrap ) return ((col % w) + w) % w;
+        return col >= 0 && col < w ? col : -1;
+    }
+
+    void fetch( const TileKey& key, osg::ref_ptr<osg::HeightField>& out_hf ) const
+    {
+        _analyzer->getHeightField( key, out_hf );
+    }
+
+    struct FetchTile
+    {
+        void execute() { _sampler->fetch( _key, _hf ); }
+        const Sampler*                 _sampler;
+        TileKey                        _key;
+        osg::ref_ptr<osg::HeightField> _hf;
+    };
+
+    // fetches all the tiles under an extent (in map coordinates) in parallel.
+    void prefetch( double xmin, double ymin, double xmax, double ymax, TaskService* service )
+    {
+        int c0 = column(xmin), c1 = column(xmax);
+        int r0 = osg::maximum( row(ymax), 0 ), r1 = osg::minimum( row(ymin), (int)_tilesHigh-1 );
+
+        std::vector< osg::ref_ptr< ParallelTask<FetchTile> > > tasks;
+        for( int r = r0; r <= r1; ++r )
+        {
+            for( int c = c0; c <= c1; ++c )
+            {
+                int wc = wrapColumn( c );
+                if ( wc < 0 || _tiles.find(std::make_pair(wc, r)) != _tiles.end() )
+                    continue;
+
+                ParallelTask<FetchTile>* task = new ParallelTask<FetchTile>();
+                task->_sampler = this;
+                task->_key     = TileKey( _lod, (unsigned)wc, (unsigned)r, _profile.get() );
+                tasks.push_back( task );
+                _tiles[std::make_pair(wc, r)] = 0L;
+            }
+        }
+
+        runTasks( tasks, service );
+
+        for( unsigned i = 0; i < tasks.size(); ++i )
+        {
+            _tiles[std::make_pair((int)tasks[i]->_key.getTileX(), (int)tasks[i]->_key.getTileY())] = tasks[i]->_hf.get();
+        }
+    }
+
+    // elevation at a point in map coordinates; false if there's no data there.
+    bool sample( double x, double y, float& out_height )
+    {
+        int c = column( x ), r = row( y );
+        if ( r < 0 || r >= (int)_tilesHigh )
+            return false;
+
+        if ( c != _lastCol || r != _lastRow )
+        {
+            _lastCol = c;
+            _lastRow = r;
+            _last    = 0L;
+
+            int wc = wrapColumn( c );
+            if ( wc >= 0 )
+            {
+                Tiles::const_iterator i = _tiles.find( std::make_pair(wc, r) );
+                if ( i != _tiles.end() )
+                {
+                    _last = i->second.get();
+                }
+                else if ( _lazy )
+                {
+                    osg::ref_ptr<osg::HeightField> hf;
+                    fetch( TileKey(_lod, (unsigned)wc, (unsigned)r, _profile.get()), hf );
+                    _tiles[std::make_pair(wc, r)] = hf.get();
+                    _last = hf.get();
+                }
+            }
+        }
+
+        if ( !_last )
+            return false;
+
+        double xmin = _profile->getExtent().xMin() + (double)c * _tileWidth;
+        double ymin = _profile->getExtent().yMax() - (double)(r+1) * _tileHeight;
+        double nx   = osg::clampBetween( (x - xmin) / _tileWidth,  0.0, 1.0 );
+        double ny   = osg::clampBetween( (y - ymin) / _tileHeight, 0.0, 1.0 );
+
+        float h = HeightFieldUtils::getHeightAtNormalizedLocation( _last, nx, ny );
+        if ( h == NO_DATA_VALUE )
+            return false;
+
+        out_height = h;
+        return true;
+    }
+
+    typedef std::map< std::pair<int,int>, osg::ref_ptr<osg::HeightField> > Tiles;
+
+    const TerrainAnalyzer*       _analyzer;
+    osg::ref_ptr<const Profile>  _profile;
+    unsigned                     _lod;
+    bool                         _lazy;
+    double                       _tileWidth, _tileHeight;
+    unsigned                     _tilesWide, _tilesHigh;
+    bool                         _wrap;
+    Tiles                        _tiles;
+    int                          _lastCol, _lastRow;
+    osg::HeightField*            _last;
+};
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    /** Samples the terrain under a band of rows of a viewshed grid. */
+    template<typename SAMPLER>
+    struct FillRows
+    {
+        void execute()
+        {
+            int H = (int)_size / 2;
+            for( unsigned r = _firstRow; r < _lastRow; ++r )
+            {
+                double n = (double)((int)r - H) * _spacing;
+                for( unsigned c = 0; c < _size; ++c )
+                {
+                    double e = (double)((int)c - H) * _spacing;
+                    double x, y;
+                    _frame->toMap( e, n, x, y );
+                    float h = 0.0f;
+                    _sampler->sample( x, y, h );
+                    (*_heights)[r*_size + c] = h;
+                }
+            }
+        }
+
+        const LocalFrame*    _frame;
+        SAMPLER*             _sampler;
+        std::vector<float>*  _heights;
+        unsigned             _size;
+        double               _spacing;
+        unsigned             _firstRow, _lastRow;
+    };
+
+    /**
+     * A ray of the R2 sweep, from the observer to a cell on the edge of the
+     * grid. The edge cell is H cells from the observer along the ray's major
+     * axis (x for the east and west sides, y for north and south) and p
+     * cells along the minor axis.
+     */
+    struct SweepRay
+    {
+        SweepRay( bool xMajor, int sign, int p ) : _xMajor(xMajor), _sign(sign), _p(p) { }
+        bool _xMajor;
+        int  _sign;
+        int  _p;
+    };
+
+    /**
+     * Runs a sector of the R2 sweep. Each ray walks out from the observer,
+     * one cell at a time along its major axis, keeping the steepest slope to
+     * the terrain seen so far (its horizon). A cell is visible if the slope
+     * to it is at least the horizon of the ray that passes nearest to its
+     * center; only that ray writes it, so sectors never write the same cell.
+     */
+    struct SweepSector
+    {
+        float height( int dx, int dy ) const {
+            return (*_heights)[(dy + _H) * _size + (dx + _H)];
+        }
+
+        void execute()
+        {
+            for( unsigned i = _first; i < _last; ++i )
+            {
+                const SweepRay& ray = (*_rays)[i];
+                double slope   = (double)ray._p / (double)_H;
+                double rayStep = _spacing * sqrt(1.0 + slope*slope);
+                double horizon = -DBL_MAX;
+
+                for( int k = 1; k <= _H; ++k )
+                {
+                    if ( (double)k * _spacing > _radius )
+                        break;
+
+                    int major = ray._sign * k;
+
+                    // the cell nearest the ray at this step, if the ray owns it:
+                    int c = roundDiv( k * ray._p, _H );
+                    bool owned =
+                        roundDiv( c * _H, k ) == ray._p &&
+                        (ray._xMajor || abs(c) < k);
+
+                    if ( owned )
+                    {
+                        int dx = ray._xMajor ? major : c;
+                        int dy = ray._xMajor ? c : major;
+                        double d = _spacing * sqrt( (double)(k*k + c*c) );
+                        if ( d <= _radius )
+                        {
+                            double z = (double)height(dx, dy) + _targetHeight - _curvature*d*d;
+                            (*_cells)[(dy + _H) * _size + (dx + _H)] =
+                                (z - _eye) / d >= horizon ? Viewshed::VISIBLE : Viewshed::HIDDEN;
+                        }
+                    }
+
+                    // terrain where the ray crosses this step, between the two
+                    // cells straddling it:
+                    double m    = (double)(k * ray._p) / (double)_H;
+                    int    m0   = (int)floor( m );
+                    double frac = m - (double)m0;
+                    int    m1   = osg::minimum( m0 + 1, _H );
+                    double z0   = ray._xMajor ? height(major, m0) : height(m0, major);
+                    double z1   = ray._xMajor ? height(major, m1) : height(m1, major);
+                    double d    = rayStep * (double)k;
+                    double z    = z0 + (z1 - z0) * frac - _curvature*d*d;
+
+                    horizon = osg::maximum( horizon, (z - _eye) / d );
+                }
+            }
+        }
+
+        const std::vector<SweepRay>*  _rays;
+        unsigned                      _first, _last;
+        const std::vector<float>*     _heights;
+        std::vector<unsigned char>*   _cells;
+        int                           _H;
+        unsigned                      _size;
+        double                        _spacing;
+        double                        _radius;
+        double                        _eye;
+        double                        _targetHeight;
+        double                        _curvature;
+    };
+
+    /** Walks a range of the spokes of a radial line of sight. */
+    template<typename SAMPLER>
+    struct RadialSpokes
+    {
+        void execute()
+        {
+            int steps = osg::maximum( (int)ceil(_radius / _spacing), 1 );
+            for( unsigned i = _first; i < _last; ++i )
+            {
+                double azimuth = 2.0 * osg::PI * (double)i / (double)_numSpokes;
+                double de = sin(azimuth), dn = cos(azimuth);
+
+                double ratio = 1.0;
+                double prevDiff = -1.0, prevD = 0.0;
+                for( int k = 1; k <= steps; ++k )
+                {
+                    double d = osg::minimum( (double)k * _spacing, _radius );
+                    double x, y;
+                    _frame->toMap( de*d, dn*d, x, y );
+                    float h;
+                    if ( !_sampler->sample(x, y, h) )
+                        continue;
+
+                    double diff = ((double)h - _curvature*d*d) - _eye;
+                    if ( diff > 0.0 )
+                    {
+                        // interpolate to where the terrain crossed the spoke:
+                        double t = prevDiff < 0.0 ? prevDiff / (prevDiff - diff) : 0.0;
+                        ratio = (prevD + (d - prevD) * t) / _radius;
+                        break;
+                    }
+                    prevDiff = diff;
+                    prevD    = d;
+                }
+                (*_ratios)[i] = ratio;
+            }
+        }
+
+        const LocalFrame*     _frame;
+        SAMPLER*              _sampler;
+        std::vector<double>*  _ratios;
+        unsigned              _numSpokes;
+        unsigned              _first, _last;
+        double                _radius;
+        double                _spacing;
+        double                _eye;
+        double                _curvature;
+    };
+
+    // splits [0, count) into about numTasks ranges.
+    void split( unsigned count, unsigned numTasks, std::vector<unsigned>& out_bounds )
+    {
+        numTasks = osg::clampBetween( numTasks, 1u, osg::maximum(count, 1u) );
+        out_bounds.clear();
+        for( unsigned i = 0; i <= numTasks; ++i )
+            out_bounds.push_back( (unsigned)(((unsigned long long)count * i) / numTasks) );
+    }
+}
+
+//------------------------------------------------------------------------
+
+GeoPoint
+Viewshed::getLocation( unsigned col, unsigned row ) const
+{
+    int H = (int)_size / 2;
+    double x = _observer.x() + (double)((int)col - H) * _spacing * _unitsPerMeterX;
+    double y = _observer.y() + (double)((int)row - H) * _spacing * _unitsPerMeterY;
+    if ( _observer.getSRS()->isGeographic() )
+    {
+        if ( x > 180.0 )       x -= 360.0;
+        else if ( x < -180.0 ) x += 360.0;
+    }
+    return GeoPoint( _observer.getSRS(), x, y, (double)getElevation(col, row), ALTMODE_ABSOLUTE );
+}
+
+unsigned
+Viewshed::getNumVisible() const
+{
+    unsigned count = 0;
+    for( unsigned i = 0; i < _cells.size(); ++i )
+    {
+        if ( _cells[i] == VISIBLE )
+            ++count;
+    }
+    return count;
+}
+
+osg::Image*
+Viewshed::createImage( const osg::Vec4f& visibleColor, const osg::Vec4f& hiddenColor ) const
+{
+    osg::Image* image = new osg::Image();
+    image->allocateImage( _size, _size, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+
+    unsigned char colors[3][4];
+    for( unsigned i = 0; i < 4; ++i )
+    {
+        colors[HIDDEN][i]       = (unsigned char)(osg::clampBetween(hiddenColor[i],  0.0f, 1.0f) * 255.0f);
+        colors[VISIBLE][i]      = (unsigned char)(osg::clampBetween(visibleColor[i], 0.0f, 1.0f) * 255.0f);
+        colors[OUT_OF_RANGE][i] = 0;
+    }
+
+    for( unsigned r = 0; r < _size; ++r )
+    {
+        unsigned char* p = image->data( 0, r );
+        for( unsigned c = 0; c < _size; ++c, p += 4 )
+        {
+            const unsigned char* color = colors[_cells[r*_size + c]];
+            p[0] = color[0]; p[1] = color[1]; p[2] = color[2]; p[3] = color[3];
+        }
+    }
+
+    return image;
+}
+
+//------------------------------------------------------------------------
+
+TerrainAnalyzer::TerrainAnalyzer( const Map* map ) :
+_mapf      ( map, Map::ELEVATION_LAYERS, "TerrainAnalyzer" ),
+_cache     ( true, 128 ),
+_resolution( 30.0 ),
+_refraction( 0.0 ),
+_lod       ( 0 )
+{
+    _service = new TaskService( "TerrainAnalyzer", osg::maximum(OpenThreads::GetNumberOfProcessors(), 1) );
+}
+
+void
+TerrainAnalyzer::setResolution( double meters )
+{
+    _resolution = osg::clampAbove( meters, 0.01 );
+}
+
+void
+TerrainAnalyzer::setMaxTilesToCache( unsigned value )
+{
+    _cache.setMaxSize( value );
+}
+
+unsigned
+TerrainAnalyzer::getMaxTilesToCache() const
+{
+    return _cache.getMaxSize();
+}
+
+void
+TerrainAnalyzer::clear()
+{
+    _cache.clear();
+}
+
+void
+TerrainAnalyzer::sync() const
+{
+    Threading::ScopedWriteLock lock( _mapfMutex );
+
+    if ( _mapf.sync() )
+        _cache.clear();
+
+    const Profile* profile = _mapf.getProfile();
+    if ( !profile )
+        return;
+
+    // pick the LOD whose data is closest to the requested resolution, but no
+    // finer than the finest data available.
+    int          tileSize     = 0;
+    unsigned int maxDataLevel = 0;
+    for( ElevationLayerVector::const_iterator i = _mapf.elevationLayers().begin(); i != _mapf.elevationLayers().end(); ++i )
+    {
+        tileSize     = osg::maximum( tileSize, (int)i->get()->getTileSize() );
+        maxDataLevel = osg::maximum( maxDataLevel, i->get()->getMaxDataLevel() );
+    }
+
+    if ( tileSize == 0 )
+    {
+        _lod = 0;
+        return;
+    }
+
+    double resolution = _resolution;
+    if ( profile->getSRS()->isGeographic() )
+        resolution /= osg::DegreesToRadians( profile->getSRS()->getEllipsoid()->getRadiusEquator() );
+
+    _lod = osg::minimum( profile->getLevelOfDetailForHorizResolution(resolution, tileSize), maxDataLevel );
+}
+
+double
+TerrainAnalyzer::getCurvature() const
+{
+    // the drop below the observer's horizontal of a point d meters away is
+    // d^2 / 2R, which refraction partly offsets.
+    if ( !_mapf.getMapInfo().isGeocentric() )
+        return 0.0;
+
+    double R = _mapf.getProfile()->getSRS()->getEllipsoid()->getRadiusEquator();
+    return (1.0 - _refraction) / (2.0 * R);
+}
+
+void
+TerrainAnalyzer::getHeightField( const TileKey& key, osg::ref_ptr<osg::HeightField>& out_hf ) const
+{
+    HeightFieldCache::Record rec;
+    if ( _cache.get(key, rec) )
+    {
+        out_hf = rec.value().get();
+        return;
+    }
+
+    // heights in the map's vertical datum, like GeoPoint altitudes:
+    _mapf.getHeightField( key, true, out_hf, 0L, false );
+    _cache.insert( key, out_hf );
+}
+
+bool
+TerrainAnalyzer::toAbsolute( const GeoPoint& input, GeoPoint& output ) const
+{
+    if ( !input.isValid() || !_mapf.getProfile() )
+        return false;
+
+    if ( !input.transform(_mapf.getProfile()->getSRS(), output) )
+        return false;
+
+    if ( output.altitudeMode() == ALTMODE_RELATIVE )
+    {
+        Sampler sampler( this, true );
+        float h = 0.0f;
+        sampler.sample( output.x(), output.y(), h );
+        output.z() += (double)h;
+        output.altitudeMode() = ALTMODE_ABSOLUTE;
+    }
+    return true;
+}
+
+bool
+TerrainAnalyzer::getHeight(const SpatialReference* srs,
+                           double                  x,
+                           double                  y,
+                           double*                 out_hamsl,
+                           double*                 out_hae) const
+{
+    sync();
+    Threading::ScopedReadLock lock( _mapfMutex );
+
+    if ( !_mapf.getProfile() )
+        return false;
+
+    const SpatialReference* mapSRS = _mapf.getProfile()->getSRS();
+    if ( srs && !srs->isHorizEquivalentTo(mapSRS) )
+    {
+        if ( !srs->transform2D(x, y, mapSRS, x, y) )
+            return false;
+    }
+
+    Sampler sampler( this, true );
+    float h;
+    if ( !sampler.sample(x, y, h) )
+        return false;
+
+    if ( out_hamsl )
+        *out_hamsl = (double)h;
+
+    if ( out_hae )
+    {
+        *out_hae = (double)h;
+        const VerticalDatum* vdatum = mapSRS->getVerticalDatum();
+        if ( vdatum )
+        {
+            double lon = x, lat = y;
+            if ( mapSRS->isGeographic() || mapSRS->transform2D(x, y, mapSRS->getGeographicSRS(), lon, lat) )
+                *out_hae = vdatum->msl2hae( lat, lon, (double)h );
+        }
+    }
+
+    return true;
+}
+
+Viewshed*
+TerrainAnalyzer::computeViewshed(const GeoPoint&   observer,
+                                 double            radius,
+                                 double            targetHeight,
+                                 ProgressCallback* progress)
+{
+    sync();
+    Threading::ScopedReadLock lock( _mapfMutex );
+
+    GeoPoint eye;
+    if ( radius <= 0.0 || !toAbsolute(observer, eye) )
+        return 0L;
+
+    LocalFrame frame( eye );
+    int        H    = (int)ceil( radius / _resolution );
+    unsigned   size = 2*H + 1;
+
+    osg::ref_ptr<Viewshed> result = new Viewshed();
+    result->_observer       = eye;
+    result->_size           = size;
+    result->_spacing        = _resolution;
+    result->_unitsPerMeterX = frame._upmX;
+    result->_unitsPerMeterY = frame._upmY;
+    result->_cells.assign( size*size, (unsigned char)Viewshed::OUT_OF_RANGE );
+    result->_heights.assign( size*size, 0.0f );
+
+    // fetch the elevation data under the grid:
+    Sampler sampler( this, false );
+    double xmin, ymin, xmax, ymax;
+    frame.toMap( -H*_resolution, -H*_resolution, xmin, ymin );
+    frame.toMap(  H*_resolution,  H*_resolution, xmax, ymax );
+    sampler.prefetch( xmin, ymin, xmax, ymax, _service.get() );
+
+    if ( progress && progress->isCanceled() )
+        return 0L;
+
+    unsigned numTasks = (unsigned)osg::maximum( _service->getNumThreads(), 1 );
+    std::vector<unsigned> bounds;
+
+    // sample the terrain at each cell, in bands of rows:
+    {
+        split( size, numTasks, bounds );
+        std::vector<Sampler> samplers( bounds.size()-1, sampler );
+        std::vector< osg::ref_ptr< ParallelTask< FillRows<Sampler> > > > tasks;
+        for( unsigned i = 0; i+1 < bounds.size(); ++i )
+        {
+            ParallelTask< FillRows<Sampler> >* task = new ParallelTask< FillRows<Sampler> >();
+            task->_frame    = &frame;
+            task->_sampler  = &samplers[i];
+            task->_heights  = &result->_heights;
+            task->_size     = size;
+            task->_spacing  = _resolution;
+            task->_firstRow = bounds[i];
+            task->_lastRow  = bounds[i+1];
+            tasks.push_back( task );
+        }
+        runTasks( tasks, _service.get() );
+    }
+
+    if ( progress && progress->isCanceled() )
+        return 0L;
+
+    result->_cells[H*size + H] = Viewshed::VISIBLE;
+
+    if ( H > 0 )
+    {
+        // rays to every cell on the edge of the grid. The east and west sides
+        // include the corners; the diagonals belong to them.
+        std::vector<SweepRay> rays;
+        rays.reserve( 8*H );
+        for( int p = -H; p <= H; ++p )
+        {
+            rays.push_back( SweepRay(true,  1, p) );
+            rays.push_back( SweepRay(true, -1, p) );
+        }
+        for( int p = -H+1; p < H; ++p )
+        {
+            rays.push_back( SweepRay(false,  1, p) );
+            rays.push_back( SweepRay(false, -1, p) );
+        }
+
+        split( rays.size(), numTasks, bounds );
+        std::vector< osg::ref_ptr< ParallelTask<SweepSector> > > tasks;
+        for( unsigned i = 0; i+1 < bounds.size(); ++i )
+        {
+            ParallelTask<SweepSector>* task = new ParallelTask<SweepSector>();
+            task->_rays         = &rays;
+            task->_first        = bounds[i];
+            task->_last         = bounds[i+1];
+            task->_heights      = &result->_heights;
+            task->_cells        = &result->_cells;
+            task->_H            = H;
+            task->_size         = size;
+            task->_spacing      = _resolution;
+            task->_radius       = radius;
+            task->_eye          = eye.z();
+            task->_targetHeight = targetHeight;
+            task->_curvature    = getCurvature();
+            tasks.push_back( task );
+        }
+        runTasks( tasks, _service.get() );
+    }
+
+    if ( progress && progress->isCanceled() )
+        return 0L;
+
+    OE_DEBUG << LC << "Viewshed: " << size << "x" << size << " cells, "
+        << result->getNumVisible() << " visible" << std::endl;
+
+    return result.release();
+}
+
+bool
+TerrainAnalyzer::computeLineOfSight(const GeoPoint& start,
+                                    const GeoPoint& end,
+                                    GeoPoint*       out_hit,
+                                    double*         out_ratio)
+{
+    sync();
+    Threading::ScopedReadLock lock( _mapfMutex );
+
+    GeoPoint a, b;
+    if ( !toAbsolute(start, a) || !toAbsolute(end, b) )
+        return true;
+
+    LocalFrame frame( a );
+    double e, n;
+    frame.toLocal( b.x(), b.y(), e, n );
+
+    double curvature = getCurvature();
+    double length    = sqrt( e*e + n*n );
+    double zStart    = a.z();
+    double zEnd      = b.z() - curvature*length*length;
+
+    // sample the terrain between the endpoints (not at them, since either
+    // one may sit right on the ground):
+    int     steps = osg::maximum( (int)ceil(length / _resolution), 1 );
+    Sampler sampler( this, true );
+
+    double prevDiff = -1.0, prevT = 0.0;
+    for( int i = 1; i < steps; ++i )
+    {
+        double t = (double)i / (double)steps;
+        double d = t * length;
+        double x, y;
+        frame.toMap( t*e, t*n, x, y );
+
+        float h;
+        if ( !sampler.sample(x, y, h) )
+            continue;
+
+        double line = zStart + (zEnd - zStart) * t;
+        double diff = ((double)h - curvature*d*d) - line;
+        if ( diff > 0.0 )
+        {
+            // interpolate to where the terrain crossed the line:
+            double hitT = prevDiff < 0.0 ? prevT + (t - prevT) * (prevDiff / (prevDiff - diff)) : t;
+            double hitD = hitT * length;
+
+            if ( out_ratio )
+                *out_ratio = hitT;
+
+            if ( out_hit )
+            {
+                double hx, hy;
+                frame.toMap( hitT*e, hitT*n, hx, hy );
+                if ( frame._geographic )
+                {
+                    if ( hx > 180.0 )       hx -= 360.0;
+                    else if ( hx < -180.0 ) hx += 360.0;
+                }
+                double hz = zStart + (zEnd - zStart) * hitT + curvature*hitD*hitD;
+                *out_hit = GeoPoint( a.getSRS(), hx, hy, hz, ALTMODE_ABSOLUTE );
+            }
+            return false;
+        }
+        prevDiff = diff;
+        prevT    = t;
+    }
+
+    return true;
+}
+
+void
+TerrainAnalyzer::computeRadialLineOfSight(const GeoPoint&      center,
+                                          double               radius,
+                                          unsigned             numSpokes,
+                                          std::vector<double>& out_ratios)
+{
+    out_ratios.assign( numSpokes, 1.0 );
+
+    sync();
+    Threading::ScopedReadLock lock( _mapfMutex );
+
+    GeoPoint eye;
+    if ( numSpokes == 0 || radius <= 0.0 || !toAbsolute(center, eye) )
+        return;
+
+    LocalFrame frame( eye );
+
+    Sampler sampler( this, false );
+    double xmin, ymin, xmax, ymax;
+    frame.toMap( -radius, -radius, xmin, ymin );
+    frame.toMap(  radius,  radius, xmax, ymax );
+    sampler.prefetch( xmin, ymin, xmax, ymax, _service.get() );
+
+    std::vector<unsigned> bounds;
+    split( numSpokes, (unsigned)osg::maximum(_service->getNumThreads(), 1), bounds );
+
+    std::vector<Sampler> samplers( bounds.size()-1, sampler );
+    std::vector< osg::ref_ptr< ParallelTask< RadialSpokes<Sampler> > > > tasks;
+    for( unsigned i = 0; i+1 < bounds.size(); ++i )
+    {
+        ParallelTask< RadialSpokes<Sampler> >* task = new ParallelTask< RadialSpokes<Sampler> >();
+        task->_frame     = &frame;
+        task->_sampler   = &samplers[i];
+        task->_ratios    = &out_ratios;
+        task->_numSpokes = numSpokes;
+        task->_first     = bounds[i];
+        task->_last      = bounds[i+1];
+        task->_radius    = radius;
+        task->_spacing   = _resolution;
+        task->_eye       = eye.z();
+        task->_curvature = getCurvature();
+        tasks.push_back( task );
+    }
+    runTasks( tasks, _service.get() );
+}
+
+void
+TerrainAnalyzer::computeProfile(const GeoPoint& start,
+                                const GeoPoint& end,
+                                unsigned        numSamples,
+                                TerrainProfile& out_profile)
+{
+    out_profile.clear();
+
+    sync();
+    Threading::ScopedReadLock lock( _mapfMutex );
+
+    const Profile* profile = _mapf.getProfile();
+    if ( !profile || !start.isValid() || !end.isValid() )
+        return;
+
+    GeoPoint a, b;
+    if ( !start.transform(profile->getSRS(), a) || !end.transform(profile->getSRS(), b) )
+        return;
+
+    numSamples = osg::maximum( numSamples, 2u );
+    bool geographic = profile->getSRS()->isGeographic();
+
+    double distance;
+    if ( geographic )
+    {
+        distance = GeoMath::distance(
+            osg::DegreesToRadians(a.y()), osg::DegreesToRadians(a.x()),
+            osg::DegreesToRadians(b.y()), osg::DegreesToRadians(b.x()),
+            profile->getSRS()->getEllipsoid()->getRadiusEquator() );
+    }
+    else
+    {
+        distance = (b.vec3d() - a.vec3d()).length();
+    }
+
+    Sampler sampler( this, true );
+    double  spacing = distance / (double)(numSamples - 1);
+
+    for( unsigned i = 0; i < numSamples; ++i )
+    {
+        double t = (double)i / (double)(numSamples - 1);
+        double x, y;
+        if ( geographic )
+        {
+            double lat, lon;
+            GeoMath::interpolate(
+                osg::DegreesToRadians(a.y()), osg::DegreesToRadians(a.x()),
+                osg::DegreesToRadians(b.y()), osg::DegreesToRadians(b.x()),
+                t, lat, lon );
+            x = osg::RadiansToDegrees( lon );
+            y = osg::RadiansToDegrees( lat );
+        }
+        else
+        {
+            x = a.x() + (b.x() - a.x()) * t;
+            y = a.y() + (b.y() - a.y()) * t;
+        }
+
+        float h = 0.0f;
+        sampler.sample( x, y, h );
+        out_profile.addElevation( spacing * (double)i, (double)h );
+    }
+}
@@ -17,6 +17,7 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarthUtil/TerrainProfile>
+#include <osgEarthUtil/TerrainAnalyzer>
 #include <osgEarth/MapNode>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/GeoMath>
@@ -218,3 +219,11 @@ void TerrainProfileCalculator::computeTerrainProfile( osgEarth::MapNode* mapNode
         profile.addElevation( spacing * (double)i, hamsl );
     }
 }
+
+void TerrainProfileCalculator::computeTerrainProfile( TerrainAnalyzer* analyzer, const GeoPoint& start, const GeoPoint& end, unsigned int numSamples, TerrainProfile& profile)
+{
+    if ( analyzer )
+        analyzer->computeProfile( start, end, numSamples, profile );
+    else
+        profile.clear();
+}